@@ -0,0 +1,128 @@
+#!/bin/sh
+#
+# Measure how flow setup, start and report collection of the controller scale
+# with the number of daemons and flows. Starts the daemons on localhost and
+# writes one JSON object per combination of daemons and flows, as written by
+# flowgrind --control-stats. Each flow has one endpoint on each of two daemons,
+# combinations that exceed the endpoint limit of a daemon are skipped. Exits
+# with failure if any run fails.
+
+DAEMONS="1 2 4"
+FLOWS="10 100 250 1000"
+# Endpoints one daemon accepts, MAX_FLOWS_DAEMON (FD_SETSIZE / 2) in common.h
+MAX_ENDPOINTS=512
+DURATION=2
+INTERVAL=0.05
+RATE=100kb
+BASE_PORT=16000
+OUTPUT=-
+BINDIR=$(dirname $0)/..
+
+usage() {
+	cat <<EOF
+Usage: $0 [OPTION]...
+  -b DIR     directory of the flowgrind and flowgrindd binaries (default: $BINDIR)
+  -d LIST    numbers of daemons to test (default: "$DAEMONS")
+  -f LIST    numbers of flows to test (default: "$FLOWS")
+  -i #.#     reporting interval in seconds (default: $INTERVAL)
+  -m #       endpoints one daemon accepts (default: $MAX_ENDPOINTS)
+  -o FILE    write the results to FILE (default: stdout)
+  -p PORT    control port of the first daemon (default: $BASE_PORT)
+  -r RATE    sending rate of each flow, see flowgrind -R (default: $RATE)
+  -t #.#     flow duration in seconds (default: $DURATION)
+EOF
+	exit $1
+}
+
+while getopts "b:d:f:hi:m:o:p:r:t:" opt; do
+	case $opt in
+	b) BINDIR=$OPTARG ;;
+	d) DAEMONS=$OPTARG ;;
+	f) FLOWS=$OPTARG ;;
+	h) usage 0 ;;
+	i) INTERVAL=$OPTARG ;;
+	m) MAX_ENDPOINTS=$OPTARG ;;
+	o) OUTPUT=$OPTARG ;;
+	p) BASE_PORT=$OPTARG ;;
+	r) RATE=$OPTARG ;;
+	t) DURATION=$OPTARG ;;
+	*) usage 1 ;;
+	esac
+done
+
+FLOWGRIND=$BINDIR/flowgrind
+FLOWGRINDD=$BINDIR/flowgrindd
+for bin in "$FLOWGRIND" "$FLOWGRINDD"; do
+	if [ ! -x "$bin" ]; then
+		echo "$bin not found, build flowgrind or use option -b." >&2
+		exit 1
+	fi
+done
+
+STATS=$(mktemp)
+PIDS=""
+FAILED=0
+
+stop_daemons() {
+	[ -n "$PIDS" ] && kill $PIDS 2>/dev/null && wait $PIDS 2>/dev/null
+	PIDS=""
+}
+
+cleanup() {
+	stop_daemons
+	rm -f "$STATS"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+[ "$OUTPUT" != "-" ] && : > "$OUTPUT"
+
+for n in $DAEMONS; do
+	# Keep the daemons in the foreground (-d) to be able to stop them
+	i=0
+	while [ $i -lt $n ]; do
+		"$FLOWGRINDD" -d -b 127.0.0.1 -p $((BASE_PORT + i)) 2>/dev/null &
+		PIDS="$PIDS $!"
+		i=$((i + 1))
+	done
+	sleep 1
+
+	for m in $FLOWS; do
+		# Round robin puts 2m / n endpoints on each daemon, both endpoints
+		# of a flow on the same daemon if there is only one
+		if [ $((2 * m)) -gt $((MAX_ENDPOINTS * n)) ]; then
+			echo "skipping $n daemons, $m flows: more than" \
+				"$MAX_ENDPOINTS endpoints per daemon" >&2
+			continue
+		fi
+
+		# Flow j runs from daemon j to the next daemon, round robin
+		set -- -q -o -n $m -i $INTERVAL -T s=$DURATION -R s=$RATE \
+			--control-stats="$STATS"
+		j=0
+		while [ $j -lt $m ]; do
+			src=$((BASE_PORT + j % n))
+			dst=$((BASE_PORT + (j + 1) % n))
+			set -- "$@" -F $j \
+				-H s=127.0.0.1/127.0.0.1:$src,d=127.0.0.1/127.0.0.1:$dst
+			j=$((j + 1))
+		done
+
+		echo "$n daemons, $m flows" >&2
+		if ! "$FLOWGRIND" "$@" >/dev/null; then
+			echo "flowgrind failed with $n daemons and $m flows" >&2
+			FAILED=1
+			continue
+		fi
+
+		if [ "$OUTPUT" = "-" ]; then
+			cat "$STATS"
+		else
+			cat "$STATS" >> "$OUTPUT"
+		fi
+	done
+
+	stop_daemons
+done
+
+exit $FAILED
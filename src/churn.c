@@ -0,0 +1,599 @@
+/**
+ * @file churn.c
+ * @brief Open-loop connection churn generator of the Flowgrind daemon
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "churn.h"
+#include "debug.h"
+#include "fg_block_pool.h"
+#include "fg_definitions.h"
+#include "fg_histogram.h"
+#include "fg_log.h"
+#include "fg_metrics.h"
+#include "fg_socket.h"
+#include "fg_time.h"
+#include "trafgen.h"
+
+/**
+ * Allocate the churn generator of flow @p flow with room for as many
+ * connections as given by the flow settings.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int init_churn(struct flow *flow)
+{
+	struct churn *churn = calloc(1, sizeof(struct churn));
+	if (!churn)
+		return -1;
+
+	churn->max_conns = flow->settings.churn;
+	churn->conn = calloc(churn->max_conns, sizeof(struct churn_conn));
+	if (!churn->conn) {
+		free(churn);
+		return -1;
+	}
+
+	flow->churn = churn;
+	return 0;
+}
+
+/** Close all connections of flow @p flow and free its churn generator. */
+void free_churn(struct flow *flow)
+{
+	struct churn *churn = flow->churn;
+
+	if (!churn)
+		return;
+
+	for (unsigned i = 0; i < churn->num_conns; i++)
+		close(churn->conn[i].fd);
+	free(churn->conn);
+	free(churn);
+	flow->churn = NULL;
+}
+
+/** Schedule the first arrival of flow @p flow once it has been started. */
+void start_churn(struct flow *flow)
+{
+	flow->churn->next_arrival = flow->start_timestamp[WRITE];
+}
+
+/** Whether new connections of flow @p flow may still arrive at @p now. */
+static int churn_open(struct timespec *now, struct flow *flow)
+{
+	const int dir = flow->endpoint == SOURCE ? WRITE : READ;
+	struct timespec stop = flow->stop_timestamp[dir];
+
+	if (flow->settings.duration[dir] < 0)
+		return 1;
+
+	/* the source may have been started a bit later */
+	if (flow->endpoint == DESTINATION)
+		time_add(&stop, CHURN_LINGER);
+
+	return time_is_after(&stop, now);
+}
+
+/**
+ * Whether flow @p flow is finished, i.e. no more connections arrive and all
+ * open connections are done.
+ */
+int churn_finished(struct timespec *now, struct flow *flow)
+{
+	return !flow->churn->num_conns && !churn_open(now, flow);
+}
+
+/** Apply the socket settings of flow @p flow to connection socket @p fd. */
+static int churn_setup_socket(struct flow *flow, int fd)
+{
+	if (flow->settings.requested_send_buffer_size)
+		set_window_size_directed(fd,
+			flow->settings.requested_send_buffer_size, SO_SNDBUF);
+	if (flow->settings.requested_read_buffer_size)
+		set_window_size_directed(fd,
+			flow->settings.requested_read_buffer_size, SO_RCVBUF);
+
+	if (set_socket_tcp_options(flow, fd) == -1) {
+		DEBUG_MSG(LOG_WARNING, "failed to set up churn connection of "
+			  "flow %d: %s", flow->id, flow->meta->error);
+		free(flow->meta->error);
+		flow->meta->error = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Close connection @p i of flow @p flow and account for its outcome.
+ *
+ * The last connection is moved into the slot of the closed one.
+ *
+ * @param[in,out] flow flow the connection belongs to
+ * @param[in] i index of the connection
+ * @param[in] completed whether the transfer of the connection completed
+ */
+static void churn_close(struct flow *flow, unsigned i, int completed)
+{
+	struct churn *churn = flow->churn;
+	struct churn_conn *conn = &churn->conn[i];
+
+	if (completed) {
+		struct timespec now;
+		gettime(&now);
+		const double fct = time_diff(&conn->start, &now);
+
+		foreach(int *j, INTERVAL, FINAL) {
+			flow->statistics[*j].conns_completed++;
+			ASSIGN_MIN(flow->statistics[*j].fct_min, fct);
+			ASSIGN_MAX(flow->statistics[*j].fct_max, fct);
+			flow->statistics[*j].fct_sum += fct;
+			histogram_add(&churn->fct[*j], fct);
+		}
+	} else {
+		foreach(int *j, INTERVAL, FINAL)
+			flow->statistics[*j].conns_failed++;
+	}
+
+	close(conn->fd);
+	*conn = churn->conn[--churn->num_conns];
+}
+
+/** Add a new connection on socket @p fd to flow @p flow. */
+static struct churn_conn *churn_add(struct flow *flow, int fd,
+				    enum churn_conn_state state)
+{
+	struct churn_conn *conn = &flow->churn->conn[flow->churn->num_conns++];
+
+	memset(conn, 0, sizeof(struct churn_conn));
+	conn->fd = fd;
+	conn->state = state;
+	gettime(&conn->start);
+
+	return conn;
+}
+
+/** Open a new connection to the destination (source only). */
+static void churn_connect(struct flow *flow)
+{
+	struct churn_conn *conn;
+	int fd;
+
+	/* open loop: an arrival is not delayed, but lost at the limit */
+	if (flow->churn->num_conns == flow->churn->max_conns) {
+		foreach(int *i, INTERVAL, FINAL)
+			flow->statistics[*i].conns_dropped++;
+		return;
+	}
+
+	foreach(int *i, INTERVAL, FINAL)
+		flow->statistics[*i].conns_opened++;
+
+	fd = socket(flow->meta->addr->sa_family, SOCK_STREAM, IPPROTO_TCP);
+	/* FIXME: currently we use portable select() API, which
+	 * is limited by the number of bits in an fd_set */
+	if (fd == -1 || fd >= FD_SETSIZE ||
+	    churn_setup_socket(flow, fd) == -1) {
+		DEBUG_MSG(LOG_WARNING, "failed to create churn connection "
+			  "of flow %d", flow->id);
+		goto fail;
+	}
+
+	conn = churn_add(flow, fd, CHURN_CONNECTING);
+	conn->request_size = next_request_block_size(flow);
+	conn->response_size = next_response_block_size(flow);
+
+	if (connect(fd, flow->meta->addr, flow->meta->addr_len) == -1 &&
+	    errno != EINPROGRESS) {
+		DEBUG_MSG(LOG_WARNING, "connect() failed for churn connection "
+			  "of flow %d: %s", flow->id, strerror(errno));
+		churn_close(flow, flow->churn->num_conns - 1, 0);
+	}
+	return;
+
+fail:
+	if (fd != -1)
+		close(fd);
+	foreach(int *i, INTERVAL, FINAL)
+		flow->statistics[*i].conns_failed++;
+}
+
+/** Accept pending connections from the source (destination only). */
+static void churn_accept(struct flow *flow)
+{
+	for (unsigned n = 0; n < CHURN_MAX_ARRIVALS; n++) {
+		int fd = accept(flow->listenfd_data, NULL, NULL);
+
+		if (fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				logging(LOG_WARNING, "accept() failed for churn "
+					"flow %d: %s", flow->id,
+					strerror(errno));
+			return;
+		}
+
+		if (flow->churn->num_conns == flow->churn->max_conns ||
+		    fd >= FD_SETSIZE) {
+			close(fd);
+			foreach(int *i, INTERVAL, FINAL)
+				flow->statistics[*i].conns_dropped++;
+			continue;
+		}
+
+		foreach(int *i, INTERVAL, FINAL)
+			flow->statistics[*i].conns_opened++;
+
+		if (churn_setup_socket(flow, fd) == -1) {
+			close(fd);
+			foreach(int *i, INTERVAL, FINAL)
+				flow->statistics[*i].conns_failed++;
+			continue;
+		}
+
+		churn_add(flow, fd, CHURN_REQUEST);
+	}
+}
+
+/** Open the connections of flow @p flow which are due by @p now. */
+static void churn_arrivals(struct timespec *now, struct flow *flow,
+			   struct timespec *timeout)
+{
+	struct churn *churn = flow->churn;
+
+	for (unsigned n = 0; churn_open(now, flow) &&
+	     !time_is_after(&churn->next_arrival, now); n++) {
+		/* do not starve the other flows, continue right after select */
+		if (n == CHURN_MAX_ARRIVALS) {
+			timeout->tv_sec = timeout->tv_nsec = 0;
+			return;
+		}
+
+		churn_connect(flow);
+
+		/* distributions may sample a gap of zero */
+		const double gap = next_interpacket_gap(flow);
+		time_add(&churn->next_arrival, MAX(gap, CHURN_MIN_GAP));
+	}
+
+	/* wake up in time for the next arrival */
+	if (churn_open(now, flow)) {
+		const double wait = time_diff(now, &churn->next_arrival);
+
+		if (wait < timeout->tv_sec + timeout->tv_nsec / 1e9) {
+			timeout->tv_sec = (time_t)wait;
+			timeout->tv_nsec = (wait - timeout->tv_sec) * 1e9;
+		}
+	}
+}
+
+/**
+ * Send the rest of the current block of connection @p conn.
+ *
+ * The header is taken from the connection, the payload from the block pool.
+ *
+ * @return 1 if the block is complete, 0 if not, -1 on error
+ */
+static int churn_send(struct flow *flow, struct churn_conn *conn,
+		      unsigned size)
+{
+	const unsigned payload = MAX(conn->bytes, (unsigned)MIN_BLOCK_SIZE);
+	struct iovec iov[2];
+	int iovcnt = 0;
+	ssize_t rc;
+
+	if (conn->bytes < (unsigned)MIN_BLOCK_SIZE) {
+		iov[iovcnt].iov_base = (char *)&conn->header + conn->bytes;
+		iov[iovcnt++].iov_len = MIN_BLOCK_SIZE - conn->bytes;
+	}
+	if (size > payload) {
+		iov[iovcnt].iov_base = (char *)
+			block_pool_payload(flow->settings.byte_counting) +
+			payload;
+		iov[iovcnt++].iov_len = size - payload;
+	}
+
+	rc = writev(conn->fd, iov, iovcnt);
+	if (rc == -1) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		DEBUG_MSG(LOG_NOTICE, "write failed on churn connection of "
+			  "flow %d: %s", flow->id, strerror(errno));
+		return -1;
+	}
+
+	conn->bytes += rc;
+	foreach(int *i, INTERVAL, FINAL)
+		flow->statistics[*i].bytes_written += rc;
+	metrics_add(&metrics.bytes_written, rc);
+
+	return conn->bytes == size;
+}
+
+/**
+ * Receive the rest of the request block of connection @p conn (destination
+ * only). The payload is discarded into the scratch buffer of the block pool.
+ *
+ * @return 1 if the block is complete, 0 if not, -1 on error
+ */
+static int churn_recv_request(struct flow *flow, struct churn_conn *conn)
+{
+	const int max = flow->settings.maximum_block_size;
+
+	for (;;) {
+		char *buf = block_pool_scratch();
+		size_t len;
+		ssize_t rc;
+
+		if (conn->bytes < (unsigned)MIN_BLOCK_SIZE) {
+			buf = (char *)&conn->header + conn->bytes;
+			len = MIN_BLOCK_SIZE - conn->bytes;
+		} else {
+			len = MIN(conn->request_size - conn->bytes,
+				  (unsigned)max);
+		}
+
+		rc = read(conn->fd, buf, len);
+		if (rc == -1)
+			return errno == EAGAIN || errno == EINTR ? 0 : -1;
+		if (rc == 0) {
+			DEBUG_MSG(LOG_NOTICE, "premature end of churn "
+				  "connection of flow %d", flow->id);
+			return -1;
+		}
+
+		conn->bytes += rc;
+		foreach(int *i, INTERVAL, FINAL)
+			flow->statistics[*i].bytes_read += rc;
+		metrics_add(&metrics.bytes_read, rc);
+
+		/* parse and check the header once it is complete */
+		if (!conn->request_size && conn->bytes == (unsigned)MIN_BLOCK_SIZE) {
+			const int request = ntohl(conn->header.this_block_size);
+			const int response = ntohl(conn->header.request_block_size);
+
+			if (request < MIN_BLOCK_SIZE || request > max ||
+			    (response && (response < MIN_BLOCK_SIZE ||
+					  response > max))) {
+				logging(LOG_WARNING, "flow %d parsed illegal "
+					"churn request (cbs %d, qbs %d, max %d)",
+					flow->id, request, response, max);
+				return -1;
+			}
+			conn->request_size = request;
+			conn->response_size = response;
+		}
+
+		if (conn->request_size && conn->bytes == conn->request_size)
+			return 1;
+	}
+}
+
+/**
+ * Receive the response of connection @p conn until the destination closes
+ * the connection (source only). The data is discarded into the scratch buffer
+ * of the block pool.
+ *
+ * @return 1 if the complete response was received, 0 if the connection is
+ * still open, -1 on error
+ */
+static int churn_recv_response(struct flow *flow, struct churn_conn *conn)
+{
+	for (;;) {
+		ssize_t rc = read(conn->fd, block_pool_scratch(),
+				  block_pool_scratch_size());
+
+		if (rc == -1)
+			return errno == EAGAIN || errno == EINTR ? 0 : -1;
+		if (rc == 0)
+			return conn->bytes >= conn->response_size ? 1 : -1;
+
+		if (conn->bytes < conn->response_size &&
+		    conn->bytes + rc >= conn->response_size)
+			foreach(int *i, INTERVAL, FINAL)
+				flow->statistics[*i].response_blocks_read++;
+
+		conn->bytes += rc;
+		foreach(int *i, INTERVAL, FINAL)
+			flow->statistics[*i].bytes_read += rc;
+		metrics_add(&metrics.bytes_read, rc);
+	}
+}
+
+/**
+ * Send the response block of connection @p conn (destination only).
+ *
+ * @return 1 if the response is complete, 0 if not, -1 on error
+ */
+static int churn_respond(struct flow *flow, struct churn_conn *conn)
+{
+	int rc = churn_send(flow, conn, conn->response_size);
+
+	if (rc == 1)
+		foreach(int *i, INTERVAL, FINAL)
+			flow->statistics[*i].response_blocks_written++;
+
+	return rc;
+}
+
+/**
+ * Handle the writable socket of connection @p conn.
+ *
+ * @return 1 if the connection completed, 0 if not, -1 on error
+ */
+static int churn_writable(struct flow *flow, struct churn_conn *conn)
+{
+	int rc;
+
+	/* the descriptor may have been reused by a new connection, which
+	 * has no response to send yet */
+	if (flow->endpoint == DESTINATION)
+		return conn->state == CHURN_RESPONSE ?
+		       churn_respond(flow, conn) : 0;
+
+	if (conn->state == CHURN_CONNECTING) {
+		int error = 0;
+		socklen_t len = sizeof(error);
+
+		if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error,
+			       &len) == -1 || error) {
+			DEBUG_MSG(LOG_NOTICE, "churn connection of flow %d "
+				  "failed: %s", flow->id,
+				  strerror(error ? error : errno));
+			return -1;
+		}
+
+		/* echoed back by the destination like for the other flows */
+		conn->header.this_block_size = htonl(conn->request_size);
+		conn->header.request_block_size = htonl(conn->response_size);
+		conn->header.data = conn->start;
+		conn->state = CHURN_REQUEST;
+	}
+
+	rc = churn_send(flow, conn, conn->request_size);
+	if (rc != 1)
+		return rc;
+
+	foreach(int *i, INTERVAL, FINAL)
+		flow->statistics[*i].request_blocks_written++;
+	conn->state = CHURN_RESPONSE;
+	conn->bytes = 0;
+
+	return 0;
+}
+
+/**
+ * Handle the readable socket of connection @p conn.
+ *
+ * @return 1 if the connection completed, 0 if not, -1 on error
+ */
+static int churn_readable(struct flow *flow, struct churn_conn *conn)
+{
+	int rc;
+
+	if (flow->endpoint == SOURCE)
+		return churn_recv_response(flow, conn);
+
+	rc = churn_recv_request(flow, conn);
+	if (rc != 1)
+		return rc;
+
+	foreach(int *i, INTERVAL, FINAL)
+		flow->statistics[*i].request_blocks_read++;
+	if (!conn->response_size)
+		return 1;
+
+	/* the header with the echoed timestamp becomes the response header */
+	conn->header.this_block_size = htonl(conn->response_size);
+	conn->header.request_block_size = htonl(-1);
+	conn->state = CHURN_RESPONSE;
+	conn->bytes = 0;
+
+	return churn_respond(flow, conn);
+}
+
+/**
+ * Open due connections and add the sockets of flow @p flow to the fd sets.
+ *
+ * @param[in] now current time
+ * @param[in,out] flow churn flow
+ * @param[in,out] rfds read fd set
+ * @param[in,out] wfds write fd set
+ * @param[in,out] maxfd highest fd in the fd sets
+ * @param[in,out] timeout select() timeout, shortened to the next arrival
+ */
+void churn_prepare_fds(struct timespec *now, struct flow *flow,
+		       fd_set *rfds, fd_set *wfds, int *maxfd,
+		       struct timespec *timeout)
+{
+	struct churn *churn = flow->churn;
+
+	if (!started)
+		return;
+
+	if (flow->endpoint == SOURCE) {
+		churn_arrivals(now, flow, timeout);
+	} else if (flow->listenfd_data != -1) {
+		if (churn_open(now, flow)) {
+			FD_SET(flow->listenfd_data, rfds);
+			*maxfd = MAX(*maxfd, flow->listenfd_data);
+		} else {
+			close(flow->listenfd_data);
+			flow->listenfd_data = -1;
+		}
+	}
+
+	for (unsigned i = 0; i < churn->num_conns; i++) {
+		const struct churn_conn *conn = &churn->conn[i];
+		/* the source sends the request, the destination the response */
+		const int sending = (flow->endpoint == SOURCE) ==
+				    (conn->state != CHURN_RESPONSE);
+
+		FD_SET(conn->fd, sending ? wfds : rfds);
+		*maxfd = MAX(*maxfd, conn->fd);
+	}
+}
+
+/**
+ * Accept new connections and continue the transfers of the connections of
+ * flow @p flow whose sockets are ready.
+ */
+void churn_process_fds(struct flow *flow, fd_set *rfds, fd_set *wfds)
+{
+	struct churn *churn = flow->churn;
+
+	if (flow->listenfd_data != -1 && FD_ISSET(flow->listenfd_data, rfds))
+		churn_accept(flow);
+
+	for (unsigned i = 0; i < churn->num_conns; ) {
+		struct churn_conn *conn = &churn->conn[i];
+		int rc = 0;
+
+		if (FD_ISSET(conn->fd, wfds))
+			rc = churn_writable(flow, conn);
+		else if (FD_ISSET(conn->fd, rfds))
+			rc = churn_readable(flow, conn);
+
+		/* the last connection moves into slot i */
+		if (rc)
+			churn_close(flow, i, rc == 1);
+		else
+			i++;
+	}
+}
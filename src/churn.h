@@ -0,0 +1,110 @@
+/**
+ * @file churn.h
+ * @brief Open-loop connection churn generator of the Flowgrind daemon
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _CHURN_H_
+#define _CHURN_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/select.h>
+#include <time.h>
+
+#include "common.h"
+#include "daemon.h"
+#include "fg_histogram.h"
+
+/**
+ * Time in seconds the destination keeps accepting connections after the end
+ * of the flow, to make up for the start time offset between the daemons.
+ */
+#define CHURN_LINGER 1.0
+
+/** Maximal number of arrivals handled per iteration of the event loop. */
+#define CHURN_MAX_ARRIVALS 256
+
+/**
+ * Smallest gap between two arrivals in seconds. Sampled gaps of zero or
+ * below are raised to it, so the arrival time always moves forward.
+ */
+#define CHURN_MIN_GAP 1e-6
+
+/** Life cycle of a churn connection. */
+enum churn_conn_state {
+	/** Non-blocking connect() in progress (source only). */
+	CHURN_CONNECTING = 0,
+	/** Transferring the request block. */
+	CHURN_REQUEST,
+	/** Transferring the response block, or waiting for the peer to close. */
+	CHURN_RESPONSE,
+};
+
+/**
+ * Short connection opened by the churn generator.
+ *
+ * The source sends one request block and reads until the destination closes
+ * the connection, the destination reads the request block, sends the
+ * requested response block and closes the connection.
+ */
+struct churn_conn {
+	/** Socket of the connection. */
+	int fd;
+	/** State of the connection. */
+	enum churn_conn_state state;
+	/** Time the connection was opened or accepted. */
+	struct timespec start;
+	/** Header of the block currently transferred. */
+	struct block header;
+	/** Size of the request block. */
+	unsigned request_size;
+	/** Size of the response block, 0 for none. */
+	unsigned response_size;
+	/** Bytes of the current block transferred so far. */
+	unsigned bytes;
+};
+
+/** State of the churn generator of a flow. */
+struct churn {
+	/** Maximal number of concurrently open connections. */
+	unsigned max_conns;
+	/** Number of open connections, stored in the front of @p conn. */
+	unsigned num_conns;
+	/** Open connections. */
+	struct churn_conn *conn;
+	/** Time the next connection arrives (source only). */
+	struct timespec next_arrival;
+	/** Flow completion times of the current interval and the whole test. */
+	struct fg_histogram fct[2];
+};
+
+int init_churn(struct flow *flow);
+void free_churn(struct flow *flow);
+void start_churn(struct flow *flow);
+int churn_finished(struct timespec *now, struct flow *flow);
+void churn_prepare_fds(struct timespec *now, struct flow *flow,
+		       fd_set *rfds, fd_set *wfds, int *maxfd,
+		       struct timespec *timeout);
+void churn_process_fds(struct flow *flow, fd_set *rfds, fd_set *wfds);
+
+#endif /* _CHURN_H_ */
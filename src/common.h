@@ -49,7 +49,7 @@
 #endif /* GITVERSION */
 
 /** XML-RPC API version in integer representation. */
-#define FLOWGRIND_API_VERSION 3
+#define FLOWGRIND_API_VERSION 9
 
 /** Daemon's default listen port. */
 #define DEFAULT_LISTEN_PORT 5999
@@ -64,12 +64,19 @@
   */
 #define MAX_FLOWS_DAEMON FD_SETSIZE >> 1
 
+/** Maximal number of concurrent connections of a churn flow, also limited by
+  * the file descriptors which can be added to an fd_set. */
+#define MAX_CHURN_CONNECTIONS (FD_SETSIZE >> 1)
+
 /** Max number of arbitrary extra socket options which may sent to the deamon. */
 #define MAX_EXTRA_SOCKET_OPTIONS 10
 
 /** Ensures extra options are limited in length on both controller and deamon. */
 #define MAX_EXTRA_SOCKET_OPTION_VALUE_LENGTH 100
 
+/** Max length of the name of a trace file uploaded to the daemon. */
+#define MAX_TRACE_NAME_LENGTH 32
+
 #ifndef TCP_CA_NAME_MAX
 /** Max size of the congestion control algorithm specifier string. */
 #define TCP_CA_NAME_MAX 16
@@ -142,6 +149,8 @@ enum distribution_t {
 	PARETO,
 	/** Log Normal distribution. */
 	LOGNORMAL,
+	/** Empirical distribution given by a CDF table. */
+	EMPIRICAL,
 };
 
 /** Flowgrind's data block layout. */
@@ -170,17 +179,57 @@ struct trafgen_options {
 	double param_one;
 	/** Second mathematical parameter of the distribution, if required. */
 	double param_two;
+	/** CDF table of an empirical distribution (see fg_cdf.h). */
+	struct empirical_cdf *cdf;
 
 };
 
 /**
- * Settings that describe a flow between from a endpoint's perspective.
+ * Settings of a flow endpoint which are usually the same for many flows.
  *
- * These options can be specified for each of the two endpoints.
+ * A profile is reference counted and shared by all flow endpoints with the
+ * same settings. Once shared it must not be changed anymore (see
+ * fg_profile.h).
  */
-struct flow_settings {
+struct flow_profile {
+	/** Number of flow settings referencing this profile. */
+	unsigned refcount;
+	/** Hash of the settings if the profile is interned, 0 otherwise. */
+	unsigned hash;
+	/** Next interned profile in the same hash bucket. */
+	struct flow_profile *next;
+
 	/** The interface address for the flow (used by daemon). */
 	char bind_address[1000];
+	/** Set congestion control algorithm ALG on test socket (option -O). */
+	char cc_alg[TCP_CA_NAME_MAX];
+
+	/** Stochastic traffic generation settings for the request size. */
+	struct trafgen_options request_trafgen_options;
+	/** Stochastic traffic generation settings for the response size. */
+	struct trafgen_options response_trafgen_options;
+	/** Stochastic traffic generation settings for the interpacket gap. */
+	struct trafgen_options interpacket_gap_trafgen_options;
+
+	/* XXX add a brief description doxygen + is this obsolete? */
+	struct extra_socket_options {
+		int level;
+		int optname;
+		int optlen;
+		char optval[MAX_EXTRA_SOCKET_OPTION_VALUE_LENGTH];
+	} extra_socket_options[MAX_EXTRA_SOCKET_OPTIONS];
+	int num_extra_socket_options;
+};
+
+/**
+ * Settings that describe a flow between from a endpoint's perspective.
+ *
+ * These options can be specified for each of the two endpoints. The bulky
+ * settings most flows have in common are kept in a shared profile.
+ */
+struct flow_settings {
+	/** Shared settings of the endpoint, never NULL once initialized. */
+	struct flow_profile *profile;
 
 	/** Flow ID maintained by controller. */
 	int flow_id;
@@ -202,6 +251,9 @@ struct flow_settings {
 
 	/** Dump traffic using libpcap (option -M). */
 	int traffic_dump;
+	/** Merge the dump with those of the other flows on the same interface
+	 * (option --dump-merge). */
+	int dump_merge;
 	/** Sets SO_DEBUG on test socket (option -O). */
 	int so_debug;
 	/** Sets ROUTE_RECORD on test socket (option -O). */
@@ -232,8 +284,6 @@ struct flow_settings {
 	int cork;
 	/** Disable nagle algorithm on test socket (option -O). */
 	int nonagle;
-	/** Set congestion control algorithm ALG on test socket (option -O). */
-	char cc_alg[TCP_CA_NAME_MAX];
 	/** Set TCP_ELCN (20) on test socket (option -O). */
 	int elcn;
 	/** Set TCP_LCD (21) on test socket (option -O). */
@@ -245,21 +295,23 @@ struct flow_settings {
 	/** Set IP_MTU_DISCOVER on test socket (option -O). */
 	int ipmtudiscover;
 
-	/** Stochastic traffic generation settings for the request size. */
-	struct trafgen_options request_trafgen_options;
-	/** Stochastic traffic generation settings for the response size. */
-	struct trafgen_options response_trafgen_options;
-	/** Stochastic traffic generation settings for the interpacket gap. */
-	struct trafgen_options interpacket_gap_trafgen_options;
+	/** Uploaded trace to replay instead of traffic generation (option --trace). */
+	char trace_name[MAX_TRACE_NAME_LENGTH];
 
-	/* XXX add a brief description doxygen + is this obsolete? */
-	struct extra_socket_options {
-		int level;
-		int optname;
-		int optlen;
-		char optval[MAX_EXTRA_SOCKET_OPTION_VALUE_LENGTH];
-	} extra_socket_options[MAX_EXTRA_SOCKET_OPTIONS];
-	int num_extra_socket_options;
+	/** Max concurrent connections of the churn generator, 0 if disabled
+	 * (option --churn). */
+	int churn;
+
+	/** Bytes after which a direction of the flow is complete, 0 for no
+	 * limit (option -Z). */
+#ifdef HAVE_UNSIGNED_LONG_LONG_INT
+	unsigned long long flow_size[2];
+#else /* HAVE_UNSIGNED_LONG_LONG_INT */
+	long flow_size[2];
+#endif /* HAVE_UNSIGNED_LONG_LONG_INT */
+	/** Request blocks after which a direction of the flow is complete, 0
+	 * for no limit (option --blocks). */
+	unsigned flow_blocks[2];
 };
 
 /* Flowgrinds view on the tcp_info struct for
@@ -323,6 +375,84 @@ struct report {
 	double rtt_max;
 	/** Accumulated round-trip time. */
 	double rtt_sum;
+	/** Minimum delay of replayed blocks behind their scheduled send time. */
+	double drift_min;
+	/** Maximum delay of replayed blocks behind their scheduled send time. */
+	double drift_max;
+	/** Accumulated delay of replayed blocks behind their scheduled send time. */
+	double drift_sum;
+
+	/** Connections opened (source) or accepted (destination) in churn mode. */
+	unsigned conns_opened;
+	/** Connections which completed their transfer. */
+	unsigned conns_completed;
+	/** Connections which failed or were aborted. */
+	unsigned conns_failed;
+	/** Arrivals dropped because the connection limit was reached. */
+	unsigned conns_dropped;
+	/** Minimum flow completion time. */
+	double fct_min;
+	/** Maximum flow completion time. */
+	double fct_max;
+	/** Accumulated flow completion time. */
+	double fct_sum;
+	/** Median flow completion time. */
+	double fct_p50;
+	/** 90th percentile of the flow completion time. */
+	double fct_p90;
+	/** 99th percentile of the flow completion time. */
+	double fct_p99;
+
+	/** Blocks read whose payload differs from the enumerated bytes of
+	 * option -E. */
+	unsigned blocks_corrupted;
+	/** Bytes of payload read which differ from the enumerated bytes of
+	 * option -E. */
+#ifdef HAVE_UNSIGNED_LONG_LONG_INT
+	unsigned long long bytes_corrupted;
+#else /* HAVE_UNSIGNED_LONG_LONG_INT */
+	long bytes_corrupted;
+#endif /* HAVE_UNSIGNED_LONG_LONG_INT */
+
+	/** Packets of the flow written to the dump file of option -M. */
+	unsigned pcap_packets;
+	/** Packets of the flow dropped by the dump writer of option -M. */
+	unsigned pcap_drops;
+	/** Packets dropped by the kernel on the interface of the flow during
+	 * the capture of option -M. Shared by all flows on the interface,
+	 * hence not additive across flows. */
+	unsigned pcap_ring_drops;
+
+	/** Segments retransmitted by the flow as seen by the capture of
+	 * option -M. */
+	unsigned wire_retransmits;
+	/** Segments received by the flow out of order as seen by the capture
+	 * of option -M. */
+	unsigned wire_reordered;
+	/** RTT samples taken by the capture of option -M, their minimum,
+	 * maximum and sum in seconds. @{ */
+	unsigned wire_rtt_samples;
+	double wire_rtt_min;
+	double wire_rtt_max;
+	double wire_rtt_sum;                                    /** @} */
+	/** Bytes sent by the flow acknowledged as seen by the capture of
+	 * option -M. */
+#ifdef HAVE_UNSIGNED_LONG_LONG_INT
+	unsigned long long wire_acked;
+#else /* HAVE_UNSIGNED_LONG_LONG_INT */
+	long wire_acked;
+#endif /* HAVE_UNSIGNED_LONG_LONG_INT */
+	/** Bytes sent by the flow not yet acknowledged as seen by the capture
+	 * of option -M. */
+	unsigned wire_flight;
+
+	/** Completion time of a flow of finite size per direction, from the
+	 * first byte until the last byte is acknowledged (WRITE) or received
+	 * (READ). 0 if not completed. */
+	double completion_time[2];
+
+	/** Time the flow started after its scheduled start time, in seconds. */
+	double start_skew;
 
 	/* on the Daemon this is filled from the os specific
 	 * tcp_info struct */
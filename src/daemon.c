@@ -43,6 +43,7 @@
 #include <sys/socket.h>
 #include <sys/param.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -59,16 +60,22 @@
 
 #include "common.h"
 #include "debug.h"
+#include "fg_block_pool.h"
 #include "fg_error.h"
+#include "fg_flow_table.h"
 #include "fg_math.h"
 #include "fg_definitions.h"
 #include "fg_socket.h"
 #include "fg_time.h"
 #include "fg_log.h"
+#include "fg_metrics.h"
 #include "daemon.h"
 #include "source.h"
 #include "destination.h"
 #include "trafgen.h"
+#include "fg_trace.h"
+#include "fg_profile.h"
+#include "churn.h"
 
 #ifdef HAVE_LIBPCAP
 #include "fg_pcap.h"
@@ -84,6 +91,16 @@
 
 #define CONGESTION_LIMIT 10000
 
+/** Interval in which the acknowledgment of the last byte of a flow of finite
+ * size is polled, in nanoseconds. */
+#define COMPLETION_POLL_INTERVAL 100000
+
+/* Linux drops the data of a TCP socket read with MSG_TRUNC instead of copying
+ * it into the buffer, other systems ignore the flag for TCP */
+#if defined(__LINUX__) && defined(MSG_TRUNC)
+#define HAVE_MSG_TRUNC_DISCARD
+#endif /* __LINUX__ && MSG_TRUNC */
+
 int daemon_pipe[2];
 
 pthread_mutex_t mutex;
@@ -96,17 +113,27 @@ struct report* reports = 0;
 struct report* reports_last = 0;
 unsigned pending_reports = 0;
 
-struct linked_list flows;
-
 char started = 0;
 
+/** Whether the flows wait for their scheduled start. */
+static char start_pending = 0;
+/** Scheduled start of the flows in the clock of the daemon. */
+static struct timespec scheduled_start;
+
+#ifdef HAVE_MSG_TRUNC_DISCARD
+/** Whether the kernel discards payload read with MSG_TRUNC. */
+static bool msg_trunc_discards = true;
+#endif /* HAVE_MSG_TRUNC_DISCARD */
+
 /* Forward declarations */
 static int write_data(struct flow *flow);
 static int read_data(struct flow *flow);
 static void process_rtt(struct flow* flow);
 static void process_iat(struct flow* flow);
 static void process_delay(struct flow* flow);
+static void process_drift(struct flow* flow);
 static void report_flow(struct flow* flow, int type);
+static void start_scheduled_flows(const struct timespec *start);
 static void send_response(struct flow* flow,
 			  int requested_response_block_size);
 int get_tcp_info(struct flow *flow, struct fg_tcp_info *info);
@@ -121,8 +148,8 @@ void flow_error(struct flow *flow, const char *fmt, ...)
 	vsnprintf(str, 1000, fmt, ap);
 	va_end(ap);
 	str[sizeof(str) - 1] = 0;
-	flow->error = malloc(strlen(str) + 1);
-	strcpy(flow->error, str);
+	flow->meta->error = malloc(strlen(str) + 1);
+	strcpy(flow->meta->error, str);
 }
 
 void request_error(struct request *request, const char *fmt, ...)
@@ -148,6 +175,15 @@ static inline int flow_in_delay(struct timespec *now, struct flow *flow,
 static inline int flow_sending(struct timespec *now, struct flow *flow,
 			       int direction)
 {
+	/* a flow of finite size ends once it is complete */
+	if (flow->completed[direction])
+		return 0;
+
+	/* a replayed trace ends with its last record */
+	if (direction == WRITE && flow->trace &&
+	    flow->trace->current >= flow->trace->num_records)
+		return 0;
+
 	return !flow_in_delay(now, flow, direction) &&
 		(flow->settings.duration[direction] < 0 ||
 		 time_diff_now(&flow->stop_timestamp[direction]) < 0.0);
@@ -158,6 +194,79 @@ static inline int flow_block_scheduled(struct timespec *now, struct flow *flow)
 	return time_is_after(now, &flow->next_write_block_timestamp);
 }
 
+/* Whether all bytes or blocks of a direction of a flow of finite size are
+ * transferred, which only happens at a block boundary */
+static inline int flow_size_reached(struct flow *flow, int direction)
+{
+	const struct statistics *stats = &flow->statistics[FINAL];
+
+	if (direction == WRITE)
+		return !flow->current_block_bytes_written &&
+			((flow->settings.flow_size[WRITE] &&
+			  stats->bytes_written >= flow->settings.flow_size[WRITE]) ||
+			 (flow->settings.flow_blocks[WRITE] &&
+			  stats->request_blocks_written >= flow->settings.flow_blocks[WRITE]));
+
+	return !flow->current_block_bytes_read &&
+		((flow->settings.flow_size[READ] &&
+		  stats->bytes_read >= flow->settings.flow_size[READ]) ||
+		 (flow->settings.flow_blocks[READ] &&
+		  stats->request_blocks_read >= flow->settings.flow_blocks[READ]));
+}
+
+static void complete_flow(struct timespec *now, struct flow *flow,
+			  int direction)
+{
+	flow->completed[direction] = 1;
+	flow->meta->completion_time[direction] =
+		time_diff(&flow->meta->first_byte_timestamp[direction], now);
+	DEBUG_MSG(LOG_NOTICE, "flow %d completed %s after %.6fs", flow->id,
+		  direction == WRITE ? "sending" : "receiving",
+		  flow->meta->completion_time[direction]);
+}
+
+/**
+ * Shorten the select() timeout @p timeout to at most @p wait seconds.
+ */
+static void shorten_timeout(struct timespec *timeout, double wait)
+{
+	if (wait >= timeout->tv_sec + timeout->tv_nsec / 1e9)
+		return;
+
+	timeout->tv_sec = (time_t)wait;
+	timeout->tv_nsec = (wait - timeout->tv_sec) * 1e9;
+}
+
+/* The sending direction of a flow of finite size is complete once the last
+ * byte is acknowledged. Until then poll the send queue more frequently */
+static void check_write_completion(struct timespec *now, struct flow *flow,
+				   struct timespec *timeout)
+{
+	if (get_unacked_bytes(flow->fd) > 0) {
+		timeout->tv_sec = 0;
+		timeout->tv_nsec = MIN(timeout->tv_nsec,
+				       COMPLETION_POLL_INTERVAL);
+		return;
+	}
+
+	complete_flow(now, flow, WRITE);
+}
+
+static inline int flow_finished(struct timespec *now, struct flow *flow)
+{
+	if (flow->churn)
+		return churn_finished(now, flow);
+
+	return (flow->finished[READ] ||
+		!flow->settings.duration[READ] ||
+		(!flow_in_delay(now, flow, READ) &&
+		 !flow_sending(now, flow, READ))) &&
+	       (flow->finished[WRITE] ||
+		!flow->settings.duration[WRITE] ||
+		(!flow_in_delay(now, flow, WRITE) &&
+		 !flow_sending(now, flow, WRITE)));
+}
+
 void uninit_flow(struct flow *flow)
 {
 	DEBUG_MSG(LOG_DEBUG,"uninit_flow() called for flow %d",flow->id);
@@ -166,30 +275,25 @@ void uninit_flow(struct flow *flow)
 	if (flow->listenfd_data != -1)
 		close(flow->listenfd_data);
 #ifdef HAVE_LIBPCAP
-	int rc;
-	if (flow->settings.traffic_dump && flow->pcap_thread) {
-		rc = pthread_cancel(flow->pcap_thread);
-		if (rc)
-			logging(LOG_WARNING, "failed to cancel dump thread: %s",
-				strerror(rc));
-
-		/* wait for the dump thread to react to the cancellation request */
-		rc = pthread_join(flow->pcap_thread, NULL);
-		if (rc)
-			logging(LOG_WARNING, "failed to join dump thread: %s",
-				strerror(rc));
-	}
+	fg_pcap_stop(flow);
 #endif /* HAVE_LIBPCAP */
-	free_all(flow->read_block, flow->write_block, flow->addr, flow->error);
+	free_all(flow->meta->addr, flow->meta->error);
 	free_math_functions(flow);
+	free_trafgen(flow);
+	profile_unref(flow->settings.profile);
+	flow->settings.profile = NULL;
+	trace_unmap(flow->trace);
+	flow->trace = NULL;
+	free_churn(flow);
 }
 
 void remove_flow(struct flow * const flow)
 {
-	fg_list_remove(&flows, flow);
-	free(flow);
-	if (!fg_list_size(&flows))
-		started = 0;
+	flow_table_free(flow);
+	if (!flow_table_size()) {
+		started = start_pending = 0;
+		block_pool_trim();
+	}
 }
 
 static void prepare_wfds(struct timespec *now, struct flow *flow, fd_set *wfds)
@@ -204,7 +308,10 @@ static void prepare_wfds(struct timespec *now, struct flow *flow, fd_set *wfds)
 
 	if (flow_sending(now, flow, WRITE)) {
 		assert(!flow->finished[WRITE]);
-		if (flow_block_scheduled(now, flow)) {
+		if (flow_size_reached(flow, WRITE)) {
+			DEBUG_MSG(LOG_DEBUG, "flow %d waits for the last byte "
+				  "to be acknowledged", flow->id);
+		} else if (flow_block_scheduled(now, flow)) {
 			DEBUG_MSG(LOG_DEBUG, "adding sock of flow %d to wfds",
 				  flow->id);
 			FD_SET(flow->fd, wfds);
@@ -240,7 +347,7 @@ static int prepare_rfds(struct timespec *now, struct flow *flow, fd_set *rfds)
 		}
 	}
 
-	if (flow->source_settings.late_connect && !flow->connect_called ) {
+	if (!flow->connect_called && flow->meta->source_settings.late_connect) {
 		DEBUG_MSG(LOG_ERR, "late connecting test socket for flow %d "
 			  "after %.3fs delay",
 			  flow->id, flow->settings.delay[WRITE]);
@@ -260,10 +367,10 @@ static int prepare_rfds(struct timespec *now, struct flow *flow, fd_set *rfds)
 	return 0;
 }
 
-static int prepare_fds() {
+static int prepare_fds(struct timespec *timeout) {
 
 	DEBUG_MSG(LOG_DEBUG, "prepare_fds() called, number of flows: %zu",
-		  fg_list_size(&flows));
+		  flow_table_size());
 
 	FD_ZERO(&rfds);
 	FD_ZERO(&wfds);
@@ -275,28 +382,30 @@ static int prepare_fds() {
 	struct timespec now;
 	gettime(&now);
 
-	const struct list_node *node = fg_list_front(&flows);
-	while (node) {
-		struct flow *flow = node->data;
-		node = node->next;
-
-		if (started &&
-		    (flow->finished[READ] ||
-		     !flow->settings.duration[READ] ||
-		     (!flow_in_delay(&now, flow, READ) &&
-		      !flow_sending(&now, flow, READ))) &&
-		    (flow->finished[WRITE] ||
-		     !flow->settings.duration[WRITE] ||
-		     (!flow_in_delay(&now, flow, WRITE) &&
-		      !flow_sending(&now, flow, WRITE)))) {
+	if (start_pending) {
+		if (time_is_after(&scheduled_start, &now))
+			shorten_timeout(timeout, time_diff(&now,
+							   &scheduled_start));
+		else
+			start_scheduled_flows(&scheduled_start);
+	}
+
+	struct flow *flow;
+	flow_table_foreach(flow) {
+		if (started && flow->fd != -1 && !flow->completed[WRITE] &&
+		    flow_size_reached(flow, WRITE))
+			check_write_completion(&now, flow, timeout);
+
+		if (started && flow_finished(&now, flow)) {
 
 			/* On Other OSes than Linux or FreeBSD, tcp_info will contain all zeroes */
-			flow->statistics[FINAL].has_tcp_info =
-				get_tcp_info(flow,
-					     &flow->statistics[FINAL].tcp_info)
-					? 0 : 1;
+			if (flow->fd != -1)
+				flow->meta->has_tcp_info[FINAL] =
+					get_tcp_info(flow,
+						     &flow->meta->tcp_info[FINAL])
+						? 0 : 1;
 
-			flow->pmtu = get_pmtu(flow->fd);
+			flow->meta->pmtu = get_pmtu(flow->fd);
 
 			if (flow->settings.reporting_interval)
 				report_flow(flow, INTERVAL);
@@ -306,6 +415,13 @@ static int prepare_fds() {
 			continue;
 		}
 
+		/* connections of a churn flow come and go on their own */
+		if (flow->churn) {
+			churn_prepare_fds(&now, flow, &rfds, &wfds, &maxfd,
+					  timeout);
+			continue;
+		}
+
 		if (flow->state == GRIND_WAIT_ACCEPT &&
 		    flow->listenfd_data != -1) {
 			FD_SET(flow->listenfd_data, &rfds);
@@ -323,35 +439,37 @@ static int prepare_fds() {
 		}
 	}
 
-	return fg_list_size(&flows);
+	return flow_table_size();
 }
 
-static void start_flows(struct request_start_flows *request)
+/**
+ * Start all flows of the daemon.
+ *
+ * The timestamps of the flows are based on @p start, which is the scheduled
+ * start unless the start request arrived too late. Thus all daemons with
+ * synchronized clocks send and stop at the same time. The time each flow
+ * actually started after the scheduled start is recorded as its start skew.
+ *
+ * @param[in] start start of the flows in the clock of the daemon
+ */
+static void start_scheduled_flows(const struct timespec *start)
 {
-	struct timespec start;
-	gettime(&start);
-
-#if 0
-	if (start.tv_sec < request->start_timestamp) {
-		/* If the clock is synchronized between nodes, all nodes will
-		 * start at the same time regardless of any RPC delays */
-		start.tv_sec = request->start_timestamp;
-		start.tv_nsec = 0;
-	}
-#else /* 0 */
-	UNUSED_ARGUMENT(request);
-#endif /* 0 */
-
-	const struct list_node *node = fg_list_front(&flows);
-	while (node) {
-		struct flow *flow = node->data;
-		node = node->next;
+	struct timespec now;
+
+	start_pending = 0;
+
+	struct flow *flow;
+	flow_table_foreach(flow) {
 		/* initalize random number generator etc */
 		init_math_functions(flow, flow->settings.random_seed);
+		init_trafgen(flow);
+
+		gettime(&now);
+		flow->meta->start_skew = time_diff(&scheduled_start, &now);
 
 		/* READ and WRITE */
 		for (int j = 0; j < 2; j++) {
-			flow->start_timestamp[j] = start;
+			flow->start_timestamp[j] = *start;
 			time_add(&flow->start_timestamp[j],
 				 flow->settings.delay[j]);
 			if (flow->settings.duration[j] >= 0) {
@@ -363,16 +481,76 @@ static void start_flows(struct request_start_flows *request)
 		}
 		flow->next_write_block_timestamp =
 			flow->start_timestamp[WRITE];
+		if (flow->churn)
+			start_churn(flow);
+		/* first block of a replayed trace is due at its send time */
+		if (flow->trace)
+			time_add(&flow->next_write_block_timestamp,
+				 trace_time(flow->trace, 0));
+
+		gettime(&flow->meta->last_report_time);
+		flow->meta->first_report_time = flow->meta->last_report_time;
+
+		struct flow_timer *timer = flow_table_timer(flow);
+		timer->interval = flow->settings.reporting_interval;
+		timer->next = flow->meta->last_report_time;
+		time_add(&timer->next, timer->interval);
+	}
 
-		gettime(&flow->last_report_time);
-		flow->first_report_time = flow->last_report_time;
-		flow->next_report_time = flow->last_report_time;
+	started = 1;
+}
 
-		time_add(&flow->next_report_time,
-			 flow->settings.reporting_interval);
+/**
+ * Schedule the start of all flows.
+ *
+ * The flows are started by the event loop once the requested start time is
+ * reached. If it already passed, e.g. because the request was delayed or no
+ * clock offset was applied, the flows are started immediately.
+ */
+static void start_flows(struct request_start_flows *request)
+{
+	struct timespec now;
+	gettime(&now);
+
+	scheduled_start = request->start_timestamp;
+
+	if (!flow_table_size() || !time_is_after(&scheduled_start, &now)) {
+		if (flow_table_size())
+			logging(LOG_WARNING, "start of flows scheduled %.3f s "
+				"in the past", time_diff(&scheduled_start, &now));
+		start_scheduled_flows(&now);
+		return;
 	}
 
-	started = 1;
+	DEBUG_MSG(LOG_NOTICE, "start of flows scheduled in %.6f s",
+		  time_diff(&now, &scheduled_start));
+	start_pending = 1;
+}
+
+/**
+ * Add all flow endpoints of a batch request.
+ *
+ * @param[in,out] request flow endpoints to add, with their own replies
+ */
+static void add_flows(struct request_add_flows *request)
+{
+	for (int i = 0; i < request->num_flows; i++) {
+		struct request *r = request->flows[i];
+
+		switch (r->type) {
+		case REQUEST_ADD_DESTINATION:
+			add_flow_destination((struct
+						request_add_flow_destination
+						*)r);
+			break;
+		case REQUEST_ADD_SOURCE:
+			add_flow_source((struct request_add_flow_source *)r);
+			break;
+		default:
+			request_error(r, "Unknown request type");
+			break;
+		}
+	}
 }
 
 static void stop_flow(struct request_stop_flow *request)
@@ -383,16 +561,14 @@ static void stop_flow(struct request_stop_flow *request)
 	if (request->flow_id == -1) {
 		/* Stop all flows */
 
-		const struct list_node *node = fg_list_front(&flows);
-		while (node) {
-			struct flow *flow = node->data;
-			node = node->next;
-
-			flow->statistics[FINAL].has_tcp_info =
-				get_tcp_info(flow,
-					     &flow->statistics[FINAL].tcp_info)
-					? 0 : 1;
-			flow->pmtu = get_pmtu(flow->fd);
+		struct flow *flow;
+		flow_table_foreach(flow) {
+			if (flow->fd != -1)
+				flow->meta->has_tcp_info[FINAL] =
+					get_tcp_info(flow,
+						     &flow->meta->tcp_info[FINAL])
+						? 0 : 1;
+			flow->meta->pmtu = get_pmtu(flow->fd);
 
 			if (flow->settings.reporting_interval)
 				report_flow(flow, INTERVAL);
@@ -405,31 +581,25 @@ static void stop_flow(struct request_stop_flow *request)
 		return;
 	}
 
-	const struct list_node *node = fg_list_front(&flows);
-	while (node) {
-		struct flow *flow = node->data;
-		node = node->next;
-
-		if (flow->id != request->flow_id)
-			continue;
+	struct flow *flow = flow_table_find(request->flow_id);
+	if (!flow) {
+		request_error(&request->r, "Unknown flow id");
+		return;
+	}
 
-		/* On Other OSes than Linux or FreeBSD, tcp_info will contain all zeroes */
-		flow->statistics[FINAL].has_tcp_info =
-			get_tcp_info(flow,
-				     &flow->statistics[FINAL].tcp_info)
+	/* On Other OSes than Linux or FreeBSD, tcp_info will contain all zeroes */
+	if (flow->fd != -1)
+		flow->meta->has_tcp_info[FINAL] =
+			get_tcp_info(flow, &flow->meta->tcp_info[FINAL])
 				? 0 : 1;
-		flow->pmtu = get_pmtu(flow->fd);
-
-		if (flow->settings.reporting_interval)
-			report_flow(flow, INTERVAL);
-		report_flow(flow, FINAL);
+	flow->meta->pmtu = get_pmtu(flow->fd);
 
-		uninit_flow(flow);
-		remove_flow(flow);
-		return;
-	}
+	if (flow->settings.reporting_interval)
+		report_flow(flow, INTERVAL);
+	report_flow(flow, FINAL);
 
-	request_error(&request->r, "Unknown flow id");
+	uninit_flow(flow);
+	remove_flow(flow);
 }
 
 /**
@@ -469,6 +639,9 @@ static void process_requests()
 						request_add_flow_source
 						*)request);
 			break;
+		case REQUEST_ADD_FLOWS:
+			add_flows((struct request_add_flows *)request);
+			break;
 		case REQUEST_START_FLOWS:
 			start_flows((struct request_start_flows *)request);
 			break;
@@ -479,8 +652,8 @@ static void process_requests()
 			{
 				struct request_get_status *r =
 					(struct request_get_status *)request;
-				r->started = started;
-				r->num_flows = fg_list_size(&flows);
+				r->started = started || start_pending;
+				r->num_flows = flow_table_size();
 			}
 			break;
 		case REQUEST_GET_UUID:
@@ -527,12 +700,12 @@ static void report_flow(struct flow* flow, int type)
 	report->type = type;
 
 	if (type == INTERVAL)
-		report->begin = flow->last_report_time;
+		report->begin = flow->meta->last_report_time;
 	else
-		report->begin = flow->first_report_time;
+		report->begin = flow->meta->first_report_time;
 
 	gettime(&report->end);
-	flow->last_report_time = report->end;
+	flow->meta->last_report_time = report->end;
 
 	/* abort if we were scheduled way to early for a interval report */
 	if (time_diff(&report->begin,&report->end) < 0.2 *
@@ -561,15 +734,57 @@ static void report_flow(struct flow* flow, int type)
 	report->delay_min = flow->statistics[type].delay_min;
 	report->delay_max = flow->statistics[type].delay_max;
 	report->delay_sum = flow->statistics[type].delay_sum;
+	report->drift_min = flow->statistics[type].drift_min;
+	report->drift_max = flow->statistics[type].drift_max;
+	report->drift_sum = flow->statistics[type].drift_sum;
+
+	report->conns_opened = flow->statistics[type].conns_opened;
+	report->conns_completed = flow->statistics[type].conns_completed;
+	report->conns_failed = flow->statistics[type].conns_failed;
+	report->conns_dropped = flow->statistics[type].conns_dropped;
+	report->fct_min = flow->statistics[type].fct_min;
+	report->fct_max = flow->statistics[type].fct_max;
+	report->fct_sum = flow->statistics[type].fct_sum;
+	if (flow->churn) {
+		report->fct_p50 = histogram_quantile(&flow->churn->fct[type], 0.5);
+		report->fct_p90 = histogram_quantile(&flow->churn->fct[type], 0.9);
+		report->fct_p99 = histogram_quantile(&flow->churn->fct[type], 0.99);
+		/* connections still open at the end are aborted */
+		if (type == FINAL)
+			report->conns_failed += flow->churn->num_conns;
+	} else {
+		report->fct_p50 = report->fct_p90 = report->fct_p99 = 0.0;
+	}
+
+	report->blocks_corrupted = flow->statistics[type].blocks_corrupted;
+	report->bytes_corrupted = flow->statistics[type].bytes_corrupted;
+#ifdef HAVE_LIBPCAP
+	fg_pcap_stats(flow, type, report);
+#else /* HAVE_LIBPCAP */
+	report->pcap_packets = report->pcap_drops = 0;
+	report->pcap_ring_drops = 0;
+	report->wire_retransmits = report->wire_reordered = 0;
+	report->wire_rtt_samples = 0;
+	report->wire_rtt_min = FLT_MAX;
+	report->wire_rtt_max = FLT_MIN;
+	report->wire_rtt_sum = 0.0;
+	report->wire_acked = 0;
+	report->wire_flight = 0;
+#endif /* HAVE_LIBPCAP */
+
+	foreach(int *i, READ, WRITE)
+		report->completion_time[*i] =
+			flow->completed[*i] ? flow->meta->completion_time[*i] : 0.0;
+	report->start_skew = flow->meta->start_skew;
 
 	/* Currently this will only contain useful information on Linux
 	 * and FreeBSD */
-	report->tcp_info = flow->statistics[type].tcp_info;
+	report->tcp_info = flow->meta->tcp_info[type];
 
 	if (flow->fd != -1) {
 		/* Get latest MTU */
-		flow->pmtu = get_pmtu(flow->fd);
-		report->pmtu = flow->pmtu;
+		flow->meta->pmtu = get_pmtu(flow->fd);
+		report->pmtu = flow->meta->pmtu;
 		if (type == FINAL)
 			report->imtu = get_imtu(flow->fd);
 		else
@@ -634,6 +849,22 @@ static void report_flow(struct flow* flow, int type)
 		flow->statistics[INTERVAL].delay_min = FLT_MAX;
 		flow->statistics[INTERVAL].delay_max = FLT_MIN;
 		flow->statistics[INTERVAL].delay_sum = 0.0F;
+		flow->statistics[INTERVAL].drift_min = FLT_MAX;
+		flow->statistics[INTERVAL].drift_max = FLT_MIN;
+		flow->statistics[INTERVAL].drift_sum = 0.0F;
+
+		flow->statistics[INTERVAL].conns_opened = 0;
+		flow->statistics[INTERVAL].conns_completed = 0;
+		flow->statistics[INTERVAL].conns_failed = 0;
+		flow->statistics[INTERVAL].conns_dropped = 0;
+		flow->statistics[INTERVAL].fct_min = FLT_MAX;
+		flow->statistics[INTERVAL].fct_max = FLT_MIN;
+		flow->statistics[INTERVAL].fct_sum = 0.0F;
+		if (flow->churn)
+			histogram_reset(&flow->churn->fct[INTERVAL]);
+
+		flow->statistics[INTERVAL].blocks_corrupted = 0;
+		flow->statistics[INTERVAL].bytes_corrupted = 0;
 	}
 
 	add_report(report);
@@ -692,46 +923,45 @@ static void timer_check()
 		return;
 
 	gettime(&now);
-	const struct list_node *node = fg_list_front(&flows);
-	while (node) {
-		struct flow *flow = node->data;
-		node = node->next;
-
+	struct flow *flow;
+	/* only the flows with a report due are touched */
+	flow_table_foreach_due(flow, &now) {
 		DEBUG_MSG(LOG_DEBUG, "processing timer_check() for flow %d",
 			  flow->id);
 
-		if (!flow->settings.reporting_interval)
-			continue;
-
-		if (!time_is_after(&now, &flow->next_report_time))
-			continue;
+		struct flow_timer *timer = flow_table_timer(flow);
 
 		/* On Other OSes than Linux or FreeBSD, tcp_info will contain all zeroes */
 		if (flow->fd != -1)
-			flow->statistics[INTERVAL].has_tcp_info =
+			flow->meta->has_tcp_info[INTERVAL] =
 				get_tcp_info(flow,
-					     &flow->statistics[INTERVAL].tcp_info)
+					     &flow->meta->tcp_info[INTERVAL])
 					? 0 : 1;
 		report_flow(flow, INTERVAL);
 
 		do {
-			time_add(&flow->next_report_time,
-				 flow->settings.reporting_interval);
-		} while (time_is_after(&now, &flow->next_report_time));
+			time_add(&timer->next, timer->interval);
+		} while (time_is_after(&now, &timer->next));
 	}
 	DEBUG_MSG(LOG_DEBUG, "finished timer_check()");
 }
 
-static void process_select(fd_set *rfds, fd_set *wfds, fd_set *efds)
+static void process_select(const struct timespec *now, fd_set *rfds,
+			   fd_set *wfds, fd_set *efds)
 {
-	const struct list_node *node = fg_list_front(&flows);
-	while (node) {
-		struct flow *flow = node->data;
-		node = node->next;
+	/* flows with a ready test socket */
+	uint64_t serviced = 0;
 
+	struct flow *flow;
+	flow_table_foreach(flow) {
 		DEBUG_MSG(LOG_DEBUG, "processing pselect() for flow %d",
 			  flow->id);
 
+		if (flow->churn) {
+			churn_process_fds(flow, rfds, wfds);
+			continue;
+		}
+
 		if (flow->listenfd_data != -1 &&
 		    FD_ISSET(flow->listenfd_data, rfds)) {
 			DEBUG_MSG(LOG_DEBUG, "ready for accept");
@@ -765,6 +995,19 @@ static void process_select(fd_set *rfds, fd_set *wfds, fd_set *efds)
 					goto remove;
 				}
 			}
+			if (FD_ISSET(flow->fd, wfds) || FD_ISSET(flow->fd, rfds))
+				serviced++;
+
+			/* a flow that finished its last block ahead of the
+			 * schedule waited for this wakeup */
+			if (FD_ISSET(flow->fd, wfds) &&
+			    !flow->current_block_bytes_written &&
+			    time_is_after(&flow->next_write_block_timestamp,
+					  &flow->last_block_written))
+				metrics_observe(&metrics.write_lateness,
+						&flow->next_write_block_timestamp,
+						now);
+
 			if (FD_ISSET(flow->fd, wfds))
 				if (write_data(flow) == -1) {
 					DEBUG_MSG(LOG_ERR, "write_data() failed");
@@ -780,31 +1023,69 @@ static void process_select(fd_set *rfds, fd_set *wfds, fd_set *efds)
 		continue;
 remove:
 		if (flow->fd != -1) {
-			flow->statistics[FINAL].has_tcp_info =
+			flow->meta->has_tcp_info[FINAL] =
 				get_tcp_info(flow,
-					     &flow->statistics[FINAL].tcp_info)
+					     &flow->meta->tcp_info[FINAL])
 					? 0 : 1;
 		}
-		flow->pmtu = get_pmtu(flow->fd);
+		flow->meta->pmtu = get_pmtu(flow->fd);
 		report_flow(flow, FINAL);
 		uninit_flow(flow);
 		DEBUG_MSG(LOG_ERR, "removing flow %d", flow->id);
 		remove_flow(flow);
 	}
+	metrics_add(&metrics.flows_serviced, serviced);
+}
+
+/**
+ * Account the time since @p mark to phase @p phase of the event loop and move
+ * @p mark to the current time.
+ */
+static inline void account_phase(enum loop_phase phase, struct timespec *mark)
+{
+	struct timespec now;
+
+	gettime(&now);
+	metrics_observe(&metrics.phases[phase], mark, &now);
+	*mark = now;
 }
 
 void* daemon_main(void* ptr __attribute__((unused)))
 {
 	struct timespec timeout;
-	for (;;) {
-		int need_timeout = prepare_fds();
+	/* last wakeup from pselect(), zero if already accounted */
+	struct timespec wakeup = {0, 0};
+	/* end of the last phase of the event loop */
+	struct timespec mark;
 
+	gettime(&metrics.since);
+	mark = metrics.since;
+	for (;;) {
 		timeout.tv_sec = 0;
 		timeout.tv_nsec = DEFAULT_SELECT_TIMEOUT;
+
+		int need_timeout = prepare_fds(&timeout);
+		/* wake up now and then to remove abandoned trace uploads */
+		if (!need_timeout) {
+			timeout.tv_sec = TRACE_UPLOAD_TIMEOUT;
+			timeout.tv_nsec = 0;
+			need_timeout = 1;
+		}
+		account_phase(PHASE_PREPARE_FDS, &mark);
+		if (wakeup.tv_sec) {
+			metrics_observe(&metrics.loop_latency, &wakeup, &mark);
+			metrics_set(&metrics.flows_active, flow_table_size());
+			wakeup.tv_sec = 0;
+		}
+		metrics_log_profile(&mark);
+
 		DEBUG_MSG(LOG_DEBUG, "calling pselect() need_timeout: %i",
 			  need_timeout);
 		int rc = pselect(maxfd + 1, &rfds, &wfds, &efds,
 				 need_timeout ? &timeout : 0, NULL);
+		account_phase(PHASE_PSELECT, &mark);
+		wakeup = mark;
+		metrics_add(&metrics.loop_iterations, 1);
 		if (rc < 0) {
 			if (errno == EINTR)
 				continue;
@@ -812,11 +1093,17 @@ void* daemon_main(void* ptr __attribute__((unused)))
 		}
 		DEBUG_MSG(LOG_DEBUG, "pselect() finished");
 
-		if (FD_ISSET(daemon_pipe[0], &rfds))
+		if (FD_ISSET(daemon_pipe[0], &rfds)) {
 			process_requests();
+			account_phase(PHASE_PROCESS_REQUESTS, &mark);
+		}
 
 		timer_check();
-		process_select(&rfds, &wfds, &efds);
+		trace_expire(&mark);
+		account_phase(PHASE_TIMER_CHECK, &mark);
+
+		process_select(&mark, &rfds, &wfds, &efds);
+		account_phase(PHASE_PROCESS_SELECT, &mark);
 	}
 }
 
@@ -827,6 +1114,7 @@ void add_report(struct report* report)
 	DEBUG_MSG(LOG_DEBUG, "add_report aquired mutex");
 	/* Do not keep too much data */
 	if (pending_reports >= 250 && report->type != FINAL) {
+		metrics_add(&metrics.reports_dropped, 1);
 		free(report);
 		pthread_mutex_unlock(&mutex);
 		return;
@@ -841,6 +1129,7 @@ void add_report(struct report* report)
 
 	reports_last = report;
 	pending_reports++;
+	metrics_set(&metrics.pending_reports, pending_reports);
 
 	pthread_mutex_unlock(&mutex);
 	DEBUG_MSG(LOG_DEBUG, "add_report unlocked mutex");
@@ -873,6 +1162,7 @@ struct report* get_reports(int *has_more)
 		pending_reports -= max_reports;
 		*has_more = 1;
 	}
+	metrics_set(&metrics.pending_reports, pending_reports);
 
 	pthread_mutex_unlock(&mutex);
 	DEBUG_MSG(LOG_DEBUG, "get_reports unlocked mutex");
@@ -887,11 +1177,14 @@ struct report* get_reports(int *has_more)
  * their metrics details.
  *
  * @param[in,out] flow flow structure maintained by a daemon
+ * @param[in,out] meta cold metadata of the flow
  * @param[in] is_source to determine flow endpoint i.e. source or destination
  */
-void init_flow(struct flow* flow, int is_source)
+static void init_flow(struct flow* flow, struct flow_meta *meta, int is_source)
 {
 	memset(flow, 0, sizeof(struct flow));
+	memset(meta, 0, sizeof(struct flow_meta));
+	flow->meta = meta;
 
 	/* flow id is given by controller */
 	flow->id = -1;
@@ -905,7 +1198,7 @@ void init_flow(struct flow* flow, int is_source)
 
 	flow->finished[READ] = flow->finished[WRITE] = 0;
 
-	flow->addr = 0;
+	flow->meta->addr = 0;
 
 	foreach(int *i, INTERVAL, FINAL) {
 		flow->statistics[*i].bytes_read = 0;
@@ -925,11 +1218,65 @@ void init_flow(struct flow* flow, int is_source)
 		flow->statistics[*i].delay_min = FLT_MAX;
 		flow->statistics[*i].delay_max = FLT_MIN;
 		flow->statistics[*i].delay_sum = 0.0F;
+		flow->statistics[*i].drift_min = FLT_MAX;
+		flow->statistics[*i].drift_max = FLT_MIN;
+		flow->statistics[*i].drift_sum = 0.0F;
+
+		flow->statistics[*i].conns_opened = 0;
+		flow->statistics[*i].conns_completed = 0;
+		flow->statistics[*i].conns_failed = 0;
+		flow->statistics[*i].conns_dropped = 0;
+		flow->statistics[*i].fct_min = FLT_MAX;
+		flow->statistics[*i].fct_max = FLT_MIN;
+		flow->statistics[*i].fct_sum = 0.0F;
+
+		flow->statistics[*i].blocks_corrupted = 0;
+		flow->statistics[*i].bytes_corrupted = 0;
 	}
 
 	DEBUG_MSG(LOG_NOTICE, "called init flow %d", flow->id);
 }
 
+struct flow *alloc_flow(int is_source)
+{
+	struct flow *flow = flow_table_alloc();
+
+	if (!flow)
+		return NULL;
+
+	init_flow(flow, flow->meta, is_source);
+	return flow;
+}
+
+/**
+ * Write the rest of the current outgoing block of @p size bytes of @p flow.
+ *
+ * The header is taken from the write block of the flow, the payload from the
+ * block pool.
+ *
+ * @return number of bytes written, -1 on error
+ */
+static inline ssize_t write_block_rest(struct flow *flow, unsigned size)
+{
+	const unsigned written = flow->current_block_bytes_written;
+	const unsigned payload = MAX(written, (unsigned)MIN_BLOCK_SIZE);
+	struct iovec iov[2];
+	int iovcnt = 0;
+
+	if (written < (unsigned)MIN_BLOCK_SIZE) {
+		iov[iovcnt].iov_base = flow->write_block + written;
+		iov[iovcnt++].iov_len = MIN_BLOCK_SIZE - written;
+	}
+	if (size > payload) {
+		iov[iovcnt].iov_base = (char *)
+			block_pool_payload(flow->settings.byte_counting) +
+			payload;
+		iov[iovcnt++].iov_len = size - payload;
+	}
+
+	return writev(flow->fd, iov, iovcnt);
+}
+
 static int write_data(struct flow *flow)
 {
 	int rc = 0;
@@ -941,6 +1288,16 @@ static int write_data(struct flow *flow)
 		if (flow->current_block_bytes_written == 0) {
 			flow->current_write_block_size =
 				next_request_block_size(flow);
+			/* the last block of a flow of finite size is cut to
+			 * the remaining bytes */
+			if (flow->settings.flow_size[WRITE]) {
+				const unsigned long long remaining =
+					flow->settings.flow_size[WRITE] -
+					flow->statistics[FINAL].bytes_written;
+				if ((unsigned long long)flow->current_write_block_size > remaining)
+					flow->current_write_block_size =
+						MAX(remaining, MIN_BLOCK_SIZE);
+			}
 			response_block_size = next_response_block_size(flow);
 			/* serialize data:
 			 * this_block_size */
@@ -954,6 +1311,10 @@ static int write_data(struct flow *flow)
 			gettime((struct timespec *)
 				(flow->write_block + 2 * (sizeof (int32_t))));
 
+			/* how late a replayed block is sent */
+			if (flow->trace)
+				process_drift(flow);
+
 			DEBUG_MSG(LOG_DEBUG, "wrote new request data to out "
 				  "buffer bs = %d, rqs = %d, on flow %d",
 				  ntohl(((struct block *)flow->write_block)->this_block_size),
@@ -961,14 +1322,14 @@ static int write_data(struct flow *flow)
 				  flow->id);
 		}
 
-		rc = write(flow->fd,
-			   flow->write_block +
-			   flow->current_block_bytes_written,
-			   flow->current_write_block_size -
-			   flow->current_block_bytes_written);
+		if (!flow->statistics[FINAL].bytes_written)
+			gettime(&flow->meta->first_byte_timestamp[WRITE]);
+
+		rc = write_block_rest(flow, flow->current_write_block_size);
 
 		if (rc == -1) {
 			if (errno == EAGAIN) {
+				metrics_add(&metrics.eagain_write, 1);
 				logging(LOG_WARNING, "write queue limit hit for "
 					"flow %d", flow->id);
 				break;
@@ -994,6 +1355,7 @@ static int write_data(struct flow *flow)
 
 		foreach(int *i, INTERVAL, FINAL)
 			flow->statistics[*i].bytes_written += rc;
+		metrics_add(&metrics.bytes_written, rc);
 
 		flow->current_block_bytes_written += rc;
 
@@ -1039,6 +1401,15 @@ static int write_data(struct flow *flow)
 				DEBUG_MSG(LOG_NOTICE, "failed to recork test "
 					  "socket for flow %d: %s",
 					  flow->id, strerror(errno));
+
+			/* a replayed trace dictates the send time of each
+			 * block, so never write ahead of the schedule */
+			if (flow->trace)
+				break;
+
+			/* nothing more to send for a complete flow */
+			if (flow_size_reached(flow, WRITE))
+				break;
 		}
 
 		if (!flow->settings.pushy)
@@ -1052,6 +1423,9 @@ static inline int try_read_n_bytes(struct flow *flow, int bytes)
 	int rc;
 	struct iovec iov;
 	struct msghdr msg;
+	bool payload = flow->current_block_bytes_read >=
+		       (unsigned)MIN_BLOCK_SIZE;
+	bool copy = true;
 /* we only read out of band data for debugging purpose */
 #ifdef DEBUG
 	char cbuf[512];
@@ -1059,9 +1433,17 @@ static inline int try_read_n_bytes(struct flow *flow, int bytes)
 #else /* DEBUG */
 	char cbuf[16];
 #endif /* DEBUG */
-	iov.iov_base = flow->read_block +
-		       flow->current_block_bytes_read;
-	iov.iov_len = bytes;
+
+	if (!payload) {
+		iov.iov_base = flow->read_block +
+			       flow->current_block_bytes_read;
+		iov.iov_len = MIN((unsigned)bytes, MIN_BLOCK_SIZE -
+				  flow->current_block_bytes_read);
+	} else {
+		/* the payload is never looked at */
+		iov.iov_base = block_pool_scratch();
+		iov.iov_len = MIN((size_t)bytes, block_pool_scratch_size());
+	}
 	/* no name required */
 	msg.msg_name = NULL;
 	msg.msg_namelen = 0;
@@ -1070,14 +1452,35 @@ static inline int try_read_n_bytes(struct flow *flow, int bytes)
 	msg.msg_control = cbuf;
 	msg.msg_controllen = sizeof(cbuf);
 
-	rc = recvmsg(flow->fd, &msg, 0);
+#ifdef HAVE_MSG_TRUNC_DISCARD
+	/* drop the payload in the kernel, unless it has to be copied for the
+	 * verification of option -E. The buffer is not written to, so the
+	 * whole rest of the block is dropped at once */
+	if (payload && !flow->settings.byte_counting && msg_trunc_discards) {
+		rc = recv(flow->fd, iov.iov_base, bytes, MSG_TRUNC);
+		copy = false;
+		if (rc > 0) {
+			metrics_add(&metrics.bytes_discarded, rc);
+		} else if (rc == -1 && (errno == EINVAL ||
+					errno == EOPNOTSUPP)) {
+			logging(LOG_WARNING, "kernel does not discard data "
+				"read with MSG_TRUNC, copying the payload");
+			msg_trunc_discards = false;
+			copy = true;
+		}
+	}
+#endif /* HAVE_MSG_TRUNC_DISCARD */
+	if (copy)
+		rc = recvmsg(flow->fd, &msg, 0);
 
 	DEBUG_MSG(LOG_DEBUG, "tried reading %d bytes, got %d", bytes, rc);
 
 	if (rc == -1) {
-		if (errno == EAGAIN)
+		if (errno == EAGAIN) {
+			metrics_add(&metrics.eagain_read, 1);
 			flow_error(flow, "Premature end of test: %s",
 				   strerror(errno));
+		}
 		return -1;
 	}
 
@@ -1092,10 +1495,27 @@ static inline int try_read_n_bytes(struct flow *flow, int bytes)
 
 	DEBUG_MSG(LOG_DEBUG, "flow %d received %u bytes", flow->id, rc);
 
+	if (!flow->statistics[FINAL].bytes_read)
+		gettime(&flow->meta->first_byte_timestamp[READ]);
+
 	flow->current_block_bytes_read += rc;
 
 	foreach(int *i, INTERVAL, FINAL)
 		flow->statistics[*i].bytes_read += rc;
+	metrics_add(&metrics.bytes_read, rc);
+
+	/* check the payload of option -E against the enumerated bytes */
+	if (payload && flow->settings.byte_counting) {
+		size_t corrupted = block_pool_verify(iov.iov_base,
+			flow->current_block_bytes_read - rc, rc);
+
+		if (corrupted) {
+			foreach(int *i, INTERVAL, FINAL)
+				flow->statistics[*i].bytes_corrupted +=
+					corrupted;
+			flow->current_block_corrupted = 1;
+		}
+	}
 
 #ifdef DEBUG
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
@@ -1106,6 +1526,56 @@ static inline int try_read_n_bytes(struct flow *flow, int bytes)
 	return rc;
 }
 
+/**
+ * Set the receive low water mark of the test socket of @p flow to the rest of
+ * the block being read.
+ *
+ * The daemon is then woken once the block is complete instead of for every
+ * segment. Between blocks the mark is the block header, which the source
+ * always sends along with the block, so a flow never stalls on a mark it
+ * does not reach.
+ */
+static inline void update_rcvlowat(struct flow *flow)
+{
+#ifdef HAVE_SO_RCVLOWAT
+	int lowat;
+
+	if (flow->rcvlowat == -1 || flow->fd == -1)
+		return;
+
+	if (!flow->rcvlowat) {
+		int rcvbuf = 0;
+		socklen_t opt_len = sizeof(rcvbuf);
+
+		/* leave room for the overhead the kernel accounts to the
+		 * receive buffer, a larger mark would never be reached */
+		getsockopt(flow->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &opt_len);
+		flow->meta->rcvlowat_max = MAX(rcvbuf / 4, 1);
+	}
+
+	if (flow->current_block_bytes_read < MIN_BLOCK_SIZE)
+		lowat = MIN_BLOCK_SIZE - flow->current_block_bytes_read;
+	else
+		lowat = flow->current_read_block_size -
+			flow->current_block_bytes_read;
+	lowat = MIN(lowat, flow->meta->rcvlowat_max);
+
+	if (lowat == flow->rcvlowat)
+		return;
+
+	if (setsockopt(flow->fd, SOL_SOCKET, SO_RCVLOWAT, &lowat,
+		       sizeof(lowat)) == -1) {
+		DEBUG_MSG(LOG_WARNING, "failed to set SO_RCVLOWAT of flow %d: "
+			  "%s", flow->id, strerror(errno));
+		flow->rcvlowat = -1;
+		return;
+	}
+	flow->rcvlowat = lowat;
+#else /* HAVE_SO_RCVLOWAT */
+	UNUSED_ARGUMENT(flow);
+#endif /* HAVE_SO_RCVLOWAT */
+}
+
 static int read_data(struct flow *flow)
 {
 	int rc = 0;
@@ -1167,6 +1637,15 @@ static int read_data(struct flow *flow)
 					flow->current_read_block_size);
 			flow->current_block_bytes_read = 0;
 
+			if (flow->current_block_corrupted) {
+				if (!flow->statistics[FINAL].blocks_corrupted)
+					logging(LOG_WARNING, "flow %d received "
+						"corrupted payload", flow->id);
+				foreach(int *i, INTERVAL, FINAL)
+					flow->statistics[*i].blocks_corrupted++;
+				flow->current_block_corrupted = 0;
+			}
+
 			/* TODO process_rtt(), process_iat(), and
 			 * process_delay () call all gettime().
 			 * Quite inefficient... */
@@ -1190,10 +1669,20 @@ static int read_data(struct flow *flow)
 					send_response(flow,
 						      requested_response_block_size);
 			}
+
+			/* a flow of finite size is complete with its last
+			 * block */
+			if (!flow->completed[READ] &&
+			    flow_size_reached(flow, READ)) {
+				struct timespec now;
+				gettime(&now);
+				complete_flow(&now, flow, READ);
+			}
 		}
 		if (!flow->settings.pushy)
 			break;
 	}
+	update_rcvlowat(flow);
 	return rc;
 }
 
@@ -1291,6 +1780,25 @@ static void process_delay(struct flow* flow)
 		  flow->id, current_delay * 1e3);
 }
 
+static void process_drift(struct flow* flow)
+{
+	double current_drift = .0;
+	struct timespec *data = (struct timespec *)
+		(flow->write_block + 2*(sizeof (int32_t)));
+
+	/* blocks of a replayed trace are only started once they are due */
+	current_drift = time_diff(&flow->next_write_block_timestamp, data);
+
+	foreach(int *i, INTERVAL, FINAL) {
+		ASSIGN_MIN(flow->statistics[*i].drift_min, current_drift);
+		ASSIGN_MAX(flow->statistics[*i].drift_max, current_drift);
+		flow->statistics[*i].drift_sum += current_drift;
+	}
+
+	DEBUG_MSG(LOG_NOTICE, "processed send drift of flow %d (%.3lfms)",
+		  flow->id, current_drift * 1e3);
+}
+
 static void send_response(struct flow* flow, int requested_response_block_size)
 {
 	int rc;
@@ -1322,16 +1830,14 @@ static void send_response(struct flow* flow, int requested_response_block_size)
 	/* send data out until block is finished (or abort if 0 zero bytes are
 	 * send CONGESTION_LIMIT times) */
 	for (;;) {
-		rc = write(flow->fd,
-			   flow->write_block + flow->current_block_bytes_written,
-			   requested_response_block_size -
-				flow->current_block_bytes_written);
+		rc = write_block_rest(flow, requested_response_block_size);
 
 		DEBUG_MSG(LOG_NOTICE, "send %d bytes response (rqs %d) on flow "
 			  "%d", rc, requested_response_block_size,flow->id);
 
 		if (rc == -1) {
 			if (errno == EAGAIN) {
+				metrics_add(&metrics.eagain_write, 1);
 				DEBUG_MSG(LOG_DEBUG, "%s, still trying to send "
 					  "response block (write queue hit "
 					  "limit)", strerror(errno));
@@ -1354,6 +1860,7 @@ static void send_response(struct flow* flow, int requested_response_block_size)
 			flow->current_block_bytes_written += rc;
 			foreach(int *i, INTERVAL, FINAL)
 				flow->statistics[*i].bytes_written += rc;
+			metrics_add(&metrics.bytes_written, rc);
 
 			if (flow->current_block_bytes_written >=
 			    (unsigned)requested_response_block_size) {
@@ -1371,12 +1878,12 @@ static void send_response(struct flow* flow, int requested_response_block_size)
 }
 
 
-int apply_extra_socket_options(struct flow *flow)
+int apply_extra_socket_options(struct flow *flow, int fd)
 {
-	for (int i = 0; i < flow->settings.num_extra_socket_options; i++) {
+	for (int i = 0; i < flow->settings.profile->num_extra_socket_options; i++) {
 		int level, res;
 		const struct extra_socket_options *option =
-			&flow->settings.extra_socket_options[i];
+			&flow->settings.profile->extra_socket_options[i];
 
 		switch (option->level) {
 		case level_sol_socket:
@@ -1403,7 +1910,7 @@ int apply_extra_socket_options(struct flow *flow)
 			return -1;
 		}
 
-		res = setsockopt(flow->fd, level, option->optname,
+		res = setsockopt(fd, level, option->optname,
 				 option->optval, option->optlen);
 
 		if (res == -1) {
@@ -1416,71 +1923,77 @@ int apply_extra_socket_options(struct flow *flow)
 	return 0;
 }
 
-/* Set the TCP options on the data socket */
-int set_flow_tcp_options(struct flow *flow)
+/* Set the TCP options of flow @p flow on socket @p fd */
+int set_socket_tcp_options(struct flow *flow, int fd)
 {
-	set_non_blocking(flow->fd);
+	set_non_blocking(fd);
 
-	if (*flow->settings.cc_alg &&
-	    set_congestion_control(flow->fd, flow->settings.cc_alg) == -1) {
+	if (*flow->settings.profile->cc_alg &&
+	    set_congestion_control(fd, flow->settings.profile->cc_alg) == -1) {
 		flow_error(flow, "Unable to set congestion control "
 			   "algorithm: %s", strerror(errno));
 		return -1;
 	}
 	if (flow->settings.elcn &&
-	    set_so_elcn(flow->fd, flow->settings.elcn) == -1) {
+	    set_so_elcn(fd, flow->settings.elcn) == -1) {
 		flow_error(flow, "Unable to set TCP_ELCN: %s",
 			   strerror(errno));
 		return -1;
 	}
-	if (flow->settings.lcd && set_so_lcd(flow->fd) == -1) {
+	if (flow->settings.lcd && set_so_lcd(fd) == -1) {
 		flow_error(flow, "Unable to set TCP_LCD: %s",
 			   strerror(errno));
 		return -1;
 	}
-	if (flow->settings.cork && set_tcp_cork(flow->fd) == -1) {
+	if (flow->settings.cork && set_tcp_cork(fd) == -1) {
 		flow_error(flow, "Unable to set TCP_CORK: %s",
 			   strerror(errno));
 		return -1;
 	}
-	if (flow->settings.so_debug && set_so_debug(flow->fd) == -1) {
+	if (flow->settings.so_debug && set_so_debug(fd) == -1) {
 		flow_error(flow, "Unable to set SO_DEBUG: %s",
 			   strerror(errno));
 		return -1;
 	}
-	if (flow->settings.mtcp && set_tcp_mtcp(flow->fd) == -1) {
+	if (flow->settings.mtcp && set_tcp_mtcp(fd) == -1) {
 		flow_error(flow, "Unable to set TCP_MTCP: %s",
 			   strerror(errno));
 		return -1;
 	}
-	if (flow->settings.nonagle && set_tcp_nodelay(flow->fd) == -1) {
+	if (flow->settings.nonagle && set_tcp_nodelay(fd) == -1) {
 		flow_error(flow, "Unable to set TCP_NODELAY: %s",
 			   strerror(errno));
 		return -1;
 	}
-	if (flow->settings.route_record && set_route_record(flow->fd) == -1) {
+	if (flow->settings.route_record && set_route_record(fd) == -1) {
 		flow_error(flow, "Unable to set route record option: %s",
 			   strerror(errno));
 		return -1;
 	}
 	if (flow->settings.dscp &&
-	    set_dscp(flow->fd, flow->settings.dscp) == -1) {
+	    set_dscp(fd, flow->settings.dscp) == -1) {
 		flow_error(flow, "Unable to set DSCP value: %s",
 			   strerror(errno));
 		return -1;
 	}
 	if (flow->settings.ipmtudiscover &&
-	    set_ip_mtu_discover(flow->fd) == -1) {
+	    set_ip_mtu_discover(fd) == -1) {
 		flow_error(flow, "Unable to set IP_MTU_DISCOVER value: %s",
 			   strerror(errno));
 		return -1;
 	}
-	if (apply_extra_socket_options(flow) == -1)
+	if (apply_extra_socket_options(flow, fd) == -1)
 		return -1;
 
 	return 0;
 }
 
+/* Set the TCP options on the data socket */
+int set_flow_tcp_options(struct flow *flow)
+{
+	return set_socket_tcp_options(flow, flow->fd);
+}
+
 /* Dispatch an incoming request to daemon thread */
 int dispatch_request(struct request *request, int type)
 {
@@ -40,7 +40,6 @@
 #endif /* HAVE_LIBGSL */
 
 #include "common.h"
-#include "fg_list.h"
 
 #include <xmlrpc-c/base.h>
 #include <xmlrpc-c/server.h>
@@ -70,32 +69,81 @@ struct flow_source_settings
 	pthread_cond_t* add_source_condition;
 };
 
-struct flow
+/** Size of a cache line, the alignment of struct flow. */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Cold metadata of a flow.
+ *
+ * Only needed to set up, report and tear down a flow. Kept out of struct
+ * flow, so the event loop does not pull it into the cache for every flow on
+ * every iteration.
+ */
+struct flow_meta
 {
-	int id;
+	struct flow_source_settings source_settings;
 
-	enum flow_state_t state;
-	enum endpoint_t endpoint;
+	/* Used for do_connect for source flows */
+	struct sockaddr *addr;
+	socklen_t addr_len;
 
-	int fd;
-	int listenfd_data;
+	unsigned short requested_server_test_port;
 
-	struct flow_settings settings;
-	struct flow_source_settings source_settings;
+	unsigned real_listen_send_buffer_size;
+	unsigned real_listen_receive_buffer_size;
 
-	struct timespec start_timestamp[2];
-	struct timespec stop_timestamp[2];
-	struct timespec last_block_read;
-	struct timespec last_block_written;
+	/** Largest receive low water mark the receive buffer can reach. */
+	int rcvlowat_max;
+
+	int pmtu;
 
 	struct timespec first_report_time;
 	struct timespec last_report_time;
-	struct timespec next_report_time;
 
-	struct timespec next_write_block_timestamp;
+	/** Time the first byte of a direction was written or read. */
+	struct timespec first_byte_timestamp[2];
+	/** Flow completion time of a direction, in seconds. */
+	double completion_time[2];
+
+	/** Time the flow actually started after the scheduled start. */
+	double start_skew;
+
+	/** TCP state of the test socket per report type. @{ */
+	int has_tcp_info[2];
+	struct fg_tcp_info tcp_info[2];                         /** @} */
+
+#ifdef HAVE_LIBPCAP
+	/** Capture of the flow, NULL if none. */
+	struct pcap_tap *pcap_tap;
+	/** Captured and dropped packets of the flow and packets dropped on its
+	 * interface at the last report per report type. @{ */
+	uint64_t pcap_packets[2];
+	uint64_t pcap_drops[2];
+	uint64_t pcap_ring_drops[2];                            /** @} */
+#endif /* HAVE_LIBPCAP */
+
+	char* error;
+};
+
+/**
+ * A flow endpoint handled by the daemon thread.
+ *
+ * The members are ordered by how often the event loop touches them: the
+ * state checked for every flow on every iteration comes first, the counters
+ * updated per block follow. Cold metadata lives in @p meta.
+ */
+struct flow
+{
+	int fd;
+	int listenfd_data;
 
-	char *read_block;
-	char *write_block;
+	enum flow_state_t state;
+	enum endpoint_t endpoint;
+
+	char connect_called;
+	char finished[2];
+	/** Whether a direction of a flow of finite size is complete. */
+	char completed[2];
 
 	unsigned current_write_block_size;
 	unsigned current_read_block_size;
@@ -103,21 +151,43 @@ struct flow
 	unsigned current_block_bytes_read;
 	unsigned current_block_bytes_written;
 
-	unsigned short requested_server_test_port;
+	/** Receive low water mark set on @p fd, 0 if not yet set and -1 if
+	 * not supported. */
+	int rcvlowat;
+	/** Whether the payload of the block being read differs from the
+	 * enumerated bytes of option -E. */
+	char current_block_corrupted;
+
+	/** Header of the block being read, the payload is discarded into the
+	 * scratch buffer of the block pool (see fg_block_pool.h). */
+	char read_block[MIN_BLOCK_SIZE]
+		__attribute__((aligned(__alignof__(struct block))));
+	/** Header of the block being written, the payload is sent from the
+	 * block pool. */
+	char write_block[MIN_BLOCK_SIZE]
+		__attribute__((aligned(__alignof__(struct block))));
 
-	unsigned real_listen_send_buffer_size;
-	unsigned real_listen_receive_buffer_size;
+	struct timespec next_write_block_timestamp;
 
-	char connect_called;
-	char finished[2];
+	struct timespec start_timestamp[2];
+	struct timespec stop_timestamp[2];
+	struct timespec last_block_read;
+	struct timespec last_block_written;
 
-	int pmtu;
+	/** Pre-generated traffic generation samples (see trafgen.h). */
+	struct trafgen_samples *samples;
+	/** Trace replayed instead of traffic generation (see fg_trace.h). */
+	struct trace_replay *trace;
+	/** Short connections opened from this flow as template (see churn.h). */
+	struct churn *churn;
 
-	unsigned congestion_counter;
+#ifdef HAVE_LIBGSL
+	gsl_rng * r;
+#endif /* HAVE_LIBGSL */
 
-	/* Used for do_connect for source flows */
-	struct sockaddr *addr;
-	socklen_t addr_len;
+	int id;
+
+	unsigned congestion_counter;
 
 	struct statistics {
 #ifdef HAVE_UNSIGNED_LONG_LONG_INT
@@ -152,23 +222,43 @@ struct flow
 		double rtt_max;
 		/** Accumulated round-trip time. */
 		double rtt_sum;
-
-		int has_tcp_info;
-		struct fg_tcp_info tcp_info;
+		/** Minimum send time drift of replayed blocks. */
+		double drift_min;
+		/** Maximum send time drift of replayed blocks. */
+		double drift_max;
+		/** Accumulated send time drift of replayed blocks. */
+		double drift_sum;
+		/** Connections opened or accepted by the churn generator. */
+		unsigned conns_opened;
+		/** Churn connections which completed their transfer. */
+		unsigned conns_completed;
+		/** Churn connections which failed or were aborted. */
+		unsigned conns_failed;
+		/** Churn arrivals dropped due to the connection limit. */
+		unsigned conns_dropped;
+		/** Minimum flow completion time of churn connections. */
+		double fct_min;
+		/** Maximum flow completion time of churn connections. */
+		double fct_max;
+		/** Accumulated flow completion time of churn connections. */
+		double fct_sum;
+		/** Blocks read whose payload differs from the enumerated bytes
+		 * of option -E. */
+		unsigned blocks_corrupted;
+		/** Bytes of payload read which differ from the enumerated
+		 * bytes of option -E. */
+#ifdef HAVE_UNSIGNED_LONG_LONG_INT
+		unsigned long long bytes_corrupted;
+#else /* HAVE_UNSIGNED_LONG_LONG_INT */
+		long bytes_corrupted;
+#endif /* HAVE_UNSIGNED_LONG_LONG_INT */
 	} statistics[2];
 
-#ifdef HAVE_LIBPCAP
-	pthread_t pcap_thread;
-	struct pcap_t *pcap_handle;
-	struct pcap_dumper_t *pcap_dumper;
-#endif /* HAVE_LIBPCAP */
-
-#ifdef HAVE_LIBGSL
-	gsl_rng * r;
-#endif /* HAVE_LIBGSL */
+	struct flow_settings settings;
 
-	char* error;
-};
+	/** Cold metadata in the flow table (see fg_flow_table.h). */
+	struct flow_meta *meta;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
 
 #define REQUEST_ADD_DESTINATION 0
 #define REQUEST_ADD_SOURCE 1
@@ -176,6 +266,7 @@ struct flow
 #define REQUEST_STOP_FLOW 3
 #define REQUEST_GET_STATUS 4
 #define REQUEST_GET_UUID 5
+#define REQUEST_ADD_FLOWS 6
 struct request
 {
 	char type;
@@ -217,11 +308,29 @@ struct request_add_flow_source
 	int real_read_buffer_size;
 };
 
+/**
+ * Several flow endpoints to be added at once.
+ *
+ * The daemon thread adds all of them in a single pass. Each entry is a
+ * request of type REQUEST_ADD_DESTINATION or REQUEST_ADD_SOURCE and receives
+ * its own reply or error, an entry failing does not affect the others.
+ */
+struct request_add_flows
+{
+	struct request r;
+
+	/** Number of entries. */
+	int num_flows;
+	/** The entries, added in this order. */
+	struct request **flows;
+};
+
 struct request_start_flows
 {
 	struct request r;
 
-	int start_timestamp;
+	/** Scheduled start of all flows in the clock of the daemon. */
+	struct timespec start_timestamp;
 };
 
 struct request_stop_flow
@@ -259,7 +368,6 @@ extern int daemon_pipe[2];
 
 extern char started;
 extern pthread_mutex_t mutex;
-extern struct linked_list flows;
 extern struct report* reports;
 extern struct report* reports_last;
 extern unsigned pending_reports;
@@ -275,8 +383,22 @@ char *dump_dir;
 void *daemon_main(void* ptr);
 void add_report(struct report* report);
 void flow_error(struct flow *flow, const char *fmt, ...);
+
+/**
+ * Take a slot of the flow table for a new flow endpoint and initialize it.
+ *
+ * The flow is added to the active flows with flow_table_insert() once it is
+ * set up. remove_flow() returns the slot, whether it was added or not.
+ *
+ * @param[in] is_source to determine flow endpoint i.e. source or destination
+ * @return the new flow, NULL if all slots are taken
+ */
+struct flow *alloc_flow(int is_source);
+void uninit_flow(struct flow *flow);
+void remove_flow(struct flow * const flow);
 void request_error(struct request *request, const char *fmt, ...);
 int set_flow_tcp_options(struct flow *flow);
+int set_socket_tcp_options(struct flow *flow, int fd);
 
 /** Dispatch a request to daemon loop.
  * Is called by the rpc server to feed in requests to the daemon. */
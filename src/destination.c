@@ -60,20 +60,21 @@
 #include "fg_math.h"
 #include "fg_log.h"
 #include "daemon.h"
+#include "trafgen.h"
+#include "fg_trace.h"
+#include "fg_profile.h"
+#include "fg_flow_table.h"
+#include "fg_block_pool.h"
+#include "churn.h"
 
 #ifdef HAVE_LIBPCAP
 #include "fg_pcap.h"
 #endif /* HAVE_LIBPCAP */
 
-void remove_flow(unsigned i);
-
 #ifdef HAVE_TCP_INFO
 int get_tcp_info(struct flow *flow, struct tcp_info *info);
 #endif /* HAVE_TCP_INFO */
 
-void init_flow(struct flow* flow, int is_source);
-void uninit_flow(struct flow *flow);
-
 /* listen_port will receive the port of the created socket */
 static int create_listen_socket(struct flow *flow, char *bind_addr,
 				unsigned short *listen_port)
@@ -124,10 +125,11 @@ static int create_listen_socket(struct flow *flow, char *bind_addr,
 	if (flow->settings.mtcp)
 		set_tcp_mtcp(fd);
 
-	if (flow->settings.cc_alg)
-		set_congestion_control(fd, flow->settings.cc_alg);
+	if (flow->settings.profile->cc_alg)
+		set_congestion_control(fd, flow->settings.profile->cc_alg);
 
-	if (listen(fd, 0) < 0) {
+	/* a churn flow accepts many connections in a short time */
+	if (listen(fd, flow->settings.churn ? SOMAXCONN : 0) < 0) {
 		logging(LOG_ALERT, "listen failed: %s", strerror(errno));
 		flow_error(flow, "listen failed: %s", strerror(errno));
 		return -1;
@@ -160,55 +162,70 @@ void add_flow_destination(struct request_add_flow_destination *request)
 	struct flow *flow;
 	unsigned short server_data_port;
 
-	if (fg_list_size(&flows) >= MAX_FLOWS_DAEMON) {
+	if (flow_table_size() >= MAX_FLOWS_DAEMON) {
 		logging(LOG_WARNING, "can not accept another flow, already "
-			"handling %zu flows", fg_list_size(&flows));
+			"handling %zu flows", flow_table_size());
 		request_error(&request->r, "Can not accept another flow, "
-			     "already handling %zu flows.", fg_list_size(&flows));
+			     "already handling %zu flows.", flow_table_size());
 		return;
 	}
 
-	flow = malloc(sizeof(struct flow));
+	flow = alloc_flow(0);
 	if (!flow) {
 		logging(LOG_ALERT, "could not allocate memory for flow");
 		return;
 	}
 
-	init_flow(flow, 0);
-
 	flow->settings = request->settings;
-	flow->write_block = calloc(1, flow->settings.maximum_block_size );
-	flow->read_block = calloc(1, flow->settings.maximum_block_size );
+	/* flows with equal settings share a single profile */
+	flow->settings.profile = profile_intern(request->settings.profile);
+	if (!flow->settings.profile) {
+		logging(LOG_ALERT, "could not allocate memory for flow "
+			"profile");
+		request_error(&request->r, "could not allocate memory for "
+			      "flow profile");
+		uninit_flow(flow);
+		remove_flow(flow);
+		return;
+	}
+	if (flow->settings.trace_name[0]) {
+		const char *problem = NULL;
+		flow->trace = trace_map(flow->settings.trace_name, &problem);
+		if (!flow->trace) {
+			logging(LOG_ALERT, "could not map trace %s: %s",
+				flow->settings.trace_name, problem);
+			request_error(&request->r, "could not map trace: %s",
+				      problem);
+			uninit_flow(flow);
+			remove_flow(flow);
+			return;
+		}
+	}
 	/* Controller flow ID is set in the daemon */
 	flow->id=flow->settings.flow_id;
-	if (flow->write_block == NULL || flow->read_block == NULL) {
+	if (block_pool_reserve(flow->settings.maximum_block_size,
+			       flow->settings.byte_counting) == -1) {
 		logging(LOG_ALERT, "could not allocate memory for read/write "
 			"blocks");
 		request_error(&request->r, "could not allocate memory "
 			      "for read/write blocks");
 		uninit_flow(flow);
+		remove_flow(flow);
 		return;
 	}
 
-	if (flow->settings.byte_counting) {
-		int byte_idx;
-		for (byte_idx = 0; byte_idx < flow->settings.maximum_block_size;
-		     byte_idx++)
-			*(flow->write_block + byte_idx) =
-				(unsigned char)(byte_idx & 0xff);
-	}
-
 	/* Create listen socket for data connection */
 	if ((flow->listenfd_data =
 			create_listen_socket(flow,
-					     flow->settings.bind_address[0]
-						? flow->settings.bind_address : 0,
+					     flow->settings.profile->bind_address[0]
+						? flow->settings.profile->bind_address : 0,
 					     &server_data_port)) == -1) {
 		logging(LOG_ALERT, "could not create listen socket for "
-			"data connection: %s", flow->error);
+			"data connection: %s", flow->meta->error);
 		request_error(&request->r, "could not create listen socket "
-			      "for data connection: %s", flow->error);
+			      "for data connection: %s", flow->meta->error);
 		uninit_flow(flow);
+		remove_flow(flow);
 		return;
 	} else {
 		/* FIXME: currently we use portable select() API, which
@@ -219,30 +236,41 @@ void add_flow_destination(struct request_add_flow_destination *request)
 			flow_error(flow, "failed to add listen socket: too many"
 				"file descriptors in use by this daemon");
 			uninit_flow(flow);
+			remove_flow(flow);
 			return;
 		}
 		DEBUG_MSG(LOG_WARNING, "listening on %s port %u for data "
-			  "connection (fd=%u)", flow->settings.bind_address,
+			  "connection (fd=%u)", flow->settings.profile->bind_address,
 			  server_data_port, flow->listenfd_data);
 	}
 
-	flow->real_listen_send_buffer_size =
+	flow->meta->real_listen_send_buffer_size =
 		set_window_size_directed(flow->listenfd_data,
 					 flow->settings.requested_send_buffer_size,
 					 SO_SNDBUF);
-	flow->real_listen_receive_buffer_size =
+	flow->meta->real_listen_receive_buffer_size =
 		set_window_size_directed(flow->listenfd_data,
 					 flow->settings.requested_read_buffer_size,
 					 SO_RCVBUF);
 
+	if (flow->settings.churn && init_churn(flow) == -1) {
+		logging(LOG_ALERT, "could not allocate memory for churn "
+			"connections");
+		request_error(&request->r, "could not allocate memory for "
+			      "churn connections");
+		uninit_flow(flow);
+		remove_flow(flow);
+		return;
+	}
+
 	request->listen_data_port = (int)server_data_port;
 	request->real_listen_send_buffer_size =
-		flow->real_listen_send_buffer_size;
+		flow->meta->real_listen_send_buffer_size;
 	request->real_listen_read_buffer_size =
-		flow->real_listen_receive_buffer_size;
+		flow->meta->real_listen_receive_buffer_size;
 	request->flow_id = flow->id;
 
-	fg_list_push_back(&flows, flow);
+	flow_table_insert(flow);
 
 	return;
 }
@@ -290,24 +318,24 @@ int accept_data(struct flow *flow)
 		set_window_size_directed(flow->fd,
 					 flow->settings.requested_send_buffer_size,
 					 SO_SNDBUF);
-	if (flow->requested_server_test_port &&
-	    flow->real_listen_send_buffer_size != real_send_buffer_size) {
+	if (flow->meta->requested_server_test_port &&
+	    flow->meta->real_listen_send_buffer_size != real_send_buffer_size) {
 		logging(LOG_WARNING, "failed to set send buffer size of test "
 			"socket to send buffer size size of listen socket "
 			"(listen = %u, test = %u)",
-			flow->real_listen_send_buffer_size, real_send_buffer_size);
+			flow->meta->real_listen_send_buffer_size, real_send_buffer_size);
 		return -1;
 	}
 	real_receive_buffer_size =
 		set_window_size_directed(flow->fd,
 					 flow->settings.requested_read_buffer_size,
 					 SO_RCVBUF);
-	if (flow->requested_server_test_port &&
-	    flow->real_listen_receive_buffer_size != real_receive_buffer_size) {
+	if (flow->meta->requested_server_test_port &&
+	    flow->meta->real_listen_receive_buffer_size != real_receive_buffer_size) {
 		logging(LOG_WARNING, "failed to set receive buffer size "
 			"(advertised window) of test socket to receive "
 			"buffer size of listen socket (listen = %u, "
-			"test = %u)", flow->real_listen_receive_buffer_size,
+			"test = %u)", flow->meta->real_listen_receive_buffer_size,
 			real_receive_buffer_size);
 		return -1;
 	}
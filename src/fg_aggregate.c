@@ -0,0 +1,336 @@
+/**
+ * @file fg_aggregate.c
+ * @brief Aggregation of interval reports of groups of flows
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fg_aggregate.h"
+#include "fg_definitions.h"
+
+/** All aggregation groups. */
+static struct linked_list aggregates;
+/** Prints a complete interval of a group. */
+static aggregate_print_t print_aggregate;
+
+/** Start a new, empty interval with index @p interval in group @p a. */
+static void reset_interval(struct aggregate *a, long interval)
+{
+	a->interval = interval;
+
+	foreach(int *i, SOURCE, DESTINATION) {
+		a->received[*i] = 0;
+		a->begin[*i] = INFINITY;
+		a->end[*i] = 0.0;
+
+		/* no member reported in the new interval yet */
+		const struct list_node *node = fg_list_front(&a->members[*i]);
+		while (node) {
+			struct aggregate_member *m = node->data;
+			m->interval = -1;
+			node = node->next;
+		}
+
+		struct report *sum = &a->sum[*i];
+		memset(sum, 0, sizeof(struct report));
+		sum->endpoint = *i;
+		sum->type = INTERVAL;
+		sum->iat_min = sum->delay_min = sum->rtt_min = FLT_MAX;
+		sum->drift_min = sum->fct_min = sum->wire_rtt_min = FLT_MAX;
+
+	}
+}
+
+/**
+ * Compute the fairness between the members of group @p a of type @p e in the
+ * current interval, and update the convergence.
+ */
+static void update_fairness(struct aggregate *a, enum endpoint_t e)
+{
+	struct fairness *f = &a->fairness[e];
+	double tput_sum = 0.0, tput_sum_squares = 0.0;
+	double tput_min = INFINITY, tput_max = 0.0;
+
+	f->jain = f->ratio = NAN;
+
+	/* Fairness needs competing members */
+	if (a->received[e] < 2)
+		return;
+
+	/* Throughput of each member that reported in the interval */
+	const struct list_node *node = fg_list_front(&a->members[e]);
+	while (node) {
+		const struct aggregate_member *m = node->data;
+		node = node->next;
+
+		if (m->interval != a->interval)
+			continue;
+		const double tput = m->end > m->begin ?
+				    m->bytes_written / (m->end - m->begin) :
+				    0.0;
+		tput_sum += tput;
+		tput_sum_squares += tput * tput;
+		ASSIGN_MIN(tput_min, tput);
+		ASSIGN_MAX(tput_max, tput);
+	}
+	if (!tput_sum_squares)
+		return;
+
+	f->jain = tput_sum * tput_sum / (a->received[e] * tput_sum_squares);
+	f->ratio = tput_min > 0 ? tput_max / tput_min : INFINITY;
+
+	if (!f->intervals++)
+		f->competing_since = a->begin[e];
+	f->jain_sum += f->jain;
+	ASSIGN_MIN(f->jain_min, f->jain);
+	ASSIGN_MAX(f->ratio_max, f->ratio);
+
+	if (f->jain < AGGREGATE_CONVERGED)
+		f->converged_since = NAN;
+	else if (isnan(f->converged_since))
+		f->converged_since = a->begin[e];
+}
+
+/** Print the current interval of group @p a, if any, and clear it. */
+static void flush_interval(struct aggregate *a)
+{
+	foreach(int *i, SOURCE, DESTINATION) {
+		if (!a->received[*i])
+			continue;
+		update_fairness(a, *i);
+		print_aggregate(a, *i, a->begin[*i], a->end[*i], &a->sum[*i]);
+	}
+
+	reset_interval(a, a->interval);
+}
+
+/** Whether all active members of group @p a reported the current interval. */
+static inline bool interval_complete(const struct aggregate *a)
+{
+	return a->received[SOURCE] + a->received[DESTINATION] >=
+	       a->active[SOURCE] + a->active[DESTINATION];
+}
+
+/** Merge interval report @p report into the merged report @p sum. */
+static void merge_report(struct report *sum, const struct report *report)
+{
+	sum->bytes_read += report->bytes_read;
+	sum->bytes_written += report->bytes_written;
+	sum->request_blocks_read += report->request_blocks_read;
+	sum->request_blocks_written += report->request_blocks_written;
+	sum->response_blocks_read += report->response_blocks_read;
+	sum->response_blocks_written += report->response_blocks_written;
+
+	/* Averages are derived from the merged sums and block counts */
+	ASSIGN_MIN(sum->iat_min, report->iat_min);
+	ASSIGN_MAX(sum->iat_max, report->iat_max);
+	sum->iat_sum += report->iat_sum;
+	ASSIGN_MIN(sum->delay_min, report->delay_min);
+	ASSIGN_MAX(sum->delay_max, report->delay_max);
+	sum->delay_sum += report->delay_sum;
+	ASSIGN_MIN(sum->rtt_min, report->rtt_min);
+	ASSIGN_MAX(sum->rtt_max, report->rtt_max);
+	sum->rtt_sum += report->rtt_sum;
+	ASSIGN_MIN(sum->drift_min, report->drift_min);
+	ASSIGN_MAX(sum->drift_max, report->drift_max);
+	sum->drift_sum += report->drift_sum;
+
+	sum->conns_opened += report->conns_opened;
+	sum->conns_completed += report->conns_completed;
+	sum->conns_failed += report->conns_failed;
+	sum->conns_dropped += report->conns_dropped;
+	ASSIGN_MIN(sum->fct_min, report->fct_min);
+	ASSIGN_MAX(sum->fct_max, report->fct_max);
+	sum->fct_sum += report->fct_sum;
+
+	sum->blocks_corrupted += report->blocks_corrupted;
+	sum->bytes_corrupted += report->bytes_corrupted;
+	sum->pcap_packets += report->pcap_packets;
+	sum->pcap_drops += report->pcap_drops;
+	/* the members on the same interface report the same kernel drops */
+	ASSIGN_MAX(sum->pcap_ring_drops, report->pcap_ring_drops);
+	sum->wire_retransmits += report->wire_retransmits;
+	sum->wire_reordered += report->wire_reordered;
+	sum->wire_rtt_samples += report->wire_rtt_samples;
+	ASSIGN_MIN(sum->wire_rtt_min, report->wire_rtt_min);
+	ASSIGN_MAX(sum->wire_rtt_max, report->wire_rtt_max);
+	sum->wire_rtt_sum += report->wire_rtt_sum;
+	sum->wire_acked += report->wire_acked;
+	sum->wire_flight += report->wire_flight;
+
+	/* Percentiles cannot be merged, show the worst one of all members */
+	ASSIGN_MAX(sum->fct_p50, report->fct_p50);
+	ASSIGN_MAX(sum->fct_p90, report->fct_p90);
+	ASSIGN_MAX(sum->fct_p99, report->fct_p99);
+}
+
+void aggregate_init(aggregate_print_t print)
+{
+	fg_list_init(&aggregates);
+	print_aggregate = print;
+}
+
+struct aggregate *aggregate_get(const char *name)
+{
+	const struct list_node *node = fg_list_front(&aggregates);
+	while (node) {
+		struct aggregate *a = node->data;
+		node = node->next;
+		if (!strcmp(a->name, name))
+			return a;
+	}
+
+	struct aggregate *a = calloc(1, sizeof(struct aggregate));
+	if (!a)
+		return NULL;
+
+	a->name = strdup(name);
+	if (!a->name) {
+		free(a);
+		return NULL;
+	}
+	foreach(int *i, SOURCE, DESTINATION)
+		fg_list_init(&a->members[*i]);
+	reset_interval(a, -1);
+	foreach(int *i, SOURCE, DESTINATION) {
+		struct fairness *f = &a->fairness[*i];
+		f->jain = f->ratio = NAN;
+		f->jain_min = INFINITY;
+		f->competing_since = f->converged_since = NAN;
+	}
+	fg_list_push_back(&aggregates, a);
+
+	return a;
+}
+
+size_t aggregate_count(void)
+{
+	return fg_list_size(&aggregates);
+}
+
+int aggregate_join(struct aggregate *a, struct linked_list *membership,
+		   enum endpoint_t e)
+{
+	/* An endpoint is counted only once per group */
+	const struct list_node *node = fg_list_front(membership);
+	while (node) {
+		const struct aggregate_member *m = node->data;
+		if (m->group == a)
+			return 0;
+		node = node->next;
+	}
+
+	struct aggregate_member *m = calloc(1, sizeof(struct aggregate_member));
+	if (!m)
+		return -1;
+	m->group = a;
+	m->interval = -1;
+
+	fg_list_push_back(&a->members[e], m);
+	fg_list_push_back(membership, m);
+	a->active[e]++;
+
+	return 0;
+}
+
+void aggregate_report(struct linked_list *membership, enum endpoint_t e,
+		      long interval, double begin, double end,
+		      const struct report *report)
+{
+	const struct list_node *node = fg_list_front(membership);
+	while (node) {
+		struct aggregate_member *m = node->data;
+		struct aggregate *a = m->group;
+		node = node->next;
+
+		if (interval > a->interval) {
+			flush_interval(a);
+			reset_interval(a, interval);
+		}
+
+		/* A late report of an interval already printed is merged into
+		 * the current one, so no data is lost */
+		merge_report(&a->sum[e], report);
+
+		/* A second report of a member in the same interval adds to its
+		 * first one instead of counting as another member */
+		if (m->interval != a->interval) {
+			m->interval = a->interval;
+			m->bytes_written = 0;
+			m->begin = begin;
+			m->end = end;
+			a->received[e]++;
+		}
+		m->bytes_written += report->bytes_written;
+		ASSIGN_MIN(m->begin, begin);
+		ASSIGN_MAX(m->end, end);
+		ASSIGN_MIN(a->begin[e], begin);
+		ASSIGN_MAX(a->end[e], end);
+
+		if (interval_complete(a))
+			flush_interval(a);
+	}
+}
+
+void aggregate_finish(struct linked_list *membership, enum endpoint_t e)
+{
+	const struct list_node *node = fg_list_front(membership);
+	while (node) {
+		const struct aggregate_member *m = node->data;
+		struct aggregate *a = m->group;
+		node = node->next;
+
+		if (a->active[e])
+			a->active[e]--;
+		if (a->received[SOURCE] + a->received[DESTINATION] &&
+		    interval_complete(a))
+			flush_interval(a);
+	}
+}
+
+void aggregate_flush(void)
+{
+	const struct list_node *node = fg_list_front(&aggregates);
+	while (node) {
+		flush_interval(node->data);
+		node = node->next;
+	}
+}
+
+void aggregate_cleanup(aggregate_summary_t summary)
+{
+	struct aggregate *a;
+	while ((a = fg_list_pop_front(&aggregates))) {
+		if (summary)
+			summary(a);
+		foreach(int *i, SOURCE, DESTINATION)
+			fg_list_clear(&a->members[*i]);
+		free_all(a->name, a);
+	}
+}
@@ -0,0 +1,183 @@
+/**
+ * @file fg_aggregate.h
+ * @brief Aggregation of interval reports of groups of flows
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_AGGREGATE_H_
+#define _FG_AGGREGATE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "common.h"
+#include "fg_list.h"
+
+/** Jain's fairness index at or above which the members of a group are
+ * considered to have converged to a fair share. */
+#define AGGREGATE_CONVERGED 0.95
+
+/** Fairness between the member endpoints of an aggregation group. */
+struct fairness {
+	/** Jain's fairness index and ratio of the largest to the smallest
+	 * throughput of the members in the last interval. NaN if less than
+	 * two members reported or none was sending. */
+	double jain, ratio;
+	/** Sum and minimum of Jain's index and maximal ratio over all
+	 * intervals it was defined in. */
+	double jain_sum, jain_min, ratio_max;
+	/** Number of intervals Jain's index was defined in. */
+	unsigned intervals;
+	/** Begin of the first interval Jain's index was defined in, in seconds
+	 * since the start of the test. */
+	double competing_since;
+	/** Begin of the current run of intervals with Jain's index at or above
+	 * AGGREGATE_CONVERGED, NaN if the last interval was below. */
+	double converged_since;
+};
+
+struct aggregate;
+
+/**
+ * Membership of a flow endpoint in an aggregation group.
+ *
+ * An endpoint may send two reports within one interval, e.g. due to timer
+ * jitter. They are accumulated, so the endpoint counts once in the fairness
+ * of the interval.
+ */
+struct aggregate_member {
+	/** Group the endpoint is a member of. */
+	struct aggregate *group;
+	/** Index of the current interval of the group if the endpoint reported
+	 * in it, -1 otherwise. */
+	long interval;
+	/** Bytes written in that interval. */
+	unsigned long long bytes_written;
+	/** Begin and end of the reports in that interval, in seconds since the
+	 * start of the test. */
+	double begin, end;
+};
+
+/**
+ * Aggregation group of flow endpoints.
+ *
+ * Interval reports of the member endpoints are merged into a single report
+ * per endpoint type as they arrive. An interval is complete once all member
+ * endpoints that have not finished yet reported it, or once a report of a
+ * later interval arrives.
+ */
+struct aggregate {
+	/** Name of the group, shown in the ID column. */
+	char *name;
+	/** Number of member endpoints per endpoint type (SOURCE or
+	 * DESTINATION) which have not sent their final report yet. */
+	unsigned active[2];
+	/** Index of the interval currently merged, -1 before the first one. */
+	long interval;
+	/** Members per endpoint type, the group owns the memberships. */
+	struct linked_list members[2];
+	/** Number of members which reported in the current interval per
+	 * type. */
+	unsigned received[2];
+	/** Begin and end of the current interval per endpoint type, in
+	 * seconds since the start of the test. */
+	double begin[2], end[2];
+	/** Merged reports of the current interval per endpoint type. */
+	struct report sum[2];
+	/** Fairness between the members per endpoint type. */
+	struct fairness fairness[2];
+};
+
+/**
+ * Called with the merged report @p sum of the endpoints of type @p e of group
+ * @p a for the interval from @p begin to @p end seconds after the start of
+ * the test.
+ */
+typedef void (*aggregate_print_t)(const struct aggregate *a,
+				  enum endpoint_t e, double begin, double end,
+				  struct report *sum);
+
+/** Called with group @p a once all its intervals are printed. */
+typedef void (*aggregate_summary_t)(const struct aggregate *a);
+
+/**
+ * Initialize the aggregation of interval reports.
+ *
+ * @param[in] print function printing a complete interval of a group
+ */
+void aggregate_init(aggregate_print_t print);
+
+/**
+ * Find the aggregation group with name @p name, or create it.
+ *
+ * @return the group, NULL if out of memory
+ */
+struct aggregate *aggregate_get(const char *name);
+
+/** Number of aggregation groups. */
+size_t aggregate_count(void);
+
+/**
+ * Add an endpoint of type @p e to group @p a.
+ *
+ * @param[in,out] a aggregation group
+ * @param[in,out] membership memberships (struct aggregate_member) of the
+ * endpoint
+ * @param[in] e endpoint type (SOURCE or DESTINATION)
+ * @return 0 on success, -1 if out of memory
+ */
+int aggregate_join(struct aggregate *a, struct linked_list *membership,
+		   enum endpoint_t e);
+
+/**
+ * Merge interval report @p report of an endpoint into all its groups.
+ *
+ * @param[in,out] membership memberships of the endpoint
+ * @param[in] e endpoint type (SOURCE or DESTINATION)
+ * @param[in] interval index of the reporting interval, starting at 0
+ * @param[in] begin begin of the report in seconds since the test start
+ * @param[in] end end of the report in seconds since the test start
+ * @param[in] report interval report
+ */
+void aggregate_report(struct linked_list *membership, enum endpoint_t e,
+		      long interval, double begin, double end,
+		      const struct report *report);
+
+/**
+ * Remove a finished endpoint from the active members of all its groups.
+ *
+ * @param[in] membership memberships of the endpoint
+ * @param[in] e endpoint type (SOURCE or DESTINATION)
+ */
+void aggregate_finish(struct linked_list *membership, enum endpoint_t e);
+
+/** Print the incomplete intervals of all groups. */
+void aggregate_flush(void);
+
+/**
+ * Free all groups.
+ *
+ * @param[in] summary function called with each group before it is freed,
+ * may be NULL
+ */
+void aggregate_cleanup(aggregate_summary_t summary);
+
+#endif /* _FG_AGGREGATE_H_ */
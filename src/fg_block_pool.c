@@ -0,0 +1,214 @@
+/**
+ * @file fg_block_pool.c
+ * @brief Block buffers shared by all flows of the daemon
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "fg_block_pool.h"
+#include "fg_log.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif /* MAP_ANONYMOUS */
+
+/** A shared buffer, mapped on its own. */
+struct pool_buffer {
+	/** Start of the mapping, NULL if not mapped. */
+	char *data;
+	/** Size of the mapping in bytes. */
+	size_t size;
+};
+
+/** The shared buffers. */
+enum pool_buffer_type {
+	/** Payload of outgoing blocks, all zeros. */
+	POOL_ZEROS = 0,
+	/** Payload of outgoing blocks of option -E, enumerated bytes. */
+	POOL_ENUMERATED,
+	/** Payload of incoming blocks is discarded into this buffer. */
+	POOL_SCRATCH,
+	/** Number of elements in enum. Must be last element. */
+	NUM_POOL_BUFFERS,
+};
+
+/** The shared buffers, indexed by enum pool_buffer_type. */
+static struct pool_buffer buffers[NUM_POOL_BUFFERS];
+
+/** Whether to back the buffers with hugepages. */
+static bool use_hugepages = false;
+
+/** Whether the lack of hugepages was already logged. */
+static bool hugepages_missing = false;
+
+/** Round @p size up to a multiple of @p align. */
+static inline size_t round_up(size_t size, size_t align)
+{
+	return (size + align - 1) / align * align;
+}
+
+/**
+ * Map an anonymous buffer of at least @p size bytes, backed by hugepages if
+ * requested and available.
+ *
+ * @param[in] size minimum size of the buffer
+ * @param[out] mapped actual size of the buffer
+ * @return the zeroed buffer, NULL on failure
+ */
+static char *map_buffer(size_t size, size_t *mapped)
+{
+	void *data;
+
+	if (use_hugepages) {
+#ifdef MAP_HUGETLB
+		*mapped = round_up(size, BLOCK_POOL_HUGEPAGE_SIZE);
+		data = mmap(NULL, *mapped, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (data != MAP_FAILED)
+			return data;
+#endif /* MAP_HUGETLB */
+		if (!hugepages_missing)
+			logging(LOG_WARNING, "no hugepages available for the "
+				"block buffers, using regular pages");
+		hugepages_missing = true;
+	}
+
+	*mapped = round_up(size, sysconf(_SC_PAGESIZE));
+	data = mmap(NULL, *mapped, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	/* transparent hugepages are the next best thing */
+	if (use_hugepages)
+		madvise(data, *mapped, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+	return data;
+}
+
+/** Unmap buffer @p b. */
+static void release(struct pool_buffer *b)
+{
+	if (b->data)
+		munmap(b->data, b->size);
+	b->data = NULL;
+	b->size = 0;
+}
+
+/**
+ * Grow buffer @p b to at least @p size bytes.
+ *
+ * @param[in,out] b buffer to grow
+ * @param[in] size minimum size of the buffer
+ * @param[in] enumerate whether to fill the buffer with enumerated bytes
+ * @return zero on success, -1 if out of memory
+ */
+static int reserve(struct pool_buffer *b, size_t size, bool enumerate)
+{
+	size_t mapped;
+	char *data;
+
+	if (size <= b->size)
+		return 0;
+
+	data = map_buffer(size, &mapped);
+	if (!data)
+		return -1;
+	if (enumerate)
+		for (size_t i = 0; i < mapped; i++)
+			data[i] = (unsigned char)(i & 0xff);
+
+	release(b);
+	b->data = data;
+	b->size = mapped;
+
+	DEBUG_MSG(LOG_NOTICE, "grew block buffer %td to %zu bytes",
+		  b - buffers, mapped);
+
+	return 0;
+}
+
+void block_pool_use_hugepages(bool hugepages)
+{
+	use_hugepages = hugepages;
+}
+
+int block_pool_reserve(size_t block_size, bool enumerated)
+{
+	if (reserve(&buffers[enumerated ? POOL_ENUMERATED : POOL_ZEROS],
+		    block_size, enumerated) == -1)
+		return -1;
+
+	return reserve(&buffers[POOL_SCRATCH], block_size, false);
+}
+
+void block_pool_trim(void)
+{
+	for (int i = 0; i < NUM_POOL_BUFFERS; i++)
+		release(&buffers[i]);
+}
+
+const char *block_pool_payload(bool enumerated)
+{
+	return buffers[enumerated ? POOL_ENUMERATED : POOL_ZEROS].data;
+}
+
+char *block_pool_scratch(void)
+{
+	return buffers[POOL_SCRATCH].data;
+}
+
+size_t block_pool_scratch_size(void)
+{
+	return buffers[POOL_SCRATCH].size;
+}
+
+size_t block_pool_verify(const char *data, size_t offset, size_t len)
+{
+	const char *expected = buffers[POOL_ENUMERATED].data + offset;
+	size_t mismatched = 0;
+
+	assert(offset + len <= buffers[POOL_ENUMERATED].size);
+
+	/* memcmp() is vectorized by the C library and the enumerated buffer
+	 * stays in the cache, so intact payload is checked at memory speed */
+	if (!memcmp(data, expected, len))
+		return 0;
+
+	for (size_t i = 0; i < len; i++)
+		mismatched += data[i] != expected[i];
+
+	return mismatched;
+}
@@ -0,0 +1,100 @@
+/**
+ * @file fg_block_pool.h
+ * @brief Block buffers shared by all flows of the daemon
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_BLOCK_POOL_H_
+#define _FG_BLOCK_POOL_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Only the header of a block (struct block) differs between flows, so each
+ * flow merely keeps the headers of its current blocks. The payload of all
+ * outgoing blocks is sent from a shared buffer, which holds zeros or, for
+ * flows with option -E, enumerated bytes. The payload of incoming blocks is
+ * discarded into a shared scratch buffer. The buffers grow to the largest
+ * block size of the flows and are released once the daemon has no flows
+ * left, so their size does not depend on the number of flows.
+ *
+ * The buffers may move when they grow, never keep a pointer to them across
+ * calls of block_pool_reserve(). Only the daemon thread uses the pool.
+ */
+
+/** Size of a hugepage the buffers are backed with, 2 MB. */
+#define BLOCK_POOL_HUGEPAGE_SIZE (2UL << 20)
+
+/**
+ * Back the buffers with hugepages of BLOCK_POOL_HUGEPAGE_SIZE.
+ *
+ * Regular pages are used if no hugepages are available. Must be called
+ * before the daemon thread starts.
+ *
+ * @param[in] hugepages whether to use hugepages
+ */
+void block_pool_use_hugepages(bool hugepages);
+
+/**
+ * Make the buffers hold blocks of @p block_size bytes.
+ *
+ * @param[in] block_size largest block size of a flow
+ * @param[in] enumerated whether the flow sends enumerated bytes (option -E)
+ * @return zero on success, -1 if out of memory
+ */
+int block_pool_reserve(size_t block_size, bool enumerated);
+
+/** Release the buffers, called once the daemon has no flows left. */
+void block_pool_trim(void);
+
+/**
+ * Payload of outgoing blocks, the byte at offset i is the byte at offset i
+ * of a block.
+ *
+ * @param[in] enumerated whether to return the enumerated bytes (option -E)
+ * instead of zeros
+ */
+const char *block_pool_payload(bool enumerated);
+
+/** Scratch buffer the payload of incoming blocks is discarded into. */
+char *block_pool_scratch(void);
+
+/** Size of the scratch buffer in bytes. */
+size_t block_pool_scratch_size(void);
+
+/**
+ * Compare received payload with the enumerated bytes of option -E.
+ *
+ * The enumerated buffer must hold at least @p offset + @p len bytes, which
+ * block_pool_reserve() for a flow with option -E ensures.
+ *
+ * @param[in] data received payload
+ * @param[in] offset offset of @p data in its block
+ * @param[in] len number of bytes received
+ * @return number of bytes which differ from the enumerated bytes
+ */
+size_t block_pool_verify(const char *data, size_t offset, size_t len);
+
+#endif /* _FG_BLOCK_POOL_H_ */
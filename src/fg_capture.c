@@ -0,0 +1,534 @@
+/**
+ * @file fg_capture.c
+ * @brief Capture file of all reports of a test run
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fg_capture.h"
+#include "fg_error.h"
+#include "fg_io.h"
+
+#define UINT_COLUMN(name) {#name, CAPTURE_UINT}
+#define DOUBLE_COLUMN(name) {#name, CAPTURE_DOUBLE}
+
+const struct capture_column_info capture_columns[NUM_CAPTURE_COLUMNS] = {
+	[CAPTURE_TYPE] = UINT_COLUMN(type),
+	[CAPTURE_BEGIN] = DOUBLE_COLUMN(begin),
+	[CAPTURE_END] = DOUBLE_COLUMN(end),
+	[CAPTURE_BYTES_WRITTEN] = UINT_COLUMN(bytes_written),
+	[CAPTURE_BYTES_READ] = UINT_COLUMN(bytes_read),
+	[CAPTURE_REQUEST_BLOCKS_WRITTEN] = UINT_COLUMN(request_blocks_written),
+	[CAPTURE_REQUEST_BLOCKS_READ] = UINT_COLUMN(request_blocks_read),
+	[CAPTURE_RESPONSE_BLOCKS_WRITTEN] = UINT_COLUMN(response_blocks_written),
+	[CAPTURE_RESPONSE_BLOCKS_READ] = UINT_COLUMN(response_blocks_read),
+	[CAPTURE_RTT_MIN] = DOUBLE_COLUMN(rtt_min),
+	[CAPTURE_RTT_AVG] = DOUBLE_COLUMN(rtt_avg),
+	[CAPTURE_RTT_MAX] = DOUBLE_COLUMN(rtt_max),
+	[CAPTURE_IAT_MIN] = DOUBLE_COLUMN(iat_min),
+	[CAPTURE_IAT_AVG] = DOUBLE_COLUMN(iat_avg),
+	[CAPTURE_IAT_MAX] = DOUBLE_COLUMN(iat_max),
+	[CAPTURE_DELAY_MIN] = DOUBLE_COLUMN(delay_min),
+	[CAPTURE_DELAY_AVG] = DOUBLE_COLUMN(delay_avg),
+	[CAPTURE_DELAY_MAX] = DOUBLE_COLUMN(delay_max),
+	[CAPTURE_DRIFT_MIN] = DOUBLE_COLUMN(drift_min),
+	[CAPTURE_DRIFT_AVG] = DOUBLE_COLUMN(drift_avg),
+	[CAPTURE_DRIFT_MAX] = DOUBLE_COLUMN(drift_max),
+	[CAPTURE_CONNS_COMPLETED] = UINT_COLUMN(conns_completed),
+	[CAPTURE_CONNS_FAILED] = UINT_COLUMN(conns_failed),
+	[CAPTURE_CONNS_DROPPED] = UINT_COLUMN(conns_dropped),
+	[CAPTURE_FCT_P50] = DOUBLE_COLUMN(fct_p50),
+	[CAPTURE_FCT_P90] = DOUBLE_COLUMN(fct_p90),
+	[CAPTURE_FCT_P99] = DOUBLE_COLUMN(fct_p99),
+	[CAPTURE_TCPI_SND_CWND] = UINT_COLUMN(tcpi_snd_cwnd),
+	[CAPTURE_TCPI_SND_SSTHRESH] = UINT_COLUMN(tcpi_snd_ssthresh),
+	[CAPTURE_TCPI_UNACKED] = UINT_COLUMN(tcpi_unacked),
+	[CAPTURE_TCPI_SACKED] = UINT_COLUMN(tcpi_sacked),
+	[CAPTURE_TCPI_LOST] = UINT_COLUMN(tcpi_lost),
+	[CAPTURE_TCPI_RETRANS] = UINT_COLUMN(tcpi_retrans),
+	[CAPTURE_TCPI_RETRANSMITS] = UINT_COLUMN(tcpi_retransmits),
+	[CAPTURE_TCPI_FACKETS] = UINT_COLUMN(tcpi_fackets),
+	[CAPTURE_TCPI_REORDERING] = UINT_COLUMN(tcpi_reordering),
+	[CAPTURE_TCPI_BACKOFF] = UINT_COLUMN(tcpi_backoff),
+	[CAPTURE_TCPI_CA_STATE] = UINT_COLUMN(tcpi_ca_state),
+	[CAPTURE_TCPI_SND_MSS] = UINT_COLUMN(tcpi_snd_mss),
+	[CAPTURE_TCPI_RTT] = DOUBLE_COLUMN(tcpi_rtt),
+	[CAPTURE_TCPI_RTTVAR] = DOUBLE_COLUMN(tcpi_rttvar),
+	[CAPTURE_TCPI_RTO] = DOUBLE_COLUMN(tcpi_rto),
+	[CAPTURE_PMTU] = UINT_COLUMN(pmtu),
+	[CAPTURE_BLOCKS_CORRUPTED] = UINT_COLUMN(blocks_corrupted),
+	[CAPTURE_BYTES_CORRUPTED] = UINT_COLUMN(bytes_corrupted),
+	[CAPTURE_PCAP_PACKETS] = UINT_COLUMN(pcap_packets),
+	[CAPTURE_PCAP_DROPS] = UINT_COLUMN(pcap_drops),
+	[CAPTURE_PCAP_RING_DROPS] = UINT_COLUMN(pcap_ring_drops),
+	[CAPTURE_WIRE_RETRANSMITS] = UINT_COLUMN(wire_retransmits),
+	[CAPTURE_WIRE_REORDERED] = UINT_COLUMN(wire_reordered),
+	[CAPTURE_WIRE_RTT_MIN] = DOUBLE_COLUMN(wire_rtt_min),
+	[CAPTURE_WIRE_RTT_AVG] = DOUBLE_COLUMN(wire_rtt_avg),
+	[CAPTURE_WIRE_RTT_MAX] = DOUBLE_COLUMN(wire_rtt_max),
+	[CAPTURE_WIRE_ACKED] = UINT_COLUMN(wire_acked),
+	[CAPTURE_WIRE_FLIGHT] = UINT_COLUMN(wire_flight),
+};
+
+/** File descriptor of the capture file, -1 if there is none. */
+static int capture_fd = -1;
+/** Number of flows of the test. */
+static unsigned capture_flows = 0;
+/** Whether the header has been written. */
+static int started = 0;
+/** Chunk being filled per flow endpoint, allocated on first use. */
+static struct capture_chunk **chunks = NULL;
+/** Index entries of all chunks written. */
+static struct capture_index_entry *index_entries = NULL;
+/** Number of index entries and allocated entries. */
+static size_t num_entries = 0, max_entries = 0;
+/** Number of bytes written to the capture file. */
+static uint64_t file_offset = 0;
+
+/** Size of the header including the flow descriptions for @p num_flows. */
+static inline size_t header_size(unsigned num_flows)
+{
+	size_t size = sizeof(struct capture_header) +
+		      num_flows * sizeof(struct capture_flow);
+	return (size + CAPTURE_ALIGN - 1) / CAPTURE_ALIGN * CAPTURE_ALIGN;
+}
+
+/** Write @p len bytes of @p data to the capture file. */
+static void capture_write(const void *data, size_t len)
+{
+	if (write_all(capture_fd, data, len) == -1)
+		crit("could not write capture file");
+	file_offset += len;
+}
+
+/** Write chunk @p chunk if not empty, and record it in the index. */
+static void write_chunk(struct capture_chunk *chunk)
+{
+	if (!chunk->count)
+		return;
+
+	/* Clear the unused values left from the previous chunk */
+	if (chunk->count < CAPTURE_CHUNK_RECORDS)
+		for (unsigned col = 0; col < NUM_CAPTURE_COLUMNS; col++)
+			memset(&chunk->values[col][chunk->count], 0,
+			       (CAPTURE_CHUNK_RECORDS - chunk->count) *
+			       sizeof(union capture_value));
+
+	if (num_entries == max_entries) {
+		max_entries = max_entries ? 2 * max_entries : 256;
+		index_entries = realloc(index_entries, max_entries *
+					sizeof(struct capture_index_entry));
+		if (!index_entries)
+			critx("could not allocate memory for capture index");
+	}
+
+	index_entries[num_entries++] = (struct capture_index_entry) {
+		.flow_id = chunk->flow_id,
+		.endpoint = chunk->endpoint,
+		.count = chunk->count,
+		.begin = chunk->begin,
+		.end = chunk->end,
+		.offset = file_offset,
+	};
+
+	chunk->sequence = num_entries - 1;
+	capture_write(chunk, sizeof(struct capture_chunk));
+
+	chunk->count = 0;
+	chunk->begin = INFINITY;
+	chunk->end = -INFINITY;
+}
+
+/**
+ * Order of the chunk index: by flow ID, endpoint and time. The chunks of an
+ * endpoint are written in the order of its reports.
+ */
+static int compare_entries(const void *a, const void *b)
+{
+	const struct capture_index_entry *x = a, *y = b;
+
+	if (x->flow_id != y->flow_id)
+		return x->flow_id < y->flow_id ? -1 : 1;
+	if (x->endpoint != y->endpoint)
+		return x->endpoint < y->endpoint ? -1 : 1;
+	if (x->offset != y->offset)
+		return x->offset < y->offset ? -1 : 1;
+	return 0;
+}
+
+void capture_open(int fd, unsigned num_flows)
+{
+	capture_fd = fd;
+	capture_flows = num_flows;
+
+	chunks = calloc(2 * num_flows, sizeof(struct capture_chunk *));
+	if (!chunks)
+		critx("could not allocate memory for capture chunks");
+}
+
+void capture_start(const struct timespec *start, double reporting_interval,
+		   const struct capture_flow *flows)
+{
+	if (capture_fd == -1)
+		return;
+
+	const size_t size = header_size(capture_flows);
+	char *header = calloc(1, size);
+	if (!header)
+		critx("could not allocate memory for capture header");
+
+	*(struct capture_header *)header = (struct capture_header) {
+		.magic = CAPTURE_MAGIC,
+		.version = CAPTURE_VERSION,
+		.byte_order = CAPTURE_BYTE_ORDER,
+		.header_size = size,
+		.chunk_size = sizeof(struct capture_chunk),
+		.chunk_records = CAPTURE_CHUNK_RECORDS,
+		.num_columns = NUM_CAPTURE_COLUMNS,
+		.num_flows = capture_flows,
+		.start_sec = start->tv_sec,
+		.start_nsec = start->tv_nsec,
+		.reporting_interval = reporting_interval,
+	};
+	memcpy(header + sizeof(struct capture_header), flows,
+	       capture_flows * sizeof(struct capture_flow));
+
+	capture_write(header, size);
+	free(header);
+	started = 1;
+}
+
+/** Average of @p count samples summing up to @p sum, NaN if none. */
+static inline double average(double sum, unsigned count)
+{
+	return count ? sum / count : NAN;
+}
+
+void capture_report(int flow_id, enum endpoint_t e, double begin, double end,
+		    const struct report *report)
+{
+	if (!started || flow_id < 0 || (unsigned)flow_id >= capture_flows)
+		return;
+
+	struct capture_chunk **chunk = &chunks[2 * flow_id + e];
+	if (!*chunk) {
+		*chunk = calloc(1, sizeof(struct capture_chunk));
+		if (!*chunk)
+			critx("could not allocate memory for capture chunk");
+		(*chunk)->magic = CAPTURE_CHUNK_MAGIC;
+		(*chunk)->flow_id = flow_id;
+		(*chunk)->endpoint = e;
+		(*chunk)->begin = INFINITY;
+		(*chunk)->end = -INFINITY;
+	}
+
+	struct capture_chunk *c = *chunk;
+	const unsigned n = c->count++;
+	const struct fg_tcp_info *tcp_info = &report->tcp_info;
+	const unsigned rsp_read = report->response_blocks_read;
+	const unsigned req_read = report->request_blocks_read;
+	const unsigned req_written = report->request_blocks_written;
+	const unsigned completed = report->conns_completed;
+	const unsigned wire_samples = report->wire_rtt_samples;
+
+#define U(col, value) c->values[col][n].u = (value)
+#define D(col, value) c->values[col][n].d = (value)
+	U(CAPTURE_TYPE, report->type);
+	D(CAPTURE_BEGIN, begin);
+	D(CAPTURE_END, end);
+	U(CAPTURE_BYTES_WRITTEN, report->bytes_written);
+	U(CAPTURE_BYTES_READ, report->bytes_read);
+	U(CAPTURE_REQUEST_BLOCKS_WRITTEN, req_written);
+	U(CAPTURE_REQUEST_BLOCKS_READ, req_read);
+	U(CAPTURE_RESPONSE_BLOCKS_WRITTEN, report->response_blocks_written);
+	U(CAPTURE_RESPONSE_BLOCKS_READ, rsp_read);
+	D(CAPTURE_RTT_MIN, rsp_read ? report->rtt_min : NAN);
+	D(CAPTURE_RTT_AVG, average(report->rtt_sum, rsp_read));
+	D(CAPTURE_RTT_MAX, rsp_read ? report->rtt_max : NAN);
+	D(CAPTURE_IAT_MIN, req_read ? report->iat_min : NAN);
+	D(CAPTURE_IAT_AVG, average(report->iat_sum, req_read));
+	D(CAPTURE_IAT_MAX, req_read ? report->iat_max : NAN);
+	D(CAPTURE_DELAY_MIN, req_read ? report->delay_min : NAN);
+	D(CAPTURE_DELAY_AVG, average(report->delay_sum, req_read));
+	D(CAPTURE_DELAY_MAX, req_read ? report->delay_max : NAN);
+	D(CAPTURE_DRIFT_MIN, req_written ? report->drift_min : NAN);
+	D(CAPTURE_DRIFT_AVG, average(report->drift_sum, req_written));
+	D(CAPTURE_DRIFT_MAX, req_written ? report->drift_max : NAN);
+	U(CAPTURE_CONNS_COMPLETED, completed);
+	U(CAPTURE_CONNS_FAILED, report->conns_failed);
+	U(CAPTURE_CONNS_DROPPED, report->conns_dropped);
+	D(CAPTURE_FCT_P50, completed ? report->fct_p50 : NAN);
+	D(CAPTURE_FCT_P90, completed ? report->fct_p90 : NAN);
+	D(CAPTURE_FCT_P99, completed ? report->fct_p99 : NAN);
+	U(CAPTURE_TCPI_SND_CWND, tcp_info->tcpi_snd_cwnd);
+	U(CAPTURE_TCPI_SND_SSTHRESH, tcp_info->tcpi_snd_ssthresh);
+	U(CAPTURE_TCPI_UNACKED, tcp_info->tcpi_unacked);
+	U(CAPTURE_TCPI_SACKED, tcp_info->tcpi_sacked);
+	U(CAPTURE_TCPI_LOST, tcp_info->tcpi_lost);
+	U(CAPTURE_TCPI_RETRANS, tcp_info->tcpi_retrans);
+	U(CAPTURE_TCPI_RETRANSMITS, tcp_info->tcpi_retransmits);
+	U(CAPTURE_TCPI_FACKETS, tcp_info->tcpi_fackets);
+	U(CAPTURE_TCPI_REORDERING, tcp_info->tcpi_reordering);
+	U(CAPTURE_TCPI_BACKOFF, tcp_info->tcpi_backoff);
+	U(CAPTURE_TCPI_CA_STATE, tcp_info->tcpi_ca_state);
+	U(CAPTURE_TCPI_SND_MSS, tcp_info->tcpi_snd_mss);
+	/* the kernel reports microseconds */
+	D(CAPTURE_TCPI_RTT, tcp_info->tcpi_rtt / 1e6);
+	D(CAPTURE_TCPI_RTTVAR, tcp_info->tcpi_rttvar / 1e6);
+	D(CAPTURE_TCPI_RTO, tcp_info->tcpi_rto / 1e6);
+	U(CAPTURE_PMTU, report->pmtu);
+	U(CAPTURE_BLOCKS_CORRUPTED, report->blocks_corrupted);
+	U(CAPTURE_BYTES_CORRUPTED, report->bytes_corrupted);
+	U(CAPTURE_PCAP_PACKETS, report->pcap_packets);
+	U(CAPTURE_PCAP_DROPS, report->pcap_drops);
+	U(CAPTURE_PCAP_RING_DROPS, report->pcap_ring_drops);
+	U(CAPTURE_WIRE_RETRANSMITS, report->wire_retransmits);
+	U(CAPTURE_WIRE_REORDERED, report->wire_reordered);
+	D(CAPTURE_WIRE_RTT_MIN, wire_samples ? report->wire_rtt_min : NAN);
+	D(CAPTURE_WIRE_RTT_AVG, average(report->wire_rtt_sum, wire_samples));
+	D(CAPTURE_WIRE_RTT_MAX, wire_samples ? report->wire_rtt_max : NAN);
+	U(CAPTURE_WIRE_ACKED, report->wire_acked);
+	U(CAPTURE_WIRE_FLIGHT, report->wire_flight);
+#undef U
+#undef D
+
+	if (begin < c->begin)
+		c->begin = begin;
+	if (end > c->end)
+		c->end = end;
+
+	if (c->count == CAPTURE_CHUNK_RECORDS)
+		write_chunk(c);
+}
+
+void capture_close(void)
+{
+	if (capture_fd == -1)
+		return;
+
+	for (unsigned i = 0; i < 2 * capture_flows; i++) {
+		if (!chunks[i])
+			continue;
+		write_chunk(chunks[i]);
+		free(chunks[i]);
+	}
+	free(chunks);
+	chunks = NULL;
+
+	if (started) {
+		qsort(index_entries, num_entries,
+		      sizeof(struct capture_index_entry), compare_entries);
+
+		struct capture_trailer trailer = {
+			.index_offset = file_offset,
+			.num_chunks = num_entries,
+			.magic = CAPTURE_INDEX_MAGIC,
+		};
+		capture_write(index_entries,
+			      num_entries * sizeof(struct capture_index_entry));
+		capture_write(&trailer, sizeof(trailer));
+	}
+	free(index_entries);
+	index_entries = NULL;
+
+	if (close(capture_fd) == -1)
+		crit("could not close capture file");
+	capture_fd = -1;
+}
+
+/** Whether the index of capture file @p cf is complete and consistent. */
+static int valid_index(const struct capture_file *cf)
+{
+	const struct capture_header *header = cf->header;
+
+	if (cf->size < header->header_size + sizeof(struct capture_trailer))
+		return 0;
+
+	const struct capture_trailer *trailer = (const void *)
+		((const char *)cf->map + cf->size - sizeof(*trailer));
+	if (trailer->magic != CAPTURE_INDEX_MAGIC ||
+	    trailer->index_offset < header->header_size ||
+	    trailer->index_offset + (uint64_t)trailer->num_chunks *
+	    sizeof(struct capture_index_entry) + sizeof(*trailer) != cf->size)
+		return 0;
+
+	const struct capture_index_entry *index = (const void *)
+		((const char *)cf->map + trailer->index_offset);
+	for (size_t i = 0; i < trailer->num_chunks; i++) {
+		if (index[i].offset < header->header_size ||
+		    index[i].offset + header->chunk_size >
+		    trailer->index_offset ||
+		    index[i].count > CAPTURE_CHUNK_RECORDS)
+			return 0;
+
+		/* The entry must describe the chunk it points to */
+		const struct capture_chunk *c = (const void *)
+			((const char *)cf->map + index[i].offset);
+		if (c->magic != CAPTURE_CHUNK_MAGIC ||
+		    c->flow_id != index[i].flow_id ||
+		    c->endpoint != index[i].endpoint ||
+		    c->count != index[i].count)
+			return 0;
+	}
+
+	return 1;
+}
+
+/** Rebuild the index of capture file @p cf from its chunks. */
+static int rebuild_index(struct capture_file *cf)
+{
+	const size_t chunk_size = cf->header->chunk_size;
+	size_t max = (cf->size - cf->header->header_size) / chunk_size;
+
+	struct capture_index_entry *index =
+		calloc(max ? max : 1, sizeof(struct capture_index_entry));
+	if (!index)
+		return -1;
+
+	size_t n = 0;
+	for (size_t offset = cf->header->header_size;
+	     offset + chunk_size <= cf->size; offset += chunk_size) {
+		const struct capture_chunk *c = (const void *)
+			((const char *)cf->map + offset);
+		/* The index, or garbage of an interrupted write */
+		if (c->magic != CAPTURE_CHUNK_MAGIC ||
+		    c->count > CAPTURE_CHUNK_RECORDS)
+			break;
+		index[n++] = (struct capture_index_entry) {
+			.flow_id = c->flow_id,
+			.endpoint = c->endpoint,
+			.count = c->count,
+			.begin = c->begin,
+			.end = c->end,
+			.offset = offset,
+		};
+	}
+
+	qsort(index, n, sizeof(struct capture_index_entry), compare_entries);
+	cf->index = index;
+	cf->num_chunks = n;
+	cf->rebuilt_index = 1;
+	return 0;
+}
+
+int capture_map(const char *path, struct capture_file *cf)
+{
+	memset(cf, 0, sizeof(struct capture_file));
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(struct capture_header)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	cf->map = map;
+	cf->size = st.st_size;
+	cf->header = map;
+	cf->flows = (const void *)((const char *)map +
+				   sizeof(struct capture_header));
+
+	const struct capture_header *header = cf->header;
+	if (header->magic != CAPTURE_MAGIC ||
+	    header->byte_order != CAPTURE_BYTE_ORDER ||
+	    header->version != CAPTURE_VERSION ||
+	    header->chunk_size != sizeof(struct capture_chunk) ||
+	    header->chunk_records != CAPTURE_CHUNK_RECORDS ||
+	    header->num_columns != NUM_CAPTURE_COLUMNS ||
+	    header->header_size != header_size(header->num_flows) ||
+	    header->header_size > cf->size) {
+		capture_unmap(cf);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (valid_index(cf)) {
+		const struct capture_trailer *trailer = (const void *)
+			((const char *)map + cf->size - sizeof(*trailer));
+		cf->index = (const void *)
+			((const char *)map + trailer->index_offset);
+		cf->num_chunks = trailer->num_chunks;
+	} else if (rebuild_index(cf) == -1) {
+		capture_unmap(cf);
+		return -1;
+	}
+
+	return 0;
+}
+
+void capture_unmap(struct capture_file *cf)
+{
+	if (cf->rebuilt_index)
+		free((void *)cf->index);
+	if (cf->map)
+		munmap((void *)cf->map, cf->size);
+	memset(cf, 0, sizeof(struct capture_file));
+}
+
+size_t capture_find(const struct capture_file *cf, int flow_id,
+		    enum endpoint_t e, double time)
+{
+	size_t lo = 0, hi = cf->num_chunks;
+
+	/* First entry not ordered before (flow_id, e, end >= time) */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct capture_index_entry *entry = &cf->index[mid];
+		int before = entry->flow_id < flow_id ||
+			     (entry->flow_id == flow_id &&
+			      (entry->endpoint < (unsigned)e ||
+			       (entry->endpoint == (unsigned)e &&
+				entry->end < time)));
+		if (before)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == cf->num_chunks || cf->index[lo].flow_id != flow_id ||
+	    cf->index[lo].endpoint != (unsigned)e)
+		return cf->num_chunks;
+	return lo;
+}
@@ -0,0 +1,355 @@
+/**
+ * @file fg_capture.h
+ * @brief Capture file of all reports of a test run
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_CAPTURE_H_
+#define _FG_CAPTURE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "common.h"
+
+/** Magic number at the beginning of a capture file ("FGCP"). */
+#define CAPTURE_MAGIC 0x46474350
+/** Magic number at the beginning of a chunk ("FGCC"). */
+#define CAPTURE_CHUNK_MAGIC 0x46474343
+/** Magic number at the end of a complete capture file ("FGCI"). */
+#define CAPTURE_INDEX_MAGIC 0x46474349
+/** Version of the capture file format. */
+#define CAPTURE_VERSION 1
+/** Written in host byte order to detect a foreign byte order. */
+#define CAPTURE_BYTE_ORDER 0x01020304
+/**
+ * Number of reports of a flow endpoint stored in a chunk. The controller
+ * buffers a chunk per flow endpoint, so this bounds its memory use.
+ */
+#define CAPTURE_CHUNK_RECORDS 8
+/** Length of the strings describing a flow, including the NUL. */
+#define CAPTURE_NAME_LEN 64
+/** The header and the flow descriptions are padded to this alignment. */
+#define CAPTURE_ALIGN 64
+
+/** Columns of a chunk, one value per report. The order is stable. */
+enum capture_column {
+	/** Report type (INTERVAL or FINAL). */
+	CAPTURE_TYPE = 0,
+	/** Begin and end of the report since the start of the test. @{ */
+	CAPTURE_BEGIN,
+	CAPTURE_END,                                            /** @} */
+	/** Bytes and blocks written and read. @{ */
+	CAPTURE_BYTES_WRITTEN,
+	CAPTURE_BYTES_READ,
+	CAPTURE_REQUEST_BLOCKS_WRITTEN,
+	CAPTURE_REQUEST_BLOCKS_READ,
+	CAPTURE_RESPONSE_BLOCKS_WRITTEN,
+	CAPTURE_RESPONSE_BLOCKS_READ,                           /** @} */
+	/** Application level RTT, IAT, delay and send time drift. @{ */
+	CAPTURE_RTT_MIN,
+	CAPTURE_RTT_AVG,
+	CAPTURE_RTT_MAX,
+	CAPTURE_IAT_MIN,
+	CAPTURE_IAT_AVG,
+	CAPTURE_IAT_MAX,
+	CAPTURE_DELAY_MIN,
+	CAPTURE_DELAY_AVG,
+	CAPTURE_DELAY_MAX,
+	CAPTURE_DRIFT_MIN,
+	CAPTURE_DRIFT_AVG,
+	CAPTURE_DRIFT_MAX,                                      /** @} */
+	/** Churn connections and flow completion time. @{ */
+	CAPTURE_CONNS_COMPLETED,
+	CAPTURE_CONNS_FAILED,
+	CAPTURE_CONNS_DROPPED,
+	CAPTURE_FCT_P50,
+	CAPTURE_FCT_P90,
+	CAPTURE_FCT_P99,                                        /** @} */
+	/** Metrics from the TCP stack, see struct fg_tcp_info. @{ */
+	CAPTURE_TCPI_SND_CWND,
+	CAPTURE_TCPI_SND_SSTHRESH,
+	CAPTURE_TCPI_UNACKED,
+	CAPTURE_TCPI_SACKED,
+	CAPTURE_TCPI_LOST,
+	CAPTURE_TCPI_RETRANS,
+	CAPTURE_TCPI_RETRANSMITS,
+	CAPTURE_TCPI_FACKETS,
+	CAPTURE_TCPI_REORDERING,
+	CAPTURE_TCPI_BACKOFF,
+	CAPTURE_TCPI_CA_STATE,
+	CAPTURE_TCPI_SND_MSS,
+	CAPTURE_TCPI_RTT,
+	CAPTURE_TCPI_RTTVAR,
+	CAPTURE_TCPI_RTO,
+	CAPTURE_PMTU,                                           /** @} */
+	/** Corrupted blocks and mismatched bytes of option -E. @{ */
+	CAPTURE_BLOCKS_CORRUPTED,
+	CAPTURE_BYTES_CORRUPTED,                                /** @} */
+	/** Dumped and dropped packets of option -M, packets dropped on the
+	 * interface. @{ */
+	CAPTURE_PCAP_PACKETS,
+	CAPTURE_PCAP_DROPS,
+	CAPTURE_PCAP_RING_DROPS,                                /** @} */
+	/** Retransmitted and reordered segments, RTT, acknowledged bytes and
+	 * bytes in flight derived from the capture of option -M. @{ */
+	CAPTURE_WIRE_RETRANSMITS,
+	CAPTURE_WIRE_REORDERED,
+	CAPTURE_WIRE_RTT_MIN,
+	CAPTURE_WIRE_RTT_AVG,
+	CAPTURE_WIRE_RTT_MAX,
+	CAPTURE_WIRE_ACKED,
+	CAPTURE_WIRE_FLIGHT,                                    /** @} */
+	/** Number of elements in enum. Must be last element. */
+	NUM_CAPTURE_COLUMNS,
+};
+
+/** Types of the values of a column. */
+enum capture_type {
+	/** Unsigned integer, stored in capture_value.u. */
+	CAPTURE_UINT,
+	/** Time in seconds, stored in capture_value.d, NaN if no sample. */
+	CAPTURE_DOUBLE,
+};
+
+/** Name and type of a column. */
+struct capture_column_info {
+	/** Name of the column, same as in the machine-readable output. */
+	const char *name;
+	/** Type of the values of the column. */
+	enum capture_type type;
+};
+
+/** Names and types of all columns, indexed by enum capture_column. */
+extern const struct capture_column_info capture_columns[NUM_CAPTURE_COLUMNS];
+
+/** Value of a column. */
+union capture_value {
+	uint64_t u;
+	double d;
+};
+
+/**
+ * Header at the beginning of a capture file, followed by the description of
+ * num_flows flows and padded to header_size bytes.
+ *
+ * All values of a capture file are in the byte order of the writing host.
+ */
+struct capture_header {
+	/** Always CAPTURE_MAGIC. */
+	uint32_t magic;
+	/** Always CAPTURE_VERSION. */
+	uint32_t version;
+	/** Always CAPTURE_BYTE_ORDER. */
+	uint32_t byte_order;
+	/** Size of the header including the flow descriptions and padding. */
+	uint32_t header_size;
+	/** Size of a chunk in bytes. */
+	uint32_t chunk_size;
+	/** Number of reports a chunk can hold. */
+	uint32_t chunk_records;
+	/** Number of columns of a chunk. */
+	uint32_t num_columns;
+	/** Number of flows of the test. */
+	uint32_t num_flows;
+	/** Start of the test, wall-clock time of the controller. */
+	int64_t start_sec;
+	int64_t start_nsec;
+	/** Reporting interval in seconds (option -i). */
+	double reporting_interval;
+	uint8_t reserved[8];
+};
+
+/** Description of a flow in the header of a capture file. */
+struct capture_flow {
+	/** Flow ID. */
+	int32_t flow_id;
+	/** Transport protocol, see enum protocol_t. */
+	uint32_t proto;
+	/** Aggregation group of the flow (option --tag), empty if none. */
+	char tag[CAPTURE_NAME_LEN];
+	/** Name of the daemon of the source and destination endpoint. */
+	char host[2][CAPTURE_NAME_LEN];
+	/** Address the test connection goes to. */
+	char test_address[2][CAPTURE_NAME_LEN];
+	/** Congestion control algorithm (option -O), empty if default. */
+	char cc_alg[2][TCP_CA_NAME_MAX];
+	/** Delay and duration of the endpoints in seconds. */
+	double delay[2];
+	double duration[2];
+	/** Estimated offset of the daemon clock in seconds. */
+	double clock_offset[2];
+	/** Requested send and receive buffer in bytes (option -B, -W). */
+	int32_t send_buffer_size[2];
+	int32_t receive_buffer_size[2];
+	/** Application block size in bytes (option -U). */
+	int32_t maximum_block_size[2];
+	/** Maximal concurrent churn connections, 0 if disabled. */
+	int32_t churn;
+	/** Random seed of the traffic generation (option -J). */
+	uint32_t random_seed;
+};
+
+/**
+ * Up to chunk_records reports of a single flow endpoint, stored column by
+ * column. Only the first @p count values of each column are valid.
+ */
+struct capture_chunk {
+	/** Always CAPTURE_CHUNK_MAGIC. */
+	uint32_t magic;
+	/** Flow ID of the reports. */
+	int32_t flow_id;
+	/** Flow endpoint of the reports (SOURCE or DESTINATION). */
+	uint32_t endpoint;
+	/** Number of reports in this chunk. */
+	uint32_t count;
+	/** Earliest begin and latest end of the reports. */
+	double begin;
+	double end;
+	/** Number of chunks written before this one. */
+	uint64_t sequence;
+	uint8_t reserved[24];
+	/** Values of the reports. */
+	union capture_value values[NUM_CAPTURE_COLUMNS][CAPTURE_CHUNK_RECORDS];
+};
+
+/**
+ * Entry of the chunk index at the end of a complete capture file. Entries are
+ * sorted by flow ID, endpoint and time.
+ */
+struct capture_index_entry {
+	/** Flow ID of the chunk. */
+	int32_t flow_id;
+	/** Flow endpoint of the chunk. */
+	uint32_t endpoint;
+	/** Number of reports in the chunk. */
+	uint32_t count;
+	uint32_t reserved;
+	/** Earliest begin and latest end of the reports in the chunk. */
+	double begin;
+	double end;
+	/** Offset of the chunk from the beginning of the file. */
+	uint64_t offset;
+};
+
+/** Trailer at the very end of a complete capture file. */
+struct capture_trailer {
+	/** Offset of the chunk index from the beginning of the file. */
+	uint64_t index_offset;
+	/** Number of entries of the chunk index. */
+	uint32_t num_chunks;
+	/** Always CAPTURE_INDEX_MAGIC. */
+	uint32_t magic;
+};
+
+/** Capture file mapped into memory for reading. */
+struct capture_file {
+	/** Mapping of the whole file. */
+	const void *map;
+	/** Size of the file. */
+	size_t size;
+	/** Header of the file. */
+	const struct capture_header *header;
+	/** Descriptions of the flows. */
+	const struct capture_flow *flows;
+	/** Chunk index, rebuilt if the file is incomplete. */
+	const struct capture_index_entry *index;
+	/** Number of chunks. */
+	size_t num_chunks;
+	/** Whether the index was rebuilt and must be freed. */
+	int rebuilt_index;
+};
+
+/**
+ * Start writing a capture file to file descriptor @p fd.
+ *
+ * @param[in] fd file descriptor of the capture file
+ * @param[in] num_flows number of flows of the test
+ */
+void capture_open(int fd, unsigned num_flows);
+
+/**
+ * Write the header of the capture file.
+ *
+ * @param[in] start start of the test
+ * @param[in] reporting_interval reporting interval in seconds
+ * @param[in] flows descriptions of all flows
+ */
+void capture_start(const struct timespec *start, double reporting_interval,
+		   const struct capture_flow *flows);
+
+/**
+ * Append report @p report of endpoint @p e of flow @p flow_id.
+ *
+ * The report is stored in the chunk of the endpoint, which is written once
+ * it is full. Nothing is allocated except the first chunk of each endpoint.
+ *
+ * @param[in] flow_id flow ID
+ * @param[in] e flow endpoint (SOURCE or DESTINATION)
+ * @param[in] begin begin of the report in seconds since the test start
+ * @param[in] end end of the report in seconds since the test start
+ * @param[in] report report to be stored
+ */
+void capture_report(int flow_id, enum endpoint_t e, double begin, double end,
+		    const struct report *report);
+
+/** Write all incomplete chunks and the index, and close the capture file. */
+void capture_close(void);
+
+/**
+ * Map capture file @p path into memory.
+ *
+ * If the file has no index, e.g. since the controller was killed, or an index
+ * that does not match its chunks, the index is rebuilt from the chunks
+ * written so far.
+ *
+ * @param[in] path path of the capture file
+ * @param[out] cf mapped capture file
+ * @return zero on success, -1 on error with errno set (EINVAL if @p path is
+ * not a capture file of this host)
+ */
+int capture_map(const char *path, struct capture_file *cf);
+
+/** Unmap capture file @p cf. */
+void capture_unmap(struct capture_file *cf);
+
+/** Chunk of entry @p i of the index of capture file @p cf. */
+static inline const struct capture_chunk *
+capture_chunk(const struct capture_file *cf, size_t i)
+{
+	return (const struct capture_chunk *)
+		((const char *)cf->map + cf->index[i].offset);
+}
+
+/**
+ * Find the first chunk of endpoint @p e of flow @p flow_id with reports
+ * ending at or after @p time.
+ *
+ * @return index entry of the chunk, cf->num_chunks if there is none
+ */
+size_t capture_find(const struct capture_file *cf, int flow_id,
+		    enum endpoint_t e, double time);
+
+#endif /* _FG_CAPTURE_H_ */
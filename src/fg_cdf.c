@@ -0,0 +1,223 @@
+/**
+ * @file fg_cdf.c
+ * @brief Empirical distributions used for Flowgrind's traffic generation
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "fg_cdf.h"
+#include "fg_error.h"
+
+/** Tolerance for the cumulative probability of the last point. */
+#define CDF_EPSILON 1e-6
+
+struct empirical_cdf *cdf_new(unsigned num_points)
+{
+	struct empirical_cdf *cdf;
+
+	if (!num_points || num_points > MAX_CDF_POINTS)
+		return NULL;
+
+	/* points are stored right behind the header */
+	cdf = malloc(sizeof(struct empirical_cdf) +
+		     2 * num_points * sizeof(double));
+	if (!cdf)
+		return NULL;
+
+	cdf->num_points = num_points;
+	cdf->value = (double *)(cdf + 1);
+	cdf->probability = cdf->value + num_points;
+
+	return cdf;
+}
+
+struct empirical_cdf *cdf_dup(const struct empirical_cdf *cdf)
+{
+	struct empirical_cdf *copy;
+
+	if (!cdf)
+		return NULL;
+
+	copy = cdf_new(cdf->num_points);
+	if (!copy)
+		return NULL;
+
+	memcpy(copy->value, cdf->value, cdf->num_points * sizeof(double));
+	memcpy(copy->probability, cdf->probability,
+	       cdf->num_points * sizeof(double));
+
+	return copy;
+}
+
+void cdf_free(struct empirical_cdf *cdf)
+{
+	free(cdf);
+}
+
+const char *cdf_check(const struct empirical_cdf *cdf)
+{
+	if (!cdf->num_points || cdf->num_points > MAX_CDF_POINTS)
+		return "invalid number of points";
+
+	/* negated comparisons to catch NaNs as well */
+	for (unsigned i = 0; i < cdf->num_points; i++) {
+		if (!isfinite(cdf->value[i]))
+			return "value is not a finite number";
+		if (!(cdf->probability[i] >= 0 && cdf->probability[i] <= 1))
+			return "probability not in [0,1]";
+		if (i && !(cdf->value[i] >= cdf->value[i-1]))
+			return "values not in ascending order";
+		if (i && !(cdf->probability[i] >= cdf->probability[i-1]))
+			return "probabilities not in ascending order";
+	}
+
+	if (cdf->probability[cdf->num_points - 1] < 1 - CDF_EPSILON)
+		return "probability of last point is not 1";
+
+	return NULL;
+}
+
+struct empirical_cdf *cdf_load(const char *filename)
+{
+	FILE *fp;
+	char line[1024];
+	unsigned lineno = 0, num_points = 0;
+	double value[MAX_CDF_POINTS], probability[MAX_CDF_POINTS];
+	struct empirical_cdf *cdf = NULL;
+	const char *problem;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		warn("failed to open CDF file '%s'", filename);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *pos = line, *end;
+		double first = 0, last = 0;
+		int columns = 0;
+
+		lineno++;
+		pos += strspn(pos, " \t");
+		if (*pos == '#' || *pos == '\n' || *pos == '\0')
+			continue;
+
+		for (;;) {
+			double number;
+
+			errno = 0;
+			number = strtod(pos, &end);
+			if (end == pos)
+				break;
+			if (errno) {
+				warnx("%s:%u: number out of range", filename,
+				      lineno);
+				goto out;
+			}
+			if (!columns++)
+				first = number;
+			last = number;
+			pos = end;
+		}
+		pos += strspn(pos, " \t\r\n");
+		if (columns < 2 || *pos) {
+			warnx("%s:%u: expected value and cumulative "
+			      "probability", filename, lineno);
+			goto out;
+		}
+		if (num_points == MAX_CDF_POINTS) {
+			warnx("%s: more than %u points", filename,
+			      MAX_CDF_POINTS);
+			goto out;
+		}
+
+		value[num_points] = first;
+		probability[num_points] = last;
+		num_points++;
+	}
+
+	if (ferror(fp)) {
+		warn("failed to read CDF file '%s'", filename);
+		goto out;
+	}
+	if (!num_points) {
+		warnx("%s: no points found", filename);
+		goto out;
+	}
+
+	cdf = cdf_new(num_points);
+	if (!cdf) {
+		warnx("%s: could not allocate memory", filename);
+		goto out;
+	}
+	memcpy(cdf->value, value, num_points * sizeof(double));
+	memcpy(cdf->probability, probability, num_points * sizeof(double));
+
+	problem = cdf_check(cdf);
+	if (problem) {
+		warnx("%s: %s", filename, problem);
+		cdf_free(cdf);
+		cdf = NULL;
+		goto out;
+	}
+
+	/* compensate for rounding in the file */
+	cdf->probability[num_points - 1] = 1;
+
+out:
+	fclose(fp);
+	return cdf;
+}
+
+double cdf_quantile(const struct empirical_cdf *cdf, double u)
+{
+	unsigned lo = 0, hi = cdf->num_points;
+
+	/* find the first point with a cumulative probability >= u */
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+		if (cdf->probability[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == cdf->num_points)
+		return cdf->value[cdf->num_points - 1];
+	if (lo == 0)
+		return cdf->value[0];
+
+	/* interpolate linearly between the two neighboring points */
+	const double p0 = cdf->probability[lo - 1];
+	const double p1 = cdf->probability[lo];
+	const double v0 = cdf->value[lo - 1];
+	const double v1 = cdf->value[lo];
+
+	return v0 + (v1 - v0) * (u - p0) / (p1 - p0);
+}
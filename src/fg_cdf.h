@@ -0,0 +1,96 @@
+/**
+ * @file fg_cdf.h
+ * @brief Empirical distributions used for Flowgrind's traffic generation
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_CDF_H_
+#define _FG_CDF_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/** Maximal number of points of an empirical CDF. */
+#define MAX_CDF_POINTS 4096
+
+/**
+ * Empirical cumulative distribution function given by a table of points.
+ *
+ * Between two points the distribution is linearly interpolated.
+ */
+struct empirical_cdf {
+	/** Number of points. */
+	unsigned num_points;
+	/** Values of the points in ascending order. */
+	double *value;
+	/** Cumulative probability of the points in ascending order. */
+	double *probability;
+};
+
+/**
+ * Allocate an empirical CDF with room for @p num_points points.
+ *
+ * @param[in] num_points number of points
+ * @return new CDF, NULL on error
+ */
+struct empirical_cdf *cdf_new(unsigned num_points);
+
+/**
+ * Duplicate the empirical CDF @p cdf.
+ *
+ * @param[in] cdf CDF to duplicate, may be NULL
+ * @return copy of @p cdf, NULL if @p cdf is NULL or on error
+ */
+struct empirical_cdf *cdf_dup(const struct empirical_cdf *cdf);
+
+/** Free the empirical CDF @p cdf. */
+void cdf_free(struct empirical_cdf *cdf);
+
+/**
+ * Check whether @p cdf describes a valid distribution.
+ *
+ * @param[in] cdf CDF to check
+ * @return NULL if @p cdf is valid, description of the problem otherwise
+ */
+const char *cdf_check(const struct empirical_cdf *cdf);
+
+/**
+ * Load an empirical CDF from file @p filename.
+ *
+ * Each line of the file holds one point. The first column is the value, the
+ * last column the cumulative probability, further columns in between are
+ * ignored. Empty lines and lines starting with '#' are skipped.
+ *
+ * @param[in] filename file to read from
+ * @return loaded CDF, NULL on error
+ */
+struct empirical_cdf *cdf_load(const char *filename);
+
+/**
+ * Return the value of the empirical distribution @p cdf at quantile @p u
+ * (inverse transform sampling). Runs in O(log n) for n points.
+ *
+ * @param[in] cdf empirical CDF
+ * @param[in] u quantile in the interval (0,1)
+ */
+double cdf_quantile(const struct empirical_cdf *cdf, double u);
+
+#endif /* _FG_CDF_H_ */
@@ -0,0 +1,130 @@
+/**
+ * @file fg_control_stats.c
+ * @brief Statistics of the control plane of the Flowgrind controller
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "fg_control_stats.h"
+#include "fg_error.h"
+#include "fg_io.h"
+#include "fg_string.h"
+
+struct control_stats ctl_stats;
+
+void sample_stats_add(struct sample_stats *s, double sample)
+{
+	if (!s->count || sample < s->min)
+		s->min = sample;
+	if (!s->count || sample > s->max)
+		s->max = sample;
+	s->sum += sample;
+	s->count++;
+}
+
+double control_stats_cpu_time(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru))
+		return 0.0;
+
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+	       (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * Append the statistics @p s as JSON object member @p name to @p buf. JSON
+ * has no NaN, so the values are null if there are no samples.
+ */
+static void append_stats(char **buf, const char *name,
+			 const struct sample_stats *s)
+{
+	if (!s->count) {
+		asprintf_append(buf, "\"%s\": {\"count\": 0, \"min\": null, "
+				"\"avg\": null, \"max\": null}", name);
+		return;
+	}
+
+	asprintf_append(buf, "\"%s\": {\"count\": %lu, \"min\": %.9f, "
+			"\"avg\": %.9f, \"max\": %.9f}", name, s->count, s->min,
+			s->sum / s->count, s->max);
+}
+
+void control_stats_write(int fd)
+{
+	const struct control_stats *c = &ctl_stats;
+	char *buf = NULL;
+
+	asprintf_append(&buf, "{\"daemons\": %u, \"flows\": %u, ",
+			c->daemons, c->flows);
+
+	asprintf_append(&buf, "\"prepare\": {\"seconds\": %.9f, "
+			"\"flows_per_second\": %.1f, ", c->prepare_time,
+			c->prepare_time > 0 ? c->flows / c->prepare_time : 0.0);
+	append_stats(&buf, "flow", &c->prepare_flow);
+	asprintf_append(&buf, ", ");
+	append_stats(&buf, "batch", &c->prepare_batch);
+
+	asprintf_append(&buf, "}, \"start\": {\"seconds\": %.9f, ",
+			c->start_time);
+	append_stats(&buf, "skew", &c->start_skew);
+	asprintf_append(&buf, ", ");
+	append_stats(&buf, "offset", &c->start_offset);
+	if (c->start_offset.count)
+		asprintf_append(&buf, ", \"spread\": %.9f",
+				c->start_offset.max - c->start_offset.min);
+	else
+		asprintf_append(&buf, ", \"spread\": null");
+
+	asprintf_append(&buf, "}, \"get_reports\": {\"reports\": %lu, "
+			"\"reports_per_call\": %.1f, ", c->reports,
+			c->get_reports.count ?
+			(double)c->reports / c->get_reports.count : 0.0);
+	append_stats(&buf, "latency", &c->get_reports);
+
+	asprintf_append(&buf, "}, \"cpu\": {\"seconds\": %.6f, "
+			"\"report_seconds\": %.6f, \"per_report\": ",
+			control_stats_cpu_time(), c->report_cpu);
+	if (c->reports)
+		asprintf_append(&buf, "%.9f}}\n", c->report_cpu / c->reports);
+	else
+		asprintf_append(&buf, "null}}\n");
+
+	if (!buf)
+		critx("could not allocate memory for control plane statistics");
+
+	if (write_all(fd, buf, strlen(buf)) == -1)
+		crit("could not write control plane statistics");
+
+	free(buf);
+	if (fd != STDOUT_FILENO && close(fd))
+		crit("could not close control plane statistics");
+}
@@ -0,0 +1,91 @@
+/**
+ * @file fg_control_stats.h
+ * @brief Statistics of the control plane of the Flowgrind controller
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_CONTROL_STATS_H_
+#define _FG_CONTROL_STATS_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/** Minimum, maximum and mean of a series of samples. */
+struct sample_stats {
+	/** Number of samples. */
+	unsigned long count;
+	/** Sum of all samples. */
+	double sum;
+	/** Smallest and largest sample. @{ */
+	double min;
+	double max;                                             /** @} */
+};
+
+/**
+ * How long the controller needs to set up, start and collect the reports of
+ * the flows of a test. All times are in seconds.
+ */
+struct control_stats {
+	/** Number of distinct daemons and of flows of the test. @{ */
+	unsigned daemons;
+	unsigned flows;                                         /** @} */
+	/** Time needed to prepare all flows. */
+	double prepare_time;
+	/** Time needed to prepare a single flow (both endpoints). */
+	struct sample_stats prepare_flow;
+	/** Time needed to add a batch of flow endpoints to a daemon. */
+	struct sample_stats prepare_batch;
+	/** Time needed to send the start request to all daemons. */
+	double start_time;
+	/** How late each endpoint was started by its daemon. */
+	struct sample_stats start_skew;
+	/**
+	 * When each endpoint was started relative to the scheduled start of
+	 * the test, in the controller clock. Includes the error of the clock
+	 * offset estimation.
+	 */
+	struct sample_stats start_offset;
+	/** Latency of a single get_reports call. */
+	struct sample_stats get_reports;
+	/** Reports received from the daemons. */
+	unsigned long reports;
+	/** CPU time the controller spent fetching and processing reports. */
+	double report_cpu;
+};
+
+/** Control plane statistics of the current test. */
+extern struct control_stats ctl_stats;
+
+/** Add @p sample to the statistics @p s. */
+void sample_stats_add(struct sample_stats *s, double sample);
+
+/** CPU time consumed by the controller process so far, in seconds. */
+double control_stats_cpu_time(void);
+
+/**
+ * Write the control plane statistics as a single JSON object.
+ *
+ * @param[in] fd file descriptor to write to. It is closed unless it is
+ * stdout
+ */
+void control_stats_write(int fd);
+
+#endif /* _FG_CONTROL_STATS_H_ */
@@ -0,0 +1,522 @@
+/**
+ * @file fg_dump_writer.c
+ * @brief Writer thread of the packet dump files
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "fg_definitions.h"
+#include "fg_dump_writer.h"
+#include "fg_io.h"
+#include "fg_log.h"
+
+/** Magic number of pcap files with nanosecond timestamps. */
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+
+/** Header of a pcap file. */
+struct pcap_file_header {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+/** Header of a packet in a pcap file. */
+struct pcap_record_header {
+	uint32_t ts_sec;
+	uint32_t ts_nsec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+/** Block types of pcapng files. @{ */
+#define PCAPNG_SECTION_HEADER 0x0a0d0d0a
+#define PCAPNG_INTERFACE_DESCRIPTION 0x00000001
+#define PCAPNG_ENHANCED_PACKET 0x00000006              /** @} */
+/** Byte order magic of a pcapng section header. */
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4d
+/** Options of pcapng blocks. @{ */
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_COMMENT 1
+#define PCAPNG_OPT_IF_NAME 2
+#define PCAPNG_OPT_IF_TSRESOL 9                        /** @} */
+/** Maximum length of an interface name or packet comment in bytes. */
+#define PCAPNG_MAX_OPTION 64
+
+/** Head of a pcapng block. */
+struct pcapng_block_header {
+	uint32_t type;
+	uint32_t total_length;
+};
+
+/** Body of a pcapng section header block. */
+struct pcapng_section_header {
+	uint32_t byte_order_magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int64_t section_length;
+};
+
+/** Body of a pcapng interface description block. */
+struct pcapng_interface_description {
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+};
+
+/** Body of a pcapng enhanced packet block. */
+struct pcapng_enhanced_packet {
+	uint32_t interface_id;
+	uint32_t ts_high;
+	uint32_t ts_low;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+/** Head of a pcapng option. */
+struct pcapng_option_header {
+	uint16_t code;
+	uint16_t length;
+};
+
+/** A chunk of a dump file, written at once. */
+struct chunk {
+	/** Dump file the chunk belongs to. */
+	struct dump_file *file;
+	/** Number of bytes used. */
+	size_t len;
+	/** Close the file after writing the chunk. */
+	bool close;
+	/** Next chunk in the free list or the write queue. */
+	struct chunk *next;
+	/** Data to write. */
+	char data[DUMP_CHUNK_SIZE];
+};
+
+struct dump_file {
+	/** File descriptor of the file. */
+	int fd;
+	/** Path of the file. */
+	char *path;
+	/** Format of the file. */
+	enum dump_format format;
+	/** Snapshot length. */
+	unsigned snaplen;
+	/** Chunk being filled, NULL if none. */
+	struct chunk *chunk;
+	/** Whether a write failed, the file is not written anymore. */
+	bool failed;
+};
+
+/** Protects the free list and the write queue. */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+/** Signals the writer that the write queue is not empty. */
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+/** Free chunks. */
+static struct chunk *free_chunks;
+/** Chunks waiting to be written, oldest first. @{ */
+static struct chunk *queue_head, *queue_tail;                /** @} */
+/** Writer thread. */
+static pthread_t writer;
+
+/** Round @p len up to a multiple of 4, the alignment of pcapng. */
+static inline size_t pad4(size_t len)
+{
+	return (len + 3) & ~(size_t)3;
+}
+
+/**
+ * Append pcapng option @p code with value @p value of @p len bytes to
+ * @p buf, padded to 4 bytes.
+ *
+ * @return number of bytes appended
+ */
+static size_t put_option(char *buf, uint16_t code, const void *value,
+			 size_t len)
+{
+	const struct pcapng_option_header header = {
+		.code = code,
+		.length = len,
+	};
+
+	memcpy(buf, &header, sizeof(header));
+	memcpy(buf + sizeof(header), value, len);
+	memset(buf + sizeof(header) + len, 0, pad4(len) - len);
+
+	return sizeof(header) + pad4(len);
+}
+
+/**
+ * Build the section header and interface description blocks of a pcapng
+ * file in @p buf, which must hold at least 128 bytes.
+ *
+ * @return number of bytes used
+ */
+static size_t build_pcapng_header(char *buf, const char *ifname,
+				  int linktype, unsigned snaplen)
+{
+	const struct pcapng_section_header shb = {
+		.byte_order_magic = PCAPNG_BYTE_ORDER_MAGIC,
+		.version_major = 1,
+		.version_minor = 0,
+		/* length not specified */
+		.section_length = -1,
+	};
+	const struct pcapng_interface_description idb = {
+		.linktype = linktype,
+		.snaplen = snaplen,
+	};
+	/* timestamps in nanoseconds */
+	const uint8_t tsresol = 9;
+	const uint32_t endofopt = PCAPNG_OPT_ENDOFOPT;
+	struct pcapng_block_header block;
+	uint32_t total;
+	size_t len = 0, start;
+
+	block.type = PCAPNG_SECTION_HEADER;
+	block.total_length = total = sizeof(block) + sizeof(shb) +
+				     sizeof(total);
+	memcpy(buf + len, &block, sizeof(block));
+	memcpy(buf + len + sizeof(block), &shb, sizeof(shb));
+	memcpy(buf + len + sizeof(block) + sizeof(shb), &total, sizeof(total));
+	len += total;
+
+	start = len;
+	len += sizeof(block);
+	memcpy(buf + len, &idb, sizeof(idb));
+	len += sizeof(idb);
+	len += put_option(buf + len, PCAPNG_OPT_IF_NAME, ifname,
+			  strnlen(ifname, PCAPNG_MAX_OPTION));
+	len += put_option(buf + len, PCAPNG_OPT_IF_TSRESOL, &tsresol,
+			  sizeof(tsresol));
+	memcpy(buf + len, &endofopt, sizeof(endofopt));
+	len += sizeof(endofopt);
+	total = len - start + sizeof(total);
+	memcpy(buf + len, &total, sizeof(total));
+	len += sizeof(total);
+	block.type = PCAPNG_INTERFACE_DESCRIPTION;
+	block.total_length = total;
+	memcpy(buf + start, &block, sizeof(block));
+
+	return len;
+}
+
+/** Take a free chunk, NULL if there is none. */
+static struct chunk *get_chunk(void)
+{
+	struct chunk *c;
+
+	pthread_mutex_lock(&mutex);
+	c = free_chunks;
+	if (c)
+		free_chunks = c->next;
+	pthread_mutex_unlock(&mutex);
+
+	if (c) {
+		c->len = 0;
+		c->close = false;
+		c->next = NULL;
+	}
+	return c;
+}
+
+/** Append chunk @p c to the write queue. */
+static void queue_chunk(struct chunk *c)
+{
+	pthread_mutex_lock(&mutex);
+	c->next = NULL;
+	if (queue_tail)
+		queue_tail->next = c;
+	else
+		queue_head = c;
+	queue_tail = c;
+	pthread_cond_signal(&queued);
+	pthread_mutex_unlock(&mutex);
+}
+
+/** Write chunk @p c to its file. */
+static void write_chunk(struct chunk *c)
+{
+	struct dump_file *file = c->file;
+
+	if (!file->failed && write_all(file->fd, c->data, c->len) == -1) {
+		logging(LOG_WARNING, "pcap: failed to write dump file %s: %s",
+			file->path, strerror(errno));
+		file->failed = true;
+	}
+
+	if (c->close) {
+		DEBUG_MSG(LOG_NOTICE, "pcap: closing dump file %s", file->path);
+		close(file->fd);
+		free(file->path);
+		free(file);
+	}
+}
+
+/** Main loop of the writer thread, writes the queued chunks. */
+static void *writer_work(void *arg)
+{
+	UNUSED_ARGUMENT(arg);
+
+	for (;;) {
+		struct chunk *c;
+
+		pthread_mutex_lock(&mutex);
+		while (!queue_head)
+			pthread_cond_wait(&queued, &mutex);
+		c = queue_head;
+		queue_head = c->next;
+		if (!queue_head)
+			queue_tail = NULL;
+		pthread_mutex_unlock(&mutex);
+
+		write_chunk(c);
+
+		pthread_mutex_lock(&mutex);
+		c->next = free_chunks;
+		free_chunks = c;
+		pthread_mutex_unlock(&mutex);
+	}
+
+	return NULL;
+}
+
+int dump_writer_start(void)
+{
+	int rc;
+
+	for (int i = 0; i < DUMP_CHUNKS; i++) {
+		struct chunk *c = malloc(sizeof(*c));
+
+		if (!c) {
+			logging(LOG_ALERT, "could not allocate memory for "
+				"dump chunks");
+			return -1;
+		}
+		c->next = free_chunks;
+		free_chunks = c;
+	}
+
+	rc = pthread_create(&writer, NULL, writer_work, NULL);
+	if (rc) {
+		logging(LOG_WARNING, "could not start dump writer thread: %s",
+			strerror(rc));
+		return -1;
+	}
+
+	return 0;
+}
+
+struct dump_file *dump_file_open(const char *path, enum dump_format format,
+				 const char *ifname, int linktype,
+				 unsigned snaplen)
+{
+	struct dump_file *file = calloc(1, sizeof(*file));
+	const struct pcap_file_header pcap_header = {
+		.magic = PCAP_MAGIC_NSEC,
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = snaplen,
+		.linktype = linktype,
+	};
+	char header[128];
+	size_t header_len;
+
+	if (!file || !(file->path = strdup(path))) {
+		logging(LOG_ALERT, "could not allocate memory for dump file");
+		free(file);
+		return NULL;
+	}
+	file->snaplen = snaplen;
+	file->format = format;
+
+	if (format == DUMP_PCAPNG) {
+		header_len = build_pcapng_header(header, ifname, linktype,
+						 snaplen);
+	} else {
+		memcpy(header, &pcap_header, sizeof(pcap_header));
+		header_len = sizeof(pcap_header);
+	}
+
+	file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file->fd == -1) {
+		logging(LOG_WARNING, "pcap: failed to open dump file %s: %s",
+			path, strerror(errno));
+		free(file->path);
+		free(file);
+		return NULL;
+	}
+
+	/* the header is small, write it right away */
+	if (write_all(file->fd, header, header_len) == -1) {
+		logging(LOG_WARNING, "pcap: failed to write dump file %s: %s",
+			path, strerror(errno));
+		close(file->fd);
+		free(file->path);
+		free(file);
+		return NULL;
+	}
+
+	DEBUG_MSG(LOG_NOTICE, "pcap: dumping to \"%s\"", path);
+	return file;
+}
+
+/** Append packet @p pkt as pcap record of @p caplen bytes to @p buf. */
+static size_t put_pcap_record(char *buf, const struct pcap_packet *pkt,
+			      unsigned caplen)
+{
+	const struct pcap_record_header header = {
+		.ts_sec = pkt->ts.tv_sec,
+		.ts_nsec = pkt->ts.tv_nsec,
+		.caplen = caplen,
+		.len = pkt->len,
+	};
+
+	memcpy(buf, &header, sizeof(header));
+	memcpy(buf + sizeof(header), pkt->data, caplen);
+
+	return sizeof(header) + caplen;
+}
+
+/**
+ * Append packet @p pkt as pcapng enhanced packet block of @p caplen bytes
+ * with comment @p comment of @p comment_len bytes to @p buf.
+ */
+static size_t put_pcapng_record(char *buf, const struct pcap_packet *pkt,
+				unsigned caplen, const char *comment,
+				size_t comment_len)
+{
+	const uint64_t ts = (uint64_t)pkt->ts.tv_sec * 1000000000ULL +
+			    pkt->ts.tv_nsec;
+	const struct pcapng_enhanced_packet epb = {
+		.ts_high = ts >> 32,
+		.ts_low = ts & 0xffffffff,
+		.caplen = caplen,
+		.len = pkt->len,
+	};
+	const uint32_t endofopt = PCAPNG_OPT_ENDOFOPT;
+	struct pcapng_block_header block;
+	size_t len = sizeof(block);
+	uint32_t total;
+
+	memcpy(buf + len, &epb, sizeof(epb));
+	len += sizeof(epb);
+	memcpy(buf + len, pkt->data, caplen);
+	memset(buf + len + caplen, 0, pad4(caplen) - caplen);
+	len += pad4(caplen);
+	if (comment_len) {
+		len += put_option(buf + len, PCAPNG_OPT_COMMENT, comment,
+				  comment_len);
+		memcpy(buf + len, &endofopt, sizeof(endofopt));
+		len += sizeof(endofopt);
+	}
+	total = len + sizeof(total);
+	memcpy(buf + len, &total, sizeof(total));
+	block.type = PCAPNG_ENHANCED_PACKET;
+	block.total_length = total;
+	memcpy(buf, &block, sizeof(block));
+
+	return total;
+}
+
+bool dump_file_write(struct dump_file *file, const struct pcap_packet *pkt,
+		     const char *comment)
+{
+	const unsigned caplen = pkt->caplen < file->snaplen ? pkt->caplen
+							    : file->snaplen;
+	const size_t comment_len = comment ? strnlen(comment,
+						     PCAPNG_MAX_OPTION) : 0;
+	size_t size;
+	struct chunk *c = file->chunk;
+
+	/* upper bound of the record, the exact size is known once built */
+	if (file->format == DUMP_PCAPNG)
+		size = sizeof(struct pcapng_block_header) +
+		       sizeof(struct pcapng_enhanced_packet) + pad4(caplen) +
+		       sizeof(struct pcapng_option_header) +
+		       pad4(comment_len) + 2 * sizeof(uint32_t);
+	else
+		size = sizeof(struct pcap_record_header) + caplen;
+
+	if (c && c->len + size > DUMP_CHUNK_SIZE) {
+		queue_chunk(c);
+		c = file->chunk = NULL;
+	}
+	if (!c) {
+		c = file->chunk = get_chunk();
+		if (!c)
+			return false;
+		c->file = file;
+	}
+
+	if (file->format == DUMP_PCAPNG)
+		c->len += put_pcapng_record(c->data + c->len, pkt, caplen,
+					    comment, comment_len);
+	else
+		c->len += put_pcap_record(c->data + c->len, pkt, caplen);
+
+	return true;
+}
+
+void dump_file_flush(struct dump_file *file)
+{
+	if (!file->chunk)
+		return;
+
+	queue_chunk(file->chunk);
+	file->chunk = NULL;
+}
+
+void dump_file_close(struct dump_file *file)
+{
+	struct chunk *c = file->chunk;
+
+	/* wait for a chunk to carry the close request, the writer always
+	 * returns one eventually */
+	while (!c) {
+		c = get_chunk();
+		if (!c)
+			usleep(1000);
+		else
+			c->file = file;
+	}
+
+	c->close = true;
+	file->chunk = NULL;
+	queue_chunk(c);
+}
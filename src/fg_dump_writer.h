@@ -0,0 +1,102 @@
+/**
+ * @file fg_dump_writer.h
+ * @brief Writer thread of the packet dump files
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_DUMP_WRITER_H_
+#define _FG_DUMP_WRITER_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdbool.h>
+
+#include "fg_pcap_ring.h"
+
+/*
+ * The capture thread appends the packets to an in-memory chunk of their dump
+ * file and passes full chunks to a dedicated writer thread, which writes them
+ * in large sequential writes. The capture thread thus never blocks on the
+ * disk. The chunks come from a fixed pool shared by all dump files. If the
+ * disk cannot keep up and the pool runs empty, packets are dropped rather
+ * than stalling the capture.
+ *
+ * The dump files are pcap files or pcapng files with nanosecond timestamps.
+ * The packets of a pcapng file may carry a comment. A dump file is only used
+ * by the capture thread.
+ */
+
+/** Size of a chunk written at once, 1 MB. */
+#define DUMP_CHUNK_SIZE (1 << 20)
+/** Number of chunks shared by all dump files. */
+#define DUMP_CHUNKS 16
+
+/** Formats of a dump file. */
+enum dump_format {
+	/** Classic pcap file. */
+	DUMP_PCAP = 0,
+	/** pcapng file, which supports packet comments. */
+	DUMP_PCAPNG,
+};
+
+/** A packet dump file. */
+struct dump_file;
+
+/**
+ * Start the writer thread.
+ *
+ * @return zero on success, -1 on failure
+ */
+int dump_writer_start(void);
+
+/**
+ * Create dump file @p path in format @p format for packets of link type
+ * @p linktype, truncated to @p snaplen bytes, captured on interface
+ * @p ifname.
+ *
+ * @return the dump file, NULL on failure, which is logged
+ */
+struct dump_file *dump_file_open(const char *path, enum dump_format format,
+				 const char *ifname, int linktype,
+				 unsigned snaplen);
+
+/**
+ * Append packet @p pkt to dump file @p file.
+ *
+ * @param[in] comment comment of the packet, only written to pcapng files,
+ * NULL for none
+ * @return true if the packet was written, false if it was dropped since no
+ * chunk was free
+ */
+bool dump_file_write(struct dump_file *file, const struct pcap_packet *pkt,
+		     const char *comment);
+
+/** Pass the chunk of @p file to the writer, even if it is not yet full. */
+void dump_file_flush(struct dump_file *file);
+
+/**
+ * Flush @p file and close it once the writer has written all its chunks.
+ * The dump file must not be used afterwards.
+ */
+void dump_file_close(struct dump_file *file);
+
+#endif /* _FG_DUMP_WRITER_H_ */
@@ -0,0 +1,219 @@
+/**
+ * @file fg_flow_table.c
+ * @brief Table of the flow endpoints handled by the daemon
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "daemon.h"
+#include "fg_flow_table.h"
+#include "fg_time.h"
+
+/** Number of hash buckets of the flow IDs. */
+#define ID_BUCKETS FLOW_TABLE_SLOTS
+
+/** End of a chain of slots. */
+#define NO_SLOT -1
+
+/** State of a slot of the flow table. */
+enum slot_state {
+	/** In the free list. */
+	SLOT_FREE = 0,
+	/** Allocated, but not yet inserted. */
+	SLOT_RESERVED,
+	/** Inserted, visited when iterating. */
+	SLOT_ACTIVE,
+};
+
+/** Hot part of the flows, indexed by slot. */
+static struct flow *slots;
+/** Cold metadata of the flows, indexed by slot. */
+static struct flow_meta *metas;
+/** Interval report timers of the flows, indexed by slot. */
+static struct flow_timer timers[FLOW_TABLE_SLOTS];
+/** State of each slot. */
+static unsigned char state[FLOW_TABLE_SLOTS];
+/** Next slot in the free list or the chain of the ID bucket. */
+static int next[FLOW_TABLE_SLOTS];
+/** First free slot. */
+static int free_head = NO_SLOT;
+/** First active slot of each ID bucket, chained in insertion order. */
+static int buckets[ID_BUCKETS];
+/** Number of active slots. */
+static size_t num_active;
+/** One past the highest active slot, iteration stops there. */
+static int high;
+
+/** Slot of @p flow. */
+static inline int slot_of(const struct flow *flow)
+{
+	return flow - slots;
+}
+
+/** Hash bucket of flow ID @p id. */
+static inline unsigned bucket_of(int id)
+{
+	return (unsigned)id % ID_BUCKETS;
+}
+
+int flow_table_init(void)
+{
+	void *block;
+
+	/* the pages of the slab are only touched once their slots are used */
+	if (posix_memalign(&block, CACHE_LINE_SIZE,
+			   FLOW_TABLE_SLOTS * sizeof(struct flow)))
+		return -1;
+	slots = block;
+	metas = malloc(FLOW_TABLE_SLOTS * sizeof(struct flow_meta));
+	if (!metas) {
+		free(slots);
+		slots = NULL;
+		return -1;
+	}
+
+	/* hand out the lowest slots first to keep the active flows close */
+	for (int i = 0; i < FLOW_TABLE_SLOTS; i++) {
+		state[i] = SLOT_FREE;
+		next[i] = i + 1 < FLOW_TABLE_SLOTS ? i + 1 : NO_SLOT;
+	}
+	for (int i = 0; i < ID_BUCKETS; i++)
+		buckets[i] = NO_SLOT;
+	free_head = 0;
+	num_active = 0;
+	high = 0;
+
+	return 0;
+}
+
+struct flow *flow_table_alloc(void)
+{
+	const int i = free_head;
+
+	if (i == NO_SLOT)
+		return NULL;
+
+	free_head = next[i];
+	next[i] = NO_SLOT;
+	state[i] = SLOT_RESERVED;
+	slots[i].meta = &metas[i];
+	timers[i].interval = 0;
+
+	return &slots[i];
+}
+
+void flow_table_insert(struct flow *flow)
+{
+	const int i = slot_of(flow);
+	int *link = &buckets[bucket_of(flow->id)];
+
+	assert(state[i] == SLOT_RESERVED);
+
+	/* append, so the oldest flow of an ID is found first */
+	while (*link != NO_SLOT)
+		link = &next[*link];
+	*link = i;
+	next[i] = NO_SLOT;
+
+	state[i] = SLOT_ACTIVE;
+	num_active++;
+	if (i >= high)
+		high = i + 1;
+}
+
+void flow_table_free(struct flow *flow)
+{
+	const int i = slot_of(flow);
+
+	assert(state[i] != SLOT_FREE);
+
+	if (state[i] == SLOT_ACTIVE) {
+		int *link = &buckets[bucket_of(flow->id)];
+
+		while (*link != i)
+			link = &next[*link];
+		*link = next[i];
+
+		num_active--;
+		state[i] = SLOT_FREE;
+		while (high > 0 && state[high - 1] != SLOT_ACTIVE)
+			high--;
+	}
+
+	state[i] = SLOT_FREE;
+	next[i] = free_head;
+	free_head = i;
+}
+
+struct flow *flow_table_find(int id)
+{
+	for (int i = buckets[bucket_of(id)]; i != NO_SLOT; i = next[i])
+		if (slots[i].id == id)
+			return &slots[i];
+
+	return NULL;
+}
+
+size_t flow_table_size(void)
+{
+	return num_active;
+}
+
+/** First active flow at or after slot @p i, NULL if there is none. */
+static inline struct flow *active_from(int i)
+{
+	for (; i < high; i++)
+		if (state[i] == SLOT_ACTIVE)
+			return &slots[i];
+
+	return NULL;
+}
+
+struct flow *flow_table_first(void)
+{
+	return active_from(0);
+}
+
+struct flow *flow_table_next(const struct flow *flow)
+{
+	return active_from(slot_of(flow) + 1);
+}
+
+struct flow_timer *flow_table_timer(const struct flow *flow)
+{
+	return &timers[slot_of(flow)];
+}
+
+struct flow *flow_table_next_due(const struct timespec *now,
+				 const struct flow *flow)
+{
+	for (int i = flow ? slot_of(flow) + 1 : 0; i < high; i++)
+		if (timers[i].interval && state[i] == SLOT_ACTIVE &&
+		    time_is_after(now, &timers[i].next))
+			return &slots[i];
+
+	return NULL;
+}
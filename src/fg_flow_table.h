@@ -0,0 +1,146 @@
+/**
+ * @file fg_flow_table.h
+ * @brief Table of the flow endpoints handled by the daemon
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_FLOW_TABLE_H_
+#define _FG_FLOW_TABLE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stddef.h>
+#include <time.h>
+
+#include "common.h"
+
+/*
+ * The flow table holds all flow endpoints of the daemon in a single slab of
+ * MAX_FLOWS_DAEMON slots allocated at startup. The hot part of the flows
+ * (struct flow) lies in one array, their cold metadata (struct flow_meta) in
+ * a second one, so iterating over the flows only pulls the hot part into the
+ * cache. A flow keeps its slot, and thus its address, from flow_table_alloc()
+ * until flow_table_free(). Free slots are kept in a free list, adding and
+ * removing flows never allocates memory.
+ *
+ * The interval report timers of the flows (struct flow_timer) lie in a third,
+ * dense array. Finding the flows due for a report scans only this array and
+ * touches no flow that is not due.
+ *
+ * A flow is found by the ID the controller gave it in constant time once it
+ * was added with flow_table_insert(). The source and destination endpoint of
+ * a flow may share the same ID if both run on this daemon.
+ *
+ * The table is only used by the daemon thread and thus not locked.
+ */
+
+/** Number of slots of the flow table. */
+#define FLOW_TABLE_SLOTS (MAX_FLOWS_DAEMON)
+
+struct flow;
+
+/** Interval report timer of a flow. */
+struct flow_timer {
+	/** Time the next interval report is due. */
+	struct timespec next;
+	/** Reporting interval in seconds, 0 if the timer is not running. */
+	double interval;
+};
+
+/**
+ * Allocate the slab of the flow table.
+ *
+ * @return zero on success, -1 if out of memory
+ */
+int flow_table_init(void);
+
+/**
+ * Take a free slot of the flow table.
+ *
+ * The content of the flow is undefined, except its meta member pointing to
+ * the metadata of the slot. The flow is not visited by flow_table_foreach()
+ * until added with flow_table_insert().
+ *
+ * @return flow of the slot, NULL if all slots are taken
+ */
+struct flow *flow_table_alloc(void);
+
+/**
+ * Add @p flow allocated with flow_table_alloc() to the active flows and make
+ * it findable by its ID.
+ */
+void flow_table_insert(struct flow *flow);
+
+/**
+ * Remove @p flow from the active flows, if inserted, and return its slot to
+ * the free list. The flow must not be used afterwards.
+ */
+void flow_table_free(struct flow *flow);
+
+/**
+ * Find the first inserted flow with ID @p id.
+ *
+ * @return the flow, NULL if there is no flow with this ID
+ */
+struct flow *flow_table_find(int id);
+
+/** Number of active flows, i.e. inserted and not yet freed. */
+size_t flow_table_size(void);
+
+/** First active flow in slot order, NULL if there is none. */
+struct flow *flow_table_first(void);
+
+/**
+ * Active flow following @p flow in slot order, NULL if there is none.
+ *
+ * @p flow may have been freed in the meantime, so it is safe to remove the
+ * current flow while iterating.
+ */
+struct flow *flow_table_next(const struct flow *flow);
+
+/** Iterate over all active flows, the current @p flow may be freed. */
+#define flow_table_foreach(flow)					    \
+	for ((flow) = flow_table_first(); (flow);			    \
+	     (flow) = flow_table_next(flow))
+
+/**
+ * Interval report timer of @p flow allocated with flow_table_alloc(). The
+ * timer is stopped when the slot is allocated.
+ */
+struct flow_timer *flow_table_timer(const struct flow *flow);
+
+/**
+ * Active flow following @p flow in slot order whose report timer is running
+ * and due at time @p now, NULL if there is none.
+ *
+ * @param[in] now current time
+ * @param[in] flow flow to continue after, NULL to start at the first slot
+ */
+struct flow *flow_table_next_due(const struct timespec *now,
+				 const struct flow *flow);
+
+/** Iterate over the active flows with a due report timer. */
+#define flow_table_foreach_due(flow, now)				    \
+	for ((flow) = flow_table_next_due((now), NULL); (flow);		    \
+	     (flow) = flow_table_next_due((now), (flow)))
+
+#endif /* _FG_FLOW_TABLE_H_ */
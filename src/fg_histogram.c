@@ -0,0 +1,97 @@
+/**
+ * @file fg_histogram.c
+ * @brief Log-linear histograms for latency quantiles
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <math.h>
+#include <string.h>
+
+#include "fg_histogram.h"
+
+void histogram_reset(struct fg_histogram *h)
+{
+	memset(h, 0, sizeof(struct fg_histogram));
+}
+
+/** Bucket of histogram value @p value. */
+static unsigned histogram_bucket(double value)
+{
+	const double x = value / HISTOGRAM_RESOLUTION;
+	int exp;
+
+	/* also catches NaN */
+	if (!(x >= 1.0))
+		return 0;
+
+	/* x = m * 2^exp with m in [0.5,1), hence x lies in octave exp - 1 */
+	double m = frexp(x, &exp);
+	if (exp > HISTOGRAM_OCTAVES)
+		return HISTOGRAM_BUCKETS - 1;
+
+	unsigned sub = (unsigned)((2.0 * m - 1.0) * HISTOGRAM_SUB_BUCKETS);
+	return 1 + (exp - 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+void histogram_add(struct fg_histogram *h, double value)
+{
+	h->bucket[histogram_bucket(value)]++;
+	h->count++;
+}
+
+void histogram_merge(struct fg_histogram *dst, const struct fg_histogram *src)
+{
+	for (unsigned i = 0; i < HISTOGRAM_BUCKETS; i++)
+		dst->bucket[i] += src->bucket[i];
+	dst->count += src->count;
+}
+
+double histogram_quantile(const struct fg_histogram *h, double q)
+{
+	unsigned rank, seen = 0, i;
+
+	if (!h->count)
+		return 0.0;
+
+	/* smallest value with at least q * count values not above it */
+	rank = (unsigned)ceil(q * h->count);
+	if (rank < 1)
+		rank = 1;
+	if (rank > h->count)
+		rank = h->count;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++) {
+		seen += h->bucket[i];
+		if (seen >= rank)
+			break;
+	}
+
+	if (!i)
+		return HISTOGRAM_RESOLUTION / 2;
+
+	const unsigned octave = (i - 1) / HISTOGRAM_SUB_BUCKETS;
+	const unsigned sub = (i - 1) % HISTOGRAM_SUB_BUCKETS;
+	return ldexp(HISTOGRAM_RESOLUTION *
+		     (1.0 + (sub + 0.5) / HISTOGRAM_SUB_BUCKETS), octave);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file fg_histogram.h
+ * @brief Log-linear histograms for latency quantiles
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_HISTOGRAM_H_
+#define _FG_HISTOGRAM_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/** Smallest value distinguished by a histogram, in seconds. */
+#define HISTOGRAM_RESOLUTION 1e-6
+/** Number of linear buckets each power of two is split into. */
+#define HISTOGRAM_SUB_BUCKETS 16
+/** Number of powers of two above HISTOGRAM_RESOLUTION covered. */
+#define HISTOGRAM_OCTAVES 32
+/** Total number of buckets, including the one for values below resolution. */
+#define HISTOGRAM_BUCKETS (HISTOGRAM_OCTAVES * HISTOGRAM_SUB_BUCKETS + 1)
+
+/**
+ * Histogram with logarithmically growing buckets.
+ *
+ * Each power of two is split into HISTOGRAM_SUB_BUCKETS buckets of equal
+ * width, so the relative error of a quantile is bounded independent of the
+ * magnitude of the values. Values from 1us up to more than one hour are
+ * covered, larger values are counted in the last bucket.
+ */
+struct fg_histogram {
+	/** Number of values added. */
+	unsigned count;
+	/** Number of values per bucket. */
+	unsigned bucket[HISTOGRAM_BUCKETS];
+};
+
+/** Remove all values from histogram @p h. */
+void histogram_reset(struct fg_histogram *h);
+
+/** Add value @p value (in seconds) to histogram @p h. */
+void histogram_add(struct fg_histogram *h, double value);
+
+/** Add all values of histogram @p src to histogram @p dst. */
+void histogram_merge(struct fg_histogram *dst, const struct fg_histogram *src);
+
+/**
+ * Estimate the quantile @p q of the values in histogram @p h.
+ *
+ * @param[in] h histogram
+ * @param[in] q quantile in the interval [0,1]
+ * @return center of the bucket holding the quantile, 0 if @p h is empty
+ */
+double histogram_quantile(const struct fg_histogram *h, double q);
+
+#endif /* _FG_HISTOGRAM_H_ */
@@ -0,0 +1,45 @@
+/**
+ * @file fg_io.h
+ * @brief Input and output helpers used by Flowgrind
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_IO_H_
+#define _FG_IO_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stddef.h>
+
+/**
+ * Write all @p len bytes of @p buf to file descriptor @p fd.
+ *
+ * Writes interrupted by a signal and partial writes are continued.
+ *
+ * @param[in] fd file descriptor to write to
+ * @param[in] buf data to be written
+ * @param[in] len number of bytes to be written
+ * @return zero on success, -1 on error with errno set
+ */
+int write_all(int fd, const void *buf, size_t len);
+
+#endif /* _FG_IO_H_ */
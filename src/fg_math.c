@@ -42,6 +42,7 @@
 #include <fenv.h>
 
 #include "debug.h"
+#include "fg_cdf.h"
 #include "fg_math.h"
 #include "fg_error.h"
 #include "fg_definitions.h"
@@ -76,10 +77,15 @@ extern void init_math_functions (struct flow *flow, unsigned long seed)
 	/* if no seed supplied use urandom */
 		DEBUG_MSG(LOG_WARNING, "client did not supply random seed value");
 		int data = open("/dev/urandom", O_RDONLY);
-		rc = read(data, &seed, sizeof (long) );
+		/* remember the seed, the trafgen sample buffers are seeded
+		 * from the flow settings as well. Draw no more than the
+		 * settings hold, so the reported seed reproduces the run */
+		rc = read(data, &flow->settings.random_seed,
+			  sizeof(flow->settings.random_seed));
 		close(data);
 		if(rc == -1)
 			crit("read /dev/urandom failed");
+		seed = flow->settings.random_seed;
 	}
 
 #ifdef HAVE_LIBGSL
@@ -229,3 +235,152 @@ extern double dist_chisq (struct flow *flow, const double nu)
 #endif /* HAVE_LIBGSL */
 }
 
+
+/* Batch random number generation. The generator is xoshiro256** by Blackman
+ * and Vigna, run as RNG_LANES interleaved streams. All loops below operate on
+ * plain arrays without data-dependent branches so that they auto-vectorize.
+ * Unlike the functions above, the results neither depend on the presence of
+ * libgsl nor on the libc rand() implementation, the sequence of numbers is
+ * fully determined by the seed */
+
+static inline uint64_t rotl(const uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Seed the batch random number generator @p rng.
+ *
+ * Different values of @p stream yield independent sequences for the same
+ * @p seed.
+ */
+extern void rng_seed(struct fg_rng *rng, uint64_t seed, unsigned stream)
+{
+	uint64_t x = seed ^ ((uint64_t)stream << 32);
+
+	for (int lane = 0; lane < RNG_LANES; lane++)
+		for (int i = 0; i < 4; i++)
+			rng->s[i][lane] = splitmix64(&x);
+}
+
+/** Advance all lanes of @p rng by one step and store one number per lane. */
+static inline void rng_next(struct fg_rng *rng, uint64_t out[RNG_LANES])
+{
+	for (int lane = 0; lane < RNG_LANES; lane++) {
+		const uint64_t result = rotl(rng->s[1][lane] * 5, 7) * 9;
+		const uint64_t t = rng->s[1][lane] << 17;
+
+		rng->s[2][lane] ^= rng->s[0][lane];
+		rng->s[3][lane] ^= rng->s[1][lane];
+		rng->s[1][lane] ^= rng->s[2][lane];
+		rng->s[0][lane] ^= rng->s[3][lane];
+		rng->s[2][lane] ^= t;
+		rng->s[3][lane] = rotl(rng->s[3][lane], 45);
+
+		out[lane] = result;
+	}
+}
+
+/** Map the upper 53 bits of @p x to the open interval (0,1). */
+static inline double to_open_unit(const uint64_t x)
+{
+	return ((double)(x >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/** Fill @p out with @p n uniformly distributed numbers in (0,1). */
+extern void rng_fill_uniform(struct fg_rng *rng, double *out, size_t n)
+{
+	uint64_t x[RNG_LANES];
+	size_t i = 0;
+
+	for (; i + RNG_LANES <= n; i += RNG_LANES) {
+		rng_next(rng, x);
+		for (int lane = 0; lane < RNG_LANES; lane++)
+			out[i + lane] = to_open_unit(x[lane]);
+	}
+
+	/* partial tail, surplus numbers are discarded */
+	if (i < n) {
+		rng_next(rng, x);
+		for (int lane = 0; i < n; lane++, i++)
+			out[i] = to_open_unit(x[lane]);
+	}
+}
+
+/**
+ * Fill @p out with @p n samples of the distribution described by @p opt.
+ *
+ * The parameters have the same meaning as for the libgsl based dist_*
+ * functions above. Non-uniform samples are obtained by inversion, normal
+ * samples by the Box-Muller transform.
+ */
+extern void dist_fill(struct fg_rng *rng, const struct trafgen_options *opt,
+		      double *out, size_t n)
+{
+	const enum distribution_t type = opt->distribution;
+	const double param_one = opt->param_one;
+	const double param_two = opt->param_two;
+	size_t i;
+
+	if (type == CONSTANT) {
+		for (i = 0; i < n; i++)
+			out[i] = param_one;
+		return;
+	}
+
+	rng_fill_uniform(rng, out, n);
+
+	switch (type) {
+	case UNIFORM:
+		for (i = 0; i < n; i++)
+			out[i] = param_one + (param_two - param_one) * out[i];
+		break;
+	case EXPONENTIAL:
+		for (i = 0; i < n; i++)
+			out[i] = -param_one * log(out[i]);
+		break;
+	case WEIBULL:
+		for (i = 0; i < n; i++)
+			out[i] = param_one * pow(-log(out[i]), 1.0 / param_two);
+		break;
+	case PARETO:
+		for (i = 0; i < n; i++)
+			out[i] = param_two * pow(out[i], -1.0 / param_one);
+		break;
+	case NORMAL:
+	case LOGNORMAL:
+		for (i = 0; i + 1 < n; i += 2) {
+			const double r = sqrt(-2.0 * log(out[i]));
+			const double phi = 2.0 * M_PI * out[i + 1];
+			out[i] = r * cos(phi);
+			out[i + 1] = r * sin(phi);
+		}
+		/* odd tail needs a second uniform number */
+		if (i < n) {
+			double u;
+			rng_fill_uniform(rng, &u, 1);
+			out[i] = sqrt(-2.0 * log(out[i])) * cos(2.0 * M_PI * u);
+		}
+		if (type == NORMAL)
+			for (i = 0; i < n; i++)
+				out[i] = param_one + param_two * out[i];
+		else
+			for (i = 0; i < n; i++)
+				out[i] = exp(param_one + param_two * out[i]);
+		break;
+	case EMPIRICAL:
+		for (i = 0; i < n; i++)
+			out[i] = cdf_quantile(opt->cdf, out[i]);
+		break;
+	default:
+		break;
+	}
+}
@@ -30,8 +30,26 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
 #include "daemon.h"
 
+/** Number of independent xoshiro256** streams advanced in lockstep. */
+#define RNG_LANES 4
+
+/**
+ * State of the batch random number generator.
+ *
+ * The state is stored lane-major, i.e. word @c i of lane @c l is s[i][l], so
+ * that one generator step is a straight loop over RNG_LANES independent lanes
+ * which the compiler can map to vector instructions.
+ */
+struct fg_rng {
+	uint64_t s[4][RNG_LANES];
+};
+
 /* initalization for random number generator */
 extern void init_math_functions (struct flow *flow, unsigned long seed);
 extern void free_math_functions (struct flow *flow);
@@ -51,4 +69,10 @@ extern double dist_uniform (struct flow *flow,
 extern double dist_exponential (struct flow *flow, const double mu);
 extern double dist_chisq (struct flow *flow, const double nu);
 
+/* batch random number generation */
+extern void rng_seed (struct fg_rng *rng, uint64_t seed, unsigned stream);
+extern void rng_fill_uniform (struct fg_rng *rng, double *out, size_t n);
+extern void dist_fill (struct fg_rng *rng, const struct trafgen_options *opt,
+		       double *out, size_t n);
+
 #endif /* _FG_MATH_H_ */
@@ -0,0 +1,428 @@
+/**
+ * @file fg_metrics.c
+ * @brief Live metrics of the daemon, served in the Prometheus text format
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include "fg_metrics.h"
+#include "fg_error.h"
+#include "fg_io.h"
+#include "fg_log.h"
+#include "fg_string.h"
+#include "fg_time.h"
+#include "debug.h"
+
+/** Maximal length of a HTTP request of a scraper. */
+#define METRICS_REQUEST_LEN 1024
+
+/** Seconds a scraper may take to send its request. */
+#define METRICS_REQUEST_TIMEOUT 1
+
+const uint64_t metrics_buckets[METRICS_NUM_BUCKETS] = {
+	1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+	1000000, 2500000, 5000000, 10000000, 100000000, 1000000000
+};
+
+const char *loop_phase_names[NUM_LOOP_PHASES] = {
+	[PHASE_PREPARE_FDS] = "prepare_fds",
+	[PHASE_PSELECT] = "pselect",
+	[PHASE_PROCESS_REQUESTS] = "process_requests",
+	[PHASE_TIMER_CHECK] = "timer_check",
+	[PHASE_PROCESS_SELECT] = "process_select",
+};
+
+struct daemon_metrics metrics;
+
+double metrics_log_interval = 0;
+
+/** Metrics at the time of the last profile log line (daemon thread only). */
+static struct daemon_metrics last_profile;
+
+/** Time of the last profile log line, zero before the first iteration. */
+static struct timespec last_log;
+
+/** Listen socket of the metrics server. */
+static int listen_fd = -1;
+
+void metrics_observe(struct metrics_histogram *h, const struct timespec *begin,
+		     const struct timespec *end)
+{
+	int64_t ns = (int64_t)(end->tv_sec - begin->tv_sec) * 1000000000 +
+		     (end->tv_nsec - begin->tv_nsec);
+	unsigned bucket = 0;
+
+	/* the wall clock may have been stepped */
+	if (ns < 0)
+		ns = 0;
+
+	while (bucket < METRICS_NUM_BUCKETS &&
+	       (uint64_t)ns > metrics_buckets[bucket])
+		bucket++;
+
+	metrics_add(&h->buckets[bucket], 1);
+	metrics_add(&h->sum, ns);
+	metrics_add(&h->count, 1);
+}
+
+double metrics_quantile(const struct metrics_histogram *h,
+			const struct metrics_histogram *base, double q)
+{
+	uint64_t counts[METRICS_NUM_BUCKETS + 1];
+	uint64_t total = 0, cumulative = 0;
+
+	for (unsigned i = 0; i <= METRICS_NUM_BUCKETS; i++) {
+		counts[i] = metrics_get(&h->buckets[i]);
+		if (base)
+			counts[i] -= base->buckets[i];
+		total += counts[i];
+	}
+
+	if (!total)
+		return NAN;
+
+	for (unsigned i = 0; i < METRICS_NUM_BUCKETS; i++) {
+		cumulative += counts[i];
+		if (cumulative >= q * total)
+			return metrics_buckets[i] / 1e9;
+	}
+	return INFINITY;
+}
+
+/**
+ * Append average and quantile @p q of the samples added to histogram @p h
+ * since @p base in microseconds to the log line @p line.
+ */
+static void append_profile(char **line, const char *name,
+			   const struct metrics_histogram *h,
+			   const struct metrics_histogram *base, double q)
+{
+	const uint64_t count = h->count - base->count;
+
+	if (!count) {
+		asprintf_append(line, " %s -/-", name);
+		return;
+	}
+	asprintf_append(line, " %s %.1f/%.0f", name,
+			(h->sum - base->sum) / 1e3 / count,
+			metrics_quantile(h, base, q) * 1e6);
+}
+
+void metrics_log_profile(const struct timespec *now)
+{
+	char *line = NULL;
+
+	if (!metrics_log_interval)
+		return;
+
+	if (!last_log.tv_sec) {
+		last_log = *now;
+		last_profile = metrics;
+		return;
+	}
+
+	const double elapsed = time_diff(&last_log, now);
+	if (elapsed < metrics_log_interval)
+		return;
+
+	const uint64_t iterations = metrics.loop_iterations -
+				    last_profile.loop_iterations;
+	asprintf_append(&line, "event loop: %.0f iterations/s, %.2f "
+			"flows/wakeup; avg/p99 [us]",
+			iterations / elapsed, iterations ?
+			(double)(metrics.flows_serviced -
+				 last_profile.flows_serviced) / iterations : 0);
+	for (unsigned i = 0; i < NUM_LOOP_PHASES; i++)
+		append_profile(&line, loop_phase_names[i], &metrics.phases[i],
+			       &last_profile.phases[i], 0.99);
+	append_profile(&line, "write_lateness", &metrics.write_lateness,
+		       &last_profile.write_lateness, 0.99);
+	logging(LOG_NOTICE, "%s", line);
+	free(line);
+
+	last_log = *now;
+	last_profile = metrics;
+}
+
+/**
+ * Append a counter or gauge to the exposition @p body.
+ *
+ * @param[in,out] body exposition
+ * @param[in] name name of the metric
+ * @param[in] type "counter" or "gauge"
+ * @param[in] help description of the metric
+ * @param[in] value current value
+ */
+static void append_metric(char **body, const char *name, const char *type,
+			  const char *help, uint64_t value)
+{
+	asprintf_append(body, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n",
+			name, help, name, type, name,
+			(unsigned long long)value);
+}
+
+/**
+ * Append the samples of histogram @p h with cumulative buckets to the
+ * exposition @p body.
+ *
+ * The total count is derived from the buckets, so that it always matches the
+ * +Inf bucket even if the daemon thread updates @p h concurrently.
+ *
+ * @param[in,out] body exposition
+ * @param[in] name name of the metric
+ * @param[in] label additional label such as 'phase="pselect"', or NULL
+ * @param[in] h histogram
+ */
+static void append_histogram(char **body, const char *name, const char *label,
+			     const struct metrics_histogram *h)
+{
+	const char *sep = label ? "," : "";
+	uint64_t cumulative = 0;
+
+	if (!label)
+		label = "";
+
+	for (unsigned i = 0; i < METRICS_NUM_BUCKETS; i++) {
+		cumulative += metrics_get(&h->buckets[i]);
+		asprintf_append(body, "%s_bucket{%s%sle=\"%g\"} %llu\n", name,
+				label, sep, metrics_buckets[i] / 1e9,
+				(unsigned long long)cumulative);
+	}
+	cumulative += metrics_get(&h->buckets[METRICS_NUM_BUCKETS]);
+	asprintf_append(body, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name,
+			label, sep, (unsigned long long)cumulative);
+
+	if (*label)
+		asprintf_append(body, "%s_sum{%s} %.9f\n%s_count{%s} %llu\n",
+				name, label, metrics_get(&h->sum) / 1e9,
+				name, label, (unsigned long long)cumulative);
+	else
+		asprintf_append(body, "%s_sum %.9f\n%s_count %llu\n",
+				name, metrics_get(&h->sum) / 1e9,
+				name, (unsigned long long)cumulative);
+}
+
+/** Render all metrics in the Prometheus text exposition format. */
+static char *render_metrics(void)
+{
+	char *body = NULL;
+
+	append_metric(&body, "flowgrindd_flows_active", "gauge",
+		      "Number of flows handled by the daemon.",
+		      metrics_get(&metrics.flows_active));
+	append_metric(&body, "flowgrindd_written_bytes_total", "counter",
+		      "Bytes written to test connections.",
+		      metrics_get(&metrics.bytes_written));
+	append_metric(&body, "flowgrindd_read_bytes_total", "counter",
+		      "Bytes read from test connections.",
+		      metrics_get(&metrics.bytes_read));
+	append_metric(&body, "flowgrindd_discarded_bytes_total", "counter",
+		      "Bytes of payload read from test connections without "
+		      "copying.", metrics_get(&metrics.bytes_discarded));
+	asprintf_append(&body, "# HELP flowgrindd_eagain_total Operations on "
+			"test connections that failed with EAGAIN.\n"
+			"# TYPE flowgrindd_eagain_total counter\n"
+			"flowgrindd_eagain_total{op=\"write\"} %llu\n"
+			"flowgrindd_eagain_total{op=\"read\"} %llu\n",
+			(unsigned long long)metrics_get(&metrics.eagain_write),
+			(unsigned long long)metrics_get(&metrics.eagain_read));
+	append_metric(&body, "flowgrindd_pending_reports", "gauge",
+		      "Reports waiting to be fetched by the controller.",
+		      metrics_get(&metrics.pending_reports));
+	append_metric(&body, "flowgrindd_dropped_reports_total", "counter",
+		      "Interval reports dropped since the report queue was "
+		      "full.", metrics_get(&metrics.reports_dropped));
+	asprintf_append(&body, "# HELP flowgrindd_loop_latency_seconds Time "
+			"from a wakeup of the event loop to its next pselect() "
+			"call.\n# TYPE flowgrindd_loop_latency_seconds "
+			"histogram\n");
+	append_histogram(&body, "flowgrindd_loop_latency_seconds", NULL,
+			 &metrics.loop_latency);
+	append_metric(&body, "flowgrindd_loop_iterations_total", "counter",
+		      "Iterations of the event loop.",
+		      metrics_get(&metrics.loop_iterations));
+	append_metric(&body, "flowgrindd_serviced_flows_total", "counter",
+		      "Flows with a ready test socket, summed over all "
+		      "wakeups of the event loop.",
+		      metrics_get(&metrics.flows_serviced));
+	asprintf_append(&body, "# HELP flowgrindd_loop_phase_seconds Time "
+			"spent per phase of the event loop.\n"
+			"# TYPE flowgrindd_loop_phase_seconds histogram\n");
+	for (unsigned i = 0; i < NUM_LOOP_PHASES; i++) {
+		char label[64];
+		snprintf(label, sizeof(label), "phase=\"%s\"",
+			 loop_phase_names[i]);
+		append_histogram(&body, "flowgrindd_loop_phase_seconds", label,
+				 &metrics.phases[i]);
+	}
+	asprintf_append(&body, "# HELP flowgrindd_write_lateness_seconds How "
+			"late a flow waiting for its next scheduled block was "
+			"woken.\n# TYPE flowgrindd_write_lateness_seconds "
+			"histogram\n");
+	append_histogram(&body, "flowgrindd_write_lateness_seconds", NULL,
+			 &metrics.write_lateness);
+
+	return body;
+}
+
+/**
+ * Read the HTTP request of a scraper from @p fd and answer it.
+ *
+ * Only "GET /metrics" is served, the connection is closed after the response.
+ */
+static void serve_request(int fd)
+{
+	char request[METRICS_REQUEST_LEN + 1];
+	char method[8] = "", path[256] = "";
+	size_t len = 0;
+	const char *status = "200 OK";
+	char *body = NULL;
+	char *response = NULL;
+	struct timeval timeout = { .tv_sec = METRICS_REQUEST_TIMEOUT };
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	/* the request line and headers are complete after an empty line */
+	while (len < METRICS_REQUEST_LEN) {
+		ssize_t rc = read(fd, request + len, METRICS_REQUEST_LEN - len);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			break;
+		len += rc;
+		request[len] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+			break;
+	}
+	request[len] = '\0';
+
+	if (sscanf(request, "%7s %255s", method, path) != 2) {
+		status = "400 Bad Request";
+	} else if (strcmp(method, "GET")) {
+		status = "405 Method Not Allowed";
+	} else {
+		/* ignore query parameters of the scraper */
+		path[strcspn(path, "?")] = '\0';
+		if (strcmp(path, "/metrics"))
+			status = "404 Not Found";
+	}
+
+	if (!strcmp(status, "200 OK"))
+		body = render_metrics();
+	else
+		asprintf_append(&body, "%s\n", status);
+
+	DEBUG_MSG(LOG_DEBUG, "metrics request '%s %s': %s", method, path,
+		  status);
+
+	asprintf_append(&response, "HTTP/1.0 %s\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n\r\n%s",
+			status, strlen(body), body);
+	if (write_all(fd, response, strlen(response)) == -1)
+		DEBUG_MSG(LOG_NOTICE, "failed to send metrics: %s",
+			  strerror(errno));
+
+	free(body);
+	free(response);
+}
+
+/** Main loop of the metrics server thread, serving one scraper at a time. */
+static void *metrics_main(void *ptr __attribute__((unused)))
+{
+	for (;;) {
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd == -1) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				logging(LOG_WARNING, "accept() on metrics "
+					"socket failed: %s", strerror(errno));
+			continue;
+		}
+		serve_request(fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+void init_metrics_server(const char *bind_addr, unsigned port)
+{
+	int rc;
+	int optval = 1;
+	struct addrinfo hints, *res, *ressave;
+	char tmp_port[16];
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(tmp_port, sizeof(tmp_port), "%u", port);
+
+	if ((rc = getaddrinfo(bind_addr, tmp_port, &hints, &res)) != 0)
+		critx("failed to find address to bind metrics server: %s",
+		      gai_strerror(rc));
+	ressave = res;
+
+	for (; res; res = res->ai_next) {
+		listen_fd = socket(res->ai_family, res->ai_socktype,
+				   res->ai_protocol);
+		if (listen_fd < 0)
+			continue;
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &optval,
+			   sizeof(optval));
+		if (bind(listen_fd, res->ai_addr, res->ai_addrlen) == 0 &&
+		    listen(listen_fd, 16) == 0)
+			break;
+		close(listen_fd);
+		listen_fd = -1;
+	}
+	freeaddrinfo(ressave);
+
+	if (listen_fd == -1)
+		crit("failed to bind metrics listen socket");
+
+	logging(LOG_NOTICE, "running metrics server on port %u", port);
+}
+
+void create_metrics_thread(void)
+{
+	pthread_t thread;
+
+	int rc = pthread_create(&thread, NULL, metrics_main, 0);
+	if (rc)
+		critc(rc, "could not start metrics thread");
+	pthread_detach(thread);
+}
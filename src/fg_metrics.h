@@ -0,0 +1,185 @@
+/**
+ * @file fg_metrics.h
+ * @brief Live metrics of the daemon, served in the Prometheus text format
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_METRICS_H_
+#define _FG_METRICS_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <time.h>
+
+/** Number of finite buckets of a latency histogram. */
+#define METRICS_NUM_BUCKETS 15
+
+/** Upper bounds of the finite buckets of a latency histogram in nanoseconds. */
+extern const uint64_t metrics_buckets[METRICS_NUM_BUCKETS];
+
+/**
+ * Histogram of latencies, updated by a single thread.
+ *
+ * The buckets are not cumulative, the last bucket counts all samples above
+ * the largest bound.
+ */
+struct metrics_histogram {
+	/** Number of samples per bucket. */
+	uint64_t buckets[METRICS_NUM_BUCKETS + 1];
+	/** Number of samples. */
+	uint64_t count;
+	/** Sum of all samples in nanoseconds. */
+	uint64_t sum;
+};
+
+/** Phases of an iteration of the event loop of the daemon thread. */
+enum loop_phase {
+	/** Collect the file descriptors to wait for, finish flows. */
+	PHASE_PREPARE_FDS = 0,
+	/** Wait for file descriptors or the timeout. */
+	PHASE_PSELECT,
+	/** Handle requests of the RPC server. */
+	PHASE_PROCESS_REQUESTS,
+	/** Send interval reports. */
+	PHASE_TIMER_CHECK,
+	/** Read from and write to the ready test connections. */
+	PHASE_PROCESS_SELECT,
+	/** Number of elements in enum. Must be last element. */
+	NUM_LOOP_PHASES,
+};
+
+/** Names of the phases, indexed by enum loop_phase. */
+extern const char *loop_phase_names[NUM_LOOP_PHASES];
+
+/**
+ * Counters and gauges of the daemon.
+ *
+ * All values are written by the daemon thread only, except pending_reports
+ * which is written while holding the report mutex. The metrics server thread
+ * reads them without locking. Counters only increase.
+ */
+struct daemon_metrics {
+	/** Number of flows the daemon thread currently handles (gauge). */
+	uint64_t flows_active;
+	/** Reports waiting to be fetched by the controller (gauge). */
+	uint64_t pending_reports;
+	/** Bytes written to and read from test sockets. @{ */
+	uint64_t bytes_written;
+	uint64_t bytes_read;                                    /** @} */
+	/** Bytes of payload read and dropped by the kernel without copying. */
+	uint64_t bytes_discarded;
+	/** Writes and reads that failed with EAGAIN. @{ */
+	uint64_t eagain_write;
+	uint64_t eagain_read;                                   /** @} */
+	/** Interval reports dropped since the report queue was full. */
+	uint64_t reports_dropped;
+	/** Time from a wakeup of the event loop to its next pselect() call. */
+	struct metrics_histogram loop_latency;
+	/** Start of the event loop. */
+	struct timespec since;
+	/** Iterations of the event loop. */
+	uint64_t loop_iterations;
+	/** Flows with a ready test socket, summed over all wakeups. */
+	uint64_t flows_serviced;
+	/** Time spent per phase of the event loop. */
+	struct metrics_histogram phases[NUM_LOOP_PHASES];
+	/** How late a flow waiting for its next scheduled block was woken. */
+	struct metrics_histogram write_lateness;
+};
+
+/** Metrics of the daemon. */
+extern struct daemon_metrics metrics;
+
+/**
+ * Add @p n to counter @p counter.
+ *
+ * Since there is only a single writer, a relaxed load and store suffices and
+ * avoids a locked read-modify-write on the data path.
+ */
+static inline void metrics_add(uint64_t *counter, uint64_t n)
+{
+	__atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n,
+			 __ATOMIC_RELAXED);
+}
+
+/** Set gauge @p gauge to @p value. */
+static inline void metrics_set(uint64_t *gauge, uint64_t value)
+{
+	__atomic_store_n(gauge, value, __ATOMIC_RELAXED);
+}
+
+/** Read counter or gauge @p value from any thread. */
+static inline uint64_t metrics_get(const uint64_t *value)
+{
+	return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Add the time from @p begin to @p end as sample to histogram @p h.
+ *
+ * @param[in,out] h histogram
+ * @param[in] begin begin of the measured period
+ * @param[in] end end of the measured period
+ */
+void metrics_observe(struct metrics_histogram *h, const struct timespec *begin,
+		     const struct timespec *end);
+
+/**
+ * Upper bound of the bucket holding quantile @p q of the samples added to
+ * histogram @p h since it was copied to @p base.
+ *
+ * @param[in] h histogram
+ * @param[in] base earlier copy of @p h, NULL to use all samples
+ * @param[in] q quantile between 0 and 1
+ * @return upper bound in seconds, NaN if there are no samples and infinity if
+ * the quantile is above the largest bound
+ */
+double metrics_quantile(const struct metrics_histogram *h,
+			const struct metrics_histogram *base, double q);
+
+/** Interval of the event loop profile log line in seconds, 0 if disabled. */
+extern double metrics_log_interval;
+
+/**
+ * Log the event loop profile of the last interval once metrics_log_interval
+ * elapsed since the last log line. Called by the daemon thread.
+ *
+ * @param[in] now current time
+ */
+void metrics_log_profile(const struct timespec *now);
+
+/**
+ * Create the listen socket of the metrics server.
+ *
+ * Must be called before the daemon forks into the background to report
+ * errors to the user. Terminates the program on failure.
+ *
+ * @param[in] bind_addr address to bind to, NULL for all addresses
+ * @param[in] port TCP port to listen on
+ */
+void init_metrics_server(const char *bind_addr, unsigned port);
+
+/** Start the thread answering HTTP requests for the metrics. */
+void create_metrics_thread(void);
+
+#endif /* _FG_METRICS_H_ */
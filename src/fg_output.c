@@ -0,0 +1,622 @@
+/**
+ * @file fg_output.c
+ * @brief Machine-readable output of the Flowgrind controller
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <arpa/inet.h>
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fg_output.h"
+#include "fg_error.h"
+#include "fg_io.h"
+
+/** Upper bound of the length of a single JSON or CSV record. */
+#define OUTPUT_MAX_RECORD 4096
+/** Group names longer than this are truncated in JSON and CSV records. */
+#define OUTPUT_MAX_GROUP 256
+
+/** Report values written to the output, in host byte order. */
+struct output_values {
+	double begin;
+	double end;
+	uint64_t bytes_written;
+	uint64_t bytes_read;
+	uint64_t request_blocks_written;
+	uint64_t request_blocks_read;
+	uint64_t response_blocks_written;
+	uint64_t response_blocks_read;
+	double rtt_min;
+	double rtt_avg;
+	double rtt_max;
+	double iat_min;
+	double iat_avg;
+	double iat_max;
+	double delay_min;
+	double delay_avg;
+	double delay_max;
+	double drift_min;
+	double drift_avg;
+	double drift_max;
+	uint64_t conns_completed;
+	uint64_t conns_failed;
+	uint64_t conns_dropped;
+	double fct_p50;
+	double fct_p90;
+	double fct_p99;
+	uint64_t tcpi_snd_cwnd;
+	uint64_t tcpi_snd_ssthresh;
+	uint64_t tcpi_unacked;
+	uint64_t tcpi_sacked;
+	uint64_t tcpi_lost;
+	uint64_t tcpi_retrans;
+	uint64_t tcpi_retransmits;
+	uint64_t tcpi_fackets;
+	uint64_t tcpi_reordering;
+	uint64_t tcpi_backoff;
+	uint64_t tcpi_ca_state;
+	uint64_t tcpi_snd_mss;
+	double tcpi_rtt;
+	double tcpi_rttvar;
+	double tcpi_rto;
+	uint64_t pmtu;
+	uint64_t blocks_corrupted;
+	uint64_t bytes_corrupted;
+	uint64_t pcap_packets;
+	uint64_t pcap_drops;
+	uint64_t pcap_ring_drops;
+	uint64_t wire_retransmits;
+	uint64_t wire_reordered;
+	double wire_rtt_min;
+	double wire_rtt_avg;
+	double wire_rtt_max;
+	uint64_t wire_acked;
+	uint64_t wire_flight;
+};
+
+/** Types of the values of a record. */
+enum field_type {
+	FIELD_UINT,
+	FIELD_DOUBLE,
+};
+
+/** Value of a record in JSON and CSV output. */
+struct output_field {
+	/** Name of the value, used as JSON key and CSV header. */
+	const char *name;
+	/** Type of the value. */
+	enum field_type type;
+	/** Offset of the value in struct output_values. */
+	size_t offset;
+};
+
+#define UINT_FIELD(name) {#name, FIELD_UINT, offsetof(struct output_values, name)}
+#define DOUBLE_FIELD(name) {#name, FIELD_DOUBLE, offsetof(struct output_values, name)}
+
+/** Values of a record in JSON and CSV output. The order is stable. */
+static const struct output_field fields[] = {
+	DOUBLE_FIELD(begin),
+	DOUBLE_FIELD(end),
+	UINT_FIELD(bytes_written),
+	UINT_FIELD(bytes_read),
+	UINT_FIELD(request_blocks_written),
+	UINT_FIELD(request_blocks_read),
+	UINT_FIELD(response_blocks_written),
+	UINT_FIELD(response_blocks_read),
+	DOUBLE_FIELD(rtt_min),
+	DOUBLE_FIELD(rtt_avg),
+	DOUBLE_FIELD(rtt_max),
+	DOUBLE_FIELD(iat_min),
+	DOUBLE_FIELD(iat_avg),
+	DOUBLE_FIELD(iat_max),
+	DOUBLE_FIELD(delay_min),
+	DOUBLE_FIELD(delay_avg),
+	DOUBLE_FIELD(delay_max),
+	DOUBLE_FIELD(drift_min),
+	DOUBLE_FIELD(drift_avg),
+	DOUBLE_FIELD(drift_max),
+	UINT_FIELD(conns_completed),
+	UINT_FIELD(conns_failed),
+	UINT_FIELD(conns_dropped),
+	DOUBLE_FIELD(fct_p50),
+	DOUBLE_FIELD(fct_p90),
+	DOUBLE_FIELD(fct_p99),
+	UINT_FIELD(tcpi_snd_cwnd),
+	UINT_FIELD(tcpi_snd_ssthresh),
+	UINT_FIELD(tcpi_unacked),
+	UINT_FIELD(tcpi_sacked),
+	UINT_FIELD(tcpi_lost),
+	UINT_FIELD(tcpi_retrans),
+	UINT_FIELD(tcpi_retransmits),
+	UINT_FIELD(tcpi_fackets),
+	UINT_FIELD(tcpi_reordering),
+	UINT_FIELD(tcpi_backoff),
+	UINT_FIELD(tcpi_ca_state),
+	UINT_FIELD(tcpi_snd_mss),
+	DOUBLE_FIELD(tcpi_rtt),
+	DOUBLE_FIELD(tcpi_rttvar),
+	DOUBLE_FIELD(tcpi_rto),
+	UINT_FIELD(pmtu),
+	UINT_FIELD(blocks_corrupted),
+	UINT_FIELD(bytes_corrupted),
+	UINT_FIELD(pcap_packets),
+	UINT_FIELD(pcap_drops),
+	UINT_FIELD(pcap_ring_drops),
+	UINT_FIELD(wire_retransmits),
+	UINT_FIELD(wire_reordered),
+	DOUBLE_FIELD(wire_rtt_min),
+	DOUBLE_FIELD(wire_rtt_avg),
+	DOUBLE_FIELD(wire_rtt_max),
+	UINT_FIELD(wire_acked),
+	UINT_FIELD(wire_flight),
+};
+
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+/** Format of the output. */
+static enum output_format format = OUTPUT_NONE;
+/** File descriptor the output is written to. */
+static int output_fd = -1;
+/** Records not yet written. */
+static char buffer[OUTPUT_BUFFER_SIZE];
+/** Number of bytes in @p buffer. */
+static size_t buffer_len = 0;
+
+/** Make sure @p len more bytes fit into the output buffer. */
+static inline void reserve(size_t len)
+{
+	if (buffer_len + len > sizeof(buffer))
+		output_flush();
+}
+
+static inline void put_char(char c)
+{
+	buffer[buffer_len++] = c;
+}
+
+static inline void put_str(const char *s)
+{
+	size_t len = strlen(s);
+	memcpy(buffer + buffer_len, s, len);
+	buffer_len += len;
+}
+
+/** Append decimal representation of @p value. */
+static void put_uint(uint64_t value)
+{
+	char digits[20];
+	unsigned n = 0;
+
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+
+	while (n)
+		put_char(digits[--n]);
+}
+
+/** Whether time @p value is a sample, not a placeholder for no sample. */
+static inline int is_sample(double value)
+{
+	return isfinite(value) && value < FLT_MAX && value > -FLT_MAX;
+}
+
+/**
+ * Append time @p value in seconds with nanosecond resolution, trailing zeros
+ * of the fraction are omitted.
+ */
+static void put_time(double value)
+{
+	if (value < 0) {
+		put_char('-');
+		value = -value;
+	}
+
+	/* Out of range of fixed-point conversion, never the case for times */
+	if (value >= 9e9) {
+		buffer_len += snprintf(buffer + buffer_len, 32, "%.9e", value);
+		return;
+	}
+
+	uint64_t ns = (uint64_t)llround(value * 1e9);
+	put_uint(ns / 1000000000);
+
+	unsigned frac = ns % 1000000000;
+	if (!frac)
+		return;
+
+	char digits[9];
+	for (int i = 8; i >= 0; i--) {
+		digits[i] = '0' + frac % 10;
+		frac /= 10;
+	}
+	unsigned len = 9;
+	while (digits[len - 1] == '0')
+		len--;
+
+	put_char('.');
+	memcpy(buffer + buffer_len, digits, len);
+	buffer_len += len;
+}
+
+/** Append group name @p group as JSON string. */
+static void put_json_string(const char *group)
+{
+	put_char('"');
+	for (unsigned i = 0; group[i] && i < OUTPUT_MAX_GROUP; i++) {
+		const unsigned char c = group[i];
+		if (c == '"' || c == '\\') {
+			put_char('\\');
+			put_char(c);
+		} else if (c < 0x20) {
+			static const char hex[] = "0123456789abcdef";
+			put_str("\\u00");
+			put_char(hex[c >> 4]);
+			put_char(hex[c & 0xf]);
+		} else {
+			put_char(c);
+		}
+	}
+	put_char('"');
+}
+
+/** Append group name @p group as CSV field, quoted if needed. */
+static void put_csv_string(const char *group)
+{
+	if (!strpbrk(group, ",\"\r\n")) {
+		for (unsigned i = 0; group[i] && i < OUTPUT_MAX_GROUP; i++)
+			put_char(group[i]);
+		return;
+	}
+
+	put_char('"');
+	for (unsigned i = 0; group[i] && i < OUTPUT_MAX_GROUP; i++) {
+		if (group[i] == '"')
+			put_char('"');
+		put_char(group[i]);
+	}
+	put_char('"');
+}
+
+/** Append value @p field of @p values, nothing if there is no sample. */
+static void put_field(const struct output_field *field,
+		      const struct output_values *values, const char *missing)
+{
+	const char *p = (const char *)values + field->offset;
+
+	if (field->type == FIELD_UINT) {
+		put_uint(*(const uint64_t *)p);
+		return;
+	}
+
+	const double value = *(const double *)p;
+	if (is_sample(value))
+		put_time(value);
+	else
+		put_str(missing);
+}
+
+static void put_json(int flow_id, const char *group, enum endpoint_t e,
+		     enum report_t type, const struct output_values *values)
+{
+	put_str(type == FINAL ? "{\"type\":\"final\",\"flow_id\":"
+			      : "{\"type\":\"interval\",\"flow_id\":");
+	if (flow_id < 0)
+		put_str("-1");
+	else
+		put_uint(flow_id);
+	put_str(e == SOURCE ? ",\"endpoint\":\"S\",\"group\":"
+			    : ",\"endpoint\":\"D\",\"group\":");
+	if (group)
+		put_json_string(group);
+	else
+		put_str("null");
+
+	for (unsigned i = 0; i < NUM_FIELDS; i++) {
+		put_str(",\"");
+		put_str(fields[i].name);
+		put_str("\":");
+		put_field(&fields[i], values, "null");
+	}
+	put_str("}\n");
+}
+
+static void put_csv(int flow_id, const char *group, enum endpoint_t e,
+		    enum report_t type, const struct output_values *values)
+{
+	put_str(type == FINAL ? "final," : "interval,");
+	if (flow_id < 0)
+		put_str("-1");
+	else
+		put_uint(flow_id);
+	put_str(e == SOURCE ? ",S," : ",D,");
+	if (group)
+		put_csv_string(group);
+
+	for (unsigned i = 0; i < NUM_FIELDS; i++) {
+		put_char(',');
+		put_field(&fields[i], values, "");
+	}
+	put_char('\n');
+}
+
+/** Store @p value in network byte order into two 32 bit halves @p dst. */
+static inline void put_u64(uint32_t dst[2], uint64_t value)
+{
+	dst[0] = htonl((uint32_t)(value >> 32));
+	dst[1] = htonl((uint32_t)value);
+}
+
+/** Store the bit pattern of @p value like put_u64(), NaN for no sample. */
+static inline void put_f64(uint32_t dst[2], double value)
+{
+	uint64_t bits;
+
+	if (!is_sample(value))
+		value = NAN;
+	memcpy(&bits, &value, sizeof(bits));
+	put_u64(dst, bits);
+}
+
+static void put_binary(int flow_id, const char *group, enum endpoint_t e,
+		       enum report_t type, const struct output_values *v)
+{
+	struct output_record r;
+
+	memset(&r, 0, sizeof(r));
+	r.type = htonl(type);
+	r.flow_id = htonl(flow_id);
+	r.endpoint = htonl(e);
+	if (group)
+		strncpy(r.group, group, OUTPUT_GROUP_LEN - 1);
+
+	put_f64(r.begin, v->begin);
+	put_f64(r.end, v->end);
+	put_u64(r.bytes_written, v->bytes_written);
+	put_u64(r.bytes_read, v->bytes_read);
+	r.request_blocks_written = htonl(v->request_blocks_written);
+	r.request_blocks_read = htonl(v->request_blocks_read);
+	r.response_blocks_written = htonl(v->response_blocks_written);
+	r.response_blocks_read = htonl(v->response_blocks_read);
+
+	const double stats[4][3] = {
+		{v->rtt_min, v->rtt_avg, v->rtt_max},
+		{v->iat_min, v->iat_avg, v->iat_max},
+		{v->delay_min, v->delay_avg, v->delay_max},
+		{v->drift_min, v->drift_avg, v->drift_max},
+	};
+	for (int i = 0; i < 3; i++) {
+		put_f64(r.rtt[i], stats[0][i]);
+		put_f64(r.iat[i], stats[1][i]);
+		put_f64(r.delay[i], stats[2][i]);
+		put_f64(r.drift[i], stats[3][i]);
+	}
+
+	r.conns_completed = htonl(v->conns_completed);
+	r.conns_failed = htonl(v->conns_failed);
+	r.conns_dropped = htonl(v->conns_dropped);
+	put_f64(r.fct[0], v->fct_p50);
+	put_f64(r.fct[1], v->fct_p90);
+	put_f64(r.fct[2], v->fct_p99);
+
+	r.tcpi_snd_cwnd = htonl(v->tcpi_snd_cwnd);
+	r.tcpi_snd_ssthresh = htonl(v->tcpi_snd_ssthresh);
+	r.tcpi_unacked = htonl(v->tcpi_unacked);
+	r.tcpi_sacked = htonl(v->tcpi_sacked);
+	r.tcpi_lost = htonl(v->tcpi_lost);
+	r.tcpi_retrans = htonl(v->tcpi_retrans);
+	r.tcpi_retransmits = htonl(v->tcpi_retransmits);
+	r.tcpi_fackets = htonl(v->tcpi_fackets);
+	r.tcpi_reordering = htonl(v->tcpi_reordering);
+	r.tcpi_backoff = htonl(v->tcpi_backoff);
+	r.tcpi_ca_state = htonl(v->tcpi_ca_state);
+	r.tcpi_snd_mss = htonl(v->tcpi_snd_mss);
+	put_f64(r.tcpi_rtt, v->tcpi_rtt);
+	put_f64(r.tcpi_rttvar, v->tcpi_rttvar);
+	put_f64(r.tcpi_rto, v->tcpi_rto);
+	r.pmtu = htonl(v->pmtu);
+	r.blocks_corrupted = htonl(v->blocks_corrupted);
+	put_u64(r.bytes_corrupted, v->bytes_corrupted);
+	r.pcap_packets = htonl(v->pcap_packets);
+	r.pcap_drops = htonl(v->pcap_drops);
+	r.pcap_ring_drops = htonl(v->pcap_ring_drops);
+	r.wire_retransmits = htonl(v->wire_retransmits);
+	r.wire_reordered = htonl(v->wire_reordered);
+	put_f64(r.wire_rtt[0], v->wire_rtt_min);
+	put_f64(r.wire_rtt[1], v->wire_rtt_avg);
+	put_f64(r.wire_rtt[2], v->wire_rtt_max);
+	put_u64(r.wire_acked, v->wire_acked);
+	r.wire_flight = htonl(v->wire_flight);
+
+	memcpy(buffer + buffer_len, &r, sizeof(r));
+	buffer_len += sizeof(r);
+}
+
+/** Average of @p count samples summing up to @p sum, NaN if none. */
+static inline double average(double sum, unsigned count)
+{
+	return count ? sum / count : NAN;
+}
+
+enum output_format output_parse_format(const char *name)
+{
+	if (!strcmp(name, "json"))
+		return OUTPUT_JSON;
+	if (!strcmp(name, "csv"))
+		return OUTPUT_CSV;
+	if (!strcmp(name, "binary"))
+		return OUTPUT_BINARY;
+	return OUTPUT_NONE;
+}
+
+void output_open(enum output_format output_format, int fd)
+{
+	format = output_format;
+	output_fd = fd;
+	buffer_len = 0;
+
+	switch (format) {
+	case OUTPUT_CSV:
+		put_str("type,flow_id,endpoint,group");
+		for (unsigned i = 0; i < NUM_FIELDS; i++) {
+			put_char(',');
+			put_str(fields[i].name);
+		}
+		put_char('\n');
+		break;
+	case OUTPUT_BINARY:
+		{
+			struct output_header header = {
+				.magic = htonl(OUTPUT_MAGIC),
+				.version = htonl(OUTPUT_VERSION),
+				.record_size = htonl(sizeof(struct output_record)),
+			};
+			memcpy(buffer, &header, sizeof(header));
+			buffer_len = sizeof(header);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void output_report(int flow_id, const char *group, enum endpoint_t e,
+		   double begin, double end, const struct report *report)
+{
+	if (format == OUTPUT_NONE)
+		return;
+
+	const struct fg_tcp_info *tcp_info = &report->tcp_info;
+	const struct output_values values = {
+		.begin = begin,
+		.end = end,
+		.bytes_written = report->bytes_written,
+		.bytes_read = report->bytes_read,
+		.request_blocks_written = report->request_blocks_written,
+		.request_blocks_read = report->request_blocks_read,
+		.response_blocks_written = report->response_blocks_written,
+		.response_blocks_read = report->response_blocks_read,
+		.rtt_min = report->response_blocks_read ? report->rtt_min : NAN,
+		.rtt_avg = average(report->rtt_sum,
+				   report->response_blocks_read),
+		.rtt_max = report->response_blocks_read ? report->rtt_max : NAN,
+		.iat_min = report->request_blocks_read ? report->iat_min : NAN,
+		.iat_avg = average(report->iat_sum, report->request_blocks_read),
+		.iat_max = report->request_blocks_read ? report->iat_max : NAN,
+		.delay_min = report->request_blocks_read ? report->delay_min
+							 : NAN,
+		.delay_avg = average(report->delay_sum,
+				     report->request_blocks_read),
+		.delay_max = report->request_blocks_read ? report->delay_max
+							 : NAN,
+		.drift_min = report->request_blocks_written ? report->drift_min
+							    : NAN,
+		.drift_avg = average(report->drift_sum,
+				     report->request_blocks_written),
+		.drift_max = report->request_blocks_written ? report->drift_max
+							    : NAN,
+		.conns_completed = report->conns_completed,
+		.conns_failed = report->conns_failed,
+		.conns_dropped = report->conns_dropped,
+		.fct_p50 = report->conns_completed ? report->fct_p50 : NAN,
+		.fct_p90 = report->conns_completed ? report->fct_p90 : NAN,
+		.fct_p99 = report->conns_completed ? report->fct_p99 : NAN,
+		.tcpi_snd_cwnd = tcp_info->tcpi_snd_cwnd,
+		.tcpi_snd_ssthresh = tcp_info->tcpi_snd_ssthresh,
+		.tcpi_unacked = tcp_info->tcpi_unacked,
+		.tcpi_sacked = tcp_info->tcpi_sacked,
+		.tcpi_lost = tcp_info->tcpi_lost,
+		.tcpi_retrans = tcp_info->tcpi_retrans,
+		.tcpi_retransmits = tcp_info->tcpi_retransmits,
+		.tcpi_fackets = tcp_info->tcpi_fackets,
+		.tcpi_reordering = tcp_info->tcpi_reordering,
+		.tcpi_backoff = tcp_info->tcpi_backoff,
+		.tcpi_ca_state = tcp_info->tcpi_ca_state,
+		.tcpi_snd_mss = tcp_info->tcpi_snd_mss,
+		/* the kernel reports microseconds */
+		.tcpi_rtt = tcp_info->tcpi_rtt / 1e6,
+		.tcpi_rttvar = tcp_info->tcpi_rttvar / 1e6,
+		.tcpi_rto = tcp_info->tcpi_rto / 1e6,
+		.pmtu = report->pmtu,
+		.blocks_corrupted = report->blocks_corrupted,
+		.bytes_corrupted = report->bytes_corrupted,
+		.pcap_packets = report->pcap_packets,
+		.pcap_drops = report->pcap_drops,
+		.pcap_ring_drops = report->pcap_ring_drops,
+		.wire_retransmits = report->wire_retransmits,
+		.wire_reordered = report->wire_reordered,
+		.wire_rtt_min = report->wire_rtt_samples ? report->wire_rtt_min
+							 : NAN,
+		.wire_rtt_avg = average(report->wire_rtt_sum,
+					report->wire_rtt_samples),
+		.wire_rtt_max = report->wire_rtt_samples ? report->wire_rtt_max
+							 : NAN,
+		.wire_acked = report->wire_acked,
+		.wire_flight = report->wire_flight,
+	};
+
+	reserve(OUTPUT_MAX_RECORD);
+
+	switch (format) {
+	case OUTPUT_JSON:
+		put_json(flow_id, group, e, report->type, &values);
+		break;
+	case OUTPUT_CSV:
+		put_csv(flow_id, group, e, report->type, &values);
+		break;
+	case OUTPUT_BINARY:
+		put_binary(flow_id, group, e, report->type, &values);
+		break;
+	default:
+		break;
+	}
+}
+
+void output_flush(void)
+{
+	if (format == OUTPUT_NONE || !buffer_len)
+		return;
+
+	if (write_all(output_fd, buffer, buffer_len) == -1)
+		crit("could not write machine-readable output");
+	buffer_len = 0;
+}
+
+void output_close(void)
+{
+	if (format == OUTPUT_NONE)
+		return;
+
+	output_flush();
+	if (output_fd != STDOUT_FILENO && close(output_fd) == -1)
+		crit("could not close machine-readable output");
+	format = OUTPUT_NONE;
+	output_fd = -1;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file fg_output.h
+ * @brief Machine-readable output of the Flowgrind controller
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_OUTPUT_H_
+#define _FG_OUTPUT_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+
+#include "common.h"
+
+/** Magic number at the beginning of a binary output stream ("FGOR"). */
+#define OUTPUT_MAGIC 0x46474f52
+/** Version of the binary output format. */
+#define OUTPUT_VERSION 1
+/** Size of the output buffer. Records are written once it is full. */
+#define OUTPUT_BUFFER_SIZE 65536
+/** Maximal length of a group name in a binary record, including the NUL. */
+#define OUTPUT_GROUP_LEN 24
+
+/** Formats of the machine-readable output. */
+enum output_format {
+	/** No machine-readable output. */
+	OUTPUT_NONE = 0,
+	/** One JSON object per line. */
+	OUTPUT_JSON,
+	/** Comma-separated values with a header line. */
+	OUTPUT_CSV,
+	/** Fixed-size binary records, see struct output_record. */
+	OUTPUT_BINARY,
+};
+
+/**
+ * Header of a binary output stream. All fields are in network byte order.
+ *
+ * The header is followed by records until the end of the stream.
+ */
+struct output_header {
+	/** Always OUTPUT_MAGIC. */
+	uint32_t magic;
+	/** Always OUTPUT_VERSION. */
+	uint32_t version;
+	/** Size of a record in bytes. */
+	uint32_t record_size;
+};
+
+/**
+ * One report in a binary output stream.
+ *
+ * All integers are in network byte order. 64 bit values are split into a
+ * high and a low half, doubles are stored as their IEEE 754 bit pattern.
+ * Times are in seconds, a time is NaN if there is no sample.
+ */
+struct output_record {
+	/** Report type (INTERVAL or FINAL). */
+	uint32_t type;
+	/** Flow ID, -1 for an aggregation group. */
+	int32_t flow_id;
+	/** Flow endpoint (SOURCE or DESTINATION). */
+	uint32_t endpoint;
+	/** Name of the aggregation group, empty for a flow. */
+	char group[OUTPUT_GROUP_LEN];
+	/** Begin and end of the report since the start of the test. */
+	uint32_t begin[2];
+	uint32_t end[2];
+	/** Bytes written and read. */
+	uint32_t bytes_written[2];
+	uint32_t bytes_read[2];
+	/** Request and response blocks written and read. */
+	uint32_t request_blocks_written;
+	uint32_t request_blocks_read;
+	uint32_t response_blocks_written;
+	uint32_t response_blocks_read;
+	/** Minimum, average and maximum of RTT, IAT, delay and drift. */
+	uint32_t rtt[3][2];
+	uint32_t iat[3][2];
+	uint32_t delay[3][2];
+	uint32_t drift[3][2];
+	/** Churn connections completed, failed and dropped. */
+	uint32_t conns_completed;
+	uint32_t conns_failed;
+	uint32_t conns_dropped;
+	/** 50th, 90th and 99th percentile of the flow completion time. */
+	uint32_t fct[3][2];
+	/** Kernel metrics, see struct fg_tcp_info. */
+	uint32_t tcpi_snd_cwnd;
+	uint32_t tcpi_snd_ssthresh;
+	uint32_t tcpi_unacked;
+	uint32_t tcpi_sacked;
+	uint32_t tcpi_lost;
+	uint32_t tcpi_retrans;
+	uint32_t tcpi_retransmits;
+	uint32_t tcpi_fackets;
+	uint32_t tcpi_reordering;
+	uint32_t tcpi_backoff;
+	uint32_t tcpi_ca_state;
+	uint32_t tcpi_snd_mss;
+	/** Kernel RTT, RTT variance and RTO. */
+	uint32_t tcpi_rtt[2];
+	uint32_t tcpi_rttvar[2];
+	uint32_t tcpi_rto[2];
+	/** Path MTU. */
+	uint32_t pmtu;
+	/** Corrupted blocks and mismatched bytes of option -E. */
+	uint32_t blocks_corrupted;
+	uint32_t bytes_corrupted[2];
+	/** Dumped and dropped packets of the capture of option -M, packets
+	 * dropped on the interface. */
+	uint32_t pcap_packets;
+	uint32_t pcap_drops;
+	uint32_t pcap_ring_drops;
+	/** Retransmitted and reordered segments, minimum, average and maximum
+	 * RTT, acknowledged bytes and bytes in flight derived from the
+	 * capture of option -M. */
+	uint32_t wire_retransmits;
+	uint32_t wire_reordered;
+	uint32_t wire_rtt[3][2];
+	uint32_t wire_acked[2];
+	uint32_t wire_flight;
+};
+
+/**
+ * Parse the name of an output format.
+ *
+ * @param[in] name 'json', 'csv' or 'binary'
+ * @return output format, OUTPUT_NONE if @p name is unknown
+ */
+enum output_format output_parse_format(const char *name);
+
+/**
+ * Start the machine-readable output in format @p format to file descriptor
+ * @p fd, and write the CSV header or binary header.
+ */
+void output_open(enum output_format format, int fd);
+
+/**
+ * Append report @p report to the output.
+ *
+ * No memory is allocated. The record is buffered until the buffer is full
+ * or output_flush() is called.
+ *
+ * @param[in] flow_id flow ID, -1 for an aggregation group
+ * @param[in] group name of the aggregation group, NULL for a flow
+ * @param[in] e flow endpoint (SOURCE or DESTINATION)
+ * @param[in] begin begin of the report in seconds since the test start
+ * @param[in] end end of the report in seconds since the test start
+ * @param[in] report report to be written
+ */
+void output_report(int flow_id, const char *group, enum endpoint_t e,
+		   double begin, double end, const struct report *report);
+
+/** Write all buffered records. */
+void output_flush(void);
+
+/** Write all buffered records and close the file descriptor. */
+void output_close(void);
+
+#endif /* _FG_OUTPUT_H_ */
@@ -29,6 +29,7 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -43,43 +44,144 @@
 #include <time.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pcap.h>
-#include <netdb.h>
 
 #include "debug.h"
+#include "fg_definitions.h"
+#include "fg_dump_writer.h"
 #include "fg_socket.h"
 #include "fg_time.h"
 #include "fg_string.h"
 #include "fg_log.h"
+#include "fg_pcap_ring.h"
+#include "fg_tcp_analyzer.h"
 #include "daemon.h"
 #include "fg_pcap.h"
 
-/* OS X hasn't defined pthread_barrier */
-#ifndef HAVE_PTHREAD_BARRIER
-#include "fg_barrier.h"
-#endif
-
-/* PCAP snapshot length */
-#define PCAP_SNAPLEN 130
+/*
+ * PCAP snapshot length, enough for the headers of a TCP segment with all
+ * options behind an Ethernet header with a VLAN tag and an IPv4 header with
+ * all options. Only the headers are written to the dump files.
+ */
+#define PCAP_SNAPLEN (18 + 60 + 60)
 
-/* PCAP filter string */
+/* PCAP filter string if the flows cannot be filtered one by one */
 #define PCAP_FILTER "tcp"
 
-/* Flag whether to use promiscuous mode */
-#define PCAP_PROMISC 0
+/* Up to this many flows on an interface are filtered by the kernel one by
+ * one, the filter of more flows would exceed the size limit of BPF */
+#define PCAP_FILTER_MAX_FLOWS 32
+
+/* Number of hash buckets of the flows of an interface, a power of two */
+#define PCAP_TAP_BUCKETS 256
+
+/* Interval in which packets not yet written are passed to the writer, in ms */
+#define PCAP_FLUSH_INTERVAL 1000
+
+/** Connection of a flow as seen on the wire. */
+struct pcap_tuple {
+	/** Address family, AF_INET or AF_INET6. */
+	int family;
+	/** Source and destination address. @{ */
+	uint8_t src[16];
+	uint8_t dst[16];                                        /** @} */
+	/** Source and destination port in network byte order. @{ */
+	uint16_t sport;
+	uint16_t dport;                                         /** @} */
+};
+
+/** Capture of a flow on its interface. */
+struct pcap_tap {
+	/** Flow ID of the controller, written as packet comment. */
+	char comment[32];
+	/** Connection of the flow, source is the local endpoint. */
+	struct pcap_tuple tuple;
+	/** Flow ID of the controller, used in the name of the dump file. */
+	int flow_id;
+	/** Whether the flow is dumped into the dump of the interface. */
+	bool merge;
+	/** Name of the interface the flow is captured on. */
+	const char *ifname;
+	/** Own dump file of the flow, NULL if the dump of the interface is
+	 * used. */
+	struct dump_file *dump;
+	/** Interface the flow is captured on, NULL until the capture thread
+	 * picked up the flow or if it failed to. */
+	struct pcap_iface *iface;
+	/** Whether the flow stopped, the capture thread releases the tap. */
+	bool stopped;
+	/** Packets of the flow written to its dump. */
+	uint64_t packets;
+	/** Packets of the flow dropped by the writer. */
+	uint64_t drops;
+	/** Packets dropped by the kernel on the interface since the flow
+	 * joined, of any flow on the interface. */
+	uint64_t ring_drops;
+	/** Packets dropped by the kernel on the interface before the flow
+	 * joined. */
+	uint64_t ring_drops_base;
+	/** Analysis of the segments of the flow, only used by the capture
+	 * thread. */
+	struct tcp_analyzer analyzer;
+	/** Protects the published wire metrics. */
+	pthread_mutex_t wire_lock;
+	/** Wire metrics of the flow since its last interval report and since
+	 * it joined, indexed by the type of the report. */
+	struct tcp_wire_stats wire[2];
+	/** Next tap in the same hash bucket or list. */
+	struct pcap_tap *next;
+};
+
+/** Capture of a network interface, shared by all flows using it. */
+struct pcap_iface {
+	/** Name of the interface. */
+	char *name;
+	/** Capture ring of the interface. */
+	struct pcap_ring *ring;
+	/** Merged dump file of the flows option --dump-merge was given for,
+	 * NULL until needed. */
+	struct dump_file *dump;
+	/** Flows on the interface, hashed by their ports. */
+	struct pcap_tap *taps[PCAP_TAP_BUCKETS];
+	/** Number of flows on the interface, closed once zero. */
+	unsigned num_taps;
+	/** Whether the flows changed and the filter is outdated. */
+	bool filter_outdated;
+	/** Whether the link type was logged as not supported. */
+	bool linktype_logged;
+	/** Next captured interface. */
+	struct pcap_iface *next;
+};
 
 /* Error message buffer filled by the pcap library in case of an error */
 static char errbuf[PCAP_ERRBUF_SIZE] = "";
 
-/* Barrier to block fg_pcap_go() until worker thread reaches its main loop */
-static pthread_barrier_t pcap_barrier;
-
 /* Pointer to the first element in a list containing all 'pcapable' devices */
 static pcap_if_t *alldevs;
 
-/* Flag if traffic is currently dumped */
-static bool dumping;
+/** Protects the flows handed to the capture thread. */
+static pthread_mutex_t pcap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Flows handed to the capture thread, not yet picked up. */
+static struct pcap_tap *new_taps;
+
+/** Captured interfaces, only used by the capture thread. */
+static struct pcap_iface *ifaces;
+
+/** Flows the capture thread failed to pick up, released once stopped. */
+static struct pcap_tap *failed_taps;
+
+/** Whether the capture and writer thread are running. */
+static bool capture_started;
+
+/** Capture thread reading the rings of all interfaces. */
+static pthread_t capture_thread;
+
+/** Pipe to wake up the capture thread if flows are handed over or stop. */
+static int wakeup_pipe[2] = {-1, -1};
 
 int fg_pcap_init(void)
 {
@@ -110,137 +212,472 @@ int fg_pcap_init(void)
 	}
 #endif /* DEBUG*/
 
-	pthread_barrier_init(&pcap_barrier, NULL, 2);
 	return 0;
 }
 
+/** Wake up the capture thread to pick up changed interfaces. */
+static void wakeup_capture(void)
+{
+	const char c = 0;
+
+	if (write(wakeup_pipe[1], &c, 1) == -1 && errno != EAGAIN)
+		logging(LOG_WARNING, "pcap: failed to wake up capture thread: "
+			"%s", strerror(errno));
+}
+
+/** Hash bucket of the flow with ports @p sport and @p dport, the same for
+ * both directions. */
+static inline unsigned tap_bucket(uint16_t sport, uint16_t dport)
+{
+	return (ntohs(sport) ^ ntohs(dport)) & (PCAP_TAP_BUCKETS - 1);
+}
+
 /**
- * Cleanup method to be called after dumping of the specified flow has finished.
+ * Parse the headers of packet @p pkt of link type @p linktype.
  *
- * It closes the handle to the savefile and the handle to the device whose
- * traffic was captured.
+ * Fragments, IPv6 extension headers and other protocols than TCP are not
+ * parsed.
  *
- * @param[in] arg pointer to the flow whose dumping finished
+ * @param[out] tuple connection of the packet
+ * @param[out] seg TCP header of the packet, except its direction
+ * @param[out] headers length of the link, IP and TCP header
+ * @return true if the packet is a TCP segment, false otherwise
  */
-void fg_pcap_cleanup(void *arg)
+static bool parse_packet(const struct pcap_packet *pkt, int linktype,
+			 struct pcap_tuple *tuple, struct tcp_segment *seg,
+			 unsigned *headers)
+{
+	const unsigned char *data = pkt->data;
+	unsigned offset, l4, tcp_len;
+	unsigned ethertype;
+	uint32_t n;
+
+	switch (linktype) {
+	case LINKTYPE_ETHERNET:
+		if (pkt->caplen < 14)
+			return false;
+		ethertype = data[12] << 8 | data[13];
+		offset = 14;
+		/* VLAN tags */
+		while ((ethertype == 0x8100 || ethertype == 0x88a8) &&
+		       pkt->caplen >= offset + 4) {
+			ethertype = data[offset + 2] << 8 | data[offset + 3];
+			offset += 4;
+		}
+		break;
+	case LINKTYPE_NULL:
+	case LINKTYPE_RAW:
+		offset = linktype == LINKTYPE_NULL ? 4 : 0;
+		if (pkt->caplen < offset + 1)
+			return false;
+		ethertype = (data[offset] >> 4) == 4 ? 0x0800 :
+			    (data[offset] >> 4) == 6 ? 0x86dd : 0;
+		break;
+	default:
+		return false;
+	}
+
+	if (ethertype == 0x0800) {
+		if (pkt->caplen < offset + 20 || data[offset + 9] != IPPROTO_TCP)
+			return false;
+		/* only the first fragment has the TCP header */
+		if (((data[offset + 6] & 0x1f) << 8 | data[offset + 7]) != 0)
+			return false;
+		tuple->family = AF_INET;
+		memset(tuple->src, 0, sizeof(tuple->src));
+		memset(tuple->dst, 0, sizeof(tuple->dst));
+		memcpy(tuple->src, data + offset + 12, 4);
+		memcpy(tuple->dst, data + offset + 16, 4);
+		l4 = offset + (data[offset] & 0x0f) * 4;
+		/* total length, the payload is not captured */
+		tcp_len = data[offset + 2] << 8 | data[offset + 3];
+		tcp_len -= MIN(tcp_len, l4 - offset);
+	} else if (ethertype == 0x86dd) {
+		if (pkt->caplen < offset + 40 || data[offset + 6] != IPPROTO_TCP)
+			return false;
+		tuple->family = AF_INET6;
+		memcpy(tuple->src, data + offset + 8, 16);
+		memcpy(tuple->dst, data + offset + 24, 16);
+		l4 = offset + 40;
+		/* payload length */
+		tcp_len = data[offset + 4] << 8 | data[offset + 5];
+	} else {
+		return false;
+	}
+
+	if (pkt->caplen < l4 + 20)
+		return false;
+	memcpy(&tuple->sport, data + l4, 2);
+	memcpy(&tuple->dport, data + l4 + 2, 2);
+	*headers = l4 + (data[l4 + 12] >> 4) * 4;
+
+	seg->ts = pkt->ts;
+	memcpy(&n, data + l4 + 4, 4);
+	seg->seq = ntohl(n);
+	memcpy(&n, data + l4 + 8, 4);
+	seg->ack = ntohl(n);
+	seg->flags = data[l4 + 13];
+	seg->len = tcp_len - MIN(tcp_len, *headers - l4);
+
+	return true;
+}
+
+/** Whether the flow of @p tap stopped. */
+static inline bool tap_stopped(const struct pcap_tap *tap)
 {
-	/* signature of pthread_create() requires that all arguments must be
-	 * passed by reference and cast to (void *) */
-	struct flow *flow = (struct flow *) arg;
+	return __atomic_load_n(&tap->stopped, __ATOMIC_ACQUIRE);
+}
+
+/** Whether the packet with connection @p t belongs to the flow of @p tap,
+ * in either direction. */
+static inline bool tap_matches(const struct pcap_tap *tap,
+			       const struct pcap_tuple *t)
+{
+	const struct pcap_tuple *c = &tap->tuple;
+
+	if (c->family != t->family)
+		return false;
+
+	return (c->sport == t->sport && c->dport == t->dport &&
+		!memcmp(c->src, t->src, 16) && !memcmp(c->dst, t->dst, 16)) ||
+	       (c->sport == t->dport && c->dport == t->sport &&
+		!memcmp(c->src, t->dst, 16) && !memcmp(c->dst, t->src, 16));
+}
+
+/** Write the headers @p headers of a packet to the dump of @p tap. */
+static void tap_packet(struct pcap_tap *tap, const struct pcap_packet *headers)
+{
+	bool written;
+
+	if (tap->dump)
+		written = dump_file_write(tap->dump, headers, NULL);
+	else
+		written = dump_file_write(tap->iface->dump, headers,
+					  tap->comment);
+
+	if (written)
+		__atomic_store_n(&tap->packets, tap->packets + 1,
+				 __ATOMIC_RELAXED);
+	else
+		__atomic_store_n(&tap->drops, tap->drops + 1,
+				 __ATOMIC_RELAXED);
+}
 
-	if (!dumping)
+/** Analyze segment @p seg with connection @p t of the flow of @p tap. */
+static inline void tap_segment(struct pcap_tap *tap, const struct pcap_tuple *t,
+			       struct tcp_segment *seg)
+{
+	seg->outgoing = t->sport == tap->tuple.sport &&
+			!memcmp(t->src, tap->tuple.src, 16);
+	tcp_analyzer_segment(&tap->analyzer, seg);
+}
+
+/** Packet handler of the capture thread, writes the headers of packet
+ * @p pkt to the dump of its flow on interface @p arg and analyzes them. */
+static void capture_packet(void *arg, const struct pcap_packet *pkt)
+{
+	struct pcap_iface *iface = arg;
+	struct pcap_packet headers = *pkt;
+	struct pcap_tuple tuple;
+	struct tcp_segment seg;
+
+	if (!parse_packet(pkt, pcap_ring_linktype(iface->ring), &tuple, &seg,
+			  &headers.caplen)) {
+		if (!iface->linktype_logged &&
+		    pcap_ring_linktype(iface->ring) != LINKTYPE_ETHERNET &&
+		    pcap_ring_linktype(iface->ring) != LINKTYPE_RAW &&
+		    pcap_ring_linktype(iface->ring) != LINKTYPE_NULL) {
+			logging(LOG_WARNING, "pcap: link type %d of %s not "
+				"supported", pcap_ring_linktype(iface->ring),
+				iface->name);
+			iface->linktype_logged = true;
+		}
 		return;
+	}
 
-	DEBUG_MSG(LOG_DEBUG, "fg_pcap_cleanup() called for flow %d", flow->id);
-	if (flow->pcap_dumper)
-		pcap_dump_close((pcap_dumper_t *)flow->pcap_dumper);
-	flow->pcap_dumper = NULL;
+	/* headers only */
+	if (headers.caplen > pkt->caplen)
+		headers.caplen = pkt->caplen;
 
-	if (flow->pcap_handle)
-		pcap_close((pcap_t *)flow->pcap_handle);
-	flow->pcap_handle = NULL;
-	dumping = false;
+	/* packets of other connections pass the filter of the interface if
+	 * it has too many flows. Both endpoints of a flow may be on the same
+	 * interface, so a packet may belong to two flows. */
+	for (struct pcap_tap *tap =
+	     iface->taps[tap_bucket(tuple.sport, tuple.dport)];
+	     tap; tap = tap->next) {
+		if (tap_stopped(tap) || !tap_matches(tap, &tuple))
+			continue;
+		tap_packet(tap, &headers);
+		tap_segment(tap, &tuple, &seg);
+	}
 }
 
 /**
- * Worker method performing actual packet capturing for the provided flow.
- *
- * It prepares the flow for packet capturing by figuring out the correct
- * device, constructing the pcap filter, etc. and finally starts capturing.
- * Synchronizes with fg_pcap_go() after initialization before starting
- * capturing.
+ * Update the filter of interface @p iface to its flows.
  *
- * @param[in] arg pointer to the flow whose traffic should be captured
+ * Up to PCAP_FILTER_MAX_FLOWS flows are filtered by the kernel one by one,
+ * otherwise all TCP segments are captured and the packets of other
+ * connections are dropped by the capture thread.
  */
-static void* fg_pcap_work(void *arg)
+static void update_filter(struct pcap_iface *iface)
 {
-	/* note: all the wierd casts in this function are completely useless,
-	 * execpt they cirumvent strange compiler warnings because of libpcap
-	 * typedef woo's */
+	char *filter = NULL;
+	unsigned n = 0;
 
-	/* signature of pthread_create() requires that all arguments must be
-	 * passed by reference and cast to (void *) */
-	struct flow *flow = (struct flow *) arg;
+	iface->filter_outdated = false;
+	if (iface->num_taps > PCAP_FILTER_MAX_FLOWS)
+		goto fallback;
 
-	DEBUG_MSG(LOG_DEBUG, "fg_pcap_thread() called for flow %d", flow->id);
+	for (unsigned i = 0; i < PCAP_TAP_BUCKETS; i++) {
+		for (struct pcap_tap *tap = iface->taps[i]; tap;
+		     tap = tap->next) {
+			const struct pcap_tuple *t = &tap->tuple;
+			char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
 
-	/* make sure all resources are released when finished */
-	pthread_cleanup_push(fg_pcap_cleanup, (void*) flow);
+			if (tap_stopped(tap))
+				continue;
+			inet_ntop(t->family, t->src, src, sizeof(src));
+			inet_ntop(t->family, t->dst, dst, sizeof(dst));
+			asprintf_append(&filter, "%s(src host %s and src port %u "
+					"and dst host %s and dst port %u) or "
+					"(src host %s and src port %u and "
+					"dst host %s and dst port %u)",
+					n++ ? " or " : "tcp and (",
+					src, ntohs(t->sport), dst,
+					ntohs(t->dport), dst, ntohs(t->dport),
+					src, ntohs(t->sport));
+		}
+	}
+	if (!filter)
+		return;
+	asprintf_append(&filter, ")");
 
-	struct addrinfo *ainf = NULL;
-	int rc = getaddrinfo(flow->settings.bind_address, NULL, NULL, &ainf);
-	if (rc) {
-		logging(LOG_WARNING, "getaddrinfo() failed (%s). Eliding "
-			"packet capture for flow", gai_strerror(rc));
-		goto remove;
+	if (pcap_ring_set_filter(iface->ring, filter) == 0) {
+		DEBUG_MSG(LOG_NOTICE, "pcap: filtering %u flows on %s", n,
+			  iface->name);
+		free(filter);
+		return;
 	}
+	free(filter);
 
-	/* find appropriate (used for test) interface to dump */
-	bool found = false;
-	pcap_if_t *d = NULL;
-	for (d = alldevs; d; d = d->next) {
-		for (pcap_addr_t *a = d->addresses; a; a = a->next) {
-			if (!a->addr)
+fallback:
+	DEBUG_MSG(LOG_NOTICE, "pcap: filtering all TCP segments on %s",
+		  iface->name);
+	if (pcap_ring_set_filter(iface->ring, PCAP_FILTER) == -1)
+		logging(LOG_WARNING, "pcap: failed to set filter of %s",
+			iface->name);
+}
+
+/** Release the tap of a flow which stopped. */
+static void close_tap(struct pcap_tap *tap)
+{
+	DEBUG_MSG(LOG_NOTICE, "pcap: stopped capturing %s on %s (%llu "
+		  "packets, %llu dropped, %llu dropped on the interface)",
+		  tap->comment, tap->ifname, (unsigned long long)tap->packets,
+		  (unsigned long long)tap->drops,
+		  (unsigned long long)tap->ring_drops);
+
+	if (tap->dump)
+		dump_file_close(tap->dump);
+	pthread_mutex_destroy(&tap->wire_lock);
+	free(tap);
+}
+
+/** Publish the wire metrics of the segments of @p tap analyzed since the
+ * last call for the reports of its flow. */
+static void publish_wire_stats(struct pcap_tap *tap)
+{
+	struct tcp_wire_stats stats;
+
+	tcp_analyzer_collect(&tap->analyzer, &stats);
+
+	pthread_mutex_lock(&tap->wire_lock);
+	foreach(int *i, INTERVAL, FINAL)
+		tcp_wire_stats_add(&tap->wire[*i], &stats);
+	pthread_mutex_unlock(&tap->wire_lock);
+}
+
+/** Release interface @p iface no flow captures on anymore. */
+static void close_iface(struct pcap_iface *iface)
+{
+	DEBUG_MSG(LOG_NOTICE, "pcap: stopped capturing on %s", iface->name);
+
+	pcap_ring_close(iface->ring);
+	if (iface->dump)
+		dump_file_close(iface->dump);
+	free(iface->name);
+	free(iface);
+}
+
+/**
+ * Update the drop counters and wire metrics of the flows on @p iface,
+ * release the stopped flows and update the filter if the flows changed.
+ *
+ * @return number of flows left on the interface
+ */
+static unsigned update_taps(struct pcap_iface *iface, bool flush)
+{
+	const uint64_t ring_drops = pcap_ring_drops(iface->ring);
+
+	for (unsigned i = 0; i < PCAP_TAP_BUCKETS; i++) {
+		for (struct pcap_tap **link = &iface->taps[i]; *link;) {
+			struct pcap_tap *tap = *link;
+
+			__atomic_store_n(&tap->ring_drops, ring_drops -
+					 tap->ring_drops_base, __ATOMIC_RELAXED);
+			publish_wire_stats(tap);
+			if (tap_stopped(tap)) {
+				*link = tap->next;
+				iface->num_taps--;
+				iface->filter_outdated = true;
+				close_tap(tap);
 				continue;
-			if (sockaddr_compare(a->addr, ainf->ai_addr)) {
-				DEBUG_MSG(LOG_NOTICE, "pcap: data connection "
-					  "inbound from %s (%s)", d->name,
-					  fg_nameinfo(a->addr,
-						      sizeof(struct sockaddr)));
-				found = true;
-				break;
 			}
+			if (flush && tap->dump)
+				dump_file_flush(tap->dump);
+			link = &tap->next;
 		}
-		if (found)
-			break;
 	}
 
-	if (!found) {
-		logging(LOG_WARNING, "failed to determine interface for data "
-			"connection. No pcap support");
-		goto remove;
+	if (flush && iface->dump)
+		dump_file_flush(iface->dump);
+	if (iface->filter_outdated && iface->num_taps)
+		update_filter(iface);
+
+	return iface->num_taps;
+}
+
+/**
+ * Convert socket address @p sa into address @p addr and port @p port as
+ * seen on the wire. IPv4-mapped IPv6 addresses are converted to IPv4.
+ *
+ * @return address family, or -1 if not an IP address
+ */
+static int wire_address(const struct sockaddr_storage *sa, uint8_t addr[16],
+			uint16_t *port)
+{
+	memset(addr, 0, 16);
+
+	if (sa->ss_family == AF_INET) {
+		const struct sockaddr_in *in = (const struct sockaddr_in *)sa;
+
+		memcpy(addr, &in->sin_addr, 4);
+		*port = in->sin_port;
+		return AF_INET;
 	}
+	if (sa->ss_family == AF_INET6) {
+		const struct sockaddr_in6 *in6 =
+			(const struct sockaddr_in6 *)sa;
 
-	flow->pcap_handle = (struct pcap_t *)pcap_open_live(
-				d->name, PCAP_SNAPLEN, PCAP_PROMISC,
-				0, errbuf); /* 0 = no read timeout */
+		*port = in6->sin6_port;
+		if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)) {
+			memcpy(addr, in6->sin6_addr.s6_addr + 12, 4);
+			return AF_INET;
+		}
+		memcpy(addr, &in6->sin6_addr, 16);
+		return AF_INET6;
+	}
 
-	if (!flow->pcap_handle) {
-		logging(LOG_WARNING, "failed to init pcap on device %s: %s",
-			d->name, errbuf);
-		goto remove;
+	return -1;
+}
+
+/**
+ * Determine the connection of the test socket of @p flow.
+ *
+ * A source which is still connecting has no peer yet, its peer is the
+ * address it connects to.
+ *
+ * @return true on success, false on failure, which is logged
+ */
+static bool flow_tuple(struct flow *flow, struct pcap_tuple *tuple)
+{
+	struct sockaddr_storage local, remote;
+	socklen_t len = sizeof(local);
+	int remote_family;
+
+	if (getsockname(flow->fd, (struct sockaddr *)&local, &len) == -1) {
+		logging(LOG_WARNING, "pcap: getsockname() failed: %s",
+			strerror(errno));
+		return false;
 	}
 
-	uint32_t net = 0, mask = 0;
-	if (pcap_lookupnet(d->name, &net, &mask, errbuf) < 0) {
-		logging(LOG_WARNING, "pcap: netmask lookup failed: %s", errbuf);
-		goto remove;
+	len = sizeof(remote);
+	if (getpeername(flow->fd, (struct sockaddr *)&remote, &len) == -1) {
+		if (!flow->meta->addr) {
+			logging(LOG_WARNING, "pcap: getpeername() failed: %s",
+				strerror(errno));
+			return false;
+		}
+		memset(&remote, 0, sizeof(remote));
+		memcpy(&remote, flow->meta->addr,
+		       MIN(flow->meta->addr_len, sizeof(remote)));
 	}
 
-	/* we rely on a non-blocking dispatch loop */
-	if (pcap_setnonblock((pcap_t *)flow->pcap_handle, 1, errbuf) < 0) {
-		logging(LOG_WARNING, "pcap: failed to set non-blocking: %s",
-			errbuf);
-		goto remove;
+	tuple->family = wire_address(&local, tuple->src, &tuple->sport);
+	remote_family = wire_address(&remote, tuple->dst, &tuple->dport);
+	if (tuple->family == -1 || tuple->family != remote_family) {
+		logging(LOG_WARNING, "pcap: unsupported address of data "
+			"connection. No pcap support");
+		return false;
 	}
 
-	/* compile filter */
-	struct bpf_program pcap_program;
-	if (pcap_compile((pcap_t *)flow->pcap_handle,
-			 &pcap_program, PCAP_FILTER, 1, mask) < 0) {
-		logging(LOG_WARNING, "pcap: failed compiling filter '%s': %s",
-			PCAP_FILTER, pcap_geterr((pcap_t *)flow->pcap_handle));
-		goto remove;
+	return true;
+}
+
+/**
+ * Find the interface with local address @p tuple.
+ *
+ * @return name of the interface, NULL if not found, which is logged
+ */
+static const char *find_device(const struct pcap_tuple *tuple)
+{
+	struct sockaddr_storage local;
+
+	memset(&local, 0, sizeof(local));
+	if (tuple->family == AF_INET) {
+		struct sockaddr_in *in = (struct sockaddr_in *)&local;
+
+		in->sin_family = AF_INET;
+		memcpy(&in->sin_addr, tuple->src, 4);
+	} else {
+		struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&local;
+
+		in6->sin6_family = AF_INET6;
+		memcpy(&in6->sin6_addr, tuple->src, 16);
 	}
 
-	/* attach filter to interface */
-	if (pcap_setfilter((pcap_t *)flow->pcap_handle,
-			   &pcap_program) < 0) {
-		logging(LOG_WARNING, "pcap: failed to set filter: %s",
-			pcap_geterr((pcap_t *)flow->pcap_handle));
-		goto remove;
+	/* find appropriate (used for test) interface to dump */
+	for (pcap_if_t *d = alldevs; d; d = d->next) {
+		for (pcap_addr_t *a = d->addresses; a; a = a->next) {
+			if (!a->addr)
+				continue;
+			if (sockaddr_compare(a->addr,
+					     (struct sockaddr *)&local)) {
+				DEBUG_MSG(LOG_NOTICE, "pcap: data connection "
+					  "inbound from %s (%s)", d->name,
+					  fg_nameinfo(a->addr,
+						      sizeof(struct sockaddr)));
+				return d->name;
+			}
+		}
 	}
 
+	logging(LOG_WARNING, "failed to determine interface for data "
+		"connection. No pcap support");
+	return NULL;
+}
+
+/**
+ * Create a dump file on interface @p ifname, for flow @p flow_id if not
+ * negative.
+ *
+ * @return the dump file, NULL on failure, which is logged
+ */
+static struct dump_file *open_dump(const char *ifname, int flow_id,
+				   const struct pcap_ring *ring)
+{
+	struct dump_file *dump;
+
 	/* generate a nice filename */
 	char *dump_filename = NULL;
 
@@ -260,79 +697,352 @@ static void* fg_pcap_work(void *arg)
 	if (!gethostname(hostname, sizeof(hostname)))
 		asprintf_append(&dump_filename, "-%s", hostname);
 
-	/* interface and suffix */
-	asprintf_append(&dump_filename, "-%s.pcap", d->name);
-
-	DEBUG_MSG(LOG_NOTICE, "dumping to \"%s\"", dump_filename);
+	/* interface, flow and suffix */
+	if (flow_id < 0)
+		asprintf_append(&dump_filename, "-%s.pcapng", ifname);
+	else
+		asprintf_append(&dump_filename, "-%s-flow%d.pcap", ifname,
+				flow_id);
 
-	flow->pcap_dumper = (struct pcap_dumper_t *)pcap_dump_open(
-				(pcap_t *)flow->pcap_handle, dump_filename);
+	dump = dump_file_open(dump_filename,
+			      flow_id < 0 ? DUMP_PCAPNG : DUMP_PCAP, ifname,
+			      pcap_ring_linktype(ring), PCAP_SNAPLEN);
 	free(dump_filename);
 
-	if (!flow->pcap_dumper) {
-		logging(LOG_WARNING, "pcap: failed to open dump file writing: %s",
-			pcap_geterr((pcap_t *)flow->pcap_handle));
-		goto remove;
+	return dump;
+}
+
+/**
+ * Find or open the capture of interface @p name.
+ *
+ * @return the interface, NULL on failure, which is logged
+ */
+static struct pcap_iface *get_iface(const char *name)
+{
+	struct pcap_iface *iface;
+	unsigned num_ifaces = 0;
+
+	for (iface = ifaces; iface; iface = iface->next) {
+		if (!strcmp(iface->name, name))
+			return iface;
+		num_ifaces++;
+	}
+
+	if (num_ifaces == PCAP_MAX_IFACES) {
+		logging(LOG_WARNING, "pcap: already capturing on %u "
+			"interfaces, not capturing on %s", PCAP_MAX_IFACES,
+			name);
+		return NULL;
+	}
+
+	iface = calloc(1, sizeof(*iface));
+	if (!iface || !(iface->name = strdup(name))) {
+		logging(LOG_ALERT, "could not allocate memory for capture");
+		free(iface);
+		return NULL;
+	}
+
+	/* the capture thread narrows the filter down to the flows */
+	iface->ring = pcap_ring_open(name, PCAP_SNAPLEN);
+	if (!iface->ring ||
+	    pcap_ring_set_filter(iface->ring, PCAP_FILTER) == -1) {
+		pcap_ring_close(iface->ring);
+		free(iface->name);
+		free(iface);
+		return NULL;
 	}
 
-	/* barrier: dump is ready */
-	pthread_barrier_wait(&pcap_barrier);
+	iface->next = ifaces;
+	ifaces = iface;
+	logging(LOG_NOTICE, "pcap: started capturing on %s", name);
+
+	return iface;
+}
+
+/** Release the tap of a flow the capture thread failed to pick up. */
+static void release_failed_tap(struct pcap_tap *tap)
+{
+	pthread_mutex_destroy(&tap->wire_lock);
+	free(tap);
+}
+
+/**
+ * Add the flow of @p tap to the capture of its interface, opening the
+ * capture and the dump file on first use.
+ *
+ * @return true on success, false on failure, which is logged
+ */
+static bool attach_tap(struct pcap_tap *tap)
+{
+	struct pcap_iface *iface = get_iface(tap->ifname);
+
+	if (!iface)
+		return false;
+
+	/* update_taps() closes the interface if it has no flows */
+	if (tap->merge && !iface->dump)
+		iface->dump = open_dump(tap->ifname, -1, iface->ring);
+	else if (!tap->merge)
+		tap->dump = open_dump(tap->ifname, tap->flow_id, iface->ring);
+	if (tap->merge ? !iface->dump : !tap->dump)
+		return false;
+
+	const unsigned bucket = tap_bucket(tap->tuple.sport, tap->tuple.dport);
+	tap->iface = iface;
+	tap->ring_drops_base = pcap_ring_drops(iface->ring);
+	tap->next = iface->taps[bucket];
+	iface->taps[bucket] = tap;
+	iface->num_taps++;
+	iface->filter_outdated = true;
+
+	return true;
+}
+
+/** Pick up the flows handed to the capture thread and release the flows
+ * it failed to pick up once they stopped. */
+static void pick_up_taps(void)
+{
+	struct pcap_tap *tap, *next;
+
+	pthread_mutex_lock(&pcap_mutex);
+	tap = new_taps;
+	new_taps = NULL;
+	pthread_mutex_unlock(&pcap_mutex);
+
+	for (; tap; tap = next) {
+		next = tap->next;
+		if (tap_stopped(tap)) {
+			release_failed_tap(tap);
+		} else if (!attach_tap(tap)) {
+			tap->next = failed_taps;
+			failed_taps = tap;
+		}
+	}
+
+	for (struct pcap_tap **link = &failed_taps; *link;) {
+		tap = *link;
+		if (tap_stopped(tap)) {
+			*link = tap->next;
+			release_failed_tap(tap);
+			continue;
+		}
+		link = &tap->next;
+	}
+}
+
+/**
+ * Main loop of the capture thread.
+ *
+ * Picks up new flows, waits for packets on the rings of all captured
+ * interfaces, hands them to the dump writer and closes interfaces without
+ * flows. The interfaces and their flows are only used by this thread.
+ */
+static void *capture_work(void *arg)
+{
+	struct timespec last_flush;
+
+	UNUSED_ARGUMENT(arg);
+	gettime(&last_flush);
 
 	for (;;) {
-		int rc = pcap_dispatch((pcap_t *)flow->pcap_handle, -1,
-				       &pcap_dump, (u_char *)flow->pcap_dumper);
-
-		if (rc < 0) {
-			logging(LOG_WARNING, "pcap_dispatch() failed. Packet "
-				"dumping stopped for flow %d", flow->id);
-			/* cleanup automatically called */
-			pthread_exit(0);
+		struct pollfd fds[PCAP_MAX_IFACES + 1];
+		struct timespec now;
+		nfds_t nfds = 0;
+		bool flush;
+		char buf[64];
+
+		fds[nfds].fd = wakeup_pipe[0];
+		fds[nfds++].events = POLLIN;
+		for (struct pcap_iface *iface = ifaces; iface;
+		     iface = iface->next) {
+			fds[nfds].fd = pcap_ring_fd(iface->ring);
+			fds[nfds++].events = POLLIN;
+		}
+
+		if (poll(fds, nfds, PCAP_FLUSH_INTERVAL) == -1 &&
+		    errno != EINTR) {
+			logging(LOG_WARNING, "pcap: poll() failed: %s",
+				strerror(errno));
+			continue;
+		}
+		if (fds[0].revents & POLLIN)
+			while (read(wakeup_pipe[0], buf, sizeof(buf)) > 0)
+				;
+		pick_up_taps();
+
+		gettime(&now);
+		flush = time_diff(&last_flush, &now) * 1e3 >= PCAP_FLUSH_INTERVAL;
+		if (flush)
+			last_flush = now;
+
+		/* reading an idle ring only checks the status of its next
+		 * block, so all rings are read on every wakeup. A ring is read
+		 * at most once around per wakeup, so the flows are updated
+		 * even if the packets arrive faster than they are handled. */
+		for (struct pcap_iface **link = &ifaces; *link;) {
+			struct pcap_iface *iface = *link;
+
+			if (pcap_ring_dispatch(iface->ring, capture_packet,
+					       iface) == -1)
+				logging(LOG_WARNING, "pcap: failed to read "
+					"capture ring of %s", iface->name);
+
+			if (!update_taps(iface, flush)) {
+				*link = iface->next;
+				close_iface(iface);
+				continue;
+			}
+			link = &iface->next;
 		}
-#ifdef DEBUG
-		struct pcap_stat p_stats;
-		pcap_stats((pcap_t *)flow->pcap_handle, &p_stats);
-#endif /* DEBUG */
-		DEBUG_MSG(LOG_NOTICE, "pcap: finished dumping %d packets for "
-			  "flow %d", rc, flow->id);
-		DEBUG_MSG(LOG_NOTICE, "pcap: %d packets received by filter for "
-			  "flow %d", p_stats.ps_recv, flow->id);
-		DEBUG_MSG(LOG_NOTICE, "pcap: %d packets dropped by kernel for "
-			  "flow %d", p_stats.ps_drop, flow->id);
-		if (rc == 0)
-			/* if no packets are received try if we should cancel */
-			pthread_testcancel();
 	}
 
-remove: ;
+	return NULL;
+}
+
+/**
+ * Start the capture and the dump writer thread on first use.
+ *
+ * @return zero on success, -1 on failure
+ */
+static int start_capture(void)
+{
+	int rc;
+
+	if (capture_started)
+		return 0;
 
-	pthread_cleanup_pop(1);
+	if (pipe(wakeup_pipe) == -1) {
+		logging(LOG_WARNING, "pcap: failed to create pipe: %s",
+			strerror(errno));
+		return -1;
+	}
+	fcntl(wakeup_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakeup_pipe[1], F_SETFL, O_NONBLOCK);
+
+	if (dump_writer_start() == -1)
+		return -1;
 
-	pthread_barrier_wait(&pcap_barrier);
+	rc = pthread_create(&capture_thread, NULL, capture_work, NULL);
+	if (rc) {
+		logging(LOG_WARNING, "could not start pcap thread: %s",
+			strerror(rc));
+		return -1;
+	}
+
+	capture_started = true;
 	return 0;
 }
 
 void fg_pcap_go(struct flow *flow)
 {
-	if (!flow->settings.traffic_dump)
+	struct pcap_tap *tap;
+	const char *name;
+
+	if (!flow->settings.traffic_dump || flow->meta->pcap_tap)
+		return;
+
+	DEBUG_MSG(LOG_DEBUG, "called fg_pcap_go() for flow %d", flow->id);
+
+	if (start_capture() == -1)
 		return;
 
-	if (dumping) {
-		logging(LOG_WARNING, "pcap: dumping already in progress on "
-			"this host");
+	tap = calloc(1, sizeof(*tap));
+	if (!tap) {
+		logging(LOG_ALERT, "could not allocate memory for capture");
 		return;
 	}
+	snprintf(tap->comment, sizeof(tap->comment), "flow %d",
+		 flow->settings.flow_id);
+	tap->flow_id = flow->settings.flow_id;
+	tap->merge = flow->settings.dump_merge;
+	tcp_analyzer_init(&tap->analyzer);
+	pthread_mutex_init(&tap->wire_lock, NULL);
+	foreach(int *i, INTERVAL, FINAL)
+		tcp_wire_stats_reset(&tap->wire[*i]);
+	if (!flow_tuple(flow, &tap->tuple))
+		goto error;
+	name = find_device(&tap->tuple);
+	if (!name)
+		goto error;
 
-	DEBUG_MSG(LOG_DEBUG, "called fg_pcap_go() for flow %d", flow->id);
-	dumping = true;
+	tap->ifname = name;
 
-	int rc = pthread_create(&flow->pcap_thread, NULL, fg_pcap_work,
-				(void*)flow);
+	/* the capture thread opens the capture and the dump, so the daemon
+	 * never waits for it or the disk */
+	pthread_mutex_lock(&pcap_mutex);
+	tap->next = new_taps;
+	new_taps = tap;
+	pthread_mutex_unlock(&pcap_mutex);
+	wakeup_capture();
 
-	/* barrier: dump thread is ready (or aborted) */
-	pthread_barrier_wait(&pcap_barrier);
+	flow->meta->pcap_tap = tap;
+	foreach(int *i, INTERVAL, FINAL)
+		flow->meta->pcap_packets[*i] = flow->meta->pcap_drops[*i] =
+			flow->meta->pcap_ring_drops[*i] = 0;
+	return;
 
-	if (rc)
-		logging(LOG_WARNING, "could not start pcap thread: %s",
-			strerror(rc) );
+error:
+	pthread_mutex_destroy(&tap->wire_lock);
+	free(tap);
+}
+
+void fg_pcap_stop(struct flow *flow)
+{
+	struct pcap_tap *tap = flow->meta->pcap_tap;
+
+	if (!tap)
+		return;
+
+	DEBUG_MSG(LOG_DEBUG, "called fg_pcap_stop() for flow %d", flow->id);
+
+	__atomic_store_n(&tap->stopped, true, __ATOMIC_RELEASE);
+	flow->meta->pcap_tap = NULL;
+
+	/* the capture thread releases the tap and the interface once unused */
+	wakeup_capture();
 }
 
+void fg_pcap_stats(struct flow *flow, enum report_t type,
+		   struct report *report)
+{
+	struct pcap_tap *tap = flow->meta->pcap_tap;
+	struct tcp_wire_stats wire;
+	uint64_t now_packets, now_drops, now_ring_drops;
+
+	if (!tap) {
+		report->pcap_packets = report->pcap_drops = 0;
+		report->pcap_ring_drops = 0;
+		tcp_wire_stats_reset(&wire);
+		goto wire;
+	}
+
+	now_packets = __atomic_load_n(&tap->packets, __ATOMIC_RELAXED);
+	now_drops = __atomic_load_n(&tap->drops, __ATOMIC_RELAXED);
+	now_ring_drops = __atomic_load_n(&tap->ring_drops, __ATOMIC_RELAXED);
+	report->pcap_packets = now_packets - flow->meta->pcap_packets[type];
+	report->pcap_drops = now_drops - flow->meta->pcap_drops[type];
+	report->pcap_ring_drops = now_ring_drops -
+				  flow->meta->pcap_ring_drops[type];
+
+	pthread_mutex_lock(&tap->wire_lock);
+	wire = tap->wire[type];
+	/* the next interval starts now */
+	if (type == INTERVAL) {
+		flow->meta->pcap_packets[INTERVAL] = now_packets;
+		flow->meta->pcap_drops[INTERVAL] = now_drops;
+		flow->meta->pcap_ring_drops[INTERVAL] = now_ring_drops;
+		tcp_wire_stats_reset(&tap->wire[INTERVAL]);
+		tap->wire[INTERVAL].flight = wire.flight;
+	}
+	pthread_mutex_unlock(&tap->wire_lock);
+
+wire:
+	report->wire_retransmits = wire.retransmits;
+	report->wire_reordered = wire.reordered;
+	report->wire_rtt_samples = wire.rtt_samples;
+	report->wire_rtt_min = wire.rtt_min;
+	report->wire_rtt_max = wire.rtt_max;
+	report->wire_rtt_sum = wire.rtt_sum;
+	report->wire_acked = wire.acked;
+	report->wire_flight = wire.flight;
+}
@@ -45,16 +45,63 @@
  */
 int fg_pcap_init(void);
 
+/** Maximum number of interfaces captured at the same time. */
+#define PCAP_MAX_IFACES 16
+
+/*
+ * All flows on the same interface share one capture ring of that interface.
+ * The filter of the ring only passes the TCP segments of the connections of
+ * these flows. A single capture thread reads the rings of all interfaces and
+ * passes the headers of the segments to the dump writer thread, either into
+ * a pcap file per flow or into a pcapng file per interface shared by the
+ * flows with option --dump-merge, annotated with their flow IDs. The capture
+ * thread also follows the sequence and acknowledgment numbers of the segments
+ * of each flow and publishes the derived wire metrics for its reports.
+ *
+ * The daemon hands new flows to the capture thread and marks stopped flows
+ * without waiting for it, the capture thread alone opens and closes the
+ * captures, dump files and filters.
+ */
+
 /**
- * Start a tcpdump to capture traffic of the provided flow.
+ * Start to capture the traffic of the provided flow.
  *
- * If the flow was not configured for tcp dumping or dumping is already in
- * progress the method will do nothing and return immediately. Otherwise the
- * method blocks until the actual capturing starts. In case an error occurs a
- * log message is created.
+ * Must be called once connect() was called on or accept() returned the test
+ * socket, as the capture is limited to its connection. If the flow was not
+ * configured for tcp dumping or dumping is already in progress the method
+ * will do nothing and return immediately. If another flow already captures on
+ * the interface of the flow, its capture is shared. Otherwise the capture
+ * thread starts a capture of the interface. In case an error occurs a log
+ * message is created.
  *
  * @param[in] flow the flow whose traffic should be captured
  */
 void fg_pcap_go(struct flow *flow);
 
+/**
+ * Stop to capture the traffic of the provided flow.
+ *
+ * The dump of the flow is closed, the capture of the interface ends once no
+ * flow uses it anymore.
+ *
+ * @param[in] flow the flow whose traffic was captured
+ */
+void fg_pcap_stop(struct flow *flow);
+
+/**
+ * Capture statistics and wire metrics of the provided flow since its last
+ * report of type @p type.
+ *
+ * Fills the number of packets of the flow written to its dump, the number of
+ * packets dropped by the kernel on the interface of the flow or of the flow
+ * by the writer and the metrics derived from the captured segments of the
+ * flow by fg_tcp_analyzer.h. Without capture, no segments are reported.
+ *
+ * @param[in] flow the flow whose traffic is captured
+ * @param[in] type type of the report
+ * @param[out] report report to fill the pcap_* and wire_* fields of
+ */
+void fg_pcap_stats(struct flow *flow, enum report_t type,
+		   struct report *report);
+
 #endif /* _FG_PCAP_H_ */
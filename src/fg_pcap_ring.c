@@ -0,0 +1,438 @@
+/**
+ * @file fg_pcap_ring.c
+ * @brief Packet capture ring of a network interface
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <pcap.h>
+
+#ifdef HAVE_TPACKET_V3
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#endif /* HAVE_TPACKET_V3 */
+
+#include "debug.h"
+#include "fg_log.h"
+#include "fg_pcap_ring.h"
+
+#ifdef HAVE_TPACKET_V3
+
+struct pcap_ring {
+	/** AF_PACKET socket of the ring. */
+	int fd;
+	/** Name of the interface. */
+	char ifname[IF_NAMESIZE];
+	/** Blocks of the ring mapped from the kernel. */
+	unsigned char *map;
+	/** Block to read next. */
+	unsigned block;
+	/** Snapshot length. */
+	unsigned snaplen;
+	/** Link type for the BPF compiler (DLT_*) and pcap files. @{ */
+	int dlt;
+	int linktype;                                           /** @} */
+	/** Whether the interface is the loopback interface. */
+	bool loopback;
+	/** Packets dropped by the kernel since the ring was opened. */
+	uint64_t drops;
+};
+
+/** Block @p i of @p ring. */
+static inline struct tpacket_block_desc *ring_block(struct pcap_ring *ring,
+						    unsigned i)
+{
+	return (struct tpacket_block_desc *)(ring->map +
+					     (size_t)i * PCAP_RING_BLOCK_SIZE);
+}
+
+struct pcap_ring *pcap_ring_open(const char *ifname, unsigned snaplen)
+{
+	struct pcap_ring *ring = calloc(1, sizeof(*ring));
+	struct tpacket_req3 req;
+	struct sockaddr_ll sll;
+	struct ifreq ifr;
+	int version = TPACKET_V3;
+	int type = SOCK_RAW;
+
+	if (!ring) {
+		logging(LOG_ALERT, "could not allocate memory for capture "
+			"ring");
+		return NULL;
+	}
+	ring->fd = -1;
+	ring->map = MAP_FAILED;
+	ring->snaplen = snaplen;
+	strncpy(ring->ifname, ifname, sizeof(ring->ifname) - 1);
+
+	/* Ethernet and loopback frames are captured as they are, all other
+	 * interfaces without their link layer header */
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+	ring->fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (ring->fd == -1 || ioctl(ring->fd, SIOCGIFHWADDR, &ifr) == -1) {
+		logging(LOG_WARNING, "pcap: failed to open packet socket on "
+			"%s: %s", ifname, strerror(errno));
+		goto error;
+	}
+	switch (ifr.ifr_hwaddr.sa_family) {
+	case ARPHRD_LOOPBACK:
+		ring->loopback = true;
+		/* fall through */
+	case ARPHRD_ETHER:
+		ring->dlt = ring->linktype = DLT_EN10MB;
+		break;
+	default:
+		close(ring->fd);
+		type = SOCK_DGRAM;
+		ring->fd = socket(AF_PACKET, type, 0);
+		if (ring->fd == -1) {
+			logging(LOG_WARNING, "pcap: failed to open packet "
+				"socket on %s: %s", ifname, strerror(errno));
+			goto error;
+		}
+		ring->dlt = DLT_RAW;
+		ring->linktype = LINKTYPE_RAW;
+	}
+
+	if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version,
+		       sizeof(version)) == -1) {
+		logging(LOG_WARNING, "pcap: TPACKET_V3 not supported on %s: "
+			"%s", ifname, strerror(errno));
+		goto error;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = PCAP_RING_BLOCK_SIZE;
+	req.tp_block_nr = PCAP_RING_BLOCKS;
+	req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+	req.tp_frame_nr = (PCAP_RING_BLOCK_SIZE / req.tp_frame_size) *
+			  PCAP_RING_BLOCKS;
+	req.tp_retire_blk_tov = PCAP_RING_BLOCK_TIMEOUT;
+	if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &req,
+		       sizeof(req)) == -1) {
+		logging(LOG_WARNING, "pcap: failed to set up capture ring on "
+			"%s: %s", ifname, strerror(errno));
+		goto error;
+	}
+
+	ring->map = mmap(NULL, (size_t)PCAP_RING_BLOCK_SIZE * PCAP_RING_BLOCKS,
+			 PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+	if (ring->map == MAP_FAILED) {
+		logging(LOG_WARNING, "pcap: failed to map capture ring of %s: "
+			"%s", ifname, strerror(errno));
+		goto error;
+	}
+
+	/* the socket does not see any packet before it is bound, so the
+	 * filter is in place for the first one */
+	if (pcap_ring_set_filter(ring, "") == -1)
+		goto error;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = if_nametoindex(ifname);
+	if (!sll.sll_ifindex ||
+	    bind(ring->fd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
+		logging(LOG_WARNING, "pcap: failed to bind packet socket to "
+			"%s: %s", ifname, strerror(errno));
+		goto error;
+	}
+
+	DEBUG_MSG(LOG_NOTICE, "pcap: opened capture ring of %u blocks on %s",
+		  PCAP_RING_BLOCKS, ifname);
+	return ring;
+
+error:
+	pcap_ring_close(ring);
+	return NULL;
+}
+
+int pcap_ring_set_filter(struct pcap_ring *ring, const char *filter)
+{
+	struct bpf_program program;
+	struct sock_fprog fprog;
+	pcap_t *dead = pcap_open_dead(ring->dlt, ring->snaplen);
+	int rc = 0;
+
+	if (!dead) {
+		logging(LOG_ALERT, "could not allocate memory for BPF "
+			"compiler");
+		return -1;
+	}
+
+	/* the filter returns the snapshot length, so the kernel truncates
+	 * the packets before they are copied into the ring */
+	if (pcap_compile(dead, &program, filter, 1,
+			 PCAP_NETMASK_UNKNOWN) == -1) {
+		logging(LOG_WARNING, "pcap: failed compiling filter '%s': %s",
+			filter, pcap_geterr(dead));
+		pcap_close(dead);
+		return -1;
+	}
+
+	/* struct bpf_insn and struct sock_filter share their layout */
+	fprog.len = program.bf_len;
+	fprog.filter = (struct sock_filter *)program.bf_insns;
+	if (setsockopt(ring->fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog,
+		       sizeof(fprog)) == -1) {
+		logging(LOG_WARNING, "pcap: failed to attach filter to %s: %s",
+			ring->ifname, strerror(errno));
+		rc = -1;
+	}
+
+	pcap_freecode(&program);
+	pcap_close(dead);
+	return rc;
+}
+
+int pcap_ring_fd(const struct pcap_ring *ring)
+{
+	return ring->fd;
+}
+
+int pcap_ring_linktype(const struct pcap_ring *ring)
+{
+	return ring->linktype;
+}
+
+int pcap_ring_dispatch(struct pcap_ring *ring, pcap_ring_handler handler,
+		       void *arg)
+{
+	int count = 0;
+
+	/* at most once around, the caller must get a chance to do its
+	 * housekeeping even if the kernel fills the ring as fast */
+	for (unsigned n = 0; n < PCAP_RING_BLOCKS; n++) {
+		struct tpacket_block_desc *desc = ring_block(ring, ring->block);
+		struct tpacket3_hdr *hdr;
+
+		if (!(__atomic_load_n(&desc->hdr.bh1.block_status,
+				      __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+			break;
+
+		hdr = (struct tpacket3_hdr *)((unsigned char *)desc +
+					      desc->hdr.bh1.offset_to_first_pkt);
+		for (unsigned i = 0; i < desc->hdr.bh1.num_pkts; i++) {
+			const struct sockaddr_ll *sll = (void *)
+				((unsigned char *)hdr +
+				 TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+			/* the loopback interface passes every packet twice,
+			 * once outgoing and once incoming */
+			if (!ring->loopback ||
+			    sll->sll_pkttype != PACKET_OUTGOING) {
+				const struct pcap_packet pkt = {
+					.ts.tv_sec = hdr->tp_sec,
+					.ts.tv_nsec = hdr->tp_nsec,
+					.caplen = hdr->tp_snaplen,
+					.len = hdr->tp_len,
+					.data = (unsigned char *)hdr +
+						hdr->tp_mac,
+				};
+				handler(arg, &pkt);
+				count++;
+			}
+			hdr = (struct tpacket3_hdr *)((unsigned char *)hdr +
+						      hdr->tp_next_offset);
+		}
+
+		/* hand the block back to the kernel */
+		__atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+				 __ATOMIC_RELEASE);
+		ring->block = (ring->block + 1) % PCAP_RING_BLOCKS;
+	}
+
+	return count;
+}
+
+uint64_t pcap_ring_drops(struct pcap_ring *ring)
+{
+	struct tpacket_stats_v3 stats;
+	socklen_t len = sizeof(stats);
+
+	/* reading the statistics resets them */
+	if (!getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &stats,
+			&len))
+		ring->drops += stats.tp_drops;
+
+	return ring->drops;
+}
+
+void pcap_ring_close(struct pcap_ring *ring)
+{
+	if (!ring)
+		return;
+
+	if (ring->map != MAP_FAILED)
+		munmap(ring->map, (size_t)PCAP_RING_BLOCK_SIZE *
+		       PCAP_RING_BLOCKS);
+	if (ring->fd != -1)
+		close(ring->fd);
+	free(ring);
+}
+
+#else /* HAVE_TPACKET_V3 */
+
+struct pcap_ring {
+	/** Capture handle of libpcap. */
+	pcap_t *handle;
+	/** Link type of the packets in pcap files. */
+	int linktype;
+	/** Packet handler of the current pcap_ring_dispatch() call. @{ */
+	pcap_ring_handler handler;
+	void *arg;                                              /** @} */
+};
+
+/** Error message buffer filled by the pcap library in case of an error */
+static char errbuf[PCAP_ERRBUF_SIZE] = "";
+
+struct pcap_ring *pcap_ring_open(const char *ifname, unsigned snaplen)
+{
+	struct pcap_ring *ring = calloc(1, sizeof(*ring));
+
+	if (!ring) {
+		logging(LOG_ALERT, "could not allocate memory for capture "
+			"ring");
+		return NULL;
+	}
+
+	ring->handle = pcap_open_live(ifname, snaplen, 0, 1, errbuf);
+	if (!ring->handle) {
+		logging(LOG_WARNING, "failed to init pcap on device %s: %s",
+			ifname, errbuf);
+		free(ring);
+		return NULL;
+	}
+
+	/* we rely on a non-blocking dispatch loop */
+	if (pcap_setnonblock(ring->handle, 1, errbuf) == -1 ||
+	    pcap_get_selectable_fd(ring->handle) == -1) {
+		logging(LOG_WARNING, "pcap: failed to set non-blocking: %s",
+			errbuf);
+		pcap_ring_close(ring);
+		return NULL;
+	}
+
+	/* DLT_RAW differs between the systems, pcap files use their own */
+	ring->linktype = pcap_datalink(ring->handle);
+	if (ring->linktype == DLT_RAW)
+		ring->linktype = LINKTYPE_RAW;
+
+	return ring;
+}
+
+int pcap_ring_set_filter(struct pcap_ring *ring, const char *filter)
+{
+	struct bpf_program program;
+	int rc = 0;
+
+	if (pcap_compile(ring->handle, &program, filter, 1,
+			 PCAP_NETMASK_UNKNOWN) == -1) {
+		logging(LOG_WARNING, "pcap: failed compiling filter '%s': %s",
+			filter, pcap_geterr(ring->handle));
+		return -1;
+	}
+
+	if (pcap_setfilter(ring->handle, &program) == -1) {
+		logging(LOG_WARNING, "pcap: failed to set filter: %s",
+			pcap_geterr(ring->handle));
+		rc = -1;
+	}
+
+	pcap_freecode(&program);
+	return rc;
+}
+
+int pcap_ring_fd(const struct pcap_ring *ring)
+{
+	return pcap_get_selectable_fd(ring->handle);
+}
+
+int pcap_ring_linktype(const struct pcap_ring *ring)
+{
+	return ring->linktype;
+}
+
+/** Pass a packet of libpcap on to the handler of pcap_ring_dispatch(). */
+static void ring_callback(unsigned char *arg, const struct pcap_pkthdr *hdr,
+			  const unsigned char *data)
+{
+	struct pcap_ring *ring = (struct pcap_ring *)arg;
+	const struct pcap_packet pkt = {
+		.ts.tv_sec = hdr->ts.tv_sec,
+		.ts.tv_nsec = hdr->ts.tv_usec * 1000,
+		.caplen = hdr->caplen,
+		.len = hdr->len,
+		.data = data,
+	};
+
+	ring->handler(ring->arg, &pkt);
+}
+
+int pcap_ring_dispatch(struct pcap_ring *ring, pcap_ring_handler handler,
+		       void *arg)
+{
+	ring->handler = handler;
+	ring->arg = arg;
+
+	return pcap_dispatch(ring->handle, -1, ring_callback,
+			     (unsigned char *)ring);
+}
+
+uint64_t pcap_ring_drops(struct pcap_ring *ring)
+{
+	struct pcap_stat stats;
+
+	if (pcap_stats(ring->handle, &stats) == -1)
+		return 0;
+
+	return stats.ps_drop;
+}
+
+void pcap_ring_close(struct pcap_ring *ring)
+{
+	if (!ring)
+		return;
+
+	pcap_close(ring->handle);
+	free(ring);
+}
+
+#endif /* HAVE_TPACKET_V3 */
@@ -0,0 +1,114 @@
+/**
+ * @file fg_pcap_ring.h
+ * @brief Packet capture ring of a network interface
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_PCAP_RING_H_
+#define _FG_PCAP_RING_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * On Linux a ring is an AF_PACKET socket with a TPACKET_V3 receive ring
+ * mapped into the daemon. The kernel fills whole blocks of packets and hands
+ * them over at once, so reading them costs neither a system call nor a copy
+ * per packet. The BPF filter of the ring already truncates the packets to
+ * the snapshot length in the kernel. Other systems fall back to libpcap.
+ *
+ * A ring is used by a single thread at a time.
+ */
+
+/** Size of a block of the TPACKET_V3 ring, 1 MB. */
+#define PCAP_RING_BLOCK_SIZE (1 << 20)
+/** Number of blocks of the TPACKET_V3 ring. */
+#define PCAP_RING_BLOCKS 32
+/** Time after which the kernel hands over a block not yet full, in ms. */
+#define PCAP_RING_BLOCK_TIMEOUT 10
+
+/** Link types of pcap files. @{ */
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101                                  /** @} */
+
+/** A packet read from a ring. */
+struct pcap_packet {
+	/** Time the packet was captured. */
+	struct timespec ts;
+	/** Number of bytes captured. */
+	unsigned caplen;
+	/** Length of the packet on the wire. */
+	unsigned len;
+	/** Captured bytes, starting with the link layer header. */
+	const unsigned char *data;
+};
+
+/** Called by pcap_ring_dispatch() for each packet @p pkt. */
+typedef void (*pcap_ring_handler)(void *arg, const struct pcap_packet *pkt);
+
+/** Packet capture ring of a network interface. */
+struct pcap_ring;
+
+/**
+ * Open a ring capturing all packets of interface @p ifname, truncated to
+ * @p snaplen bytes.
+ *
+ * @return the ring, NULL on failure, which is logged
+ */
+struct pcap_ring *pcap_ring_open(const char *ifname, unsigned snaplen);
+
+/**
+ * Capture only packets matching @p filter in pcap-filter(7) syntax.
+ *
+ * @return zero on success, -1 on failure, which is logged
+ */
+int pcap_ring_set_filter(struct pcap_ring *ring, const char *filter);
+
+/** File descriptor which becomes readable once packets are ready. */
+int pcap_ring_fd(const struct pcap_ring *ring);
+
+/** Link type of the packets as defined for pcap files. */
+int pcap_ring_linktype(const struct pcap_ring *ring);
+
+/**
+ * Hand the packets ready in the ring to @p handler without blocking, at most
+ * those of PCAP_RING_BLOCKS blocks. The file descriptor of the ring stays
+ * readable if more are ready.
+ *
+ * @return number of packets handled, -1 on failure
+ */
+int pcap_ring_dispatch(struct pcap_ring *ring, pcap_ring_handler handler,
+		       void *arg);
+
+/**
+ * Number of packets the kernel dropped because the ring was full, since the
+ * ring was opened.
+ */
+uint64_t pcap_ring_drops(struct pcap_ring *ring);
+
+/** Close @p ring and release its resources. */
+void pcap_ring_close(struct pcap_ring *ring);
+
+#endif /* _FG_PCAP_RING_H_ */
@@ -0,0 +1,268 @@
+/**
+ * @file fg_profile.c
+ * @brief Shared settings of flow endpoints
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fg_profile.h"
+#include "fg_cdf.h"
+
+/** Number of hash buckets of the interned profiles. */
+#define PROFILE_BUCKETS 64
+
+/** Interned profiles, chained by their hash. */
+static struct flow_profile *interned[PROFILE_BUCKETS];
+/** Number of interned profiles. */
+static unsigned num_interned;
+
+/** Traffic generation options of @p profile. */
+#define PROFILE_TRAFGEN_OPTIONS(profile) {				    \
+	&(profile)->request_trafgen_options,				    \
+	&(profile)->response_trafgen_options,				    \
+	&(profile)->interpacket_gap_trafgen_options,			    \
+}
+
+/** Number of traffic generation options of a profile. */
+#define NUM_TRAFGEN_OPTIONS 3
+
+/** FNV-1a hash of @p len bytes at @p data, continuing from @p hash. */
+static unsigned hash_bytes(unsigned hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/** Hash of the settings of @p profile, equal profiles hash alike. */
+static unsigned profile_hash(const struct flow_profile *profile)
+{
+	const struct trafgen_options *opts[] = PROFILE_TRAFGEN_OPTIONS(profile);
+	unsigned hash = 2166136261u;
+
+	hash = hash_bytes(hash, profile->bind_address,
+			  strlen(profile->bind_address));
+	hash = hash_bytes(hash, profile->cc_alg, strlen(profile->cc_alg));
+	for (int i = 0; i < NUM_TRAFGEN_OPTIONS; i++) {
+		hash = hash_bytes(hash, &opts[i]->distribution,
+				  sizeof(opts[i]->distribution));
+		hash = hash_bytes(hash, &opts[i]->param_one,
+				  sizeof(opts[i]->param_one));
+		hash = hash_bytes(hash, &opts[i]->param_two,
+				  sizeof(opts[i]->param_two));
+		if (opts[i]->cdf)
+			hash = hash_bytes(hash, &opts[i]->cdf->num_points,
+					  sizeof(opts[i]->cdf->num_points));
+	}
+	for (int i = 0; i < profile->num_extra_socket_options; i++) {
+		const struct extra_socket_options *o =
+			&profile->extra_socket_options[i];
+		hash = hash_bytes(hash, &o->level, sizeof(o->level));
+		hash = hash_bytes(hash, &o->optname, sizeof(o->optname));
+		hash = hash_bytes(hash, o->optval, o->optlen);
+	}
+
+	return hash;
+}
+
+/** Free the empirical distributions of @p profile. */
+static void free_cdfs(struct flow_profile *profile)
+{
+	struct trafgen_options *opts[] = PROFILE_TRAFGEN_OPTIONS(profile);
+
+	for (int i = 0; i < NUM_TRAFGEN_OPTIONS; i++) {
+		cdf_free(opts[i]->cdf);
+		opts[i]->cdf = NULL;
+	}
+}
+
+struct flow_profile *profile_new(void)
+{
+	struct flow_profile *profile = calloc(1, sizeof(struct flow_profile));
+
+	if (profile)
+		profile->refcount = 1;
+
+	return profile;
+}
+
+struct flow_profile *profile_dup(const struct flow_profile *profile)
+{
+	struct flow_profile *copy = malloc(sizeof(struct flow_profile));
+
+	if (!copy)
+		return NULL;
+
+	*copy = *profile;
+	copy->refcount = 1;
+	copy->hash = 0;
+	copy->next = NULL;
+
+	struct trafgen_options *opts[] = PROFILE_TRAFGEN_OPTIONS(copy);
+	int rc = 0;
+
+	for (int i = 0; i < NUM_TRAFGEN_OPTIONS; i++) {
+		if (!opts[i]->cdf)
+			continue;
+		/* after a failure only drop the remaining references */
+		opts[i]->cdf = rc ? NULL : cdf_dup(opts[i]->cdf);
+		if (!opts[i]->cdf)
+			rc = -1;
+	}
+	if (rc) {
+		free_cdfs(copy);
+		free(copy);
+		return NULL;
+	}
+
+	return copy;
+}
+
+struct flow_profile *profile_ref(struct flow_profile *profile)
+{
+	profile->refcount++;
+	return profile;
+}
+
+/** Remove @p profile from the interned profiles, if it is interned. */
+static void profile_unintern(struct flow_profile *profile)
+{
+	struct flow_profile **p = &interned[profile->hash % PROFILE_BUCKETS];
+
+	for (; *p; p = &(*p)->next) {
+		if (*p == profile) {
+			*p = profile->next;
+			profile->next = NULL;
+			num_interned--;
+			return;
+		}
+	}
+}
+
+void profile_unref(struct flow_profile *profile)
+{
+	if (!profile || --profile->refcount)
+		return;
+
+	profile_unintern(profile);
+	free_cdfs(profile);
+	free(profile);
+}
+
+struct flow_profile *profile_mutable(struct flow_profile **profile)
+{
+	struct flow_profile *copy;
+
+	if ((*profile)->refcount == 1 && !(*profile)->hash)
+		return *profile;
+
+	copy = profile_dup(*profile);
+	if (!copy)
+		return NULL;
+
+	profile_unref(*profile);
+	*profile = copy;
+
+	return copy;
+}
+
+/** Compare the empirical distributions @p a and @p b. */
+static bool cdf_equal(const struct empirical_cdf *a,
+		      const struct empirical_cdf *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return a->num_points == b->num_points &&
+	       !memcmp(a->value, b->value, a->num_points * sizeof(double)) &&
+	       !memcmp(a->probability, b->probability,
+		       a->num_points * sizeof(double));
+}
+
+bool profile_equal(const struct flow_profile *a, const struct flow_profile *b)
+{
+	const struct trafgen_options *a_opts[] = PROFILE_TRAFGEN_OPTIONS(a);
+	const struct trafgen_options *b_opts[] = PROFILE_TRAFGEN_OPTIONS(b);
+
+	if (strcmp(a->bind_address, b->bind_address) ||
+	    strcmp(a->cc_alg, b->cc_alg) ||
+	    a->num_extra_socket_options != b->num_extra_socket_options)
+		return false;
+
+	for (int i = 0; i < NUM_TRAFGEN_OPTIONS; i++)
+		if (a_opts[i]->distribution != b_opts[i]->distribution ||
+		    a_opts[i]->param_one != b_opts[i]->param_one ||
+		    a_opts[i]->param_two != b_opts[i]->param_two ||
+		    !cdf_equal(a_opts[i]->cdf, b_opts[i]->cdf))
+			return false;
+
+	for (int i = 0; i < a->num_extra_socket_options; i++) {
+		const struct extra_socket_options *x =
+			&a->extra_socket_options[i];
+		const struct extra_socket_options *y =
+			&b->extra_socket_options[i];
+
+		if (x->level != y->level || x->optname != y->optname ||
+		    x->optlen != y->optlen ||
+		    memcmp(x->optval, y->optval, x->optlen))
+			return false;
+	}
+
+	return true;
+}
+
+struct flow_profile *profile_intern(const struct flow_profile *profile)
+{
+	/* zero marks profiles which are not interned */
+	unsigned hash = profile_hash(profile) | 1;
+	struct flow_profile **bucket = &interned[hash % PROFILE_BUCKETS];
+	struct flow_profile *p;
+
+	for (p = *bucket; p; p = p->next)
+		if (p->hash == hash && profile_equal(p, profile))
+			return profile_ref(p);
+
+	p = profile_dup(profile);
+	if (!p)
+		return NULL;
+
+	p->hash = hash;
+	p->next = *bucket;
+	*bucket = p;
+	num_interned++;
+
+	return p;
+}
+
+unsigned profile_count(void)
+{
+	return num_interned;
+}
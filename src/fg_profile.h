@@ -0,0 +1,98 @@
+/**
+ * @file fg_profile.h
+ * @brief Shared settings of flow endpoints
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_PROFILE_H_
+#define _FG_PROFILE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdbool.h>
+
+#include "common.h"
+
+/*
+ * A profile (struct flow_profile) holds the settings of a flow endpoint most
+ * flows have in common. Equal profiles are merged by interning them, so all
+ * flows with the same settings reference the same profile. Interned and
+ * shared profiles are immutable, use profile_mutable() to change a profile
+ * (copy on write).
+ *
+ * Reference counts are not atomic. The daemon only interns and releases
+ * profiles of flows in the daemon thread, the RPC thread only works on its
+ * own, not interned profiles.
+ */
+
+/**
+ * Allocate an empty profile with a single reference.
+ *
+ * @return new profile, NULL if out of memory
+ */
+struct flow_profile *profile_new(void);
+
+/**
+ * Copy @p profile, including its empirical distributions.
+ *
+ * @return not interned copy with a single reference, NULL if out of memory
+ */
+struct flow_profile *profile_dup(const struct flow_profile *profile);
+
+/** Take another reference of @p profile and return it. */
+struct flow_profile *profile_ref(struct flow_profile *profile);
+
+/**
+ * Release a reference of @p profile, freeing it with the last reference.
+ *
+ * @param[in] profile profile to release, may be NULL
+ */
+void profile_unref(struct flow_profile *profile);
+
+/**
+ * Make the profile referenced by @p profile safe to change.
+ *
+ * A shared or interned profile is replaced by a private copy.
+ *
+ * @param[in,out] profile reference to the profile
+ * @return the profile to change, NULL if out of memory. The old profile is
+ * still referenced then
+ */
+struct flow_profile *profile_mutable(struct flow_profile **profile);
+
+/** Compare the settings of profiles @p a and @p b. */
+bool profile_equal(const struct flow_profile *a, const struct flow_profile *b);
+
+/**
+ * Look up the interned profile equal to @p profile.
+ *
+ * If there is none yet, a copy of @p profile is interned. @p profile itself
+ * is never interned and keeps its references.
+ *
+ * @return new reference to the interned profile, NULL if out of memory
+ */
+struct flow_profile *profile_intern(const struct flow_profile *profile);
+
+/** Number of interned profiles. */
+unsigned profile_count(void);
+
+#endif /* _FG_PROFILE_H_ */
@@ -32,6 +32,11 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <sys/utsname.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 /* for log levels */
 #include <syslog.h>
 
@@ -40,8 +45,150 @@
 #include "fg_log.h"
 #include "fg_error.h"
 #include "fg_definitions.h"
+#include "fg_time.h"
+#include "fg_metrics.h"
 #include "debug.h"
 #include "fg_rpc_server.h"
+#include "fg_cdf.h"
+#include "fg_trace.h"
+#include "fg_profile.h"
+
+/**
+ * Parse the empirical CDF of a traffic generation option.
+ *
+ * The controller sends the CDF as flat array of alternating values and
+ * cumulative probabilities. For parametric distributions the array is empty.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in] array XML-RPC array holding the CDF
+ * @param[in,out] opt traffic generation option to store the CDF in
+ */
+static void parse_trafgen_cdf(xmlrpc_env * const env,
+			      xmlrpc_value * const array,
+			      struct trafgen_options *opt)
+{
+	const char *problem;
+	int size = xmlrpc_array_size(env, array);
+
+	if (env->fault_occurred)
+		goto cleanup;
+
+	if (!size) {
+		if (opt->distribution == EMPIRICAL)
+			XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Empirical "
+				    "distribution without CDF");
+		goto cleanup;
+	}
+
+	if (opt->distribution != EMPIRICAL || size % 2)
+		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Malformed CDF");
+
+	opt->cdf = cdf_new(size / 2);
+	if (!opt->cdf)
+		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "CDF has too many points");
+
+	for (int i = 0; i < size; i++) {
+		xmlrpc_value *item;
+		double val;
+
+		xmlrpc_array_read_item(env, array, i, &item);
+		if (env->fault_occurred)
+			goto cleanup;
+		xmlrpc_read_double(env, item, &val);
+		xmlrpc_DECREF(item);
+		if (env->fault_occurred)
+			goto cleanup;
+
+		if (i % 2)
+			opt->cdf->probability[i / 2] = val;
+		else
+			opt->cdf->value[i / 2] = val;
+	}
+
+	problem = cdf_check(opt->cdf);
+	if (problem)
+		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, problem);
+
+cleanup:
+	return;
+}
+
+/**
+ * Parse the extra socket options of a flow endpoint.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in] array XML-RPC array holding the options
+ * @param[in,out] profile flow profile with the number of options set, to
+ * store the options in
+ */
+static void parse_extra_socket_options(xmlrpc_env * const env,
+				       xmlrpc_value * const array,
+				       struct flow_profile *profile)
+{
+	for (int i = 0; i < profile->num_extra_socket_options; i++) {
+
+		const unsigned char* buffer = 0;
+		size_t len;
+		xmlrpc_value *option = 0, *level = 0, *optname = 0, *value = 0;
+		xmlrpc_array_read_item(env, array, i, &option);
+
+		if (!env->fault_occurred)
+			xmlrpc_struct_read_value(env, option, "level", &level);
+		if (!env->fault_occurred)
+			xmlrpc_struct_read_value(env, option, "optname", &optname);
+		if (!env->fault_occurred)
+			xmlrpc_struct_read_value(env, option, "value", &value);
+		if (!env->fault_occurred)
+			xmlrpc_read_int(env, level, &profile->extra_socket_options[i].level);
+		if (!env->fault_occurred)
+			xmlrpc_read_int(env, optname, &profile->extra_socket_options[i].optname);
+		if (!env->fault_occurred)
+			xmlrpc_read_base64(env, value, &len, &buffer);
+		if (option)
+			xmlrpc_DECREF(option);
+		if (level)
+			xmlrpc_DECREF(level);
+		if (optname)
+			xmlrpc_DECREF(optname);
+		if (value)
+			xmlrpc_DECREF(value);
+		if (!env->fault_occurred) {
+			if (len > MAX_EXTRA_SOCKET_OPTION_VALUE_LENGTH) {
+				free((void *)buffer);
+				XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Too long extra socket option length");
+			}
+			profile->extra_socket_options[i].optlen = len;
+			memcpy(profile->extra_socket_options[i].optval, buffer, len);
+			free((void *)buffer);
+		}
+		if (env->fault_occurred)
+			goto cleanup;
+	}
+
+cleanup:
+	return;
+}
+
+/**
+ * Set the flow size of direction @p direction from the two 32 bit halves
+ * sent by the controller.
+ *
+ * @param[in,out] settings flow settings to store the flow size in
+ * @param[in] direction direction of the flow size (READ or WRITE)
+ * @param[in] high upper 32 bit of the flow size
+ * @param[in] low lower 32 bit of the flow size
+ */
+static void set_flow_size(struct flow_settings *settings, int direction,
+			  int high, int low)
+{
+#ifdef HAVE_UNSIGNED_LONG_LONG_INT
+	settings->flow_size[direction] =
+		((unsigned long long)(uint32_t)high << 32) + (uint32_t)low;
+#else /* HAVE_UNSIGNED_LONG_LONG_INT */
+	UNUSED_ARGUMENT(high);
+	settings->flow_size[direction] = (uint32_t)low;
+#endif /* HAVE_UNSIGNED_LONG_LONG_INT */
+}
 
 /**
  * Prepare data connection for source endpoint.
@@ -65,12 +212,18 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 {
 	UNUSED_ARGUMENT(user_data);
 
-	int rc, i;
+	int rc;
 	xmlrpc_value *ret = 0;
 	char* destination_host = 0;
 	char* cc_alg = 0;
 	char* bind_address = 0;
 	xmlrpc_value* extra_options = 0;
+	xmlrpc_value* request_cdf = 0;
+	xmlrpc_value* response_cdf = 0;
+	xmlrpc_value* gap_cdf = 0;
+	char* trace_name = 0;
+	int write_size_high = 0, write_size_low = 0;
+	int read_size_high = 0, read_size_low = 0;
 
 	struct flow_settings settings;
 	struct flow_source_settings source_settings;
@@ -79,6 +232,12 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 
 	DEBUG_MSG(LOG_WARNING, "method add_flow_source called");
 
+	memset(&settings, 0, sizeof(settings));
+	settings.profile = profile_new();
+	if (!settings.profile)
+		XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, "Could not allocate "
+			    "memory for flow profile");
+
 	/* Parse our argument array. */
 	xmlrpc_decompose_value(env, param_array,
 		"("
@@ -98,6 +257,10 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		"{s:s,*}" /* for LIBPCAP dumps */
 		"{s:i,s:A,*}"
 		"{s:s,s:i,s:i,*}"
+		"{s:A,s:A,s:A,*}" /* empirical distributions */
+		"{s:s,*}" /* trace replay */
+		"{s:i,*}" /* connection churn */
+		"{s:i,s:i,s:i,s:i,s:i,s:i,*}" /* flow size */
 		")",
 
 		/* general settings */
@@ -125,17 +288,17 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		"write_rate", &settings.write_rate,
 		"random_seed",&settings.random_seed,
 
-		"traffic_generation_request_distribution", &settings.request_trafgen_options.distribution,
-		"traffic_generation_request_param_one", &settings.request_trafgen_options.param_one,
-		"traffic_generation_request_param_two", &settings.request_trafgen_options.param_two,
+		"traffic_generation_request_distribution", &settings.profile->request_trafgen_options.distribution,
+		"traffic_generation_request_param_one", &settings.profile->request_trafgen_options.param_one,
+		"traffic_generation_request_param_two", &settings.profile->request_trafgen_options.param_two,
 
-		"traffic_generation_response_distribution", &settings.response_trafgen_options.distribution,
-		"traffic_generation_response_param_one", &settings.response_trafgen_options.param_one,
-		"traffic_generation_response_param_two", &settings.response_trafgen_options.param_two,
+		"traffic_generation_response_distribution", &settings.profile->response_trafgen_options.distribution,
+		"traffic_generation_response_param_one", &settings.profile->response_trafgen_options.param_one,
+		"traffic_generation_response_param_two", &settings.profile->response_trafgen_options.param_two,
 
-		"traffic_generation_gap_distribution", &settings.interpacket_gap_trafgen_options.distribution,
-		"traffic_generation_gap_param_one", &settings.interpacket_gap_trafgen_options.param_one,
-		"traffic_generation_gap_param_two", &settings.interpacket_gap_trafgen_options.param_two,
+		"traffic_generation_gap_distribution", &settings.profile->interpacket_gap_trafgen_options.distribution,
+		"traffic_generation_gap_param_one", &settings.profile->interpacket_gap_trafgen_options.param_one,
+		"traffic_generation_gap_param_two", &settings.profile->interpacket_gap_trafgen_options.param_two,
 
 		"flow_control", &settings.flow_control,
 		"byte_counting", &settings.byte_counting,
@@ -150,24 +313,46 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		"dscp", &settings.dscp,
 		"ipmtudiscover", &settings.ipmtudiscover,
 		"dump_prefix", &dump_prefix,
-		"num_extra_socket_options", &settings.num_extra_socket_options,
+		"num_extra_socket_options", &settings.profile->num_extra_socket_options,
 		"extra_socket_options", &extra_options,
 
 		/* source settings */
 		"destination_address", &destination_host,
 		"destination_port", &source_settings.destination_port,
-		"late_connect", &source_settings.late_connect);
+		"late_connect", &source_settings.late_connect,
+
+		/* empirical distributions */
+		"traffic_generation_request_cdf", &request_cdf,
+		"traffic_generation_response_cdf", &response_cdf,
+		"traffic_generation_gap_cdf", &gap_cdf,
+
+		/* trace replay */
+		"trace_name", &trace_name,
+
+		/* connection churn */
+		"churn", &settings.churn,
+
+		/* flow size */
+		"write_size_high", &write_size_high,
+		"write_size_low", &write_size_low,
+		"read_size_high", &read_size_high,
+		"read_size_low", &read_size_low,
+		"write_blocks", &settings.flow_blocks[WRITE],
+		"read_blocks", &settings.flow_blocks[READ]);
 
 	if (env->fault_occurred)
 		goto cleanup;
 
+	set_flow_size(&settings, WRITE, write_size_high, write_size_low);
+	set_flow_size(&settings, READ, read_size_high, read_size_low);
+
 #ifndef HAVE_LIBPCAP
 	if (settings.traffic_dump)
 		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Daemon was asked to dump traffic, but wasn't compiled with libpcap support");
 #endif
 
 	/* Check for sanity */
-	if (strlen(bind_address) >= sizeof(settings.bind_address) - 1 ||
+	if (strlen(bind_address) >= sizeof(settings.profile->bind_address) - 1 ||
 		settings.delay[WRITE] < 0 || settings.duration[WRITE] < 0 ||
 		settings.delay[READ] < 0 || settings.duration[READ] < 0 ||
 		settings.requested_send_buffer_size < 0 || settings.requested_read_buffer_size < 0 ||
@@ -175,56 +360,37 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 		strlen(destination_host) >= sizeof(source_settings.destination_host) - 1||
 		source_settings.destination_port <= 0 || source_settings.destination_port > 65535 ||
 		strlen(cc_alg) > TCP_CA_NAME_MAX ||
-		settings.num_extra_socket_options < 0 || settings.num_extra_socket_options > MAX_EXTRA_SOCKET_OPTIONS ||
-		xmlrpc_array_size(env, extra_options) != settings.num_extra_socket_options ||
+		settings.profile->num_extra_socket_options < 0 || settings.profile->num_extra_socket_options > MAX_EXTRA_SOCKET_OPTIONS ||
+		xmlrpc_array_size(env, extra_options) != settings.profile->num_extra_socket_options ||
 		settings.dscp < 0 || settings.dscp > 255 ||
 		settings.write_rate < 0 ||
-		settings.reporting_interval < 0) {
+		settings.reporting_interval < 0 ||
+		(*trace_name && !trace_name_valid(trace_name)) ||
+		settings.churn < 0 || settings.churn > MAX_CHURN_CONNECTIONS ||
+		(settings.churn && settings.traffic_dump)) {
 		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Flow settings incorrect");
 	}
 
 	/* Parse extra socket options */
-	for (i = 0; i < settings.num_extra_socket_options; i++) {
-
-		const unsigned char* buffer = 0;
-		size_t len;
-		xmlrpc_value *option, *level = 0, *optname = 0, *value = 0;
-		xmlrpc_array_read_item(env, extra_options, i, &option);
+	parse_extra_socket_options(env, extra_options, settings.profile);
+	if (env->fault_occurred)
+		goto cleanup;
 
-		if (!env->fault_occurred)
-			xmlrpc_struct_read_value(env, option, "level", &level);
-		if (!env->fault_occurred)
-			xmlrpc_struct_read_value(env, option, "optname", &optname);
-		if (!env->fault_occurred)
-			xmlrpc_struct_read_value(env, option, "value", &value);
-		if (!env->fault_occurred)
-			xmlrpc_read_int(env, level, &settings.extra_socket_options[i].level);
-		if (!env->fault_occurred)
-			xmlrpc_read_int(env, optname, &settings.extra_socket_options[i].optname);
-		if (!env->fault_occurred)
-			xmlrpc_read_base64(env, value, &len, &buffer);
-		if (level)
-			xmlrpc_DECREF(level);
-		if (optname)
-			xmlrpc_DECREF(optname);
-		if (value)
-			xmlrpc_DECREF(value);
-		if (!env->fault_occurred) {
-			if (len > MAX_EXTRA_SOCKET_OPTION_VALUE_LENGTH) {
-				free((void *)buffer);
-				XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Too long extra socket option length");
-			}
-			settings.extra_socket_options[i].optlen = len;
-			memcpy(settings.extra_socket_options[i].optval, buffer, len);
-			free((void *)buffer);
-		}
-		if (env->fault_occurred)
-			goto cleanup;
-	}
+	/* Parse empirical distributions */
+	parse_trafgen_cdf(env, request_cdf, &settings.profile->request_trafgen_options);
+	if (!env->fault_occurred)
+		parse_trafgen_cdf(env, response_cdf,
+				  &settings.profile->response_trafgen_options);
+	if (!env->fault_occurred)
+		parse_trafgen_cdf(env, gap_cdf,
+				  &settings.profile->interpacket_gap_trafgen_options);
+	if (env->fault_occurred)
+		goto cleanup;
 
 	strcpy(source_settings.destination_host, destination_host);
-	strcpy(settings.cc_alg, cc_alg);
-	strcpy(settings.bind_address, bind_address);
+	strcpy(settings.profile->cc_alg, cc_alg);
+	strcpy(settings.profile->bind_address, bind_address);
+	strcpy(settings.trace_name, trace_name);
 
 	request = malloc(sizeof(struct request_add_flow_source));
 	request->settings = settings;
@@ -244,10 +410,21 @@ static xmlrpc_value * add_flow_source(xmlrpc_env * const env,
 cleanup:
 	if (request)
 		free_all(request->r.error, request);
-	free_all(destination_host, cc_alg, bind_address);
+	free_all(destination_host, cc_alg, bind_address, trace_name);
 
 	if (extra_options)
 		xmlrpc_DECREF(extra_options);
+	if (request_cdf)
+		xmlrpc_DECREF(request_cdf);
+	if (response_cdf)
+		xmlrpc_DECREF(response_cdf);
+	if (gap_cdf)
+		xmlrpc_DECREF(gap_cdf);
+	/* the daemon thread interns its own copy */
+	profile_unref(settings.profile);
+	/* the trace is of no use if the flow could not be added */
+	if (env->fault_occurred && trace_name)
+		trace_remove(trace_name);
 
 	if (env->fault_occurred)
 		logging(LOG_WARNING, "method add_flow_source failed: %s",
@@ -280,11 +457,17 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 {
 	UNUSED_ARGUMENT(user_data);
 
-	int rc, i;
+	int rc;
 	xmlrpc_value *ret = 0;
 	char* cc_alg = 0;
 	char* bind_address = 0;
 	xmlrpc_value* extra_options = 0;
+	xmlrpc_value* request_cdf = 0;
+	xmlrpc_value* response_cdf = 0;
+	xmlrpc_value* gap_cdf = 0;
+	char* trace_name = 0;
+	int write_size_high = 0, write_size_low = 0;
+	int read_size_high = 0, read_size_low = 0;
 
 	struct flow_settings settings;
 
@@ -292,6 +475,12 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 
 	DEBUG_MSG(LOG_WARNING, "method add_flow_destination called");
 
+	memset(&settings, 0, sizeof(settings));
+	settings.profile = profile_new();
+	if (!settings.profile)
+		XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, "Could not allocate "
+			    "memory for flow profile");
+
 	/* Parse our argument array. */
 	xmlrpc_decompose_value(env, param_array,
 		"("
@@ -310,6 +499,10 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 		"{s:i,s:i,s:i,s:i,s:i,*}"
 		"{s:s,*}" /* For libpcap dumps */
 		"{s:i,s:A,*}"
+		"{s:A,s:A,s:A,*}" /* empirical distributions */
+		"{s:s,*}" /* trace replay */
+		"{s:i,*}" /* connection churn */
+		"{s:i,s:i,s:i,s:i,s:i,s:i,*}" /* flow size */
 		")",
 
 		/* general settings */
@@ -337,17 +530,17 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 		"write_rate", &settings.write_rate,
 		"random_seed",&settings.random_seed,
 
-		"traffic_generation_request_distribution", &settings.request_trafgen_options.distribution,
-		"traffic_generation_request_param_one", &settings.request_trafgen_options.param_one,
-		"traffic_generation_request_param_two", &settings.request_trafgen_options.param_two,
+		"traffic_generation_request_distribution", &settings.profile->request_trafgen_options.distribution,
+		"traffic_generation_request_param_one", &settings.profile->request_trafgen_options.param_one,
+		"traffic_generation_request_param_two", &settings.profile->request_trafgen_options.param_two,
 
-		"traffic_generation_response_distribution", &settings.response_trafgen_options.distribution,
-		"traffic_generation_response_param_one", &settings.response_trafgen_options.param_one,
-		"traffic_generation_response_param_two", &settings.response_trafgen_options.param_two,
+		"traffic_generation_response_distribution", &settings.profile->response_trafgen_options.distribution,
+		"traffic_generation_response_param_one", &settings.profile->response_trafgen_options.param_one,
+		"traffic_generation_response_param_two", &settings.profile->response_trafgen_options.param_two,
 
-		"traffic_generation_gap_distribution", &settings.interpacket_gap_trafgen_options.distribution,
-		"traffic_generation_gap_param_one", &settings.interpacket_gap_trafgen_options.param_one,
-		"traffic_generation_gap_param_two", &settings.interpacket_gap_trafgen_options.param_two,
+		"traffic_generation_gap_distribution", &settings.profile->interpacket_gap_trafgen_options.distribution,
+		"traffic_generation_gap_param_one", &settings.profile->interpacket_gap_trafgen_options.param_one,
+		"traffic_generation_gap_param_two", &settings.profile->interpacket_gap_trafgen_options.param_two,
 
 		"flow_control", &settings.flow_control,
 		"byte_counting", &settings.byte_counting,
@@ -362,71 +555,74 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 		"dscp", &settings.dscp,
 		"ipmtudiscover", &settings.ipmtudiscover,
 		"dump_prefix", &dump_prefix,
-		"num_extra_socket_options", &settings.num_extra_socket_options,
-		"extra_socket_options", &extra_options);
+		"num_extra_socket_options", &settings.profile->num_extra_socket_options,
+		"extra_socket_options", &extra_options,
+
+		/* empirical distributions */
+		"traffic_generation_request_cdf", &request_cdf,
+		"traffic_generation_response_cdf", &response_cdf,
+		"traffic_generation_gap_cdf", &gap_cdf,
+
+		/* trace replay */
+		"trace_name", &trace_name,
+
+		/* connection churn */
+		"churn", &settings.churn,
+
+		/* flow size */
+		"write_size_high", &write_size_high,
+		"write_size_low", &write_size_low,
+		"read_size_high", &read_size_high,
+		"read_size_low", &read_size_low,
+		"write_blocks", &settings.flow_blocks[WRITE],
+		"read_blocks", &settings.flow_blocks[READ]);
 
 	if (env->fault_occurred)
 		goto cleanup;
 
+	set_flow_size(&settings, WRITE, write_size_high, write_size_low);
+	set_flow_size(&settings, READ, read_size_high, read_size_low);
+
 #ifndef HAVE_LIBPCAP
 	if (settings.traffic_dump)
 		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Daemon was asked to dump traffic, but wasn't compiled with libpcap support");
 #endif
 
 	/* Check for sanity */
-	if (strlen(bind_address) >= sizeof(settings.bind_address) - 1 ||
+	if (strlen(bind_address) >= sizeof(settings.profile->bind_address) - 1 ||
 		settings.delay[WRITE] < 0 || settings.duration[WRITE] < 0 ||
 		settings.delay[READ] < 0 || settings.duration[READ] < 0 ||
 		settings.requested_send_buffer_size < 0 || settings.requested_read_buffer_size < 0 ||
 		settings.maximum_block_size < MIN_BLOCK_SIZE ||
 		settings.write_rate < 0 ||
 		strlen(cc_alg) > TCP_CA_NAME_MAX ||
-		settings.num_extra_socket_options < 0 || settings.num_extra_socket_options > MAX_EXTRA_SOCKET_OPTIONS ||
-		xmlrpc_array_size(env, extra_options) != settings.num_extra_socket_options) {
+		settings.profile->num_extra_socket_options < 0 || settings.profile->num_extra_socket_options > MAX_EXTRA_SOCKET_OPTIONS ||
+		xmlrpc_array_size(env, extra_options) != settings.profile->num_extra_socket_options ||
+		(*trace_name && !trace_name_valid(trace_name)) ||
+		settings.churn < 0 || settings.churn > MAX_CHURN_CONNECTIONS ||
+		(settings.churn && settings.traffic_dump)) {
 		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Flow settings incorrect");
 	}
 
 	/* Parse extra socket options */
-	for (i = 0; i < settings.num_extra_socket_options; i++) {
-
-		const unsigned char* buffer = 0;
-		size_t len;
-		xmlrpc_value *option, *level = 0, *optname = 0, *value = 0;
-		xmlrpc_array_read_item(env, extra_options, i, &option);
+	parse_extra_socket_options(env, extra_options, settings.profile);
+	if (env->fault_occurred)
+		goto cleanup;
 
-		if (!env->fault_occurred)
-			xmlrpc_struct_read_value(env, option, "level", &level);
-		if (!env->fault_occurred)
-			xmlrpc_struct_read_value(env, option, "optname", &optname);
-		if (!env->fault_occurred)
-			xmlrpc_struct_read_value(env, option, "value", &value);
-		if (!env->fault_occurred)
-			xmlrpc_read_int(env, level, &settings.extra_socket_options[i].level);
-		if (!env->fault_occurred)
-			xmlrpc_read_int(env, optname, &settings.extra_socket_options[i].optname);
-		if (!env->fault_occurred)
-			xmlrpc_read_base64(env, value, &len, &buffer);
-		if (level)
-			xmlrpc_DECREF(level);
-		if (optname)
-			xmlrpc_DECREF(optname);
-		if (value)
-			xmlrpc_DECREF(value);
-		if (!env->fault_occurred) {
-			if (len > MAX_EXTRA_SOCKET_OPTION_VALUE_LENGTH) {
-				free((void *)buffer);
-				XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Too long extra socket option length");
-			}
-			settings.extra_socket_options[i].optlen = len;
-			memcpy(settings.extra_socket_options[i].optval, buffer, len);
-			free((void *)buffer);
-		}
-		if (env->fault_occurred)
-			goto cleanup;
-	}
+	/* Parse empirical distributions */
+	parse_trafgen_cdf(env, request_cdf, &settings.profile->request_trafgen_options);
+	if (!env->fault_occurred)
+		parse_trafgen_cdf(env, response_cdf,
+				  &settings.profile->response_trafgen_options);
+	if (!env->fault_occurred)
+		parse_trafgen_cdf(env, gap_cdf,
+				  &settings.profile->interpacket_gap_trafgen_options);
+	if (env->fault_occurred)
+		goto cleanup;
 
-	strcpy(settings.cc_alg, cc_alg);
-	strcpy(settings.bind_address, bind_address);
+	strcpy(settings.profile->cc_alg, cc_alg);
+	strcpy(settings.profile->bind_address, bind_address);
+	strcpy(settings.trace_name, trace_name);
 	DEBUG_MSG(LOG_WARNING, "bind_address=%s", bind_address);
 	request = malloc(sizeof(struct request_add_flow_destination));
 	request->settings = settings;
@@ -445,10 +641,21 @@ static xmlrpc_value * add_flow_destination(xmlrpc_env * const env,
 cleanup:
 	if (request)
 		free_all(request->r.error, request);
-	free_all(cc_alg, bind_address);
+	free_all(cc_alg, bind_address, trace_name);
 
 	if (extra_options)
 		xmlrpc_DECREF(extra_options);
+	if (request_cdf)
+		xmlrpc_DECREF(request_cdf);
+	if (response_cdf)
+		xmlrpc_DECREF(response_cdf);
+	if (gap_cdf)
+		xmlrpc_DECREF(gap_cdf);
+	/* the daemon thread interns its own copy */
+	profile_unref(settings.profile);
+	/* the trace is of no use if the flow could not be added */
+	if (env->fault_occurred && trace_name)
+		trace_remove(trace_name);
 
 	if (env->fault_occurred)
 		logging(LOG_WARNING, "method add_flow_destination failed: %s",
@@ -459,6 +666,587 @@ cleanup:
 	return ret;
 }
 
+/** Type of a flow setting sent to method add_flows. */
+enum setting_type {
+	SETTING_INT = 0,
+	SETTING_BOOL,
+	SETTING_DOUBLE,
+	/** String stored in a char array, including the terminating NUL. */
+	SETTING_STRING,
+};
+
+/** Structure a flow setting sent to method add_flows is stored in. */
+enum setting_owner {
+	/** struct flow_settings */
+	OWNER_FLOW = 0,
+	/** struct flow_source_settings */
+	OWNER_SOURCE,
+	/** struct flow_profile */
+	OWNER_PROFILE,
+};
+
+/** Flow setting sent to method add_flows. */
+struct setting_member {
+	/** Name, as in the parameters of add_flow_source. */
+	const char *name;
+	/** Type of the value. */
+	enum setting_type type;
+	/** Structure the value is part of. */
+	enum setting_owner owner;
+	/** Offset of the value in its structure. */
+	size_t offset;
+	/** Size of the value in its structure. */
+	size_t size;
+};
+
+/** Setting stored in struct flow_settings. */
+#define FLOW_SETTING(name, type, field)					    \
+	{name, type, OWNER_FLOW, offsetof(struct flow_settings, field),    \
+	 sizeof(((struct flow_settings *)0)->field)}
+/** Setting stored in struct flow_source_settings. */
+#define SOURCE_SETTING(name, type, field)				    \
+	{name, type, OWNER_SOURCE,					    \
+	 offsetof(struct flow_source_settings, field),			    \
+	 sizeof(((struct flow_source_settings *)0)->field)}
+/** Setting stored in struct flow_profile. */
+#define PROFILE_SETTING(name, type, field)				    \
+	{name, type, OWNER_PROFILE, offsetof(struct flow_profile, field),  \
+	 sizeof(((struct flow_profile *)0)->field)}
+
+/**
+ * Flow settings of method add_flows that map directly to a field. The flow
+ * size, extra socket options, empirical distributions and the dump prefix
+ * are handled by apply_flow_settings() itself.
+ */
+static const struct setting_member setting_members[] = {
+	PROFILE_SETTING("bind_address", SETTING_STRING, bind_address),
+	FLOW_SETTING("flow_id", SETTING_INT, flow_id),
+	FLOW_SETTING("write_delay", SETTING_DOUBLE, delay[WRITE]),
+	FLOW_SETTING("write_duration", SETTING_DOUBLE, duration[WRITE]),
+	FLOW_SETTING("read_delay", SETTING_DOUBLE, delay[READ]),
+	FLOW_SETTING("read_duration", SETTING_DOUBLE, duration[READ]),
+	FLOW_SETTING("reporting_interval", SETTING_DOUBLE, reporting_interval),
+	FLOW_SETTING("requested_send_buffer_size", SETTING_INT,
+		     requested_send_buffer_size),
+	FLOW_SETTING("requested_read_buffer_size", SETTING_INT,
+		     requested_read_buffer_size),
+	FLOW_SETTING("maximum_block_size", SETTING_INT, maximum_block_size),
+	FLOW_SETTING("traffic_dump", SETTING_BOOL, traffic_dump),
+	FLOW_SETTING("dump_merge", SETTING_BOOL, dump_merge),
+	FLOW_SETTING("so_debug", SETTING_BOOL, so_debug),
+	FLOW_SETTING("route_record", SETTING_BOOL, route_record),
+	FLOW_SETTING("pushy", SETTING_BOOL, pushy),
+	FLOW_SETTING("shutdown", SETTING_BOOL, shutdown),
+	FLOW_SETTING("write_rate", SETTING_INT, write_rate),
+	FLOW_SETTING("random_seed", SETTING_INT, random_seed),
+	PROFILE_SETTING("traffic_generation_request_distribution", SETTING_INT,
+			request_trafgen_options.distribution),
+	PROFILE_SETTING("traffic_generation_request_param_one", SETTING_DOUBLE,
+			request_trafgen_options.param_one),
+	PROFILE_SETTING("traffic_generation_request_param_two", SETTING_DOUBLE,
+			request_trafgen_options.param_two),
+	PROFILE_SETTING("traffic_generation_response_distribution", SETTING_INT,
+			response_trafgen_options.distribution),
+	PROFILE_SETTING("traffic_generation_response_param_one", SETTING_DOUBLE,
+			response_trafgen_options.param_one),
+	PROFILE_SETTING("traffic_generation_response_param_two", SETTING_DOUBLE,
+			response_trafgen_options.param_two),
+	PROFILE_SETTING("traffic_generation_gap_distribution", SETTING_INT,
+			interpacket_gap_trafgen_options.distribution),
+	PROFILE_SETTING("traffic_generation_gap_param_one", SETTING_DOUBLE,
+			interpacket_gap_trafgen_options.param_one),
+	PROFILE_SETTING("traffic_generation_gap_param_two", SETTING_DOUBLE,
+			interpacket_gap_trafgen_options.param_two),
+	FLOW_SETTING("flow_control", SETTING_BOOL, flow_control),
+	FLOW_SETTING("byte_counting", SETTING_BOOL, byte_counting),
+	FLOW_SETTING("cork", SETTING_INT, cork),
+	FLOW_SETTING("nonagle", SETTING_INT, nonagle),
+	PROFILE_SETTING("cc_alg", SETTING_STRING, cc_alg),
+	FLOW_SETTING("elcn", SETTING_INT, elcn),
+	FLOW_SETTING("lcd", SETTING_INT, lcd),
+	FLOW_SETTING("mtcp", SETTING_INT, mtcp),
+	FLOW_SETTING("dscp", SETTING_INT, dscp),
+	FLOW_SETTING("ipmtudiscover", SETTING_INT, ipmtudiscover),
+	FLOW_SETTING("trace_name", SETTING_STRING, trace_name),
+	FLOW_SETTING("churn", SETTING_INT, churn),
+	FLOW_SETTING("write_blocks", SETTING_INT, flow_blocks[WRITE]),
+	FLOW_SETTING("read_blocks", SETTING_INT, flow_blocks[READ]),
+	SOURCE_SETTING("destination_address", SETTING_STRING,
+		       destination_host),
+	SOURCE_SETTING("destination_port", SETTING_INT, destination_port),
+	SOURCE_SETTING("late_connect", SETTING_INT, late_connect),
+};
+
+/** Number of settings in setting_members. */
+#define NUM_SETTING_MEMBERS \
+	(sizeof(setting_members) / sizeof(setting_members[0]))
+
+/** Names of the empirical distributions of the traffic generation. */
+static const char *cdf_members[] = {
+	"traffic_generation_request_cdf",
+	"traffic_generation_response_cdf",
+	"traffic_generation_gap_cdf",
+};
+
+/** Number of empirical distributions in cdf_members. */
+#define NUM_CDF_MEMBERS (sizeof(cdf_members) / sizeof(cdf_members[0]))
+
+/** Traffic generation options of @p profile, in the order of cdf_members. */
+#define TRAFGEN_OPTIONS(profile) {					    \
+	&(profile)->request_trafgen_options,				    \
+	&(profile)->response_trafgen_options,				    \
+	&(profile)->interpacket_gap_trafgen_options,			    \
+}
+
+/**
+ * Read one half of the flow size of direction @p direction, if present.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in] value XML-RPC struct with the settings
+ * @param[in] name name of the member holding the half
+ * @param[in,out] half the half to update
+ */
+static void read_flow_size_half(xmlrpc_env * const env,
+				xmlrpc_value * const value, const char *name,
+				int *half)
+{
+	xmlrpc_value *member = 0;
+
+	xmlrpc_struct_find_value(env, value, name, &member);
+	if (member) {
+		xmlrpc_read_int(env, member, half);
+		xmlrpc_DECREF(member);
+	}
+}
+
+/**
+ * Apply the flow settings in XML-RPC struct @p value to a flow endpoint.
+ *
+ * Members that are not present leave the settings unchanged, so the settings
+ * shared by all endpoints of method add_flows and the settings of a single
+ * endpoint are applied one after the other. A profile shared with other
+ * settings is copied before its first member is changed.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in] value XML-RPC struct with the settings
+ * @param[in,out] settings flow settings to update
+ * @param[in,out] source_settings source settings to update
+ * @param[in,out] endpoint endpoint type (SOURCE or DESTINATION) to update
+ */
+static void apply_flow_settings(xmlrpc_env * const env,
+				xmlrpc_value * const value,
+				struct flow_settings *settings,
+				struct flow_source_settings *source_settings,
+				int *endpoint)
+{
+	xmlrpc_value *member = 0;
+	struct flow_profile *profile;
+
+	for (unsigned i = 0; i < NUM_SETTING_MEMBERS; i++) {
+		const struct setting_member *m = &setting_members[i];
+		char *field = 0;
+		const char *str = 0;
+		xmlrpc_bool b;
+
+		xmlrpc_struct_find_value(env, value, m->name, &member);
+		if (env->fault_occurred)
+			goto cleanup;
+		if (!member)
+			continue;
+
+		switch (m->owner) {
+		case OWNER_FLOW:
+			field = (char *)settings;
+			break;
+		case OWNER_SOURCE:
+			field = (char *)source_settings;
+			break;
+		case OWNER_PROFILE:
+			field = (char *)profile_mutable(&settings->profile);
+			if (!field)
+				XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR,
+					    "Could not allocate memory for "
+					    "flow profile");
+			break;
+		}
+		field += m->offset;
+
+		switch (m->type) {
+		case SETTING_INT:
+			xmlrpc_read_int(env, member, (int *)field);
+			break;
+		case SETTING_BOOL:
+			xmlrpc_read_bool(env, member, &b);
+			*(int *)field = b;
+			break;
+		case SETTING_DOUBLE:
+			xmlrpc_read_double(env, member, (double *)field);
+			break;
+		case SETTING_STRING:
+			xmlrpc_read_string(env, member, &str);
+			if (env->fault_occurred)
+				break;
+			if (strlen(str) >= m->size)
+				xmlrpc_env_set_fault(env, XMLRPC_TYPE_ERROR,
+						     "Flow settings incorrect");
+			else
+				strcpy(field, str);
+			free((void *)str);
+			break;
+		}
+		xmlrpc_DECREF(member);
+		member = 0;
+		if (env->fault_occurred)
+			goto cleanup;
+	}
+
+	xmlrpc_struct_find_value(env, value, "endpoint", &member);
+	if (member) {
+		xmlrpc_read_int(env, member, endpoint);
+		xmlrpc_DECREF(member);
+		member = 0;
+	}
+	if (env->fault_occurred)
+		goto cleanup;
+
+	/* Flow size, sent in two 32 bit halves per direction */
+	for (int direction = 0; direction < 2; direction++) {
+		uint64_t size = settings->flow_size[direction];
+		int high = size >> 32;
+		int low = size & 0xFFFFFFFF;
+
+		read_flow_size_half(env, value, direction == WRITE ?
+				    "write_size_high" : "read_size_high", &high);
+		if (!env->fault_occurred)
+			read_flow_size_half(env, value, direction == WRITE ?
+					    "write_size_low" : "read_size_low",
+					    &low);
+		if (env->fault_occurred)
+			goto cleanup;
+		set_flow_size(settings, direction, high, low);
+	}
+
+	/* The number of extra socket options follows from the array */
+	xmlrpc_struct_find_value(env, value, "extra_socket_options", &member);
+	if (member) {
+		profile = profile_mutable(&settings->profile);
+		if (!profile)
+			XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, "Could not "
+				    "allocate memory for flow profile");
+		profile->num_extra_socket_options =
+			xmlrpc_array_size(env, member);
+		if (!env->fault_occurred &&
+		    profile->num_extra_socket_options > MAX_EXTRA_SOCKET_OPTIONS)
+			xmlrpc_env_set_fault(env, XMLRPC_TYPE_ERROR,
+					     "Too many extra socket options");
+		if (!env->fault_occurred)
+			parse_extra_socket_options(env, member, profile);
+		xmlrpc_DECREF(member);
+		member = 0;
+	}
+	if (env->fault_occurred)
+		goto cleanup;
+
+	for (unsigned i = 0; i < NUM_CDF_MEMBERS; i++) {
+		xmlrpc_struct_find_value(env, value, cdf_members[i], &member);
+		if (env->fault_occurred)
+			goto cleanup;
+		if (!member)
+			continue;
+
+		profile = profile_mutable(&settings->profile);
+		if (!profile)
+			XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, "Could not "
+				    "allocate memory for flow profile");
+
+		struct trafgen_options *opts[] = TRAFGEN_OPTIONS(profile);
+		cdf_free(opts[i]->cdf);
+		opts[i]->cdf = NULL;
+		parse_trafgen_cdf(env, member, opts[i]);
+		xmlrpc_DECREF(member);
+		member = 0;
+		if (env->fault_occurred)
+			goto cleanup;
+	}
+
+	/* Like add_flow_source, the prefix is global to the daemon */
+	xmlrpc_struct_find_value(env, value, "dump_prefix", &member);
+	if (member) {
+		const char *str = 0;
+		xmlrpc_read_string(env, member, &str);
+		if (!env->fault_occurred)
+			dump_prefix = (char *)str;
+		xmlrpc_DECREF(member);
+		member = 0;
+	}
+
+cleanup:
+	if (member)
+		xmlrpc_DECREF(member);
+}
+
+/**
+ * Check the flow settings of an endpoint of method add_flows.
+ *
+ * @param[in] settings flow settings
+ * @param[in] source_settings source settings, NULL for a destination
+ * @return true if the settings are valid
+ */
+static bool flow_settings_valid(const struct flow_settings *settings,
+				const struct flow_source_settings *source_settings)
+{
+	const struct trafgen_options *opts[] = TRAFGEN_OPTIONS(settings->profile);
+
+#ifndef HAVE_LIBPCAP
+	if (settings->traffic_dump)
+		return false;
+#endif /* HAVE_LIBPCAP */
+
+	for (unsigned i = 0; i < sizeof(opts) / sizeof(opts[0]); i++)
+		if ((opts[i]->distribution == EMPIRICAL) != !!opts[i]->cdf)
+			return false;
+
+	if (source_settings &&
+	    (source_settings->destination_port <= 0 ||
+	     source_settings->destination_port > 65535))
+		return false;
+
+	return !(settings->delay[WRITE] < 0 || settings->duration[WRITE] < 0 ||
+		 settings->delay[READ] < 0 || settings->duration[READ] < 0 ||
+		 settings->requested_send_buffer_size < 0 ||
+		 settings->requested_read_buffer_size < 0 ||
+		 settings->maximum_block_size < MIN_BLOCK_SIZE ||
+		 settings->dscp < 0 || settings->dscp > 255 ||
+		 settings->write_rate < 0 ||
+		 settings->reporting_interval < 0 ||
+		 (settings->trace_name[0] &&
+		  !trace_name_valid(settings->trace_name)) ||
+		 settings->churn < 0 ||
+		 settings->churn > MAX_CHURN_CONNECTIONS ||
+		 (settings->churn && settings->traffic_dump));
+}
+
+/** Flow endpoint of method add_flows, either a source or a destination. */
+union add_flows_entry {
+	struct request r;
+	struct request_add_flow_destination destination;
+	struct request_add_flow_source source;
+};
+
+/**
+ * Stop the flow endpoints a batch request has added.
+ *
+ * Used if the reply of method add_flows cannot be built. The controller then
+ * never learns the flow IDs and could neither start nor stop the flows.
+ *
+ * @param[in] entries flow endpoints of the batch request
+ * @param[in] num_flows number of flow endpoints in @p entries
+ */
+static void remove_added_flows(union add_flows_entry **entries, int num_flows)
+{
+	for (int i = 0; i < num_flows; i++) {
+		union add_flows_entry *entry = entries[i];
+		struct request_stop_flow *request;
+
+		if (entry->r.error)
+			continue;
+
+		request = calloc(1, sizeof(struct request_stop_flow));
+		if (!request) {
+			logging(LOG_ALERT, "could not allocate memory to "
+				"remove flow");
+			continue;
+		}
+		request->flow_id = entry->r.type == REQUEST_ADD_SOURCE ?
+				   entry->source.flow_id :
+				   entry->destination.flow_id;
+		if (dispatch_request((struct request *)request,
+				     REQUEST_STOP_FLOW) == -1)
+			logging(LOG_WARNING, "could not remove flow %d: %s",
+				request->flow_id, request->r.error);
+		free_all(request->r.error, request);
+	}
+}
+
+/**
+ * Add many flow endpoints in a single call.
+ *
+ * The first parameter is a struct with the settings shared by all endpoints.
+ * It has the members of all parameters of add_flow_source and
+ * add_flow_destination merged into one struct, and member "endpoint"
+ * (SOURCE or DESTINATION). The number of extra socket options is given by
+ * the size of their array. The second parameter is an array of structs, one
+ * per endpoint, holding only the settings which differ from the shared ones.
+ *
+ * The settings of all endpoints are checked before any of them is added. The
+ * daemon thread then adds all endpoints in a single pass.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in,out] param_array XML-RPC value
+ * @param[in,out] user_data unused arg
+ * @return array with a struct per endpoint in the order of the request,
+ * holding the reply of add_flow_source or add_flow_destination, or member
+ * "error" if the endpoint could not be added
+ */
+static xmlrpc_value * method_add_flows(xmlrpc_env * const env,
+		   xmlrpc_value * const param_array,
+		   void * const user_data)
+{
+	UNUSED_ARGUMENT(user_data);
+
+	xmlrpc_value *ret = 0;
+	xmlrpc_value *shared_value = 0;
+	xmlrpc_value *flows_value = 0;
+	struct flow_settings shared;
+	struct flow_source_settings shared_source;
+	int shared_endpoint = DESTINATION;
+	struct request_add_flows *request = 0;
+	union add_flows_entry **entries = 0;
+	int num_flows = 0, num_entries = 0;
+
+	DEBUG_MSG(LOG_WARNING, "method add_flows called");
+
+	memset(&shared, 0, sizeof(shared));
+	memset(&shared_source, 0, sizeof(shared_source));
+	shared.profile = profile_new();
+	if (!shared.profile)
+		XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, "Could not allocate "
+			    "memory for flow profile");
+
+	xmlrpc_decompose_value(env, param_array, "(SA)", &shared_value,
+			       &flows_value);
+	if (env->fault_occurred)
+		goto cleanup;
+
+	apply_flow_settings(env, shared_value, &shared, &shared_source,
+			    &shared_endpoint);
+	if (env->fault_occurred)
+		goto cleanup;
+
+	num_flows = xmlrpc_array_size(env, flows_value);
+	if (env->fault_occurred)
+		goto cleanup;
+	if (num_flows > MAX_FLOWS_DAEMON)
+		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Too many flows");
+
+	request = calloc(1, sizeof(struct request_add_flows));
+	entries = calloc(num_flows ? num_flows : 1, sizeof(*entries));
+	if (!request || !entries)
+		XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, "Could not allocate "
+			    "memory for request");
+
+	for (int i = 0; i < num_flows; i++) {
+		union add_flows_entry *entry = calloc(1, sizeof(*entry));
+		xmlrpc_value *flow_value = 0;
+		int endpoint = shared_endpoint;
+
+		if (!entry)
+			XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, "Could not "
+				    "allocate memory for request");
+		entries[num_entries++] = entry;
+
+		/* Destination and source share the settings at the start */
+		entry->source.settings = shared;
+		entry->source.settings.profile = profile_ref(shared.profile);
+		entry->source.source_settings = shared_source;
+
+		xmlrpc_array_read_item(env, flows_value, i, &flow_value);
+		if (!env->fault_occurred)
+			apply_flow_settings(env, flow_value,
+					    &entry->source.settings,
+					    &entry->source.source_settings,
+					    &endpoint);
+		if (flow_value)
+			xmlrpc_DECREF(flow_value);
+		if (env->fault_occurred)
+			goto cleanup;
+
+		if (endpoint != SOURCE && endpoint != DESTINATION)
+			XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Unknown endpoint");
+		entry->r.type = endpoint == SOURCE ? REQUEST_ADD_SOURCE
+						   : REQUEST_ADD_DESTINATION;
+		if (!flow_settings_valid(&entry->source.settings,
+					 endpoint == SOURCE ?
+					 &entry->source.source_settings : NULL))
+			XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR,
+				    "Flow settings incorrect");
+	}
+
+	request->num_flows = num_flows;
+	request->flows = (struct request **)entries;
+	if (dispatch_request((struct request *)request, REQUEST_ADD_FLOWS) == -1)
+		XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, request->r.error);
+
+	/* Return our result. */
+	ret = xmlrpc_array_new(env);
+	for (int i = 0; i < num_flows && !env->fault_occurred; i++) {
+		union add_flows_entry *entry = entries[i];
+		xmlrpc_value *item;
+
+		if (entry->r.error)
+			item = xmlrpc_build_value(env, "{s:s}",
+						  "error", entry->r.error);
+		else if (entry->r.type == REQUEST_ADD_SOURCE)
+			item = xmlrpc_build_value(env, "{s:i,s:s,s:i,s:i}",
+				"flow_id", entry->source.flow_id,
+				"cc_alg", entry->source.cc_alg,
+				"real_send_buffer_size",
+				entry->source.real_send_buffer_size,
+				"real_read_buffer_size",
+				entry->source.real_read_buffer_size);
+		else
+			item = xmlrpc_build_value(env, "{s:i,s:i,s:i,s:i}",
+				"flow_id", entry->destination.flow_id,
+				"listen_data_port",
+				entry->destination.listen_data_port,
+				"real_listen_send_buffer_size",
+				entry->destination.real_listen_send_buffer_size,
+				"real_listen_read_buffer_size",
+				entry->destination.real_listen_read_buffer_size);
+		if (env->fault_occurred)
+			break;
+		xmlrpc_array_append_item(env, ret, item);
+		xmlrpc_DECREF(item);
+	}
+	if (env->fault_occurred) {
+		remove_added_flows(entries, num_flows);
+		if (ret)
+			xmlrpc_DECREF(ret);
+		ret = 0;
+	}
+
+cleanup:
+	for (int i = 0; i < num_entries; i++) {
+		struct flow_settings *settings = &entries[i]->source.settings;
+
+		/* the trace is of no use if the flow could not be added */
+		if ((env->fault_occurred || entries[i]->r.error) &&
+		    settings->trace_name[0])
+			trace_remove(settings->trace_name);
+		/* the daemon thread interns its own copy */
+		profile_unref(settings->profile);
+		free_all(entries[i]->r.error, entries[i]);
+	}
+	free(entries);
+	if (request)
+		free_all(request->r.error, request);
+	profile_unref(shared.profile);
+
+	if (shared_value)
+		xmlrpc_DECREF(shared_value);
+	if (flows_value)
+		xmlrpc_DECREF(flows_value);
+
+	if (env->fault_occurred)
+		logging(LOG_WARNING, "method add_flows failed: %s",
+			env->fault_string);
+	else
+		DEBUG_MSG(LOG_WARNING, "method add_flows successful, added "
+			  "%d flow endpoints", num_flows);
+
+	return ret;
+}
+
 static xmlrpc_value * start_flows(xmlrpc_env * const env,
 		   xmlrpc_value * const param_array,
 		   void * const user_data)
@@ -467,22 +1255,24 @@ static xmlrpc_value * start_flows(xmlrpc_env * const env,
 
 	int rc;
 	xmlrpc_value *ret = 0;
-	int start_timestamp;
+	int start_sec, start_nsec;
 	struct request_start_flows *request = 0;
 
 	DEBUG_MSG(LOG_WARNING, "method start_flows called");
 
 	/* Parse our argument array. */
-	xmlrpc_decompose_value(env, param_array, "({s:i,*})",
+	xmlrpc_decompose_value(env, param_array, "({s:i,s:i,*})",
 
 		/* general settings */
-		"start_timestamp", &start_timestamp);
+		"start_sec", &start_sec,
+		"start_nsec", &start_nsec);
 
 	if (env->fault_occurred)
 		goto cleanup;
 
 	request = malloc(sizeof(struct request_start_flows));
-	request->start_timestamp = start_timestamp;
+	request->start_timestamp.tv_sec = start_sec;
+	request->start_timestamp.tv_nsec = start_nsec;
 	rc = dispatch_request((struct request*)request, REQUEST_START_FLOWS);
 
 	if (rc == -1)
@@ -543,6 +1333,14 @@ static xmlrpc_value * method_get_reports(xmlrpc_env * const env,
 			"{s:i,s:i,s:i,s:i}" /* bytes */
 			"{s:i,s:i,s:i,s:i}" /* block counts */
 			"{s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d}" /* RTT, IAT, Delay */
+			"{s:d,s:d,s:d}" /* send drift */
+			"{s:i,s:i,s:i,s:i}" /* churn connections */
+			"{s:d,s:d,s:d,s:d,s:d,s:d}" /* flow completion time */
+			"{s:d,s:d}" /* completion time of finite flow */
+			"{s:d}" /* start skew */
+			"{s:i,s:i,s:i}" /* corrupted payload of -E */
+			"{s:i,s:i,s:i}" /* capture of -M */
+			"{s:i,s:i,s:i,s:d,s:d,s:d,s:i,s:i,s:i}" /* wire analysis of -M */
 			"{s:i,s:i}" /* MTU */
 			"{s:i,s:i,s:i,s:i,s:i}" /* TCP info */
 			"{s:i,s:i,s:i,s:i,s:i}" /* ...      */
@@ -578,6 +1376,45 @@ static xmlrpc_value * method_get_reports(xmlrpc_env * const env,
 			"delay_max", report->delay_max,
 			"delay_sum", report->delay_sum,
 
+			"drift_min", report->drift_min,
+			"drift_max", report->drift_max,
+			"drift_sum", report->drift_sum,
+
+			"conns_opened", report->conns_opened,
+			"conns_completed", report->conns_completed,
+			"conns_failed", report->conns_failed,
+			"conns_dropped", report->conns_dropped,
+
+			"fct_min", report->fct_min,
+			"fct_max", report->fct_max,
+			"fct_sum", report->fct_sum,
+			"fct_p50", report->fct_p50,
+			"fct_p90", report->fct_p90,
+			"fct_p99", report->fct_p99,
+
+			"write_completion_time", report->completion_time[WRITE],
+			"read_completion_time", report->completion_time[READ],
+
+			"start_skew", report->start_skew,
+
+			"blocks_corrupted", report->blocks_corrupted,
+			"bytes_corrupted_high", (int32_t)(report->bytes_corrupted >> 32),
+			"bytes_corrupted_low", (int32_t)(report->bytes_corrupted & 0xFFFFFFFF),
+
+			"pcap_packets", report->pcap_packets,
+			"pcap_drops", report->pcap_drops,
+			"pcap_ring_drops", report->pcap_ring_drops,
+
+			"wire_retransmits", report->wire_retransmits,
+			"wire_reordered", report->wire_reordered,
+			"wire_rtt_samples", report->wire_rtt_samples,
+			"wire_rtt_min", report->wire_rtt_min,
+			"wire_rtt_max", report->wire_rtt_max,
+			"wire_rtt_sum", report->wire_rtt_sum,
+			"wire_acked_high", (int32_t)(report->wire_acked >> 32),
+			"wire_acked_low", (int32_t)(report->wire_acked & 0xFFFFFFFF),
+			"wire_flight", report->wire_flight,
+
 			"pmtu", report->pmtu,
 			"imtu", report->imtu,
 
@@ -665,6 +1502,96 @@ cleanup:
 	return ret;
 }
 
+/**
+ * Create an empty trace file on the daemon.
+ *
+ * The controller uploads a trace for replay with subsequent calls to
+ * append_trace and passes the returned name to add_flow_source or
+ * add_flow_destination.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in,out] param_array unused arg
+ * @param[in,out] user_data unused arg
+ * return xmlrpc_value XML-RPC value
+ */
+static xmlrpc_value * method_create_trace(xmlrpc_env * const env,
+		   xmlrpc_value * const param_array,
+		   void * const user_data)
+{
+	UNUSED_ARGUMENT(param_array);
+	UNUSED_ARGUMENT(user_data);
+
+	xmlrpc_value *ret = 0;
+	char name[MAX_TRACE_NAME_LENGTH];
+
+	DEBUG_MSG(LOG_WARNING, "method create_trace called");
+
+	if (trace_create(name, sizeof(name)) == -1)
+		XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, strerror(errno));
+
+	/* Return our result. */
+	ret = xmlrpc_build_value(env, "{s:s}", "trace_name", name);
+
+cleanup:
+	if (env->fault_occurred)
+		logging(LOG_WARNING, "method create_trace failed: %s",
+			env->fault_string);
+	else
+		DEBUG_MSG(LOG_WARNING, "method create_trace successful");
+
+	return ret;
+}
+
+/**
+ * Append a chunk of data to a trace file created by create_trace.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in,out] param_array XML-RPC value
+ * @param[in,out] user_data unused arg
+ * return xmlrpc_value XML-RPC value
+ */
+static xmlrpc_value * method_append_trace(xmlrpc_env * const env,
+		   xmlrpc_value * const param_array,
+		   void * const user_data)
+{
+	UNUSED_ARGUMENT(user_data);
+
+	xmlrpc_value *ret = 0;
+	char *trace_name = 0;
+	const unsigned char *data = 0;
+	size_t len = 0;
+
+	DEBUG_MSG(LOG_NOTICE, "method append_trace called");
+
+	/* Parse our argument array. */
+	xmlrpc_decompose_value(env, param_array, "({s:s,s:6,*})",
+		"trace_name", &trace_name,
+		"data", &data, &len);
+
+	if (env->fault_occurred)
+		goto cleanup;
+
+	if (len > TRACE_CHUNK_SIZE)
+		XMLRPC_FAIL(env, XMLRPC_TYPE_ERROR, "Trace chunk too large");
+
+	if (trace_append(trace_name, data, len) == -1)
+		XMLRPC_FAIL(env, XMLRPC_INTERNAL_ERROR, strerror(errno));
+
+	/* Return our result. */
+	ret = xmlrpc_build_value(env, "i", 0);
+
+cleanup:
+	free_all(trace_name, (void *)data);
+
+	if (env->fault_occurred)
+		logging(LOG_WARNING, "method append_trace failed: %s",
+			env->fault_string);
+	else
+		DEBUG_MSG(LOG_NOTICE, "method append_trace successful");
+
+	return ret;
+}
+
 /* This method returns version information of flowgrindd and OS as an xmlrpc struct */
 static xmlrpc_value * method_get_version(xmlrpc_env * const env,
 		   xmlrpc_value * const param_array,
@@ -698,6 +1625,129 @@ static xmlrpc_value * method_get_version(xmlrpc_env * const env,
 	return ret;
 }
 
+/**
+ * Timestamps for the estimation of the clock offset to the controller.
+ *
+ * Returns the time the request was received and the time the reply is sent
+ * in the clock of the daemon, as in the NTP on-wire protocol. Both are taken
+ * by the RPC thread without locking, so the daemon thread does not add to
+ * the measured round-trip time.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in,out] param_array unused arg
+ * @param[in,out] user_data unused arg
+ */
+static xmlrpc_value * method_get_time(xmlrpc_env * const env,
+		   xmlrpc_value * const param_array,
+		   void * const user_data)
+{
+	UNUSED_ARGUMENT(param_array);
+	UNUSED_ARGUMENT(user_data);
+
+	struct timespec recv_time, send_time;
+	xmlrpc_value *ret = 0;
+
+	gettime(&recv_time);
+	DEBUG_MSG(LOG_NOTICE, "method get_time called");
+
+	gettime(&send_time);
+	ret = xmlrpc_build_value(env, "{s:i,s:i,s:i,s:i}",
+				 "recv_sec", (int)recv_time.tv_sec,
+				 "recv_nsec", (int)recv_time.tv_nsec,
+				 "send_sec", (int)send_time.tv_sec,
+				 "send_nsec", (int)send_time.tv_nsec);
+
+	if (env->fault_occurred)
+		logging(LOG_WARNING, "method get_time failed: %s",
+			env->fault_string);
+	else
+		DEBUG_MSG(LOG_NOTICE, "method get_time successful");
+
+	return ret;
+}
+
+/**
+ * Summarize latency histogram @p h as XML-RPC struct.
+ *
+ * Quantiles are the upper bound of the histogram bucket holding them, zero if
+ * there are no samples and -1 if above the largest bucket bound.
+ */
+static xmlrpc_value *build_histogram(xmlrpc_env * const env,
+				     const struct metrics_histogram *h)
+{
+	const double count = metrics_get(&h->count);
+	double quantile[3] = {0, 0, 0};
+	const double q[3] = {0.5, 0.9, 0.99};
+
+	for (int i = 0; count && i < 3; i++) {
+		quantile[i] = metrics_quantile(h, NULL, q[i]);
+		if (isinf(quantile[i]))
+			quantile[i] = -1;
+	}
+
+	return xmlrpc_build_value(env, "{s:d,s:d,s:d,s:d,s:d}",
+				  "count", count,
+				  "avg", count ? metrics_get(&h->sum) / 1e9 / count : 0,
+				  "p50", quantile[0],
+				  "p90", quantile[1],
+				  "p99", quantile[2]);
+}
+
+/**
+ * Profile of the event loop of the daemon thread.
+ *
+ * Returns the number of loop iterations, the flows serviced per wakeup, the
+ * time spent per phase of the loop and how late paced flows were woken for
+ * their next block. The counters are read without locking, so the daemon
+ * thread is not disturbed.
+ *
+ * @param[in,out] env XML-RPC environment object
+ * @param[in,out] param_array unused arg
+ * @param[in,out] user_data unused arg
+ */
+static xmlrpc_value * method_get_loop_profile(xmlrpc_env * const env,
+		   xmlrpc_value * const param_array,
+		   void * const user_data)
+{
+	UNUSED_ARGUMENT(param_array);
+	UNUSED_ARGUMENT(user_data);
+
+	xmlrpc_value *ret = 0, *phases = 0, *item = 0;
+
+	DEBUG_MSG(LOG_NOTICE, "method get_loop_profile called");
+
+	const double uptime = time_diff_now(&metrics.since);
+	const double iterations = metrics_get(&metrics.loop_iterations);
+	const double serviced = metrics_get(&metrics.flows_serviced);
+
+	phases = xmlrpc_struct_new(env);
+	for (int i = 0; i < NUM_LOOP_PHASES; i++) {
+		item = build_histogram(env, &metrics.phases[i]);
+		xmlrpc_struct_set_value(env, phases, loop_phase_names[i], item);
+		xmlrpc_DECREF(item);
+	}
+	item = build_histogram(env, &metrics.write_lateness);
+
+	ret = xmlrpc_build_value(env, "{s:d,s:d,s:d,s:d,s:V,s:V}",
+				 "uptime", uptime,
+				 "iterations", iterations,
+				 "iteration_rate", uptime > 0 ? iterations / uptime : 0,
+				 "flows_per_wakeup", iterations ? serviced / iterations : 0,
+				 "phases", phases,
+				 "write_lateness", item);
+
+	xmlrpc_DECREF(phases);
+	xmlrpc_DECREF(item);
+
+	if (env->fault_occurred)
+		logging(LOG_WARNING, "method get_loop_profile failed: %s",
+			env->fault_string);
+	else
+		DEBUG_MSG(LOG_NOTICE, "method get_loop_profile successful");
+
+	return ret;
+}
+
 /* This method returns the number of flows and if actual test has started */
 static xmlrpc_value * method_get_status(xmlrpc_env * const env,
 		   xmlrpc_value * const param_array,
@@ -831,24 +1881,37 @@ static int bind_rpc_server(char *bind_addr, unsigned port) {
 	return fd;
 }
 
-/* Initializes the xmlrpc server and registers exported methods */
-void init_rpc_server(struct fg_rpc_server *server, char *rpc_bind_addr, unsigned port)
+/* Registers the exported methods */
+xmlrpc_registry *create_rpc_registry(xmlrpc_env *env)
 {
-	xmlrpc_registry * registryP;
-	xmlrpc_env *env = &(server->env);
-	memset(&(server->parms), 0, sizeof(server->parms));
-
-	xmlrpc_env_init(env);
-	registryP = xmlrpc_registry_new(env);
+	xmlrpc_registry * registryP = xmlrpc_registry_new(env);
 
 	xmlrpc_registry_add_method(env, registryP, NULL, "add_flow_destination", &add_flow_destination, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "add_flow_source", &add_flow_source, NULL);
+	xmlrpc_registry_add_method(env, registryP, NULL, "add_flows", &method_add_flows, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "start_flows", &start_flows, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "get_reports", &method_get_reports, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "stop_flow", &method_stop_flow, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "get_version", &method_get_version, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "get_status", &method_get_status, NULL);
 	xmlrpc_registry_add_method(env, registryP, NULL, "get_uuid", &method_get_uuid, NULL);
+	xmlrpc_registry_add_method(env, registryP, NULL, "get_time", &method_get_time, NULL);
+	xmlrpc_registry_add_method(env, registryP, NULL, "get_loop_profile", &method_get_loop_profile, NULL);
+	xmlrpc_registry_add_method(env, registryP, NULL, "create_trace", &method_create_trace, NULL);
+	xmlrpc_registry_add_method(env, registryP, NULL, "append_trace", &method_append_trace, NULL);
+
+	return registryP;
+}
+
+/* Initializes the xmlrpc server and registers exported methods */
+void init_rpc_server(struct fg_rpc_server *server, char *rpc_bind_addr, unsigned port)
+{
+	xmlrpc_registry * registryP;
+	xmlrpc_env *env = &(server->env);
+	memset(&(server->parms), 0, sizeof(server->parms));
+
+	xmlrpc_env_init(env);
+	registryP = create_rpc_registry(env);
 
 	/* In the modern form of the Abyss API, we supply parameters in memory
 	   like a normal API.  We select the modern form by setting
@@ -54,6 +54,13 @@ struct fg_rpc_server
 	xmlrpc_server_abyss_parms parms;
 };
 
+/**
+ * Create a registry of all methods exported by the daemon.
+ *
+ * @param[in,out] env XML-RPC environment object
+ */
+xmlrpc_registry *create_rpc_registry(xmlrpc_env *env);
+
 /**
  * Initializes the xmlrpc server.
  *
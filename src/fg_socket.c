@@ -49,6 +49,10 @@
 #include <arpa/inet.h>
 #include <net/if.h>
 
+#ifdef __LINUX__
+#include <linux/sockios.h>
+#endif /* __LINUX__ */
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif /* HAVE_STRING_H */
@@ -255,6 +259,24 @@ int get_imtu(int fd)
 		return 0;
 }
 
+int get_unacked_bytes(int fd)
+/* returns bytes in the send queue not yet acknowledged by the peer */
+{
+	int bytes = 0;
+
+#if defined(SIOCOUTQ)
+	if (ioctl(fd, SIOCOUTQ, &bytes) < 0)
+		return -1;
+#elif defined(FIONWRITE)
+	if (ioctl(fd, FIONWRITE, &bytes) < 0)
+		return -1;
+#else
+	UNUSED_ARGUMENT(fd);
+	return -1;
+#endif
+	return bytes;
+}
+
 int set_keepalive(int fd, int how)
 {
 	DEBUG_MSG(LOG_NOTICE, "setting TCP_KEEPALIVE(%d) on fd %d", how, fd);
@@ -0,0 +1,261 @@
+/**
+ * @file fg_tcp_analyzer.c
+ * @brief Online analysis of the captured TCP segments of a flow
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <float.h>
+#include <string.h>
+
+#include "fg_definitions.h"
+#include "fg_tcp_analyzer.h"
+#include "fg_time.h"
+
+/** Comparison of sequence numbers, which wrap around. @{ */
+#define SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+#define SEQ_GT(a, b) ((int32_t)((a) - (b)) > 0)
+#define SEQ_GEQ(a, b) ((int32_t)((a) - (b)) >= 0)            /** @} */
+
+void tcp_wire_stats_reset(struct tcp_wire_stats *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->rtt_min = FLT_MAX;
+	s->rtt_max = FLT_MIN;
+}
+
+void tcp_wire_stats_add(struct tcp_wire_stats *sum,
+			const struct tcp_wire_stats *s)
+{
+	sum->retransmits += s->retransmits;
+	sum->reordered += s->reordered;
+	sum->rtt_samples += s->rtt_samples;
+	ASSIGN_MIN(sum->rtt_min, s->rtt_min);
+	ASSIGN_MAX(sum->rtt_max, s->rtt_max);
+	sum->rtt_sum += s->rtt_sum;
+	sum->acked += s->acked;
+	sum->flight = s->flight;
+}
+
+void tcp_analyzer_init(struct tcp_analyzer *a)
+{
+	memset(a, 0, sizeof(*a));
+	tcp_wire_stats_reset(&a->pending);
+}
+
+/** Sequence number following segment @p seg, SYN and FIN count as one. */
+static inline uint32_t segment_end(const struct tcp_segment *seg)
+{
+	return seg->seq + seg->len + !!(seg->flags & TCP_FLAG_SYN) +
+	       !!(seg->flags & TCP_FLAG_FIN);
+}
+
+/** Time the outgoing segment ending at @p end sent at @p ts, unless too many
+ * segments are timed already. */
+static void time_segment(struct tcp_analyzer *a, uint32_t end,
+			 const struct timespec *ts)
+{
+	struct tcp_timed_segment *t;
+
+	if (a->timed_count == TCP_ANALYZER_TIMED)
+		return;
+
+	t = &a->timed[(a->timed_head + a->timed_count) % TCP_ANALYZER_TIMED];
+	t->end = end;
+	t->ts = *ts;
+	a->timed_count++;
+}
+
+/** Analyze outgoing segment @p seg. */
+static void segment_sent(struct tcp_analyzer *a, const struct tcp_segment *seg)
+{
+	const uint32_t end = segment_end(seg);
+
+	if (!a->out_seen) {
+		a->out_seen = true;
+		a->snd_una = a->snd_max = seg->seq;
+	}
+
+	/* pure ACK */
+	if (end == seg->seq)
+		return;
+
+	if (SEQ_GEQ(seg->seq, a->snd_max)) {
+		a->snd_max = end;
+		time_segment(a, end, &seg->ts);
+		return;
+	}
+
+	a->pending.retransmits++;
+	/* an ACK of the timed segments may acknowledge the retransmission
+	 * instead, so they are not sampled (Karn's algorithm) */
+	a->timed_count = 0;
+	if (SEQ_GT(end, a->snd_max))
+		a->snd_max = end;
+}
+
+/** Analyze the acknowledgment of incoming segment @p seg. */
+static void ack_received(struct tcp_analyzer *a, const struct tcp_segment *seg)
+{
+	struct timespec sent;
+	bool sampled = false;
+
+	if (!a->out_seen || !SEQ_GT(seg->ack, a->snd_una))
+		return;
+
+	/* the capture missed outgoing segments */
+	if (SEQ_GT(seg->ack, a->snd_max))
+		a->snd_max = seg->ack;
+
+	a->pending.acked += seg->ack - a->snd_una;
+	a->snd_una = seg->ack;
+
+	/* one sample per ACK, of the latest segment it covers */
+	while (a->timed_count && SEQ_LEQ(a->timed[a->timed_head].end,
+					 seg->ack)) {
+		sent = a->timed[a->timed_head].ts;
+		sampled = true;
+		a->timed_head = (a->timed_head + 1) % TCP_ANALYZER_TIMED;
+		a->timed_count--;
+	}
+	if (!sampled)
+		return;
+
+	double rtt = time_diff(&sent, &seg->ts);
+	if (rtt < 0)
+		return;
+	a->pending.rtt_samples++;
+	a->pending.rtt_sum += rtt;
+	ASSIGN_MIN(a->pending.rtt_min, rtt);
+	ASSIGN_MAX(a->pending.rtt_max, rtt);
+}
+
+/** Remember the gap from @p start to @p end in the incoming sequence space,
+ * forgetting the oldest gap if too many are known. */
+static void add_gap(struct tcp_analyzer *a, uint32_t start, uint32_t end)
+{
+	if (a->num_gaps == TCP_ANALYZER_GAPS) {
+		memmove(a->gaps, a->gaps + 1,
+			(TCP_ANALYZER_GAPS - 1) * sizeof(a->gaps[0]));
+		a->num_gaps--;
+	}
+
+	a->gaps[a->num_gaps].start = start;
+	a->gaps[a->num_gaps].end = end;
+	a->num_gaps++;
+}
+
+/**
+ * Remove the range from @p start to @p end from the gaps.
+ *
+ * @return true if the range overlaps a gap
+ */
+static bool fill_gaps(struct tcp_analyzer *a, uint32_t start, uint32_t end)
+{
+	bool filled = false;
+
+	for (unsigned i = 0; i < a->num_gaps;) {
+		struct tcp_gap *g = &a->gaps[i];
+
+		if (!SEQ_LT(start, g->end) || !SEQ_GT(end, g->start)) {
+			i++;
+			continue;
+		}
+		filled = true;
+
+		if (SEQ_LEQ(start, g->start) && SEQ_GEQ(end, g->end)) {
+			a->num_gaps--;
+			memmove(g, g + 1, (a->num_gaps - i) * sizeof(*g));
+			continue;
+		}
+
+		if (SEQ_LEQ(start, g->start)) {
+			g->start = end;
+		} else if (SEQ_GEQ(end, g->end)) {
+			g->end = start;
+		} else {
+			/* split the gap, the tail is lost if too many */
+			const uint32_t tail = g->end;
+
+			g->end = start;
+			if (a->num_gaps < TCP_ANALYZER_GAPS) {
+				a->gaps[a->num_gaps].start = end;
+				a->gaps[a->num_gaps].end = tail;
+				a->num_gaps++;
+			}
+		}
+		i++;
+	}
+
+	return filled;
+}
+
+/** Analyze incoming segment @p seg. */
+static void segment_received(struct tcp_analyzer *a,
+			     const struct tcp_segment *seg)
+{
+	const uint32_t end = segment_end(seg);
+
+	if (seg->flags & TCP_FLAG_ACK)
+		ack_received(a, seg);
+
+	/* pure ACK */
+	if (end == seg->seq)
+		return;
+
+	if (!a->in_seen) {
+		a->in_seen = true;
+		a->rcv_max = end;
+		return;
+	}
+
+	if (SEQ_GEQ(seg->seq, a->rcv_max)) {
+		if (SEQ_GT(seg->seq, a->rcv_max))
+			add_gap(a, a->rcv_max, seg->seq);
+		a->rcv_max = end;
+		return;
+	}
+
+	/* below the highest segment, either fills a gap or is a duplicate */
+	if (fill_gaps(a, seg->seq, end))
+		a->pending.reordered++;
+	if (SEQ_GT(end, a->rcv_max))
+		a->rcv_max = end;
+}
+
+void tcp_analyzer_segment(struct tcp_analyzer *a,
+			  const struct tcp_segment *seg)
+{
+	if (seg->outgoing)
+		segment_sent(a, seg);
+	else
+		segment_received(a, seg);
+}
+
+void tcp_analyzer_collect(struct tcp_analyzer *a, struct tcp_wire_stats *stats)
+{
+	a->pending.flight = a->out_seen ? a->snd_max - a->snd_una : 0;
+	*stats = a->pending;
+	tcp_wire_stats_reset(&a->pending);
+}
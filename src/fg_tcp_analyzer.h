@@ -0,0 +1,157 @@
+/**
+ * @file fg_tcp_analyzer.h
+ * @brief Online analysis of the captured TCP segments of a flow
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_TCP_ANALYZER_H_
+#define _FG_TCP_ANALYZER_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The analyzer follows both directions of a connection as seen on the wire
+ * by the capture of one endpoint, the local one:
+ *
+ * - Outgoing data is sent by the local endpoint. A segment below the highest
+ *   sequence number sent is a retransmission. The time from sending a
+ *   segment until the first ACK covering it arrives is an RTT sample. Like
+ *   Karn's algorithm, segments sent before a retransmission are not sampled.
+ * - Incoming data is received by the local endpoint. A segment below the
+ *   highest sequence number received which fills a gap arrived out of order,
+ *   either reordered or retransmitted after a loss upstream of the capture.
+ *
+ * The analyzer only sees what the capture sees, packets dropped by the
+ * capture distort its results.
+ */
+
+/** Number of outgoing segments timed for RTT samples at the same time. */
+#define TCP_ANALYZER_TIMED 64
+/** Number of gaps in the incoming sequence space tracked at the same time. */
+#define TCP_ANALYZER_GAPS 16
+
+/** TCP flags used by the analyzer. @{ */
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_ACK 0x10                                     /** @} */
+
+/** Header of a captured TCP segment. */
+struct tcp_segment {
+	/** Time the segment was captured. */
+	struct timespec ts;
+	/** Whether the segment was sent by the local endpoint. */
+	bool outgoing;
+	/** Sequence and acknowledgment number. @{ */
+	uint32_t seq;
+	uint32_t ack;                                           /** @} */
+	/** TCP flags. */
+	uint8_t flags;
+	/** Length of the payload in bytes. */
+	unsigned len;
+};
+
+/** Metrics derived from the captured segments. */
+struct tcp_wire_stats {
+	/** Segments retransmitted by the local endpoint. */
+	unsigned retransmits;
+	/** Segments received by the local endpoint out of order. */
+	unsigned reordered;
+	/** RTT samples, their minimum, maximum and sum in seconds. @{ */
+	unsigned rtt_samples;
+	double rtt_min;
+	double rtt_max;
+	double rtt_sum;                                         /** @} */
+	/** Bytes sent by the local endpoint newly acknowledged by the peer. */
+	uint64_t acked;
+	/** Bytes sent by the local endpoint not yet acknowledged after the
+	 * latest segment. */
+	unsigned flight;
+};
+
+/** Segment timed for an RTT sample. */
+struct tcp_timed_segment {
+	/** Sequence number following the segment. */
+	uint32_t end;
+	/** Time the segment was sent. */
+	struct timespec ts;
+};
+
+/** Gap in the incoming sequence space. */
+struct tcp_gap {
+	/** First missing sequence number. */
+	uint32_t start;
+	/** Sequence number following the gap. */
+	uint32_t end;
+};
+
+/** State of the analysis of a connection. */
+struct tcp_analyzer {
+	/** Whether an outgoing segment was seen. */
+	bool out_seen;
+	/** Sequence number following the highest outgoing segment. */
+	uint32_t snd_max;
+	/** Lowest outgoing sequence number not acknowledged. */
+	uint32_t snd_una;
+	/** Outgoing segments timed for RTT samples, oldest first. @{ */
+	struct tcp_timed_segment timed[TCP_ANALYZER_TIMED];
+	unsigned timed_head;
+	unsigned timed_count;                                   /** @} */
+
+	/** Whether an incoming segment with data was seen. */
+	bool in_seen;
+	/** Sequence number following the highest incoming segment. */
+	uint32_t rcv_max;
+	/** Gaps below rcv_max, oldest first. @{ */
+	struct tcp_gap gaps[TCP_ANALYZER_GAPS];
+	unsigned num_gaps;                                      /** @} */
+
+	/** Metrics since the last call of tcp_analyzer_collect(). */
+	struct tcp_wire_stats pending;
+};
+
+/** Initialize analyzer @p a for a new connection. */
+void tcp_analyzer_init(struct tcp_analyzer *a);
+
+/** Analyze segment @p seg of the connection of @p a. */
+void tcp_analyzer_segment(struct tcp_analyzer *a,
+			  const struct tcp_segment *seg);
+
+/**
+ * Take the metrics of @p a since the last call and start over.
+ *
+ * @param[in,out] a analyzer
+ * @param[out] stats metrics since the last call
+ */
+void tcp_analyzer_collect(struct tcp_analyzer *a, struct tcp_wire_stats *stats);
+
+/** Reset metrics @p s to no segments seen. */
+void tcp_wire_stats_reset(struct tcp_wire_stats *s);
+
+/** Add the later metrics @p s to @p sum. */
+void tcp_wire_stats_add(struct tcp_wire_stats *sum,
+			const struct tcp_wire_stats *s);
+
+#endif /* _FG_TCP_ANALYZER_H_ */
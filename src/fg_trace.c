@@ -0,0 +1,422 @@
+/**
+ * @file fg_trace.c
+ * @brief Recorded traffic traces replayed by Flowgrind flows
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include "fg_trace.h"
+#include "fg_error.h"
+#include "fg_io.h"
+#include "fg_log.h"
+#include "fg_time.h"
+
+/** Number of records read at once while scanning a trace file. */
+#define TRACE_SCAN_RECORDS 4096
+
+/** Uploaded trace file not mapped for replay yet. */
+struct trace_upload {
+	/** Next upload in the list. */
+	struct trace_upload *next;
+	/** Name of the trace file as created by trace_create(). */
+	char name[sizeof(TRACE_NAME_PREFIX) + 6];
+};
+
+/** Uploaded trace files not mapped for replay yet. */
+static struct trace_upload *uploads = NULL;
+/** Time of the last creation, append or mapping of an uploaded trace. */
+static struct timespec last_upload_activity;
+/** Protects the uploads, used by the RPC server and the daemon thread. */
+static pthread_mutex_t uploads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Send time of record @p r in nanoseconds. */
+static inline uint64_t record_time(const struct trace_record *r)
+{
+	return (uint64_t)ntohl(r->time_high) << 32 | ntohl(r->time_low);
+}
+
+int trace_scan(const char *filename, struct trace_info *info)
+{
+	struct trace_header header;
+	struct trace_record *buf;
+	uint64_t last = 0;
+	size_t n;
+	int rc = -1;
+
+	FILE *fp = fopen(filename, "rb");
+	if (!fp) {
+		warn("failed to open trace file '%s'", filename);
+		return -1;
+	}
+
+	buf = malloc(TRACE_SCAN_RECORDS * sizeof(struct trace_record));
+	if (!buf) {
+		warnx("%s: could not allocate memory", filename);
+		goto out;
+	}
+
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+	    ntohl(header.magic) != TRACE_MAGIC) {
+		warnx("%s: not a flowgrind trace file", filename);
+		goto out;
+	}
+	if (ntohl(header.version) != TRACE_VERSION) {
+		warnx("%s: unsupported trace format version %u", filename,
+		      ntohl(header.version));
+		goto out;
+	}
+
+	memset(info, 0, sizeof(struct trace_info));
+	while ((n = fread(buf, sizeof(struct trace_record), TRACE_SCAN_RECORDS,
+			  fp)) > 0) {
+		for (size_t i = 0; i < n; i++) {
+			uint64_t time = record_time(&buf[i]);
+			uint32_t request_size = ntohl(buf[i].request_size);
+			uint32_t response_size = ntohl(buf[i].response_size);
+
+			if (time < last) {
+				warnx("%s: record %llu: send time goes "
+				      "backwards", filename, (unsigned long long)
+				      (info->num_records + i));
+				goto out;
+			}
+			if (request_size > INT_MAX || response_size > INT_MAX) {
+				warnx("%s: record %llu: block size too large",
+				      filename, (unsigned long long)
+				      (info->num_records + i));
+				goto out;
+			}
+			last = time;
+			if (request_size > info->max_block_size)
+				info->max_block_size = request_size;
+			if (response_size > info->max_block_size)
+				info->max_block_size = response_size;
+		}
+		info->num_records += n;
+	}
+
+	if (ferror(fp)) {
+		warn("failed to read trace file '%s'", filename);
+		goto out;
+	}
+	/* fread() drops an incomplete record at the end of the file */
+	if (ftello(fp) != (off_t)(sizeof(header) +
+				  info->num_records * sizeof(struct trace_record))) {
+		warnx("%s: truncated record at end of file", filename);
+		goto out;
+	}
+	if (!info->num_records) {
+		warnx("%s: no records found", filename);
+		goto out;
+	}
+
+	info->duration = last / 1e9;
+	rc = 0;
+
+out:
+	free(buf);
+	fclose(fp);
+	return rc;
+}
+
+/** Note upload activity at the current time. Call with uploads_mutex held. */
+static void touch_uploads(void)
+{
+	gettime(&last_upload_activity);
+}
+
+/** Remember the uploaded trace file @p name until it is mapped or removed. */
+static int add_upload(const char *name)
+{
+	struct trace_upload *upload = malloc(sizeof(struct trace_upload));
+
+	if (!upload) {
+		errno = ENOMEM;
+		return -1;
+	}
+	strcpy(upload->name, name);
+
+	pthread_mutex_lock(&uploads_mutex);
+	upload->next = uploads;
+	uploads = upload;
+	touch_uploads();
+	pthread_mutex_unlock(&uploads_mutex);
+
+	return 0;
+}
+
+/** Forget the uploaded trace file @p name. */
+static void forget_upload(const char *name)
+{
+	pthread_mutex_lock(&uploads_mutex);
+	for (struct trace_upload **p = &uploads; *p; p = &(*p)->next) {
+		if (!strcmp((*p)->name, name)) {
+			struct trace_upload *upload = *p;
+			*p = upload->next;
+			free(upload);
+			break;
+		}
+	}
+	touch_uploads();
+	pthread_mutex_unlock(&uploads_mutex);
+}
+
+/** Directory in which the daemon stores uploaded trace files. */
+static const char *trace_dir(void)
+{
+	const char *dir = getenv("TMPDIR");
+
+	return dir && *dir ? dir : "/tmp";
+}
+
+/** Absolute path of the uploaded trace file @p name. */
+static int trace_path(const char *name, char *path, size_t len)
+{
+	int rc = snprintf(path, len, "%s/%s", trace_dir(), name);
+
+	if (rc < 0 || (size_t)rc >= len) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return 0;
+}
+
+int trace_name_valid(const char *name)
+{
+	const size_t prefix = sizeof(TRACE_NAME_PREFIX) - 1;
+
+	/* TRACE_NAME_PREFIX followed by the six characters of mkstemp() */
+	return strlen(name) == prefix + 6 &&
+	       !strncmp(name, TRACE_NAME_PREFIX, prefix) &&
+	       !strchr(name, '/');
+}
+
+int trace_create(char *name, size_t len)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	if (trace_path(TRACE_NAME_PREFIX "XXXXXX", path, sizeof(path)) == -1)
+		return -1;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return -1;
+	close(fd);
+
+	if (strlen(strrchr(path, '/') + 1) >= len) {
+		unlink(path);
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(name, strrchr(path, '/') + 1);
+
+	if (add_upload(name) == -1) {
+		unlink(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+int trace_append(const char *name, const void *buf, size_t len)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	if (!trace_name_valid(name)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (trace_path(name, path, sizeof(path)) == -1)
+		return -1;
+
+	fd = open(path, O_WRONLY | O_APPEND);
+	if (fd == -1)
+		return -1;
+
+	pthread_mutex_lock(&uploads_mutex);
+	touch_uploads();
+	pthread_mutex_unlock(&uploads_mutex);
+
+	if (write_all(fd, buf, len) == -1) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+
+	return close(fd);
+}
+
+void trace_remove(const char *name)
+{
+	char path[PATH_MAX];
+
+	if (!trace_name_valid(name))
+		return;
+
+	forget_upload(name);
+	if (trace_path(name, path, sizeof(path)) != -1)
+		unlink(path);
+}
+
+void trace_expire(const struct timespec *now)
+{
+	char path[PATH_MAX];
+
+	pthread_mutex_lock(&uploads_mutex);
+	if (uploads &&
+	    time_diff(&last_upload_activity, now) > TRACE_UPLOAD_TIMEOUT) {
+		while (uploads) {
+			struct trace_upload *upload = uploads;
+			uploads = upload->next;
+
+			logging(LOG_NOTICE, "removing unused trace %s",
+				upload->name);
+			if (trace_path(upload->name, path, sizeof(path)) != -1)
+				unlink(path);
+			free(upload);
+		}
+	}
+	pthread_mutex_unlock(&uploads_mutex);
+}
+
+struct trace_replay *trace_map(const char *name, const char **problem)
+{
+	char path[PATH_MAX];
+	struct trace_replay *trace = NULL;
+	const struct trace_header *header;
+	const struct trace_record *record;
+	size_t num_records;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (!trace_name_valid(name)) {
+		*problem = "invalid trace name";
+		return NULL;
+	}
+	if (trace_path(name, path, sizeof(path)) == -1) {
+		*problem = strerror(errno);
+		return NULL;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		*problem = strerror(errno);
+		return NULL;
+	}
+	/* the mapping keeps the data, the name is not needed anymore */
+	unlink(path);
+	forget_upload(name);
+
+	if (fstat(fd, &st) == -1) {
+		*problem = strerror(errno);
+		goto out;
+	}
+	if ((uintmax_t)st.st_size > SIZE_MAX) {
+		*problem = "trace too large for address space";
+		goto out;
+	}
+	if ((size_t)st.st_size < sizeof(struct trace_header) +
+				 sizeof(struct trace_record) ||
+	    ((size_t)st.st_size - sizeof(struct trace_header)) %
+	    sizeof(struct trace_record)) {
+		*problem = "malformed trace";
+		goto out;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		*problem = strerror(errno);
+		goto out;
+	}
+#ifdef MADV_SEQUENTIAL
+	/* records are consumed front to back, read ahead and drop behind */
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+
+	header = map;
+	if (ntohl(header->magic) != TRACE_MAGIC ||
+	    ntohl(header->version) != TRACE_VERSION) {
+		*problem = "malformed trace";
+		munmap(map, st.st_size);
+		goto out;
+	}
+
+	/* the controller checks its file, but not what arrived here */
+	record = (const struct trace_record *)(header + 1);
+	num_records = ((size_t)st.st_size - sizeof(struct trace_header)) /
+		      sizeof(struct trace_record);
+	for (size_t i = 1; i < num_records; i++) {
+		if (record_time(&record[i]) < record_time(&record[i - 1])) {
+			*problem = "send time goes backwards";
+			munmap(map, st.st_size);
+			goto out;
+		}
+	}
+
+	trace = calloc(1, sizeof(struct trace_replay));
+	if (!trace) {
+		*problem = "could not allocate memory";
+		munmap(map, st.st_size);
+		goto out;
+	}
+	trace->map = map;
+	trace->map_length = st.st_size;
+	trace->record = record;
+	trace->num_records = num_records;
+
+out:
+	close(fd);
+	return trace;
+}
+
+void trace_unmap(struct trace_replay *trace)
+{
+	if (!trace)
+		return;
+	munmap(trace->map, trace->map_length);
+	free(trace);
+}
+
+double trace_time(const struct trace_replay *trace, size_t index)
+{
+	return record_time(&trace->record[index]) / 1e9;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file fg_trace.h
+ * @brief Recorded traffic traces replayed by Flowgrind flows
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _FG_TRACE_H_
+#define _FG_TRACE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/** Magic number at the beginning of a trace file ("FGTR"). */
+#define TRACE_MAGIC 0x46475452
+/** Version of the trace file format. */
+#define TRACE_VERSION 1
+/** Prefix of the names of trace files uploaded to a daemon. */
+#define TRACE_NAME_PREFIX "flowgrind-trace-"
+/** Maximal number of bytes of a trace file sent with a single RPC. */
+#define TRACE_CHUNK_SIZE (256 * 1024)
+/** Seconds without any upload activity after which the daemon removes
+ * uploaded traces no flow has used. */
+#define TRACE_UPLOAD_TIMEOUT 60
+
+/**
+ * Header of a trace file. All fields are in network byte order.
+ *
+ * The header is followed by records until the end of the file.
+ */
+struct trace_header {
+	/** Always TRACE_MAGIC. */
+	uint32_t magic;
+	/** Always TRACE_VERSION. */
+	uint32_t version;
+};
+
+/** One request of a trace. All fields are in network byte order. */
+struct trace_record {
+	/** Send time in nanoseconds since start of the trace (non-decreasing). */
+	uint32_t time_high;
+	uint32_t time_low;
+	/** Size of the request block in bytes. */
+	uint32_t request_size;
+	/** Size of the requested response block in bytes, 0 for none. */
+	uint32_t response_size;
+};
+
+/** Summary of a trace file collected by the controller. */
+struct trace_info {
+	/** Number of records. */
+	uint64_t num_records;
+	/** Largest request or response block size. */
+	uint32_t max_block_size;
+	/** Send time of the last record in seconds. */
+	double duration;
+};
+
+/**
+ * Trace memory-mapped by the daemon for replay.
+ *
+ * Records are read in place, so the size of the trace is not limited by
+ * the available memory.
+ */
+struct trace_replay {
+	/** Start of the mapping, i.e. the trace header. */
+	void *map;
+	/** Length of the mapping in bytes. */
+	size_t map_length;
+	/** First record. */
+	const struct trace_record *record;
+	/** Number of records. */
+	size_t num_records;
+	/** Index of the record of the block currently sent. */
+	size_t current;
+};
+
+/**
+ * Validate the trace file @p filename and summarize it into @p info.
+ *
+ * The file is read sequentially, so the trace does not need to fit into
+ * memory. Problems are reported on stderr.
+ *
+ * @param[in] filename trace file to check
+ * @param[out] info summary of the trace
+ * @return 0 on success, -1 on error
+ */
+int trace_scan(const char *filename, struct trace_info *info);
+
+/**
+ * Check whether @p name is the name of a trace file uploaded to the daemon.
+ *
+ * Only names created by trace_create() are accepted, in particular no
+ * paths.
+ */
+int trace_name_valid(const char *name);
+
+/**
+ * Create a new, empty trace file in the daemon's temporary directory.
+ *
+ * @param[out] name buffer for the name of the created file
+ * @param[in] len size of @p name
+ * @return 0 on success, -1 on error with errno set
+ */
+int trace_create(char *name, size_t len);
+
+/**
+ * Append @p len bytes from @p buf to the uploaded trace file @p name.
+ *
+ * @return 0 on success, -1 on error with errno set
+ */
+int trace_append(const char *name, const void *buf, size_t len);
+
+/** Remove the uploaded trace file @p name, if it still exists. */
+void trace_remove(const char *name);
+
+/**
+ * Remove the uploaded trace files that the controller abandoned.
+ *
+ * The controller uploads its traces right before it adds the flows using
+ * them. If no trace was created, appended to or mapped for
+ * TRACE_UPLOAD_TIMEOUT seconds, the traces not mapped yet will never be
+ * used, e.g. because the controller died, and are removed.
+ *
+ * @param[in] now current time
+ */
+void trace_expire(const struct timespec *now);
+
+/**
+ * Memory-map the uploaded trace file @p name for replay.
+ *
+ * The file is unlinked afterwards, the mapping keeps the data accessible
+ * until trace_unmap() is called. A trace whose send times decrease is
+ * rejected.
+ *
+ * @param[in] name name of the trace file as created by trace_create()
+ * @param[out] problem description of the problem on error
+ * @return mapped trace, NULL on error
+ */
+struct trace_replay *trace_map(const char *name, const char **problem);
+
+/** Unmap and free @p trace. */
+void trace_unmap(struct trace_replay *trace);
+
+/** Send time of record @p index of @p trace in seconds. */
+double trace_time(const struct trace_replay *trace, size_t index);
+
+#endif /* _FG_TRACE_H_ */
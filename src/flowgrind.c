@@ -69,6 +69,12 @@
 #include "fg_rpc_client.h"
 #include "fg_argparser.h"
 #include "fg_log.h"
+#include "fg_cdf.h"
+#include "fg_trace.h"
+#include "fg_aggregate.h"
+#include "fg_output.h"
+#include "fg_control_stats.h"
+#include "fg_profile.h"
 
 /** To show intermediated interval report columns. */
 #define SHOW_COLUMNS(...)                                                   \
@@ -103,12 +109,18 @@ static bool sigint_caught = false;
 /* XML-RPC environment object that contains any error that has occurred. */
 static xmlrpc_env rpc_env;
 
+/** Start of the test in the clock of the controller. */
+static struct timespec test_start;
+
 /** Global linked list to the flow endpoints XML RPC connection information. */
 static struct linked_list flows_rpc_info;
 
 /** Global linked list to the daemons containing UUID and daemons flowgrind version. */
 static struct linked_list unique_daemons;
 
+/** Global linked list of the empirical CDFs loaded for option -G. */
+static struct linked_list cdf_files;
+
 /** Command line option parser. */
 static struct arg_parser parser;
 
@@ -124,6 +136,9 @@ static struct arg_parser parser;
 /** Number of currently active flows. */
 static unsigned short active_flows = 0;
 
+/** File descriptor of the control plane statistics, -1 if not requested. */
+static int control_stats_fd = -1;
+
 /* To cover a gcc bug (http://gcc.gnu.org/bugzilla/show_bug.cgi?id=36446) */
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
@@ -161,6 +176,42 @@ static struct column column_info[] = {
 	 .header.unit = "[ms]", .state.visible = false},
 	{.type = COL_DLY_MAX, .header.name = "max DLY",
 	 .header.unit = "[ms]", .state.visible = false},
+	{.type = COL_DRIFT_MIN, .header.name = "min DRIFT",
+	 .header.unit = "[ms]", .state.visible = false},
+	{.type = COL_DRIFT_AVG, .header.name = "avg DRIFT",
+	 .header.unit = "[ms]", .state.visible = false},
+	{.type = COL_DRIFT_MAX, .header.name = "max DRIFT",
+	 .header.unit = "[ms]", .state.visible = false},
+	{.type = COL_CONN_RATE, .header.name = "conns",
+	 .header.unit = "[#/s]", .state.visible = false},
+	{.type = COL_FCT_P50, .header.name = "p50 FCT",
+	 .header.unit = "[ms]", .state.visible = false},
+	{.type = COL_FCT_P90, .header.name = "p90 FCT",
+	 .header.unit = "[ms]", .state.visible = false},
+	{.type = COL_FCT_P99, .header.name = "p99 FCT",
+	 .header.unit = "[ms]", .state.visible = false},
+	{.type = COL_CORRUPT_BLOCKS, .header.name = "corrupt",
+	 .header.unit = "[#]", .state.visible = false},
+	{.type = COL_CORRUPT_BYTES, .header.name = "mismatch",
+	 .header.unit = "[B]", .state.visible = false},
+	{.type = COL_PCAP_PACKETS, .header.name = "dumped",
+	 .header.unit = "[#]", .state.visible = false},
+	{.type = COL_PCAP_DROPS, .header.name = "dumpdrop",
+	 .header.unit = "[#]", .state.visible = false},
+	{.type = COL_PCAP_RING_DROPS, .header.name = "ifdrop",
+	 .header.unit = "[#]", .state.visible = false},
+	{.type = COL_WIRE_RETR, .header.name = "wretr",
+	 .header.unit = "[#]", .state.visible = false},
+	{.type = COL_WIRE_REOR, .header.name = "wreor",
+	 .header.unit = "[#]", .state.visible = false},
+	{.type = COL_WIRE_RTT, .header.name = "wrtt",
+	 .header.unit = "[ms]", .state.visible = false},
+	{.type = COL_WIRE_FLIGHT, .header.name = "wflight",
+	 .header.unit = "[B]", .state.visible = false},
+	{.type = COL_FAIR_JAIN, .header.name = "fair",
+	 .header.unit = "[jain]", .state.visible = false},
+	{.type = COL_FAIR_RATIO, .header.name = "ratio",
+	 .header.unit = "[max/min]", .state.visible = false},
 	{.type = COL_TCP_CWND, .header.name = "cwnd",
 	 .header.unit = "[#]", .state.visible = true},
 	{.type = COL_TCP_SSTH, .header.name = "ssth",
@@ -213,6 +264,9 @@ static void fetch_reports(xmlrpc_client *);
 static void report_flow(struct report* report);
 static void print_interval_report(unsigned short flow_id, enum endpoint_t e,
 		                  struct report *report);
+static void print_aggregate_report(const struct aggregate *a, enum endpoint_t e,
+				   double begin, double end,
+				   struct report *sum);
 
 /**
  * Print usage or error message and exit.
@@ -243,14 +297,28 @@ static void usage(short status)
 		"  -v, --version  print version information and exit\n\n"
 
 		"Controller options:\n"
+		"      --aggregate=SPEC\n"
+		"                 print interval reports summed up over a group of flows. SPEC\n"
+		"                 is 'daemon' for one group per daemon, 'total' for all flows,\n"
+		"                 or NAME=#[-#][,#[-#]]... for a group of the given flow IDs.\n"
+		"                 Add option multiple times to define several groups\n"
+		"      --aggregate-only\n"
+		"                 print interval reports of aggregation groups only\n"
+		"      --capture=FILE\n"
+		"                 write all reports to capture FILE for post-run analysis\n"
+		"      --control-stats=FILE\n"
+		"                 write statistics of flow setup, start and report collection\n"
+		"                 as JSON to FILE, or to stdout if FILE is '-'\n"
 		"  -c, --show-colon=TYPE[,TYPE]...\n"
 		"                 display intermediated interval report column TYPE in output.\n"
 		"                 Allowed values for TYPE are: 'interval', 'through', 'transac',\n"
 		"                 'iat', 'kernel' (all show per default), and 'blocks', 'rtt',\n"
 #ifdef DEBUG
-		"                 'delay', 'status' (optional)\n"
+		"                 'delay', 'drift', 'churn', 'corrupt', 'dump', 'wire',\n"
+		"                 'fairness', 'status' (optional)\n"
 #else /* DEBUG */
-		"                 'delay' (optional)\n"
+		"                 'delay', 'drift', 'churn', 'corrupt', 'dump', 'wire',\n"
+		"                 'fairness' (optional)\n"
 #endif /* DEBUG */
 #ifdef DEBUG
 		"  -d, --debug    increase debugging verbosity. Add option multiple times to\n"
@@ -258,6 +326,10 @@ static void usage(short status)
 #endif /* DEBUG */
 		"  -e, --dump-prefix=PRE\n"
 		"                 prepend prefix PRE to pcap dump filename (default: \"%3$s\")\n"
+		"      --dump-merge\n"
+		"                 dump the traffic of all flows on an interface into one pcapng\n"
+		"                 file per interface with the flow IDs as packet comments,\n"
+		"                 instead of one pcap file per flow\n"
 		"  -i, --report-interval=#.#\n"
 		"                 reporting interval, in seconds (default: 0.05s)\n"
 		"      --log-file[=FILE]\n"
@@ -265,6 +337,11 @@ static void usage(short status)
 		"  -m             report throughput in 2**20 bytes/s (default: 10**6 bit/s)\n"
 		"  -n, --flows=#  number of test flows (default: 1)\n"
 		"  -o             overwrite existing log files (default: don't)\n"
+		"      --output=FORMAT[:FILE]\n"
+		"                 write interval and final reports in machine-readable FORMAT\n"
+		"                 to FILE, where FORMAT is 'json' (JSON lines), 'csv' or\n"
+		"                 'binary'. Without FILE or if FILE is '-', write to stdout\n"
+		"                 instead of the table\n"
 		"  -p             don't print symbolic values (like INT_MAX) instead of numbers\n"
 		"  -q, --quiet    be quiet, do not log to screen (default: off)\n"
 		"  -s, --tcp-stack=TYPE\n"
@@ -284,7 +361,8 @@ static void usage(short status)
 		"  -B x=#         set requested sending buffer, in bytes\n"
 		"  -C x           stop flow if it is experiencing local congestion\n"
 		"  -D x=DSCP      DSCP value for TOS byte\n"
-		"  -E             enumerate bytes in payload instead of sending zeros\n"
+		"  -E             enumerate bytes in payload instead of sending zeros and\n"
+		"                 verify them at the receiver\n"
 		"  -F #[,#]...    flow options following this option apply only to the given flow \n"
 		"                 IDs. Useful in combination with -n to set specific options\n"
 		"                 for certain flows. Numbering starts with 0, so -F 1 refers\n"
@@ -294,6 +372,7 @@ static void usage(short status)
 #else /* HAVE_LIBGSL */
 		"  -G x=(q|p|g):(C|U):#1:[#2]\n"
 #endif /* HAVE_LIBGSL */
+		"  -G x=(q|p|g):F:FILE\n"
 		"                 activate stochastic traffic generation and set parameters\n"
 		"                 according to the used distribution. For additional information \n"
 		"                 see 'flowgrind --help=traffic'\n"
@@ -306,7 +385,8 @@ static void usage(short status)
 		"  -L             call connect() on test socket immediately before starting to\n"
 		"                 send data (late connect). If not specified the test connection\n"
 		"                 is established in the preparation phase before the test starts\n"
-		"  -M x           dump traffic using libpcap. flowgrindd must be run as root\n"
+		"  -M x           dump and analyze traffic using libpcap. flowgrindd must be run\n"
+		"                 as root\n"
 		"  -N             shutdown() each socket direction after test flow\n"
 		"  -O x=OPT       set socket option OPT on test socket. For additional information\n"
 		"                 see 'flowgrind --help=socket'\n"
@@ -323,7 +403,23 @@ static void usage(short status)
 		"                 truncates values if used with stochastic traffic generation\n"
 		"  -W x=#         set requested receiver buffer (advertised window), in bytes\n"
 		"  -Y x=#.#       set initial delay before the host starts to send, in seconds\n"
-/*		"  -Z x=#.#       set amount of data to be send, in bytes (instead of -t)\n"*/,
+		"  -Z x=#(z|k|M|G)\n"
+		"                 stop sending after # bytes, where z = 2**0, k = 2**10,\n"
+		"                 M = 2**20, G = 2**30, and report the flow completion time.\n"
+		"                 At least %2$d bytes. The flow duration (-T) acts as timeout\n"
+		"      --blocks x=#\n"
+		"                 stop sending after # request blocks (same as -Z otherwise)\n"
+		"      --trace x=FILE\n"
+		"                 replay the recorded trace FILE instead of generating traffic.\n"
+		"                 Block sizes, response sizes and send times are taken from the\n"
+		"                 trace. The flow ends with the trace or when its duration (-T)\n"
+		"                 has elapsed, whichever comes first\n"
+		"      --churn=#  open a new short connection for each request instead of\n"
+		"                 using one long-lived connection, with at most # connections\n"
+		"                 open at a time. Connections arrive with the interpacket gap\n"
+		"                 distribution (-G s=g) regardless of completions, request and\n"
+		"                 response sizes are taken from -G s=q and -G s=p\n"
+		"      --tag=NAME add flow to aggregation group NAME (see --aggregate)\n",
 		progname,
 		MIN_BLOCK_SIZE
 		, copt.dump_prefix
@@ -400,6 +496,7 @@ static void usage_trafgenopt(void)
 #else /* HAVE_LIBGSL */
 		"  -G x=(q|p|g):(C|U):#1:[#2]\n"
 #endif /* HAVE_LIBGSL */
+		"  -G x=(q|p|g):F:FILE\n"
 		"               Flow parameter:\n"
 		"                 q = request size (in bytes)\n"
 		"                 p = response size (in bytes)\n"
@@ -417,6 +514,9 @@ static void usage_trafgenopt(void)
 #else /* HAVE_LIBGSL */
 		"               advanced distributions are only available if compiled with libgsl\n"
 #endif /* HAVE_LIBGSL */
+		"                 F = empirical (FILE: CDF table, one point per line with\n"
+		"                     the value in the first and the cumulative probability\n"
+		"                     in the last column)\n"
 		"  -U x=#       specify a cap for the calculated values for request and response\n"
 		"               size (not needed for constant values or uniform distribution),\n"
 		"               values over this cap are recalculated\n\n"
@@ -429,7 +529,9 @@ static void usage_trafgenopt(void)
 		"               variance 50\n"
 		"  -G s=g:U:0.005:0.01\n"
 		"               use uniform distributed interpacket gap with minimum 0.005s and\n"
-		"               maximum 0.01s\n\n"
+		"               maximum 0.01s\n"
+		"  -G s=q:F:websearch.cdf\n"
+		"               draw request sizes from the CDF given in file websearch.cdf\n\n"
 
 		"Notes: \n"
 		"  - The man page contains more explained examples\n"
@@ -470,10 +572,18 @@ static void init_controller_options(void)
 	copt.log_to_stdout = true;
 	copt.log_to_file = false;
 	copt.dump_prefix = "flowgrind-";
+	copt.dump_merge = false;
 	copt.clobber = false;
 	copt.mbyte = false;
 	copt.symbolic = true;
 	copt.force_unit = INT_MAX;
+	copt.aggregate_daemon = false;
+	copt.aggregate_total = false;
+	copt.aggregate_only = false;
+	copt.output_format = OUTPUT_NONE;
+	copt.output_file = NULL;
+	copt.capture_file = NULL;
+	copt.control_stats_file = NULL;
 }
 
 /**
@@ -485,6 +595,13 @@ static void init_controller_options(void)
  */
 static void init_flow_options(void)
 {
+	/* all endpoints share the default profile until they are changed */
+	struct flow_profile *profile = profile_new();
+	if (!profile)
+		critx("could not allocate memory for flow profile");
+	profile->request_trafgen_options.param_one = 8192;
+	profile->response_trafgen_options.param_one = 0;
+
 	for (int id = 0; id < MAX_FLOWS_CONTROLLER; id++) {
 
 		cflow[id].proto = PROTO_TCP;
@@ -494,8 +611,7 @@ static void init_flow_options(void)
 			cflow[id].settings[*i].requested_read_buffer_size = 0;
 			cflow[id].settings[*i].delay[WRITE] = 0;
 			cflow[id].settings[*i].maximum_block_size = 8192;
-			cflow[id].settings[*i].request_trafgen_options.param_one = 8192;
-			cflow[id].settings[*i].response_trafgen_options.param_one = 0;
+			cflow[id].settings[*i].profile = profile_ref(profile);
 			cflow[id].settings[*i].route_record = 0;
 			strcpy(cflow[id].endpoint[*i].test_address, "localhost");
 
@@ -505,7 +621,6 @@ static void init_flow_options(void)
 
 			cflow[id].settings[*i].pushy = 0;
 			cflow[id].settings[*i].cork = 0;
-			cflow[id].settings[*i].cc_alg[0] = 0;
 			cflow[id].settings[*i].elcn = 0;
 			cflow[id].settings[*i].lcd = 0;
 			cflow[id].settings[*i].mtcp = 0;
@@ -514,8 +629,6 @@ static void init_flow_options(void)
 			cflow[id].settings[*i].so_debug = 0;
 			cflow[id].settings[*i].dscp = 0;
 			cflow[id].settings[*i].ipmtudiscover = 0;
-
-			cflow[id].settings[*i].num_extra_socket_options = 0;
 		}
 		cflow[id].settings[SOURCE].duration[WRITE] = 10.0;
 		cflow[id].settings[DESTINATION].duration[WRITE] = 0.0;
@@ -530,6 +643,9 @@ static void init_flow_options(void)
 		cflow[id].finished[1] = 0;
 		cflow[id].final_report[0] = NULL;
 		cflow[id].final_report[1] = NULL;
+		cflow[id].tag = NULL;
+		fg_list_init(&cflow[id].aggregates[SOURCE]);
+		fg_list_init(&cflow[id].aggregates[DESTINATION]);
 
 		cflow[id].summarize_only = 0;
 		cflow[id].late_connect = 0;
@@ -543,6 +659,23 @@ static void init_flow_options(void)
 		if(rc == -1)
 			crit("read /dev/urandom failed");
 	}
+	profile_unref(profile);
+}
+
+/**
+ * Make the profile of endpoint settings @p settings safe to change.
+ *
+ * @param[in,out] settings endpoint settings
+ * @return profile only referenced by @p settings
+ */
+static struct flow_profile *mutable_profile(struct flow_settings *settings)
+{
+	struct flow_profile *profile = profile_mutable(&settings->profile);
+
+	if (!profile)
+		critx("could not allocate memory for flow profile");
+
+	return profile;
 }
 
 /**
@@ -583,6 +716,147 @@ static void close_logfile(void)
 	free(log_filename);
 }
 
+/**
+ * Open the file of the machine-readable output.
+ */
+static void open_output(void)
+{
+	if (copt.output_format == OUTPUT_NONE)
+		return;
+
+	int fd = STDOUT_FILENO;
+	if (strcmp(copt.output_file, "-")) {
+		int flags = O_WRONLY | O_CREAT | O_TRUNC;
+		if (!copt.clobber)
+			flags |= O_EXCL;
+		fd = open(copt.output_file, flags, 0644);
+		if (fd == -1)
+			crit("could not open output file '%s'",
+			     copt.output_file);
+	}
+
+	output_open(copt.output_format, fd);
+	DEBUG_MSG(LOG_NOTICE, "machine-readable output to '%s'",
+		  copt.output_file);
+}
+
+/**
+ * Open the capture file. Its header is written once the test starts.
+ */
+static void open_capture(void)
+{
+	if (!copt.capture_file)
+		return;
+
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	if (!copt.clobber)
+		flags |= O_EXCL;
+	int fd = open(copt.capture_file, flags, 0644);
+	if (fd == -1)
+		crit("could not open capture file '%s'", copt.capture_file);
+
+	capture_open(fd, copt.num_flows);
+	DEBUG_MSG(LOG_NOTICE, "capturing reports to '%s'", copt.capture_file);
+}
+
+/**
+ * Open the file of the control plane statistics. They are written once all
+ * flows finished.
+ */
+static void open_control_stats(void)
+{
+	if (!copt.control_stats_file)
+		return;
+
+	control_stats_fd = STDOUT_FILENO;
+	if (strcmp(copt.control_stats_file, "-")) {
+		int flags = O_WRONLY | O_CREAT | O_TRUNC;
+		if (!copt.clobber)
+			flags |= O_EXCL;
+		control_stats_fd = open(copt.control_stats_file, flags, 0644);
+		if (control_stats_fd == -1)
+			crit("could not open control plane statistics file "
+			     "'%s'", copt.control_stats_file);
+	}
+}
+
+/**
+ * Collect the start statistics of all flow endpoints from their final
+ * reports and write the control plane statistics.
+ */
+static void write_control_stats(void)
+{
+	if (control_stats_fd == -1)
+		return;
+
+	ctl_stats.daemons = fg_list_size(&unique_daemons);
+	ctl_stats.flows = copt.num_flows;
+
+	for (unsigned short id = 0; id < copt.num_flows; id++) {
+		const struct cflow *f = &cflow[id];
+		int *i = NULL;
+
+		foreach(i, SOURCE, DESTINATION) {
+			if (!f->final_report[*i])
+				continue;
+			sample_stats_add(&ctl_stats.start_skew,
+					 f->final_report[*i]->start_skew);
+			sample_stats_add(&ctl_stats.start_offset,
+				time_diff(&test_start, &f->start_timestamp[*i]) -
+				f->endpoint[*i].daemon->clock_offset);
+		}
+	}
+
+	control_stats_write(control_stats_fd);
+	control_stats_fd = -1;
+}
+
+/**
+ * Write the header of the capture file, describing all flows.
+ */
+static void start_capture(void)
+{
+	if (!copt.capture_file)
+		return;
+
+	struct capture_flow *flows = calloc(copt.num_flows,
+					    sizeof(struct capture_flow));
+	if (!flows)
+		critx("could not allocate memory for capture flows");
+
+	for (unsigned short id = 0; id < copt.num_flows; id++) {
+		const struct cflow *f = &cflow[id];
+		struct capture_flow *c = &flows[id];
+
+		c->flow_id = id;
+		c->proto = f->proto;
+		c->churn = f->churn;
+		c->random_seed = f->random_seed;
+		if (f->tag)
+			strncpy(c->tag, f->tag, CAPTURE_NAME_LEN - 1);
+
+		foreach(int *i, SOURCE, DESTINATION) {
+			const struct flow_endpoint *e = &f->endpoint[*i];
+			const struct flow_settings *s = &f->settings[*i];
+
+			strncpy(c->host[*i], e->rpc_info->server_name,
+				CAPTURE_NAME_LEN - 1);
+			strncpy(c->test_address[*i], e->test_address,
+				CAPTURE_NAME_LEN - 1);
+			strncpy(c->cc_alg[*i], s->profile->cc_alg, TCP_CA_NAME_MAX - 1);
+			c->delay[*i] = s->delay[WRITE];
+			c->duration[*i] = s->duration[WRITE];
+			c->clock_offset[*i] = e->daemon->clock_offset;
+			c->send_buffer_size[*i] = s->requested_send_buffer_size;
+			c->receive_buffer_size[*i] = s->requested_read_buffer_size;
+			c->maximum_block_size[*i] = s->maximum_block_size;
+		}
+	}
+
+	capture_start(&test_start, copt.reporting_interval, flows);
+	free(flows);
+}
+
 /**
  * Print measurement output to logfile and / or to stdout.
  *
@@ -833,6 +1107,76 @@ static void find_daemon(xmlrpc_client *rpc_client)
 	}
 }
 
+/**
+ * Estimate the clock offset of all daemons to the controller.
+ *
+ * Like NTP, each exchange yields the controller time @p t0 the request is
+ * sent, the daemon times @p t1 it is received and @p t2 the reply is sent,
+ * and the controller time @p t3 the reply is received. The offset of the
+ * daemon clock is estimated as ((t1 - t0) + (t2 - t3)) / 2, which is exact if
+ * both paths take equally long. Since the error is bounded by half the
+ * round-trip time (t3 - t0) - (t2 - t1), the exchange with the smallest
+ * round-trip time out of CLOCK_SYNC_SAMPLES is used.
+ *
+ * @param[in,out] rpc_client to connect controller to daemon
+ */
+static void sync_clocks(xmlrpc_client *rpc_client)
+{
+	xmlrpc_value * resultP = 0;
+	const struct list_node *node = fg_list_front(&unique_daemons);
+
+	while (node) {
+		struct daemon *daemon = node->data;
+		node = node->next;
+
+		daemon->clock_rtt = INFINITY;
+		for (unsigned sample = 0; sample < CLOCK_SYNC_SAMPLES;
+		     sample++) {
+			if (sigint_caught)
+				return;
+
+			struct timespec t0, t1, t2, t3;
+			int recv_sec, recv_nsec, send_sec, send_nsec;
+
+			gettime(&t0);
+			xmlrpc_client_call2f(&rpc_env, rpc_client,
+					     daemon->url,
+					     "get_time", &resultP, "()");
+			gettime(&t3);
+			die_if_fault_occurred(&rpc_env);
+
+			if (!resultP)
+				continue;
+
+			xmlrpc_decompose_value(&rpc_env, resultP,
+					       "{s:i,s:i,s:i,s:i,*}",
+					       "recv_sec", &recv_sec,
+					       "recv_nsec", &recv_nsec,
+					       "send_sec", &send_sec,
+					       "send_nsec", &send_nsec);
+			die_if_fault_occurred(&rpc_env);
+			xmlrpc_DECREF(resultP);
+
+			t1.tv_sec = recv_sec;
+			t1.tv_nsec = recv_nsec;
+			t2.tv_sec = send_sec;
+			t2.tv_nsec = send_nsec;
+
+			double rtt = time_diff(&t0, &t3) - time_diff(&t1, &t2);
+			if (rtt >= daemon->clock_rtt)
+				continue;
+
+			daemon->clock_rtt = rtt;
+			daemon->clock_offset = (time_diff(&t0, &t1) +
+						time_diff(&t3, &t2)) / 2.0;
+		}
+
+		DEBUG_MSG(LOG_WARNING, "clock offset of node %s is %.6f s "
+			  "(rtt %.6f s)", daemon->url, daemon->clock_offset,
+			  daemon->clock_rtt);
+	}
+}
+
 /**
 * Checks that all nodes are currently idle.
 *
@@ -978,6 +1322,124 @@ static void print_headline(void)
 				COL_TCP_REOR, COL_TCP_BKOF);
 }
 
+/**
+ * Build the XML-RPC representation of the empirical CDF of @p opt.
+ *
+ * The CDF is encoded as flat array of alternating values and cumulative
+ * probabilities. An empty array is built for parametric distributions.
+ *
+ * @param[in] opt traffic generation option
+ * @return XML-RPC array
+ */
+static xmlrpc_value *build_cdf_value(const struct trafgen_options *opt)
+{
+	xmlrpc_value *array = xmlrpc_array_new(&rpc_env);
+	const struct empirical_cdf *cdf =
+		opt->distribution == EMPIRICAL ? opt->cdf : NULL;
+
+	for (unsigned i = 0; cdf && i < cdf->num_points; i++) {
+		xmlrpc_value *value = xmlrpc_double_new(&rpc_env, cdf->value[i]);
+		xmlrpc_value *probability =
+			xmlrpc_double_new(&rpc_env, cdf->probability[i]);
+
+		xmlrpc_array_append_item(&rpc_env, array, value);
+		xmlrpc_array_append_item(&rpc_env, array, probability);
+		xmlrpc_DECREF(value);
+		xmlrpc_DECREF(probability);
+	}
+
+	return array;
+}
+
+/**
+ * Build the XML-RPC representation of the extra socket options of @p profile.
+ *
+ * @param[in] profile flow profile of an endpoint
+ * @return XML-RPC array
+ */
+static xmlrpc_value *build_extra_options_value(const struct flow_profile *profile)
+{
+	xmlrpc_value *extra_options = xmlrpc_array_new(&rpc_env);
+
+	for (int i = 0; i < profile->num_extra_socket_options; i++) {
+		xmlrpc_value *value;
+		xmlrpc_value *option = xmlrpc_build_value(&rpc_env, "{s:i,s:i}",
+			 "level", profile->extra_socket_options[i].level,
+			 "optname", profile->extra_socket_options[i].optname);
+
+		value = xmlrpc_base64_new(&rpc_env, profile->extra_socket_options[i].optlen, (unsigned char*)profile->extra_socket_options[i].optval);
+
+		xmlrpc_struct_set_value(&rpc_env, option, "value", value);
+
+		xmlrpc_array_append_item(&rpc_env, extra_options, option);
+		xmlrpc_DECREF(value);
+		xmlrpc_DECREF(option);
+	}
+
+	return extra_options;
+}
+
+/**
+ * Upload the trace replayed by endpoint @p e of flow @p id to its daemon.
+ *
+ * The trace is sent in chunks, so it never needs to fit into memory. The
+ * name of the uploaded trace is stored in the flow settings.
+ *
+ * @param[in] id flow id
+ * @param[in] e flow endpoint (SOURCE or DESTINATION)
+ * @param[in,out] rpc_client to connect controller to daemon
+ */
+static void upload_trace(int id, enum endpoint_t e, xmlrpc_client *rpc_client)
+{
+	xmlrpc_value *resultP = 0;
+	char *trace_name = 0;
+	unsigned char *buf;
+	size_t len;
+
+	const char *url = cflow[id].endpoint[e].rpc_info->server_url;
+	struct flow_settings *settings = &cflow[id].settings[e];
+
+	DEBUG_MSG(LOG_WARNING, "upload trace of flow %d %s", id,
+		  e ? "destination" : "source");
+
+	FILE *fp = fopen(cflow[id].trace_file[e], "rb");
+	if (!fp)
+		crit("failed to open trace file '%s'", cflow[id].trace_file[e]);
+	buf = malloc(TRACE_CHUNK_SIZE);
+	if (!buf)
+		critx("could not allocate memory for trace upload");
+
+	xmlrpc_client_call2f(&rpc_env, rpc_client, url, "create_trace",
+			     &resultP, "()");
+	die_if_fault_occurred(&rpc_env);
+
+	xmlrpc_decompose_value(&rpc_env, resultP, "{s:s,*}",
+			       "trace_name", &trace_name);
+	die_if_fault_occurred(&rpc_env);
+	xmlrpc_DECREF(resultP);
+
+	if (strlen(trace_name) >= sizeof(settings->trace_name))
+		critx("node %s returned malformed trace name", url);
+	strcpy(settings->trace_name, trace_name);
+	free(trace_name);
+
+	while ((len = fread(buf, 1, TRACE_CHUNK_SIZE, fp)) > 0) {
+		if (sigint_caught)
+			break;
+		xmlrpc_client_call2f(&rpc_env, rpc_client, url, "append_trace",
+				     &resultP, "({s:s,s:6})",
+				     "trace_name", settings->trace_name,
+				     "data", buf, len);
+		die_if_fault_occurred(&rpc_env);
+		xmlrpc_DECREF(resultP);
+	}
+	if (ferror(fp))
+		crit("failed to read trace file '%s'", cflow[id].trace_file[e]);
+
+	free(buf);
+	fclose(fp);
+}
+
 /**
  * Prepare test connection for a flow between source and destination daemons.
  * 
@@ -991,26 +1453,25 @@ static void print_headline(void)
 static void prepare_flow(int id, xmlrpc_client *rpc_client)
 {
 	xmlrpc_value *resultP, *extra_options;
+	xmlrpc_value *request_cdf, *response_cdf, *gap_cdf;
 
 	int listen_data_port;
-	DEBUG_MSG(LOG_WARNING, "prepare flow %d destination", id);
 
-	/* Contruct extra socket options array */
-	extra_options = xmlrpc_array_new(&rpc_env);
-	for (int i = 0; i < cflow[id].settings[DESTINATION].num_extra_socket_options; i++) {
-		xmlrpc_value *value;
-		xmlrpc_value *option = xmlrpc_build_value(&rpc_env, "{s:i,s:i}",
-			 "level", cflow[id].settings[DESTINATION].extra_socket_options[i].level,
-			 "optname", cflow[id].settings[DESTINATION].extra_socket_options[i].optname);
+	foreach(int *i, SOURCE, DESTINATION)
+		if (cflow[id].trace_file[*i])
+			upload_trace(id, *i, rpc_client);
+	if (sigint_caught)
+		return;
 
-		value = xmlrpc_base64_new(&rpc_env, cflow[id].settings[DESTINATION].extra_socket_options[i].optlen, (unsigned char*)cflow[id].settings[DESTINATION].extra_socket_options[i].optval);
+	DEBUG_MSG(LOG_WARNING, "prepare flow %d destination", id);
 
-		xmlrpc_struct_set_value(&rpc_env, option, "value", value);
+	/* Contruct extra socket options array */
+	extra_options = build_extra_options_value(cflow[id].settings[DESTINATION].profile);
+	/* Construct empirical distribution arrays */
+	request_cdf = build_cdf_value(&cflow[id].settings[DESTINATION].profile->request_trafgen_options);
+	response_cdf = build_cdf_value(&cflow[id].settings[DESTINATION].profile->response_trafgen_options);
+	gap_cdf = build_cdf_value(&cflow[id].settings[DESTINATION].profile->interpacket_gap_trafgen_options);
 
-		xmlrpc_array_append_item(&rpc_env, extra_options, option);
-		xmlrpc_DECREF(value);
-		xmlrpc_DECREF(option);
-	}
 	xmlrpc_client_call2f(&rpc_env, rpc_client,
 		cflow[id].endpoint[DESTINATION].rpc_info->server_url,
 		"add_flow_destination", &resultP,
@@ -1030,6 +1491,10 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"{s:i,s:i,s:i,s:i,s:i}"
 		"{s:s}"
 		"{s:i,s:A}"
+		"{s:A,s:A,s:A}" /* empirical distributions */
+		"{s:s}" /* trace replay */
+		"{s:i}" /* connection churn */
+		"{s:i,s:i,s:i,s:i,s:i,s:i}" /* flow size */
 		")",
 
 		/* general flow settings */
@@ -1057,24 +1522,24 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"write_rate", cflow[id].settings[DESTINATION].write_rate,
 		"random_seed",cflow[id].random_seed,
 
-		"traffic_generation_request_distribution", cflow[id].settings[DESTINATION].request_trafgen_options.distribution,
-		"traffic_generation_request_param_one", cflow[id].settings[DESTINATION].request_trafgen_options.param_one,
-		"traffic_generation_request_param_two", cflow[id].settings[DESTINATION].request_trafgen_options.param_two,
+		"traffic_generation_request_distribution", cflow[id].settings[DESTINATION].profile->request_trafgen_options.distribution,
+		"traffic_generation_request_param_one", cflow[id].settings[DESTINATION].profile->request_trafgen_options.param_one,
+		"traffic_generation_request_param_two", cflow[id].settings[DESTINATION].profile->request_trafgen_options.param_two,
 
-		"traffic_generation_response_distribution", cflow[id].settings[DESTINATION].response_trafgen_options.distribution,
-		"traffic_generation_response_param_one", cflow[id].settings[DESTINATION].response_trafgen_options.param_one,
-		"traffic_generation_response_param_two", cflow[id].settings[DESTINATION].response_trafgen_options.param_two,
+		"traffic_generation_response_distribution", cflow[id].settings[DESTINATION].profile->response_trafgen_options.distribution,
+		"traffic_generation_response_param_one", cflow[id].settings[DESTINATION].profile->response_trafgen_options.param_one,
+		"traffic_generation_response_param_two", cflow[id].settings[DESTINATION].profile->response_trafgen_options.param_two,
 
-		"traffic_generation_gap_distribution", cflow[id].settings[DESTINATION].interpacket_gap_trafgen_options.distribution,
-		"traffic_generation_gap_param_one", cflow[id].settings[DESTINATION].interpacket_gap_trafgen_options.param_one,
-		"traffic_generation_gap_param_two", cflow[id].settings[DESTINATION].interpacket_gap_trafgen_options.param_two,
+		"traffic_generation_gap_distribution", cflow[id].settings[DESTINATION].profile->interpacket_gap_trafgen_options.distribution,
+		"traffic_generation_gap_param_one", cflow[id].settings[DESTINATION].profile->interpacket_gap_trafgen_options.param_one,
+		"traffic_generation_gap_param_two", cflow[id].settings[DESTINATION].profile->interpacket_gap_trafgen_options.param_two,
 
 	"flow_control", cflow[id].settings[DESTINATION].flow_control,
 		"byte_counting", cflow[id].byte_counting,
 		"cork", (int)cflow[id].settings[DESTINATION].cork,
 		"nonagle", cflow[id].settings[DESTINATION].nonagle,
 
-		"cc_alg", cflow[id].settings[DESTINATION].cc_alg,
+		"cc_alg", cflow[id].settings[DESTINATION].profile->cc_alg,
 
 		"elcn", cflow[id].settings[DESTINATION].elcn,
 		"lcd", cflow[id].settings[DESTINATION].lcd,
@@ -1082,11 +1547,33 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"dscp", (int)cflow[id].settings[DESTINATION].dscp,
 		"ipmtudiscover", cflow[id].settings[DESTINATION].ipmtudiscover,
 		"dump_prefix", copt.dump_prefix,
-		"num_extra_socket_options", cflow[id].settings[DESTINATION].num_extra_socket_options,
-		"extra_socket_options", extra_options);
+		"num_extra_socket_options", cflow[id].settings[DESTINATION].profile->num_extra_socket_options,
+		"extra_socket_options", extra_options,
+
+		/* empirical distributions */
+		"traffic_generation_request_cdf", request_cdf,
+		"traffic_generation_response_cdf", response_cdf,
+		"traffic_generation_gap_cdf", gap_cdf,
+
+		/* trace replay */
+		"trace_name", cflow[id].settings[DESTINATION].trace_name,
 
+		/* connection churn */
+		"churn", cflow[id].churn,
+
+		/* flow size */
+		"write_size_high", (int32_t)(cflow[id].settings[DESTINATION].flow_size[WRITE] >> 32),
+		"write_size_low", (int32_t)(cflow[id].settings[DESTINATION].flow_size[WRITE] & 0xFFFFFFFF),
+		"read_size_high", (int32_t)(cflow[id].settings[SOURCE].flow_size[WRITE] >> 32),
+		"read_size_low", (int32_t)(cflow[id].settings[SOURCE].flow_size[WRITE] & 0xFFFFFFFF),
+		"write_blocks", cflow[id].settings[DESTINATION].flow_blocks[WRITE],
+		"read_blocks", cflow[id].settings[SOURCE].flow_blocks[WRITE]);
 	die_if_fault_occurred(&rpc_env);
 
+	xmlrpc_DECREF(request_cdf);
+	xmlrpc_DECREF(response_cdf);
+	xmlrpc_DECREF(gap_cdf);
+
 	xmlrpc_parse_value(&rpc_env, resultP, "{s:i,s:i,s:i,s:i,*}",
 		"flow_id", &cflow[id].endpoint_id[DESTINATION],
 		"listen_data_port", &listen_data_port,
@@ -1098,24 +1585,14 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		xmlrpc_DECREF(resultP);
 
 	/* Contruct extra socket options array */
-	extra_options = xmlrpc_array_new(&rpc_env);
-	for (int i = 0; i < cflow[id].settings[SOURCE].num_extra_socket_options; i++) {
-
-		xmlrpc_value *value;
-		xmlrpc_value *option = xmlrpc_build_value(&rpc_env, "{s:i,s:i}",
-			 "level", cflow[id].settings[SOURCE].extra_socket_options[i].level,
-			 "optname", cflow[id].settings[SOURCE].extra_socket_options[i].optname);
-
-		value = xmlrpc_base64_new(&rpc_env, cflow[id].settings[SOURCE].extra_socket_options[i].optlen, (unsigned char*)cflow[id].settings[SOURCE].extra_socket_options[i].optval);
-
-		xmlrpc_struct_set_value(&rpc_env, option, "value", value);
-
-		xmlrpc_array_append_item(&rpc_env, extra_options, option);
-		xmlrpc_DECREF(value);
-		xmlrpc_DECREF(option);
-	}
+	extra_options = build_extra_options_value(cflow[id].settings[SOURCE].profile);
 	DEBUG_MSG(LOG_WARNING, "prepare flow %d source", id);
 
+	/* Construct empirical distribution arrays */
+	request_cdf = build_cdf_value(&cflow[id].settings[SOURCE].profile->request_trafgen_options);
+	response_cdf = build_cdf_value(&cflow[id].settings[SOURCE].profile->response_trafgen_options);
+	gap_cdf = build_cdf_value(&cflow[id].settings[SOURCE].profile->interpacket_gap_trafgen_options);
+
 	xmlrpc_client_call2f(&rpc_env, rpc_client,
 		cflow[id].endpoint[SOURCE].rpc_info->server_url,
 		"add_flow_source", &resultP,
@@ -1136,6 +1613,10 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"{s:s}"
 		"{s:i,s:A}"
 		"{s:s,s:i,s:i}"
+		"{s:A,s:A,s:A}" /* empirical distributions */
+		"{s:s}" /* trace replay */
+		"{s:i}" /* connection churn */
+		"{s:i,s:i,s:i,s:i,s:i,s:i}" /* flow size */
 		")",
 
 		/* general flow settings */
@@ -1163,17 +1644,17 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"write_rate", cflow[id].settings[SOURCE].write_rate,
 		"random_seed",cflow[id].random_seed,
 
-		"traffic_generation_request_distribution", cflow[id].settings[SOURCE].request_trafgen_options.distribution,
-		"traffic_generation_request_param_one", cflow[id].settings[SOURCE].request_trafgen_options.param_one,
-		"traffic_generation_request_param_two", cflow[id].settings[SOURCE].request_trafgen_options.param_two,
+		"traffic_generation_request_distribution", cflow[id].settings[SOURCE].profile->request_trafgen_options.distribution,
+		"traffic_generation_request_param_one", cflow[id].settings[SOURCE].profile->request_trafgen_options.param_one,
+		"traffic_generation_request_param_two", cflow[id].settings[SOURCE].profile->request_trafgen_options.param_two,
 
-		"traffic_generation_response_distribution", cflow[id].settings[SOURCE].response_trafgen_options.distribution,
-		"traffic_generation_response_param_one", cflow[id].settings[SOURCE].response_trafgen_options.param_one,
-		"traffic_generation_response_param_two", cflow[id].settings[SOURCE].response_trafgen_options.param_two,
+		"traffic_generation_response_distribution", cflow[id].settings[SOURCE].profile->response_trafgen_options.distribution,
+		"traffic_generation_response_param_one", cflow[id].settings[SOURCE].profile->response_trafgen_options.param_one,
+		"traffic_generation_response_param_two", cflow[id].settings[SOURCE].profile->response_trafgen_options.param_two,
 
-		"traffic_generation_gap_distribution", cflow[id].settings[SOURCE].interpacket_gap_trafgen_options.distribution,
-		"traffic_generation_gap_param_one", cflow[id].settings[SOURCE].interpacket_gap_trafgen_options.param_one,
-		"traffic_generation_gap_param_two", cflow[id].settings[SOURCE].interpacket_gap_trafgen_options.param_two,
+		"traffic_generation_gap_distribution", cflow[id].settings[SOURCE].profile->interpacket_gap_trafgen_options.distribution,
+		"traffic_generation_gap_param_one", cflow[id].settings[SOURCE].profile->interpacket_gap_trafgen_options.param_one,
+		"traffic_generation_gap_param_two", cflow[id].settings[SOURCE].profile->interpacket_gap_trafgen_options.param_two,
 
 
 		"flow_control", cflow[id].settings[SOURCE].flow_control,
@@ -1181,7 +1662,7 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"cork", (int)cflow[id].settings[SOURCE].cork,
 		"nonagle", (int)cflow[id].settings[SOURCE].nonagle,
 
-		"cc_alg", cflow[id].settings[SOURCE].cc_alg,
+		"cc_alg", cflow[id].settings[SOURCE].profile->cc_alg,
 
 		"elcn", cflow[id].settings[SOURCE].elcn,
 		"lcd", cflow[id].settings[SOURCE].lcd,
@@ -1189,15 +1670,38 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 		"dscp", (int)cflow[id].settings[SOURCE].dscp,
 		"ipmtudiscover", cflow[id].settings[SOURCE].ipmtudiscover,
 		"dump_prefix", copt.dump_prefix,
-		"num_extra_socket_options", cflow[id].settings[SOURCE].num_extra_socket_options,
+		"num_extra_socket_options", cflow[id].settings[SOURCE].profile->num_extra_socket_options,
 		"extra_socket_options", extra_options,
 
 		/* source settings */
 		"destination_address", cflow[id].endpoint[DESTINATION].test_address,
 		"destination_port", listen_data_port,
-		"late_connect", (int)cflow[id].late_connect);
+		"late_connect", (int)cflow[id].late_connect,
+
+		/* empirical distributions */
+		"traffic_generation_request_cdf", request_cdf,
+		"traffic_generation_response_cdf", response_cdf,
+		"traffic_generation_gap_cdf", gap_cdf,
+
+		/* trace replay */
+		"trace_name", cflow[id].settings[SOURCE].trace_name,
+
+		/* connection churn */
+		"churn", cflow[id].churn,
+
+		/* flow size */
+		"write_size_high", (int32_t)(cflow[id].settings[SOURCE].flow_size[WRITE] >> 32),
+		"write_size_low", (int32_t)(cflow[id].settings[SOURCE].flow_size[WRITE] & 0xFFFFFFFF),
+		"read_size_high", (int32_t)(cflow[id].settings[DESTINATION].flow_size[WRITE] >> 32),
+		"read_size_low", (int32_t)(cflow[id].settings[DESTINATION].flow_size[WRITE] & 0xFFFFFFFF),
+		"write_blocks", cflow[id].settings[SOURCE].flow_blocks[WRITE],
+		"read_blocks", cflow[id].settings[DESTINATION].flow_blocks[WRITE]);
 	die_if_fault_occurred(&rpc_env);
 
+	xmlrpc_DECREF(request_cdf);
+	xmlrpc_DECREF(response_cdf);
+	xmlrpc_DECREF(gap_cdf);
+
 	xmlrpc_DECREF(extra_options);
 
 	xmlrpc_parse_value(&rpc_env, resultP, "{s:i,s:i,s:i,*}",
@@ -1211,6 +1715,434 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
 	DEBUG_MSG(LOG_WARNING, "prepare flow %d completed", id);
 }
 
+/**
+ * Build the settings of endpoint @p e of flow @p id for method add_flows.
+ *
+ * The struct has the members of the parameters of add_flow_destination and
+ * add_flow_source merged into one struct, and member "endpoint".
+ *
+ * @param[in] id flow id
+ * @param[in] e flow endpoint (SOURCE or DESTINATION)
+ * @param[in] listen_data_port data port of the destination, only used for
+ * the source
+ * @return XML-RPC struct
+ */
+static xmlrpc_value *build_endpoint_settings(int id, enum endpoint_t e,
+					     int listen_data_port)
+{
+	const struct flow_settings *settings = &cflow[id].settings[e];
+	const struct flow_settings *peer = &cflow[id].settings[e == SOURCE ?
+							       DESTINATION :
+							       SOURCE];
+	xmlrpc_value *value, *member;
+
+	value = xmlrpc_build_value(&rpc_env,
+		"{"
+		"s:i,s:s,s:i,"
+		"s:d,s:d,s:d,s:d,s:d,"
+		"s:i,s:i,s:i,"
+		"s:b,s:b,s:b,s:b,s:b,"
+		"s:i,s:i,"
+		"s:i,s:d,s:d," /* request */
+		"s:i,s:d,s:d," /* response */
+		"s:i,s:d,s:d," /* interpacket_gap */
+		"s:b,s:b,s:i,s:i,"
+		"s:s,"
+		"s:i,s:i,s:i,s:i,s:i,"
+		"s:s,"
+		"s:s," /* trace replay */
+		"s:i," /* connection churn */
+		"s:i,s:i,s:i,s:i,s:i,s:i" /* flow size */
+		"}",
+
+		"endpoint", (int)e,
+		"bind_address", cflow[id].endpoint[e].test_address,
+		"flow_id", id,
+
+		"write_delay", settings->delay[WRITE],
+		"write_duration", settings->duration[WRITE],
+		"read_delay", peer->delay[WRITE],
+		"read_duration", peer->duration[WRITE],
+		"reporting_interval", cflow[id].summarize_only ? 0 : copt.reporting_interval,
+
+		"requested_send_buffer_size", settings->requested_send_buffer_size,
+		"requested_read_buffer_size", settings->requested_read_buffer_size,
+		"maximum_block_size", settings->maximum_block_size,
+
+		"traffic_dump", settings->traffic_dump,
+		"so_debug", settings->so_debug,
+		"route_record", (int)settings->route_record,
+		"pushy", settings->pushy,
+		"shutdown", (int)cflow[id].shutdown,
+
+		"write_rate", settings->write_rate,
+		"random_seed", cflow[id].random_seed,
+
+		"traffic_generation_request_distribution", settings->profile->request_trafgen_options.distribution,
+		"traffic_generation_request_param_one", settings->profile->request_trafgen_options.param_one,
+		"traffic_generation_request_param_two", settings->profile->request_trafgen_options.param_two,
+
+		"traffic_generation_response_distribution", settings->profile->response_trafgen_options.distribution,
+		"traffic_generation_response_param_one", settings->profile->response_trafgen_options.param_one,
+		"traffic_generation_response_param_two", settings->profile->response_trafgen_options.param_two,
+
+		"traffic_generation_gap_distribution", settings->profile->interpacket_gap_trafgen_options.distribution,
+		"traffic_generation_gap_param_one", settings->profile->interpacket_gap_trafgen_options.param_one,
+		"traffic_generation_gap_param_two", settings->profile->interpacket_gap_trafgen_options.param_two,
+
+		"flow_control", settings->flow_control,
+		"byte_counting", cflow[id].byte_counting,
+		"cork", (int)settings->cork,
+		"nonagle", (int)settings->nonagle,
+
+		"cc_alg", settings->profile->cc_alg,
+
+		"elcn", settings->elcn,
+		"lcd", settings->lcd,
+		"mtcp", settings->mtcp,
+		"dscp", (int)settings->dscp,
+		"ipmtudiscover", settings->ipmtudiscover,
+
+		"dump_prefix", copt.dump_prefix,
+
+		/* trace replay */
+		"trace_name", settings->trace_name,
+
+		/* connection churn */
+		"churn", cflow[id].churn,
+
+		/* flow size */
+		"write_size_high", (int32_t)(settings->flow_size[WRITE] >> 32),
+		"write_size_low", (int32_t)(settings->flow_size[WRITE] & 0xFFFFFFFF),
+		"read_size_high", (int32_t)(peer->flow_size[WRITE] >> 32),
+		"read_size_low", (int32_t)(peer->flow_size[WRITE] & 0xFFFFFFFF),
+		"write_blocks", settings->flow_blocks[WRITE],
+		"read_blocks", peer->flow_blocks[WRITE]);
+	die_if_fault_occurred(&rpc_env);
+
+	/* source settings */
+	if (e == SOURCE) {
+		member = xmlrpc_string_new(&rpc_env, cflow[id].endpoint[DESTINATION].test_address);
+		xmlrpc_struct_set_value(&rpc_env, value, "destination_address", member);
+		xmlrpc_DECREF(member);
+		member = xmlrpc_int_new(&rpc_env, listen_data_port);
+		xmlrpc_struct_set_value(&rpc_env, value, "destination_port", member);
+		xmlrpc_DECREF(member);
+		member = xmlrpc_int_new(&rpc_env, (int)cflow[id].late_connect);
+		xmlrpc_struct_set_value(&rpc_env, value, "late_connect", member);
+		xmlrpc_DECREF(member);
+	}
+
+	/* only sent if requested, daemons without it ignore the member */
+	if (settings->traffic_dump && copt.dump_merge) {
+		member = xmlrpc_bool_new(&rpc_env, 1);
+		xmlrpc_struct_set_value(&rpc_env, value, "dump_merge", member);
+		xmlrpc_DECREF(member);
+	}
+
+	member = build_extra_options_value(settings->profile);
+	xmlrpc_struct_set_value(&rpc_env, value, "extra_socket_options", member);
+	xmlrpc_DECREF(member);
+
+	/* empirical distributions */
+	member = build_cdf_value(&settings->profile->request_trafgen_options);
+	xmlrpc_struct_set_value(&rpc_env, value, "traffic_generation_request_cdf", member);
+	xmlrpc_DECREF(member);
+	member = build_cdf_value(&settings->profile->response_trafgen_options);
+	xmlrpc_struct_set_value(&rpc_env, value, "traffic_generation_response_cdf", member);
+	xmlrpc_DECREF(member);
+	member = build_cdf_value(&settings->profile->interpacket_gap_trafgen_options);
+	xmlrpc_struct_set_value(&rpc_env, value, "traffic_generation_gap_cdf", member);
+	xmlrpc_DECREF(member);
+	die_if_fault_occurred(&rpc_env);
+
+	return value;
+}
+
+/**
+ * Compare two XML-RPC values built by build_endpoint_settings.
+ *
+ * @return true if @p a and @p b have the same type and content
+ */
+static bool xmlrpc_value_equal(xmlrpc_value *a, xmlrpc_value *b)
+{
+	bool equal = false;
+
+	if (xmlrpc_value_type(a) != xmlrpc_value_type(b))
+		return false;
+
+	switch (xmlrpc_value_type(a)) {
+	case XMLRPC_TYPE_INT: {
+		int i, j;
+		xmlrpc_read_int(&rpc_env, a, &i);
+		xmlrpc_read_int(&rpc_env, b, &j);
+		equal = i == j;
+		break;
+	}
+	case XMLRPC_TYPE_BOOL: {
+		xmlrpc_bool i, j;
+		xmlrpc_read_bool(&rpc_env, a, &i);
+		xmlrpc_read_bool(&rpc_env, b, &j);
+		equal = !i == !j;
+		break;
+	}
+	case XMLRPC_TYPE_DOUBLE: {
+		double x, y;
+		xmlrpc_read_double(&rpc_env, a, &x);
+		xmlrpc_read_double(&rpc_env, b, &y);
+		equal = x == y;
+		break;
+	}
+	case XMLRPC_TYPE_STRING: {
+		const char *x = 0, *y = 0;
+		xmlrpc_read_string(&rpc_env, a, &x);
+		xmlrpc_read_string(&rpc_env, b, &y);
+		equal = x && y && !strcmp(x, y);
+		free_all((void *)x, (void *)y);
+		break;
+	}
+	case XMLRPC_TYPE_BASE64: {
+		const unsigned char *x = 0, *y = 0;
+		size_t x_len = 0, y_len = 0;
+		xmlrpc_read_base64(&rpc_env, a, &x_len, &x);
+		xmlrpc_read_base64(&rpc_env, b, &y_len, &y);
+		equal = x_len == y_len && (!x_len || !memcmp(x, y, x_len));
+		free_all((void *)x, (void *)y);
+		break;
+	}
+	case XMLRPC_TYPE_ARRAY: {
+		int size = xmlrpc_array_size(&rpc_env, a);
+
+		equal = size == xmlrpc_array_size(&rpc_env, b);
+		for (int i = 0; equal && i < size; i++) {
+			xmlrpc_value *x, *y;
+			xmlrpc_array_read_item(&rpc_env, a, i, &x);
+			xmlrpc_array_read_item(&rpc_env, b, i, &y);
+			die_if_fault_occurred(&rpc_env);
+			equal = xmlrpc_value_equal(x, y);
+			xmlrpc_DECREF(x);
+			xmlrpc_DECREF(y);
+		}
+		break;
+	}
+	case XMLRPC_TYPE_STRUCT: {
+		int size = xmlrpc_struct_size(&rpc_env, a);
+
+		equal = size == xmlrpc_struct_size(&rpc_env, b);
+		for (int i = 0; equal && i < size; i++) {
+			xmlrpc_value *key, *x, *y = 0;
+			const char *name = 0;
+			xmlrpc_struct_read_member(&rpc_env, a, i, &key, &x);
+			xmlrpc_read_string(&rpc_env, key, &name);
+			die_if_fault_occurred(&rpc_env);
+			xmlrpc_struct_find_value(&rpc_env, b, name, &y);
+			die_if_fault_occurred(&rpc_env);
+			equal = y && xmlrpc_value_equal(x, y);
+			if (y)
+				xmlrpc_DECREF(y);
+			xmlrpc_DECREF(key);
+			xmlrpc_DECREF(x);
+			free((void *)name);
+		}
+		break;
+	}
+	default:
+		break;
+	}
+	die_if_fault_occurred(&rpc_env);
+
+	return equal;
+}
+
+/**
+ * Build a struct with the members of @p settings which differ from
+ * @p shared.
+ *
+ * @param[in] shared settings shared by the endpoints of a batch
+ * @param[in] settings settings of one endpoint
+ * @return XML-RPC struct
+ */
+static xmlrpc_value *diff_settings(xmlrpc_value *shared, xmlrpc_value *settings)
+{
+	xmlrpc_value *diff = xmlrpc_struct_new(&rpc_env);
+	int size = xmlrpc_struct_size(&rpc_env, settings);
+
+	die_if_fault_occurred(&rpc_env);
+	for (int i = 0; i < size; i++) {
+		xmlrpc_value *key, *value, *shared_value = 0;
+		const char *name = 0;
+
+		xmlrpc_struct_read_member(&rpc_env, settings, i, &key, &value);
+		xmlrpc_read_string(&rpc_env, key, &name);
+		die_if_fault_occurred(&rpc_env);
+		xmlrpc_struct_find_value(&rpc_env, shared, name, &shared_value);
+		die_if_fault_occurred(&rpc_env);
+
+		if (!shared_value || !xmlrpc_value_equal(shared_value, value))
+			xmlrpc_struct_set_value(&rpc_env, diff, name, value);
+		die_if_fault_occurred(&rpc_env);
+
+		if (shared_value)
+			xmlrpc_DECREF(shared_value);
+		xmlrpc_DECREF(key);
+		xmlrpc_DECREF(value);
+		free((void *)name);
+	}
+
+	return diff;
+}
+
+/**
+ * Add endpoint @p e of a batch of flows to one daemon with method add_flows.
+ *
+ * The settings of the first flow are sent once, every flow only sends the
+ * settings which differ from them.
+ *
+ * @param[in,out] rpc_client to connect controller to daemon
+ * @param[in] daemon daemon of all endpoints of the batch
+ * @param[in] e flow endpoint (SOURCE or DESTINATION)
+ * @param[in] ids flow ids of the batch
+ * @param[in] num_ids number of flows in the batch
+ * @param[in,out] listen_data_ports data ports of the destinations, indexed
+ * by flow id. Set for destinations, used for sources
+ */
+static void add_flows(xmlrpc_client *rpc_client, struct daemon *daemon,
+		      enum endpoint_t e, const int *ids, int num_ids,
+		      int *listen_data_ports)
+{
+	xmlrpc_value *resultP = 0, *shared, *flows;
+	struct timespec begin;
+
+	DEBUG_MSG(LOG_WARNING, "prepare %d flow %s on %s", num_ids,
+		  e ? "destinations" : "sources", daemon->url);
+
+	shared = build_endpoint_settings(ids[0], e, listen_data_ports[ids[0]]);
+	flows = xmlrpc_array_new(&rpc_env);
+	for (int i = 0; i < num_ids; i++) {
+		xmlrpc_value *settings, *diff;
+
+		settings = build_endpoint_settings(ids[i], e,
+						   listen_data_ports[ids[i]]);
+		diff = diff_settings(shared, settings);
+		xmlrpc_array_append_item(&rpc_env, flows, diff);
+		die_if_fault_occurred(&rpc_env);
+		xmlrpc_DECREF(settings);
+		xmlrpc_DECREF(diff);
+	}
+
+	gettime(&begin);
+	xmlrpc_client_call2f(&rpc_env, rpc_client, daemon->url, "add_flows",
+			     &resultP, "(SA)", shared, flows);
+	die_if_fault_occurred(&rpc_env);
+	sample_stats_add(&ctl_stats.prepare_batch, time_diff_now(&begin));
+
+	xmlrpc_DECREF(shared);
+	xmlrpc_DECREF(flows);
+
+	if (xmlrpc_array_size(&rpc_env, resultP) != num_ids)
+		critx("node %s returned malformed reply to add_flows",
+		      daemon->url);
+	die_if_fault_occurred(&rpc_env);
+
+	for (int i = 0; i < num_ids; i++) {
+		const int id = ids[i];
+		xmlrpc_value *item, *failure = 0;
+
+		xmlrpc_array_read_item(&rpc_env, resultP, i, &item);
+		die_if_fault_occurred(&rpc_env);
+
+		xmlrpc_struct_find_value(&rpc_env, item, "error", &failure);
+		die_if_fault_occurred(&rpc_env);
+		if (failure) {
+			const char *reason = 0;
+			xmlrpc_read_string(&rpc_env, failure, &reason);
+			die_if_fault_occurred(&rpc_env);
+			critx("could not prepare flow %d %s on %s: %s", id,
+			      e ? "destination" : "source", daemon->url,
+			      reason);
+		}
+
+		if (e == DESTINATION)
+			xmlrpc_parse_value(&rpc_env, item, "{s:i,s:i,s:i,s:i,*}",
+				"flow_id", &cflow[id].endpoint_id[DESTINATION],
+				"listen_data_port", &listen_data_ports[id],
+				"real_listen_send_buffer_size", &cflow[id].endpoint[DESTINATION].send_buffer_size_real,
+				"real_listen_read_buffer_size", &cflow[id].endpoint[DESTINATION].receive_buffer_size_real);
+		else
+			xmlrpc_parse_value(&rpc_env, item, "{s:i,s:i,s:i,*}",
+				"flow_id", &cflow[id].endpoint_id[SOURCE],
+				"real_send_buffer_size", &cflow[id].endpoint[SOURCE].send_buffer_size_real,
+				"real_read_buffer_size", &cflow[id].endpoint[SOURCE].receive_buffer_size_real);
+		die_if_fault_occurred(&rpc_env);
+		xmlrpc_DECREF(item);
+	}
+
+	xmlrpc_DECREF(resultP);
+}
+
+/**
+ * Prepare all flows in batches of at most ADD_FLOWS_BATCH_SIZE endpoints per
+ * daemon with method add_flows.
+ *
+ * Like prepare_flow, all destinations are added before the sources, as the
+ * sources need the data ports of their destination.
+ *
+ * @param[in,out] rpc_client to connect controller to daemon
+ */
+static void prepare_flows_batched(xmlrpc_client *rpc_client)
+{
+	static int listen_data_ports[MAX_FLOWS_CONTROLLER];
+	int ids[ADD_FLOWS_BATCH_SIZE];
+
+	for (unsigned short id = 0; id < copt.num_flows; id++)
+		foreach(int *i, SOURCE, DESTINATION)
+			if (cflow[id].trace_file[*i] && !sigint_caught)
+				upload_trace(id, *i, rpc_client);
+
+	foreach(int *e, DESTINATION, SOURCE) {
+		const struct list_node *node = fg_list_front(&unique_daemons);
+		while (node) {
+			struct daemon *daemon = node->data;
+			node = node->next;
+
+			int num_ids = 0;
+			for (unsigned short id = 0; id < copt.num_flows; id++) {
+				if (cflow[id].endpoint[*e].daemon != daemon)
+					continue;
+				ids[num_ids++] = id;
+				if (num_ids == ADD_FLOWS_BATCH_SIZE) {
+					if (sigint_caught)
+						return;
+					add_flows(rpc_client, daemon, *e, ids,
+						  num_ids, listen_data_ports);
+					num_ids = 0;
+				}
+			}
+			if (sigint_caught)
+				return;
+			if (num_ids)
+				add_flows(rpc_client, daemon, *e, ids, num_ids,
+					  listen_data_ports);
+		}
+	}
+}
+
+/**
+ * Check if all daemons support method add_flows.
+ */
+static bool daemons_support_add_flows(void)
+{
+	const struct list_node *node = fg_list_front(&unique_daemons);
+
+	for (; node; node = node->next) {
+		const struct daemon *daemon = node->data;
+		if (daemon->api_version < ADD_FLOWS_API_VERSION)
+			return false;
+	}
+
+	return true;
+}
+
 /**
  * Prepare test connection for all flows in a test
  *
@@ -1218,12 +2150,28 @@ static void prepare_flow(int id, xmlrpc_client *rpc_client)
  */
 static void prepare_all_flows(xmlrpc_client *rpc_client)
 {
-	/* prepare flows */
+	struct timespec begin, flow_begin, now;
+
+	gettime(&begin);
+
+	if (daemons_support_add_flows()) {
+		prepare_flows_batched(rpc_client);
+		ctl_stats.prepare_time = time_diff_now(&begin);
+		return;
+	}
+
+	/* prepare flows one by one for daemons of older versions */
 	for (unsigned short id = 0; id < copt.num_flows; id++) {
 		if (sigint_caught)
 			return;
+		gettime(&flow_begin);
 		prepare_flow(id, rpc_client);
+		gettime(&now);
+		sample_stats_add(&ctl_stats.prepare_flow,
+				 time_diff(&flow_begin, &now));
 	}
+
+	ctl_stats.prepare_time = time_diff(&begin, &now);
 }
 
 /**
@@ -1243,11 +2191,17 @@ static void start_all_flows(xmlrpc_client *rpc_client)
 
 	struct timespec lastreport_end;
 	struct timespec lastreport_begin;
-	struct timespec now;
+	struct timespec start;
 
 	gettime(&lastreport_end);
 	gettime(&lastreport_begin);
-	gettime(&now);
+	gettime(&start);
+	time_add(&start, START_LEAD_TIME);
+	test_start = start;
+	start_capture();
+
+	struct timespec start_begin;
+	gettime(&start_begin);
 
 	const struct list_node *node = fg_list_front(&unique_daemons);
 	while (node) {
@@ -1256,16 +2210,23 @@ static void start_all_flows(xmlrpc_client *rpc_client)
 		struct daemon *daemon = node->data;
 		node = node->next;
 
+		/* Translate the start time into the clock of the daemon */
+		struct timespec daemon_start = start;
+		time_add(&daemon_start, daemon->clock_offset);
+
 		DEBUG_MSG(LOG_ERR, "starting flow on server with UUID %s",daemon->uuid);
 		xmlrpc_client_call2f(&rpc_env, rpc_client,
 				     daemon->url,
-				     "start_flows", &resultP, "({s:i})",
-				     "start_timestamp", now.tv_sec + 2);
+				     "start_flows", &resultP, "({s:i,s:i})",
+				     "start_sec", (int)daemon_start.tv_sec,
+				     "start_nsec", (int)daemon_start.tv_nsec);
 		die_if_fault_occurred(&rpc_env);
 		if (resultP)
 			xmlrpc_DECREF(resultP);
 	}
 
+	ctl_stats.start_time = time_diff_now(&start_begin);
+
 	active_flows = copt.num_flows;
 
 	/* Reports are fetched from the daemons based on the
@@ -1299,17 +2260,22 @@ static void fetch_reports(xmlrpc_client *rpc_client)
 
 	xmlrpc_value * resultP = 0;
 	const struct list_node *node = fg_list_front(&unique_daemons);
+	const double cpu = control_stats_cpu_time();
 
 	while (node) {
 		struct daemon *daemon = node->data;
 		node = node->next;
 		int array_size, has_more;
 		xmlrpc_value *rv = 0;
+		struct timespec call_begin;
 
 has_more_reports:
 
+		gettime(&call_begin);
 		xmlrpc_client_call2f(&rpc_env, rpc_client, daemon->url,
 			"get_reports", &resultP, "()");
+		sample_stats_add(&ctl_stats.get_reports,
+				 time_diff_now(&call_begin));
 		if (rpc_env.fault_occurred) {
 			errx("XML-RPC fault: %s (%d)", rpc_env.fault_string,
 			      rpc_env.fault_code);
@@ -1359,6 +2325,8 @@ has_more_reports:
 				int tcpi_snd_mss;
 				int bytes_read_low, bytes_read_high;
 				int bytes_written_low, bytes_written_high;
+				int bytes_corrupted_low, bytes_corrupted_high;
+				int wire_acked_low, wire_acked_high;
 
 				xmlrpc_decompose_value(&rpc_env, rv,
 					"("
@@ -1366,6 +2334,14 @@ has_more_reports:
 					"{s:i,s:i,s:i,s:i,*}" /* bytes */
 					"{s:i,s:i,s:i,s:i,*}" /* blocks */
 					"{s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,s:d,*}" /* RTT, IAT, Delay */
+					"{s:d,s:d,s:d,*}" /* send drift */
+					"{s:i,s:i,s:i,s:i,*}" /* churn connections */
+					"{s:d,s:d,s:d,s:d,s:d,s:d,*}" /* flow completion time */
+					"{s:d,s:d,*}" /* completion time of finite flow */
+					"{s:d,*}" /* start skew */
+					"{s:i,s:i,s:i,*}" /* corrupted payload of -E */
+					"{s:i,s:i,s:i,*}" /* capture of -M */
+					"{s:i,s:i,s:i,s:d,s:d,s:d,s:i,s:i,s:i,*}" /* wire analysis of -M */
 					"{s:i,s:i,*}" /* MTU */
 					"{s:i,s:i,s:i,s:i,s:i,*}" /* TCP info */
 					"{s:i,s:i,s:i,s:i,s:i,*}" /* ...      */
@@ -1401,6 +2377,45 @@ has_more_reports:
 					"delay_max", &report.delay_max,
 					"delay_sum", &report.delay_sum,
 
+					"drift_min", &report.drift_min,
+					"drift_max", &report.drift_max,
+					"drift_sum", &report.drift_sum,
+
+					"conns_opened", &report.conns_opened,
+					"conns_completed", &report.conns_completed,
+					"conns_failed", &report.conns_failed,
+					"conns_dropped", &report.conns_dropped,
+
+					"fct_min", &report.fct_min,
+					"fct_max", &report.fct_max,
+					"fct_sum", &report.fct_sum,
+					"fct_p50", &report.fct_p50,
+					"fct_p90", &report.fct_p90,
+					"fct_p99", &report.fct_p99,
+
+					"write_completion_time", &report.completion_time[WRITE],
+					"read_completion_time", &report.completion_time[READ],
+
+					"start_skew", &report.start_skew,
+
+					"blocks_corrupted", &report.blocks_corrupted,
+					"bytes_corrupted_high", &bytes_corrupted_high,
+					"bytes_corrupted_low", &bytes_corrupted_low,
+
+					"pcap_packets", &report.pcap_packets,
+					"pcap_drops", &report.pcap_drops,
+					"pcap_ring_drops", &report.pcap_ring_drops,
+
+					"wire_retransmits", &report.wire_retransmits,
+					"wire_reordered", &report.wire_reordered,
+					"wire_rtt_samples", &report.wire_rtt_samples,
+					"wire_rtt_min", &report.wire_rtt_min,
+					"wire_rtt_max", &report.wire_rtt_max,
+					"wire_rtt_sum", &report.wire_rtt_sum,
+					"wire_acked_high", &wire_acked_high,
+					"wire_acked_low", &wire_acked_low,
+					"wire_flight", &report.wire_flight,
+
 					"pmtu", &report.pmtu,
 					"imtu", &report.imtu,
 
@@ -1428,9 +2443,13 @@ has_more_reports:
 #ifdef HAVE_UNSIGNED_LONG_LONG_INT
 				report.bytes_read = ((long long)bytes_read_high << 32) + (uint32_t)bytes_read_low;
 				report.bytes_written = ((long long)bytes_written_high << 32) + (uint32_t)bytes_written_low;
+				report.bytes_corrupted = ((long long)bytes_corrupted_high << 32) + (uint32_t)bytes_corrupted_low;
+				report.wire_acked = ((long long)wire_acked_high << 32) + (uint32_t)wire_acked_low;
 #else /* HAVE_UNSIGNED_LONG_LONG_INT */
 				report.bytes_read = (uint32_t)bytes_read_low;
 				report.bytes_written = (uint32_t)bytes_written_low;
+				report.bytes_corrupted = (uint32_t)bytes_corrupted_low;
+				report.wire_acked = (uint32_t)wire_acked_low;
 #endif /* HAVE_UNSIGNED_LONG_LONG_INT */
 
 				/* FIXME Kernel metrics (tcp_info). Other OS than
@@ -1462,11 +2481,15 @@ has_more_reports:
 				report_flow(&report);
 			}
 		}
+		ctl_stats.reports += array_size - 1;
 		xmlrpc_DECREF(resultP);
 
 		if (has_more)
 			goto has_more_reports;
 	}
+
+	output_flush();
+	ctl_stats.report_cpu += control_stats_cpu_time() - cpu;
 }
 
 /**
@@ -1505,8 +2528,16 @@ exit_outer_loop:
 	if (f->start_timestamp[*i].tv_sec == 0)
 		f->start_timestamp[*i] = report->begin;
 
+	/* Begin and end since the start of the test in the controller clock */
+	const double offset = f->endpoint[*i].daemon->clock_offset;
+	const double begin = time_diff(&test_start, &report->begin) - offset;
+	const double end = time_diff(&test_start, &report->end) - offset;
+
 	if (report->type == FINAL) {
 		DEBUG_MSG(LOG_DEBUG, "received final report for flow %d", id);
+		if (!copt.aggregate_only)
+			output_report(id, NULL, *i, begin, end, report);
+		capture_report(id, *i, begin, end, report);
 		/* Final report, keep it for later */
 		free(f->final_report[*i]);
 		f->final_report[*i] = malloc(sizeof(struct report));
@@ -1514,6 +2545,7 @@ exit_outer_loop:
 
 		if (!f->finished[*i]) {
 			f->finished[*i] = 1;
+			aggregate_finish(&f->aggregates[*i], *i);
 			if (f->finished[1 - *i]) {
 				active_flows--;
 				DEBUG_MSG(LOG_DEBUG, "remaining active flows: "
@@ -1523,6 +2555,22 @@ exit_outer_loop:
 		}
 		return;
 	}
+
+	capture_report(id, *i, begin, end, report);
+
+	/* Merge into the aggregates before the report is modified by printing.
+	 * Intervals are counted from the test start, a clock offset may put
+	 * the first report slightly before it */
+	if (fg_list_size(&f->aggregates[*i])) {
+		const long interval = floor(begin / copt.reporting_interval);
+		aggregate_report(&f->aggregates[*i], *i, MAX(interval, 0L),
+				 begin, end, report);
+	}
+
+	if (copt.aggregate_only)
+		return;
+
+	output_report(id, NULL, *i, begin, end, report);
 	print_interval_report(id, *i, report);
 }
 
@@ -1759,34 +2807,42 @@ static bool print_column(char **header1, char **header2, char **data,
 }
 
 /**
- * Print interval report @p report for endpoint @p e of flow @p flow_id.
+ * Print a line of the interval report.
  *
  * In addition, if the width of one intermediated interval report columns has
  * been changed, the interval column header will be printed again.
  *
- * @param[in] flow_id flow an interval report will be created for
+ * @param[in] id content of the ID column
+ * @param[in] flow_id flow the report belongs to, -1 for an aggregate
  * @param[in] e flow endpoint (SOURCE or DESTINATION)
+ * @param[in] diff_first_last begin of the report in seconds
+ * @param[in] diff_first_now end of the report in seconds
  * @param[in] report interval report to be printed
+ * @param[in] fairness fairness between the members of an aggregate, NULL for
+ * a flow
  */
-static void print_interval_report(unsigned short flow_id, enum endpoint_t e,
-				  struct report *report)
+static void print_report_line(const char *id, int flow_id, enum endpoint_t e,
+			      double diff_first_last, double diff_first_now,
+			      struct report *report,
+			      const struct fairness *fairness)
 {
 	/* Whether or not column width has been changed */
 	bool changed = false;
 	/* 1st header row, 2nd header row, and the actual measured data */
 	char *header1 = NULL, *header2 = NULL, *data = NULL;
 
-	/* Flow ID and endpoint (source or destination) */
-	if (asprintf(&header1, "%s", column_info[COL_FLOW_ID].header.name) == -1 ||
-	    asprintf(&header2, "%s", column_info[COL_FLOW_ID].header.unit) == -1 ||
-	    asprintf(&data, "%s%3d", e ? "D" : "S", flow_id) == -1)
+	/* Flow ID and endpoint (source or destination), left aligned */
+	struct column *id_column = &column_info[COL_FLOW_ID];
+	changed |= update_column_width(id_column,
+				       MAX(strlen(id),
+					   strlen(id_column->header.name)));
+	const int width = id_column->state.last_width;
+	if (asprintf(&header1, "%-*s", width, id_column->header.name) == -1 ||
+	    asprintf(&header2, "%-*s", width, id_column->header.unit) == -1 ||
+	    asprintf(&data, "%-*s", width, id) == -1)
 		critx("could not allocate memory for interval report");
 
-	/* Calculate time */
-	double diff_first_last = time_diff(&cflow[flow_id].start_timestamp[e],
-					   &report->begin);
-	double diff_first_now = time_diff(&cflow[flow_id].start_timestamp[e],
-					  &report->end);
+	/* Time */
 	changed |= print_column(&header1, &header2, &data, COL_BEGIN,
 				diff_first_last, 3);
 	changed |= print_column(&header1, &header2, &data, COL_END,
@@ -1853,6 +2909,88 @@ static void print_interval_report(unsigned short flow_id, enum endpoint_t e,
 	changed |= print_column(&header1, &header2, &data, COL_DLY_MAX,
 				report->delay_max * 1e3, 3);
 
+	/* Send time drift */
+	double drift_avg = 0.0;
+	if (report->request_blocks_written && report->drift_sum)
+		drift_avg = report->drift_sum /
+			    (double)(report->request_blocks_written);
+	else
+		report->drift_min = report->drift_max = drift_avg = INFINITY;
+	changed |= print_column(&header1, &header2, &data, COL_DRIFT_MIN,
+				report->drift_min * 1e3, 3);
+	changed |= print_column(&header1, &header2, &data, COL_DRIFT_AVG,
+				drift_avg * 1e3, 3);
+	changed |= print_column(&header1, &header2, &data, COL_DRIFT_MAX,
+				report->drift_max * 1e3, 3);
+
+	/* Connection churn */
+	double conn_rate = (double)report->conns_completed /
+			   (diff_first_now - diff_first_last);
+	changed |= print_column(&header1, &header2, &data, COL_CONN_RATE,
+				conn_rate, 2);
+	if (!report->conns_completed)
+		report->fct_p50 = report->fct_p90 = report->fct_p99 = INFINITY;
+	changed |= print_column(&header1, &header2, &data, COL_FCT_P50,
+				report->fct_p50 * 1e3, 3);
+	changed |= print_column(&header1, &header2, &data, COL_FCT_P90,
+				report->fct_p90 * 1e3, 3);
+	changed |= print_column(&header1, &header2, &data, COL_FCT_P99,
+				report->fct_p99 * 1e3, 3);
+
+	/* Payload verification of option -E */
+	changed |= print_column(&header1, &header2, &data, COL_CORRUPT_BLOCKS,
+				report->blocks_corrupted, 0);
+	changed |= print_column(&header1, &header2, &data, COL_CORRUPT_BYTES,
+				report->bytes_corrupted, 0);
+
+	/* Packet capture of option -M */
+	changed |= print_column(&header1, &header2, &data, COL_PCAP_PACKETS,
+				report->pcap_packets, 0);
+	changed |= print_column(&header1, &header2, &data, COL_PCAP_DROPS,
+				report->pcap_drops, 0);
+	changed |= print_column(&header1, &header2, &data, COL_PCAP_RING_DROPS,
+				report->pcap_ring_drops, 0);
+
+	/* Segments of the capture of option -M */
+	double wire_rtt_avg = INFINITY;
+	if (report->wire_rtt_samples)
+		wire_rtt_avg = report->wire_rtt_sum /
+			       (double)report->wire_rtt_samples;
+	changed |= print_column(&header1, &header2, &data, COL_WIRE_RETR,
+				report->wire_retransmits, 0);
+	changed |= print_column(&header1, &header2, &data, COL_WIRE_REOR,
+				report->wire_reordered, 0);
+	changed |= print_column(&header1, &header2, &data, COL_WIRE_RTT,
+				wire_rtt_avg * 1e3, 3);
+	changed |= print_column(&header1, &header2, &data, COL_WIRE_FLIGHT,
+				report->wire_flight, 0);
+
+	/* Fairness, only defined for competing members of an aggregate */
+	if (fairness && !isnan(fairness->jain)) {
+		changed |= print_column(&header1, &header2, &data,
+					COL_FAIR_JAIN, fairness->jain, 4);
+		if (isinf(fairness->ratio))
+			changed |= print_column_str(&header1, &header2, &data,
+						    COL_FAIR_RATIO, "inf");
+		else
+			changed |= print_column(&header1, &header2, &data,
+						COL_FAIR_RATIO,
+						fairness->ratio, 2);
+	} else {
+		changed |= print_column_str(&header1, &header2, &data,
+					    COL_FAIR_JAIN, "-");
+		changed |= print_column_str(&header1, &header2, &data,
+					    COL_FAIR_RATIO, "-");
+	}
+
+	/* Kernel metrics and internal state exist per connection only */
+	if (flow_id < 0) {
+		for (int col = COL_TCP_CWND; col < NUM_COL; col++)
+			changed |= print_column_str(&header1, &header2, &data,
+						    col, "-");
+		goto out;
+	}
+
 	/* TCP info struct */
 	changed |= print_column(&header1, &header2, &data, COL_TCP_CWND,
 				report->tcp_info.tcpi_snd_cwnd, 0);
@@ -1938,8 +3076,11 @@ static void print_interval_report(unsigned short flow_id, enum endpoint_t e,
 	changed |= print_column_str(&header1, &header2, &data, COL_STATUS,
 				    fg_state);
 	free(fg_state);
+#else /* DEBUG */
+	UNUSED_ARGUMENT(e);
 #endif /* DEBUG */
 
+out:
 	/* Print interval header again if either the column width has been
 	 * changed or MAX_REPORTS_BEFORE_HEADER reports have been emited
 	 * since last time header was printed */
@@ -1954,6 +3095,88 @@ static void print_interval_report(unsigned short flow_id, enum endpoint_t e,
 	free_all(header1, header2, data);
 }
 
+/**
+ * Print interval report @p report for endpoint @p e of flow @p flow_id.
+ *
+ * @param[in] flow_id flow an interval report will be created for
+ * @param[in] e flow endpoint (SOURCE or DESTINATION)
+ * @param[in] report interval report to be printed
+ */
+static void print_interval_report(unsigned short flow_id, enum endpoint_t e,
+				  struct report *report)
+{
+	char id[8];
+	snprintf(id, sizeof(id), "%s%3d", e ? "D" : "S", flow_id);
+
+	print_report_line(id, flow_id, e,
+			  time_diff(&cflow[flow_id].start_timestamp[e],
+				    &report->begin),
+			  time_diff(&cflow[flow_id].start_timestamp[e],
+				    &report->end),
+			  report, NULL);
+}
+
+/**
+ * Print the merged interval report @p sum of the endpoints of type @p e of
+ * aggregation group @p a.
+ *
+ * @param[in] a aggregation group
+ * @param[in] e flow endpoint (SOURCE or DESTINATION)
+ * @param[in] begin begin of the interval in seconds since the test start
+ * @param[in] end end of the interval in seconds since the test start
+ * @param[in] sum merged interval report to be printed
+ */
+static void print_aggregate_report(const struct aggregate *a, enum endpoint_t e,
+				   double begin, double end,
+				   struct report *sum)
+{
+	output_report(-1, a->name, e, begin, end, sum);
+
+	char *id = NULL;
+	if (asprintf(&id, "%s %s", e ? "D" : "S", a->name) == -1)
+		critx("could not allocate memory for interval report");
+
+	print_report_line(id, -1, e, begin, end, sum, &a->fairness[e]);
+	free(id);
+}
+
+/**
+ * Print the fairness and convergence between the members of aggregation
+ * group @p a over the whole test.
+ *
+ * @param[in] a aggregation group
+ */
+static void print_fairness_summary(const struct aggregate *a)
+{
+	foreach(int *i, SOURCE, DESTINATION) {
+		const struct fairness *f = &a->fairness[*i];
+		char *buf = NULL;
+
+		/* Never two members sending at the same time */
+		if (!f->intervals)
+			continue;
+
+		if (asprintf(&buf, "# %s %s: Jain's fairness index = %.4f/%.4f "
+			     "(avg/min), throughput ratio = %.2f (max/min, "
+			     "worst), ", *i ? "D" : "S", a->name,
+			     f->jain_sum / f->intervals, f->jain_min,
+			     f->ratio_max) == -1)
+			critx("could not allocate memory for fairness summary");
+
+		if (isnan(f->converged_since))
+			asprintf_append(&buf, "not converged (index >= %.2f)",
+					AGGREGATE_CONVERGED);
+		else
+			asprintf_append(&buf, "converged after %.3f [s] "
+					"(index >= %.2f)",
+					f->converged_since - f->competing_since,
+					AGGREGATE_CONVERGED);
+
+		print_output("\n%s\n", buf);
+		free(buf);
+	}
+}
+
 /**
  * Maps common MTU sizes to network known technologies.
  *
@@ -2053,8 +3276,15 @@ static void print_final_report(unsigned short flow_id, enum endpoint_t e)
 				report->imtu, guess_topology(report->imtu));
 
 	/* Congestion control algorithms */
-	if (settings->cc_alg[0])
-		asprintf_append(&buf, "CC = %s, ", settings->cc_alg);
+	if (settings->profile->cc_alg[0])
+		asprintf_append(&buf, "CC = %s, ", settings->profile->cc_alg);
+
+	/* Clock offset of the daemon and skew of the scheduled start */
+	asprintf_append(&buf, "clock offset = %.3f/%.3f [ms] (est/err), "
+			"start skew = %.3f [ms], ",
+			endpoint->daemon->clock_offset * 1e3,
+			endpoint->daemon->clock_rtt / 2.0 * 1e3,
+			report->start_skew * 1e3);
 
 	/* Calculate time */
 	double report_time = time_diff(&report->begin, &report->end);
@@ -2141,6 +3371,85 @@ static void print_final_report(unsigned short flow_id, enum endpoint_t e)
 				report->delay_max * 1e3);
 	}
 
+	/* Send time drift of replayed trace */
+	if (cflow[flow_id].trace_file[e] && report->request_blocks_written) {
+		double drift_avg = report->drift_sum /
+				   (double)(report->request_blocks_written);
+		asprintf_append(&buf, ", send drift = %.3f/%.3f/%.3f [ms] "
+				"(min/avg/max)", report->drift_min * 1e3,
+				drift_avg * 1e3, report->drift_max * 1e3);
+	}
+
+	/* Trace replay */
+	if (cflow[flow_id].trace_file[e])
+		asprintf_append(&buf, ", trace = %s", cflow[flow_id].trace_file[e]);
+
+	/* Flow completion time of a flow of finite size */
+	const struct flow_settings *peer =
+		&cflow[flow_id].settings[e == SOURCE ? DESTINATION : SOURCE];
+	if (settings->flow_size[WRITE] || settings->flow_blocks[WRITE]) {
+		if (report->completion_time[WRITE] > 0)
+			asprintf_append(&buf, ", FCT = %.3f [ms] (out)",
+					report->completion_time[WRITE] * 1e3);
+		else
+			asprintf_append(&buf, ", FCT = incomplete (out)");
+	}
+	if (peer->flow_size[WRITE] || peer->flow_blocks[WRITE]) {
+		if (report->completion_time[READ] > 0)
+			asprintf_append(&buf, ", FCT = %.3f [ms] (in)",
+					report->completion_time[READ] * 1e3);
+		else
+			asprintf_append(&buf, ", FCT = incomplete (in)");
+	}
+
+	/* Connection churn */
+	if (cflow[flow_id].churn) {
+		double conn_rate = report->conns_completed /
+				   MAX(real_read, real_write);
+		if (isnan(conn_rate))
+			conn_rate = 0.0;
+		asprintf_append(&buf, ", connections = %u/%u/%u [#] "
+				"(completed/failed/dropped), conns/s = %.2f [#]",
+				report->conns_completed, report->conns_failed,
+				report->conns_dropped, conn_rate);
+	}
+	if (cflow[flow_id].churn && report->conns_completed) {
+		double fct_avg = report->fct_sum /
+				 (double)(report->conns_completed);
+		asprintf_append(&buf, ", FCT = %.3f/%.3f/%.3f [ms] "
+				"(min/avg/max), FCT = %.3f/%.3f/%.3f [ms] "
+				"(p50/p90/p99)", report->fct_min * 1e3,
+				fct_avg * 1e3, report->fct_max * 1e3,
+				report->fct_p50 * 1e3, report->fct_p90 * 1e3,
+				report->fct_p99 * 1e3);
+	}
+
+	/* Payload verification of option -E */
+	if (cflow[flow_id].byte_counting)
+		asprintf_append(&buf, ", corrupted = %u [#] (blocks), "
+				"mismatched = %llu [B]", report->blocks_corrupted,
+				(unsigned long long)report->bytes_corrupted);
+
+	/* Packet capture of option -M */
+	if (settings->traffic_dump)
+		asprintf_append(&buf, ", dumped = %u/%u/%u [#] (packets/"
+				"dropped/dropped on interface)",
+				report->pcap_packets, report->pcap_drops,
+				report->pcap_ring_drops);
+	if (settings->traffic_dump) {
+		asprintf_append(&buf, ", wire = %u/%u [#] (retransmitted/"
+				"reordered), acked = %llu [B]",
+				report->wire_retransmits, report->wire_reordered,
+				(unsigned long long)report->wire_acked);
+		if (report->wire_rtt_samples)
+			asprintf_append(&buf, ", wire RTT = %.3f/%.3f/%.3f "
+					"[ms] (min/avg/max)",
+					report->wire_rtt_min * 1e3,
+					report->wire_rtt_sum * 1e3 /
+					report->wire_rtt_samples,
+					report->wire_rtt_max * 1e3);
+	}
+
 	/* Fixed sending rate per second was set */
 	if (settings->write_rate_str)
 		asprintf_append(&buf, ", rate = %s", settings->write_rate_str);
@@ -2170,18 +3479,101 @@ out:
 	free(buf);
 }
 
+/** Ascending order of two doubles for qsort(). */
+static int compare_double(const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Print percentiles of the flow completion time of all complete flows of
+ * finite size, grouped by the order of magnitude of their size.
+ */
+static void print_fct_summary(void)
+{
+	static const char *const units[] = {"B", "kB", "MB", "GB"};
+	/* at most one completion time per flow endpoint */
+	double *fct = malloc(2 * copt.num_flows * sizeof(double));
+	unsigned num;
+
+	if (!fct)
+		critx("could not allocate memory for FCT summary");
+
+	for (int bucket = 0; bucket < NUM_FCT_BUCKETS; bucket++) {
+		num = 0;
+		for (unsigned id = 0; id < copt.num_flows; id++) {
+			foreach(int *i, SOURCE, DESTINATION) {
+				const struct report *report =
+					cflow[id].final_report[*i];
+
+				if (!report || report->completion_time[WRITE] <= 0)
+					continue;
+
+				int size_bucket = report->bytes_written ?
+					(int)log10((double)report->bytes_written) : 0;
+				if (MIN(size_bucket, NUM_FCT_BUCKETS - 1) != bucket)
+					continue;
+
+				fct[num++] = report->completion_time[WRITE];
+			}
+		}
+		if (!num)
+			continue;
+
+		qsort(fct, num, sizeof(double), compare_double);
+
+		/* nearest rank */
+		double p50 = fct[(unsigned)ceil(0.50 * num) - 1];
+		double p90 = fct[(unsigned)ceil(0.90 * num) - 1];
+		double p99 = fct[(unsigned)ceil(0.99 * num) - 1];
+
+		char *buf = NULL;
+		if (asprintf(&buf, "# FCT of flows with %.0f %s", pow(10, bucket % 3),
+			     units[bucket / 3]) == -1)
+			critx("could not allocate memory for FCT summary");
+		if (bucket < NUM_FCT_BUCKETS - 1)
+			asprintf_append(&buf, " to %.0f %s",
+					pow(10, (bucket + 1) % 3),
+					units[(bucket + 1) / 3]);
+		else
+			asprintf_append(&buf, " and more");
+		asprintf_append(&buf, ": %u flows, FCT = %.3f/%.3f/%.3f [ms] "
+				"(p50/p90/p99)", num, p50 * 1e3, p90 * 1e3,
+				p99 * 1e3);
+		print_output("%s\n", buf);
+		free(buf);
+	}
+
+	free(fct);
+}
+
 /**
  * Print final report (i.e. summary line) for all configured flows.
  */
 static void print_all_final_reports(void)
 {
+	bool finite = false;
+
 	for (unsigned id = 0; id < copt.num_flows; id++) {
 		print_output("\n");
 		foreach(int *i, SOURCE, DESTINATION) {
 			print_final_report(id, *i);
-			free(cflow[id].final_report[*i]);
+			if (cflow[id].settings[*i].flow_size[WRITE] ||
+			    cflow[id].settings[*i].flow_blocks[WRITE])
+				finite = true;
 		}
 	}
+
+	if (finite) {
+		print_output("\n");
+		print_fct_summary();
+	}
+
+	for (unsigned id = 0; id < copt.num_flows; id++)
+		foreach(int *i, SOURCE, DESTINATION)
+			free(cflow[id].final_report[*i]);
 }
 
 /**
@@ -2241,10 +3633,55 @@ static struct rpc_info * set_rpc_info(const char* server_url,
 	return add_flow_endpoint_by_url(server_url,server_name, server_port);
 }
 
+/**
+ * Return the empirical CDF stored in file @p filename.
+ *
+ * Flow selectors apply the same file to many flows, so each file is loaded
+ * only once and kept in the list of CDF files until free_cdf_files().
+ *
+ * @param[in] filename file to load the CDF from
+ * @return CDF of the file, NULL if it cannot be loaded
+ */
+static struct empirical_cdf *get_cdf_file(const char *filename)
+{
+	const struct list_node *node = fg_list_front(&cdf_files);
+	while (node) {
+		struct cdf_file *file = node->data;
+		node = node->next;
+
+		if (!strcmp(file->filename, filename))
+			return file->cdf;
+	}
+
+	struct empirical_cdf *cdf = cdf_load(filename);
+	if (!cdf)
+		return NULL;
+
+	struct cdf_file *file = malloc(sizeof(struct cdf_file));
+	if (!file || !(file->filename = strdup(filename)))
+		critx("could not allocate memory for empirical distribution");
+	file->cdf = cdf;
+	fg_list_push_back(&cdf_files, file);
+
+	return cdf;
+}
+
+/** Free all empirical CDFs loaded by get_cdf_file(). */
+static void free_cdf_files(void)
+{
+	struct cdf_file *file;
+
+	while ((file = fg_list_pop_front(&cdf_files))) {
+		cdf_free(file->cdf);
+		free_all(file->filename, file);
+	}
+}
+
 /**
  * Parse option for stochastic traffic generation (option -G).
  *
  * @param[in] params parameter string in the form 'x=(q|p|g):(C|U|E|N|L|P|W):#1:[#2]'
+ *                   or 'x=(q|p|g):F:file'
  * @param[in] flow_id ID of flow to apply option to
  * @param[in] endpoint_id endpoint to apply option to
  */
@@ -2254,12 +3691,30 @@ static void parse_trafgen_option(const char *params, int flow_id, int endpoint_i
 	double param1 = 0, param2 = 0, unused;
 	char typechar, distchar;
 	enum distribution_t distr = CONSTANT;
+	struct empirical_cdf *cdf = NULL;
+	struct flow_profile *profile;
+	struct trafgen_options *opt = NULL;
 
 	rc = sscanf(params, "%c:%c:%lf:%lf:%lf", &typechar, &distchar,
 		    &param1, &param2, &unused);
-	if (rc != 3 && rc != 4)
+	if (rc >= 2 && distchar == 'F') {
+		/* the file name follows the distribution and its separator */
+		int prefix = 0;
+		sscanf(params, "%*c:%*c:%n", &prefix);
+		if (!prefix || !params[prefix])
+			PARSE_ERR("flow %i: option -G: empirical distribution "
+				  "needs a CDF file", flow_id);
+		cdf = get_cdf_file(params + prefix);
+		if (!cdf)
+			PARSE_ERR("flow %i: option -G: failed to load CDF "
+				  "file %s", flow_id, params + prefix);
+		/* used for the sanity check of the block size below */
+		param1 = cdf->value[0];
+		param2 = cdf->value[cdf->num_points - 1];
+	} else if (rc != 3 && rc != 4) {
 		PARSE_ERR("flow %i: option -G: malformed traffic generation "
 			  "parameters", flow_id);
+	}
 
 	switch (distchar) {
 	case 'N':
@@ -2304,41 +3759,136 @@ static void parse_trafgen_option(const char *params, int flow_id, int endpoint_i
 			PARSE_ERR("flow %i: option -G: constant distribution "
 				  "needs one positive parameters", flow_id);
 		break;
+	case 'F':
+		distr = EMPIRICAL;
+		if (param1 < 0)
+			PARSE_ERR("flow %i: option -G: empirical distribution "
+				  "needs non-negative values", flow_id);
+		break;
 	default:
 		PARSE_ERR("flow %i: option -G: syntax error: %c is not a "
 			  "distribution", flow_id, distchar);
 		break;
 	}
 
+	profile = mutable_profile(&cflow[flow_id].settings[endpoint_id]);
 	switch (typechar) {
 	case 'p':
-		cflow[flow_id].settings[endpoint_id].response_trafgen_options.distribution = distr;
-		cflow[flow_id].settings[endpoint_id].response_trafgen_options.param_one = param1;
-		cflow[flow_id].settings[endpoint_id].response_trafgen_options.param_two = param2;
+		opt = &profile->response_trafgen_options;
 		break;
 	case 'q':
-		cflow[flow_id].settings[endpoint_id].request_trafgen_options.distribution = distr;
-		cflow[flow_id].settings[endpoint_id].request_trafgen_options.param_one = param1;
-		cflow[flow_id].settings[endpoint_id].request_trafgen_options.param_two = param2;
+		opt = &profile->request_trafgen_options;
 		break;
 	case 'g':
-		cflow[flow_id].settings[endpoint_id].interpacket_gap_trafgen_options.distribution = distr;
-		cflow[flow_id].settings[endpoint_id].interpacket_gap_trafgen_options.param_one = param1;
-		cflow[flow_id].settings[endpoint_id].interpacket_gap_trafgen_options.param_two = param2;
+		opt = &profile->interpacket_gap_trafgen_options;
 		break;
 	}
+	if (opt) {
+		/* each profile owns its CDFs */
+		cdf_free(opt->cdf);
+		opt->distribution = distr;
+		opt->param_one = param1;
+		opt->param_two = param2;
+		opt->cdf = cdf_dup(cdf);
+		if (cdf && !opt->cdf)
+			critx("could not allocate memory for empirical "
+			      "distribution");
+	}
 
 	/* sanity check for max block size */
 	foreach(int *i, SOURCE, DESTINATION) {
 		if (distr == CONSTANT &&
 		    cflow[flow_id].settings[*i].maximum_block_size < param1)
 			cflow[flow_id].settings[*i].maximum_block_size = param1;
-		if (distr == UNIFORM &&
+		if ((distr == UNIFORM || distr == EMPIRICAL) &&
 		    cflow[flow_id].settings[*i].maximum_block_size < param2)
 			cflow[flow_id].settings[*i].maximum_block_size = param2;
 	}
 }
 
+/**
+ * Parse option for trace replay (option --trace).
+ *
+ * @param[in] filename trace file to replay
+ * @param[in] flow_id ID of flow to apply option to
+ * @param[in] endpoint_id endpoint to apply option to
+ */
+static void parse_trace_option(const char *filename, int flow_id,
+			       int endpoint_id)
+{
+	/* the same trace is often given for several flows, scan it once */
+	static char *last_file = NULL;
+	static struct trace_info last_info;
+
+	if (!*filename)
+		PARSE_ERR("in flow %i: option --trace requires a file for each "
+			  "given endpoint", flow_id);
+
+	if (!last_file || strcmp(last_file, filename)) {
+		if (trace_scan(filename, &last_info) == -1)
+			PARSE_ERR("in flow %i: option --trace: invalid trace "
+				  "file", flow_id);
+		last_file = strdup(filename);
+		if (!last_file)
+			critx("could not allocate memory for trace file name");
+	}
+
+	cflow[flow_id].trace_file[endpoint_id] = last_file;
+
+	/* both endpoints have to cope with the largest block of the trace */
+	foreach(int *i, SOURCE, DESTINATION)
+		ASSIGN_MAX(cflow[flow_id].settings[*i].maximum_block_size,
+			   (signed)last_info.max_block_size);
+
+	SHOW_COLUMNS(COL_DRIFT_MIN, COL_DRIFT_AVG, COL_DRIFT_MAX);
+}
+
+/**
+ * Parse argument for option -Z, which specifies the number of bytes after
+ * which the endpoint stops sending.
+ *
+ * @param[in] arg argument for option -Z in form of #(z|k|M|G)
+ * @param[in] flow_id ID of flow to apply option to
+ * @param[in] endpoint_id endpoint to apply option to
+ */
+static void parse_size_option(const char *arg, int flow_id, int endpoint_id)
+{
+	char unit = 0, garbage = 0;
+	double optdouble = 0.0;
+	int rc = sscanf(arg, "%lf%c%c", &optdouble, &unit, &garbage);
+	if (rc < 1 || rc > 2)
+		PARSE_ERR("flow %i: option -Z: malformed size", flow_id);
+
+	switch (unit) {
+	case 0:
+	case 'z':
+		break;
+
+	case 'k':
+		optdouble *= 1<<10;
+		break;
+
+	case 'M':
+		optdouble *= 1<<20;
+		break;
+
+	case 'G':
+		optdouble *= 1<<30;
+		break;
+
+	default:
+		PARSE_ERR("flow %i: option -Z: illegal unit specifier", flow_id);
+		break;
+	}
+
+	/* the last block is padded to the minimal block size */
+	if (optdouble < MIN_BLOCK_SIZE)
+		PARSE_ERR("flow %i: option -Z: size needs to be at least %d "
+			  "bytes", flow_id, MIN_BLOCK_SIZE);
+
+	cflow[flow_id].settings[endpoint_id].flow_size[WRITE] = optdouble;
+}
+
 /**
  * Parse argument for option -R, which specifies the rate the endpoint will send.
  *
@@ -2484,15 +4034,20 @@ static void parse_flow_option_endpoint(int code, const char* arg,
 	double optdouble = 0.0;
 
 	struct flow_settings* settings = &cflow[flow_id].settings[endpoint_id];
+	struct flow_profile *profile;
 
 	switch (code) {
 	case 'G':
 		parse_trafgen_option(arg, flow_id, endpoint_id);
 		break;
+	case TRACE_OPTION:
+		parse_trace_option(arg, flow_id, endpoint_id);
+		break;
 	case 'A':
 		SHOW_COLUMNS(COL_RTT_MIN, COL_RTT_AVG, COL_RTT_MAX);
-		settings->response_trafgen_options.distribution = CONSTANT;
-		settings->response_trafgen_options.param_one = MIN_BLOCK_SIZE;
+		profile = mutable_profile(settings);
+		profile->response_trafgen_options.distribution = CONSTANT;
+		profile->response_trafgen_options.param_one = MIN_BLOCK_SIZE;
 		break;
 	case 'B':
 		if (sscanf(arg, "%u", &optint) != 1 || optint < 0)
@@ -2514,6 +4069,21 @@ static void parse_flow_option_endpoint(int code, const char* arg,
 		break;
 	case 'M':
 		settings->traffic_dump = 1;
+		SHOW_COLUMNS(COL_PCAP_PACKETS, COL_PCAP_DROPS,
+			     COL_PCAP_RING_DROPS, COL_WIRE_RETR, COL_WIRE_REOR,
+			     COL_WIRE_RTT, COL_WIRE_FLIGHT);
+		break;
+	case 'Z':
+		if (!*arg)
+			PARSE_ERR("in flow %i: option %s requires a value "
+				  "for each given endpoint", flow_id, opt_string);
+		parse_size_option(arg, flow_id, endpoint_id);
+		break;
+	case BLOCKS_OPTION:
+		if (sscanf(arg, "%u", &optint) != 1 || optint <= 0)
+			PARSE_ERR("in flow %i: option %s needs positive integer",
+				  flow_id, opt_string);
+		settings->flow_blocks[WRITE] = optint;
 		break;
 	case 'O':
 		if (!*arg)
@@ -2534,17 +4104,17 @@ static void parse_flow_option_endpoint(int code, const char* arg,
 			settings->route_record = 1;
 		/* keep TCP_CONG_MODULE for backward compatibility */
 		} else if (!memcmp(arg, "TCP_CONG_MODULE=", 16)) {
-			if (strlen(arg + 16) >= sizeof(cflow[0].settings[SOURCE].cc_alg))
+			if (strlen(arg + 16) >= sizeof(cflow[0].settings[SOURCE].profile->cc_alg))
 				PARSE_ERR("in flow %i: option %s: too large "
 					  "string for TCP_CONG_MODULE",
 					  flow_id, opt_string);
-			strcpy(settings->cc_alg, arg + 16);
+			strcpy(mutable_profile(settings)->cc_alg, arg + 16);
 		} else if (!memcmp(arg, "TCP_CONGESTION=", 15)) {
-			if (strlen(arg + 16) >= sizeof(cflow[0].settings[SOURCE].cc_alg))
+			if (strlen(arg + 16) >= sizeof(cflow[0].settings[SOURCE].profile->cc_alg))
 				PARSE_ERR("in flow %i: option %s: too large "
 					  "string for TCP_CONGESTION",
 					  flow_id, opt_string);
-			strcpy(settings->cc_alg, arg + 15);
+			strcpy(mutable_profile(settings)->cc_alg, arg + 15);
 		} else if (!strcmp(arg, "SO_DEBUG")) {
 			settings->so_debug = 1;
 		} else if (!strcmp(arg, "IP_MTU_DISCOVER")) {
@@ -2568,8 +4138,9 @@ static void parse_flow_option_endpoint(int code, const char* arg,
 		if (sscanf(arg, "%u", &optint) != 1 || optint < 0)
 			PARSE_ERR("in flow %i: option %s needs positive integer",
 				  flow_id, opt_string);
-		settings->request_trafgen_options.distribution = CONSTANT;
-		settings->request_trafgen_options.param_one = optint;
+		profile = mutable_profile(settings);
+		profile->request_trafgen_options.distribution = CONSTANT;
+		profile->request_trafgen_options.param_one = optint;
 		for (int id = 0; id < MAX_FLOWS_CONTROLLER; id++) {
 			foreach(int *i, SOURCE, DESTINATION) {
 				if ((signed)optint >
@@ -2623,6 +4194,7 @@ static void parse_flow_option(int code, const char* arg, const char* opt_string,
 	/* flow options w/o endpoint identifier */
 	case 'E':
 		cflow[flow_id].byte_counting = 1;
+		SHOW_COLUMNS(COL_CORRUPT_BLOCKS, COL_CORRUPT_BYTES);
 		break;
 	case 'I':
 		SHOW_COLUMNS(COL_DLY_MIN, COL_DLY_AVG, COL_DLY_MAX);
@@ -2642,6 +4214,131 @@ static void parse_flow_option(int code, const char* arg, const char* opt_string,
 	case 'Q':
 		cflow[flow_id].summarize_only = 1;
 		break;
+	case CHURN_OPTION:
+		if (sscanf(arg, "%u", &optunsigned) != 1 || !optunsigned ||
+		    optunsigned > MAX_CHURN_CONNECTIONS)
+			PARSE_ERR("in flow %i: option %s needs an integer "
+				  "between 1 and %d", flow_id, opt_string,
+				  MAX_CHURN_CONNECTIONS);
+		cflow[flow_id].churn = optunsigned;
+		SHOW_COLUMNS(COL_CONN_RATE, COL_FCT_P50, COL_FCT_P90,
+			     COL_FCT_P99);
+		break;
+	case TAG_OPTION:
+		if (!*arg)
+			PARSE_ERR("in flow %i: option %s needs a name",
+				  flow_id, opt_string);
+		free(cflow[flow_id].tag);
+		cflow[flow_id].tag = strdup(arg);
+		SHOW_COLUMNS(COL_FAIR_JAIN, COL_FAIR_RATIO);
+		break;
+	}
+}
+
+/**
+ * Parse argument for option --aggregate to define aggregation groups.
+ *
+ * Groups of flow IDs are created right away, groups per daemon and of all
+ * flows once the daemons are known (see create_aggregates()).
+ *
+ * @param[in] arg argument for option --aggregate
+ * @param[in] opt_string contains the real cmdline option string
+ */
+static void parse_aggregate_option(const char *arg, const char *opt_string)
+{
+	SHOW_COLUMNS(COL_FAIR_JAIN, COL_FAIR_RATIO);
+
+	if (!strcmp(arg, "daemon")) {
+		copt.aggregate_daemon = true;
+		return;
+	}
+	if (!strcmp(arg, "total")) {
+		copt.aggregate_total = true;
+		return;
+	}
+
+	const char *ranges = strchr(arg, '=');
+	if (!ranges || ranges == arg || !ranges[1])
+		PARSE_ERR("option %s needs 'daemon', 'total' or NAME=FLOWS",
+			  opt_string);
+
+	char *name = strndup(arg, ranges - arg);
+	struct aggregate *a = aggregate_get(name);
+	if (!a)
+		critx("could not allocate memory for aggregation group");
+
+	char *argcpy = strdup(ranges + 1);
+	for (char *token = strtok(argcpy, ","); token;
+	     token = strtok(NULL, ",")) {
+		int first, last, n = 0;
+		int rc = sscanf(token, "%d-%d%n", &first, &last, &n);
+		if (rc == 1 && sscanf(token, "%d%n", &first, &n) == 1)
+			last = first;
+		if (rc < 1 || token[n] || first < 0 || last < first ||
+		    last >= MAX_FLOWS_CONTROLLER)
+			PARSE_ERR("option %s: malformed flow range '%s' in "
+				  "group %s", opt_string, token, name);
+
+		for (int id = first; id <= last; id++)
+			foreach(int *i, SOURCE, DESTINATION)
+				if (aggregate_join(a, &cflow[id].aggregates[*i],
+						   *i))
+					critx("could not allocate memory for "
+					      "aggregation group");
+	}
+	free_all(argcpy, name);
+}
+
+/**
+ * Create the aggregation groups of tagged flows, per daemon and of all flows,
+ * and add the flow endpoints to them.
+ */
+static void create_aggregates(void)
+{
+	for (unsigned short id = 0; id < copt.num_flows; id++) {
+		foreach(int *i, SOURCE, DESTINATION) {
+			struct flow_endpoint *e = &cflow[id].endpoint[*i];
+			struct linked_list *membership = &cflow[id].aggregates[*i];
+			struct aggregate *a;
+
+			if (cflow[id].tag) {
+				if (!(a = aggregate_get(cflow[id].tag)) ||
+				    aggregate_join(a, membership, *i))
+					critx("could not allocate memory for "
+					      "aggregation group");
+			}
+
+			/* The daemon is known by the control address of the
+			 * first endpoint it runs */
+			if (copt.aggregate_daemon && !e->daemon->aggregate) {
+				char *name = NULL;
+				int rc;
+				if (e->rpc_info->server_port != DEFAULT_LISTEN_PORT)
+					rc = asprintf(&name, "%s:%u",
+						      e->rpc_info->server_name,
+						      e->rpc_info->server_port);
+				else
+					rc = asprintf(&name, "%s",
+						      e->rpc_info->server_name);
+				if (rc == -1 ||
+				    !(e->daemon->aggregate = aggregate_get(name)))
+					critx("could not allocate memory for "
+					      "aggregation group");
+				free(name);
+			}
+			if (copt.aggregate_daemon &&
+			    aggregate_join(e->daemon->aggregate, membership,
+					   *i))
+				critx("could not allocate memory for "
+				      "aggregation group");
+
+			if (copt.aggregate_total) {
+				if (!(a = aggregate_get("total")) ||
+				    aggregate_join(a, membership, *i))
+					critx("could not allocate memory for "
+					      "aggregation group");
+			}
+		}
 	}
 }
 
@@ -2657,7 +4354,12 @@ static void parse_colon_option(const char *arg)
 	HIDE_COLUMNS(COL_BEGIN, COL_END, COL_THROUGH, COL_TRANSAC,
 		     COL_BLOCK_REQU, COL_BLOCK_RESP, COL_RTT_MIN, COL_RTT_AVG,
 		     COL_RTT_MAX, COL_IAT_MIN, COL_IAT_AVG, COL_IAT_MAX,
-		     COL_DLY_MIN, COL_DLY_AVG, COL_DLY_MAX, COL_TCP_CWND,
+		     COL_DLY_MIN, COL_DLY_AVG, COL_DLY_MAX, COL_DRIFT_MIN,
+		     COL_DRIFT_AVG, COL_DRIFT_MAX, COL_CONN_RATE, COL_FCT_P50,
+		     COL_FCT_P90, COL_FCT_P99, COL_CORRUPT_BLOCKS,
+		     COL_CORRUPT_BYTES, COL_PCAP_PACKETS, COL_PCAP_DROPS,
+		     COL_PCAP_RING_DROPS, COL_WIRE_RETR, COL_WIRE_REOR, COL_WIRE_RTT,
+		     COL_WIRE_FLIGHT, COL_FAIR_JAIN, COL_FAIR_RATIO, COL_TCP_CWND,
 		     COL_TCP_SSTH, COL_TCP_UACK, COL_TCP_SACK, COL_TCP_LOST,
 		     COL_TCP_RETR, COL_TCP_TRET, COL_TCP_FACK, COL_TCP_REOR,
 		     COL_TCP_BKOF, COL_TCP_RTT, COL_TCP_RTTVAR, COL_TCP_RTO,
@@ -2684,6 +4386,21 @@ static void parse_colon_option(const char *arg)
 			SHOW_COLUMNS(COL_IAT_MIN, COL_IAT_AVG, COL_IAT_MAX);
 		else if (!strcmp(token, "delay"))
 			SHOW_COLUMNS(COL_DLY_MIN, COL_DLY_AVG, COL_DLY_MAX);
+		else if (!strcmp(token, "drift"))
+			SHOW_COLUMNS(COL_DRIFT_MIN, COL_DRIFT_AVG, COL_DRIFT_MAX);
+		else if (!strcmp(token, "churn"))
+			SHOW_COLUMNS(COL_CONN_RATE, COL_FCT_P50, COL_FCT_P90,
+				     COL_FCT_P99);
+		else if (!strcmp(token, "corrupt"))
+			SHOW_COLUMNS(COL_CORRUPT_BLOCKS, COL_CORRUPT_BYTES);
+		else if (!strcmp(token, "dump"))
+			SHOW_COLUMNS(COL_PCAP_PACKETS, COL_PCAP_DROPS,
+				     COL_PCAP_RING_DROPS);
+		else if (!strcmp(token, "wire"))
+			SHOW_COLUMNS(COL_WIRE_RETR, COL_WIRE_REOR, COL_WIRE_RTT,
+				     COL_WIRE_FLIGHT);
+		else if (!strcmp(token, "fairness"))
+			SHOW_COLUMNS(COL_FAIR_JAIN, COL_FAIR_RATIO);
 		else if (!strcmp(token, "kernel"))
 			SHOW_COLUMNS(COL_TCP_CWND, COL_TCP_SSTH, COL_TCP_UACK,
 				     COL_TCP_SACK, COL_TCP_LOST, COL_TCP_RETR,
@@ -2732,6 +4449,37 @@ static void parse_general_option(int code, const char* arg, const char* opt_stri
 		exit(EXIT_SUCCESS);
 
 	/* controller options */
+	case AGGREGATE_OPTION:
+		parse_aggregate_option(arg, opt_string);
+		break;
+	case AGGREGATE_ONLY_OPTION:
+		copt.aggregate_only = true;
+		break;
+	case OUTPUT_OPTION:
+		{
+			const char *file = strchr(arg, ':');
+			char *name = file ? strndup(arg, file - arg) : strdup(arg);
+			copt.output_format = output_parse_format(name);
+			free(name);
+			if (copt.output_format == OUTPUT_NONE)
+				PARSE_ERR("option %s needs 'json', 'csv' or "
+					  "'binary', optionally followed by "
+					  ":FILE", opt_string);
+			free(copt.output_file);
+			copt.output_file = strdup(file && file[1] ? file + 1 : "-");
+			/* The table would be mixed with the output */
+			if (!strcmp(copt.output_file, "-"))
+				copt.log_to_stdout = false;
+		}
+		break;
+	case CAPTURE_OPTION:
+		free(copt.capture_file);
+		copt.capture_file = strdup(arg);
+		break;
+	case CONTROL_STATS_OPTION:
+		free(copt.control_stats_file);
+		copt.control_stats_file = strdup(arg);
+		break;
 	case 'c':
 		parse_colon_option(arg);
 		break;
@@ -2743,6 +4491,9 @@ static void parse_general_option(int code, const char* arg, const char* opt_stri
 	case 'e':
 		copt.dump_prefix = strdup(arg);
 		break;
+	case DUMP_MERGE_OPTION:
+		copt.dump_merge = true;
+		break;
 	case 'i':
 		if (sscanf(arg, "%lf", &copt.reporting_interval) != 1 ||
 					copt.reporting_interval <= 0)
@@ -2889,11 +4640,17 @@ static void parse_cmdline(int argc, char *argv[])
 	int optint = 0;
 
 	const struct ap_Option options[] = {
+		{AGGREGATE_OPTION, "aggregate", ap_yes, OPT_CONTROLLER, 0},
+		{AGGREGATE_ONLY_OPTION, "aggregate-only", ap_no, OPT_CONTROLLER, 0},
+		{CAPTURE_OPTION, "capture", ap_yes, OPT_CONTROLLER, 0},
 		{'c', "show-colon", ap_yes, OPT_CONTROLLER, 0},
+		{CONTROL_STATS_OPTION, "control-stats", ap_yes, OPT_CONTROLLER, 0},
+		{OUTPUT_OPTION, "output", ap_yes, OPT_CONTROLLER, 0},
 #ifdef DEBUG
 		{'d', "debug", ap_no, OPT_CONTROLLER, 0},
 #endif /* DEBUG */
 		{'e', "dump-prefix", ap_yes, OPT_CONTROLLER, 0},
+		{DUMP_MERGE_OPTION, "dump-merge", ap_no, OPT_CONTROLLER, 0},
 		{'h', "help", ap_maybe, OPT_CONTROLLER, 0},
 		{'i', "report-interval", ap_yes, OPT_CONTROLLER, 0},
 		{LOG_FILE_OPTION, "log-file", ap_maybe, OPT_CONTROLLER, 0},
@@ -2927,6 +4684,11 @@ static void parse_cmdline(int argc, char *argv[])
 		{'U', 0, ap_yes, OPT_FLOW_ENDPOINT, 0},
 		{'W', 0, ap_yes, OPT_FLOW_ENDPOINT, 0},
 		{'Y', 0, ap_yes, OPT_FLOW_ENDPOINT, 0},
+		{'Z', 0, ap_yes, OPT_FLOW_ENDPOINT, 0},
+		{TRACE_OPTION, "trace", ap_yes, OPT_FLOW_ENDPOINT, (int[]){1,2,3,0}},
+		{CHURN_OPTION, "churn", ap_yes, OPT_FLOW, 0},
+		{BLOCKS_OPTION, "blocks", ap_yes, OPT_FLOW_ENDPOINT, 0},
+		{TAG_OPTION, "tag", ap_yes, OPT_FLOW, 0},
 		{0, 0, ap_no, 0, 0}
 	};
 
@@ -3016,8 +4778,9 @@ static void parse_cmdline(int argc, char *argv[])
 	 * them like the other options supported by the -O argument.
 	 */
 	{
-		assert(cflow[0].settings[SOURCE].num_extra_socket_options < MAX_EXTRA_SOCKET_OPTIONS);
-		struct extra_socket_options *option = &cflow[0].settings[SOURCE].extra_socket_options[cflow[0].settings[SOURCE].num_extra_socket_options++];
+		struct flow_profile *profile = mutable_profile(&cflow[0].settings[SOURCE]);
+		assert(profile->num_extra_socket_options < MAX_EXTRA_SOCKET_OPTIONS);
+		struct extra_socket_options *option = &profile->extra_socket_options[profile->num_extra_socket_options++];
 		int v;
 
 		/* The value of the TCP_NODELAY constant gets passed to the daemons.
@@ -3036,6 +4799,21 @@ static void parse_cmdline(int argc, char *argv[])
 	}
 #endif /* 0 */
 
+	/* flows with equal settings share a single profile */
+	for (unsigned short id = 0; id < copt.num_flows; id++) {
+		foreach(int *i, SOURCE, DESTINATION) {
+			struct flow_settings *settings = &cflow[id].settings[*i];
+			struct flow_profile *profile =
+				profile_intern(settings->profile);
+			if (!profile)
+				critx("could not allocate memory for flow "
+				      "profile");
+			profile_unref(settings->profile);
+			settings->profile = profile;
+		}
+	}
+	DEBUG_MSG(LOG_WARNING, "%u distinct flow profiles", profile_count());
+
 	for (unsigned short id = 0; id < copt.num_flows; id++) {
 		cflow[id].settings[SOURCE].duration[READ] = cflow[id].settings[DESTINATION].duration[WRITE];
 		cflow[id].settings[DESTINATION].duration[READ] = cflow[id].settings[SOURCE].duration[WRITE];
@@ -3061,6 +4839,27 @@ static void parse_cmdline(int argc, char *argv[])
  */
 static void sanity_check(void)
 {
+	bool tagged = false;
+	for (unsigned short id = 0; id < copt.num_flows; id++)
+		if (cflow[id].tag)
+			tagged = true;
+	if (copt.aggregate_only && !tagged && !copt.aggregate_daemon &&
+	    !copt.aggregate_total && !aggregate_count()) {
+		errx("option --aggregate-only given, but no aggregation group "
+		     "defined");
+		exit(EXIT_FAILURE);
+	}
+	for (int id = copt.num_flows; id < MAX_FLOWS_CONTROLLER; id++) {
+		const struct list_node *node =
+			fg_list_front(&cflow[id].aggregates[SOURCE]);
+		if (node) {
+			const struct aggregate_member *m = node->data;
+			errx("aggregation group %s contains non-existing flow "
+			     "%d", m->group->name, id);
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	for (unsigned short id = 0; id < copt.num_flows; id++) {
 		DEBUG_MSG(LOG_DEBUG, "sanity checking parameter set of flow %d", id);
 		if (cflow[id].settings[DESTINATION].duration[WRITE] > 0 &&
@@ -3088,6 +4887,51 @@ static void sanity_check(void)
 			exit(EXIT_FAILURE);
 		}
 
+		if (cflow[id].trace_file[DESTINATION] &&
+		    !cflow[id].settings[DESTINATION].duration[WRITE]) {
+			errx("server flow %d replays a trace but has no "
+			      "runtime", id);
+			exit(EXIT_FAILURE);
+		}
+
+		if (cflow[id].churn) {
+			const struct trafgen_options *gap =
+				&cflow[id].settings[SOURCE].profile->interpacket_gap_trafgen_options;
+
+			if (cflow[id].trace_file[SOURCE] ||
+			    cflow[id].trace_file[DESTINATION]) {
+				errx("flow %d can not replay a trace in churn "
+				      "mode", id);
+				exit(EXIT_FAILURE);
+			}
+			if (cflow[id].settings[DESTINATION].duration[WRITE] ||
+			    !cflow[id].settings[SOURCE].duration[WRITE]) {
+				errx("flow %d in churn mode needs a client "
+				      "runtime and no server runtime", id);
+				exit(EXIT_FAILURE);
+			}
+			if (gap->distribution == CONSTANT &&
+			    gap->param_one <= 0) {
+				errx("flow %d in churn mode needs an arrival "
+				      "process (option -G s=g)", id);
+				exit(EXIT_FAILURE);
+			}
+			foreach(int *i, SOURCE, DESTINATION) {
+				if (cflow[id].settings[*i].flow_size[WRITE] ||
+				    cflow[id].settings[*i].flow_blocks[WRITE]) {
+					errx("flow %d in churn mode can not have "
+					      "a flow size", id);
+					exit(EXIT_FAILURE);
+				}
+				if (cflow[id].settings[*i].write_rate_str ||
+				    cflow[id].settings[*i].traffic_dump) {
+					errx("flow %d in churn mode can neither "
+					      "use a rate nor dump traffic", id);
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+
 		foreach(int *i, SOURCE, DESTINATION) {
 			if (cflow[id].settings[*i].flow_control &&
 			    !cflow[id].settings[*i].write_rate_str) {
@@ -3123,19 +4967,28 @@ int main(int argc, char *argv[])
 
 	fg_list_init(&flows_rpc_info);
 	fg_list_init(&unique_daemons);
+	fg_list_init(&cdf_files);
 
 	set_progname(argv[0]);
+	aggregate_init(print_aggregate_report);
 	init_controller_options();
 	init_flow_options();
 	parse_cmdline(argc, argv);
 	sanity_check();
 	open_logfile();
+	open_output();
+	open_capture();
+	open_control_stats();
 	prepare_xmlrpc_client(&rpc_client);
 
 	DEBUG_MSG(LOG_WARNING, "check daemons in the flows");
 	if (!sigint_caught)
 		find_daemon(rpc_client);
 
+	DEBUG_MSG(LOG_WARNING, "create aggregation groups");
+	if (!sigint_caught)
+		create_aggregates();
+
 	DEBUG_MSG(LOG_WARNING, "check flowgrindds versions");
 	if (!sigint_caught)
 		check_version(rpc_client);
@@ -3148,6 +5001,10 @@ int main(int argc, char *argv[])
 	if (!sigint_caught)
 		prepare_all_flows(rpc_client);
 
+	DEBUG_MSG(LOG_WARNING, "estimate clock offsets of flowgrindds");
+	if (!sigint_caught)
+		sync_clocks(rpc_client);
+
 	DEBUG_MSG(LOG_WARNING, "print headline");
 	if (!sigint_caught)
 		print_headline();
@@ -3161,12 +5018,18 @@ int main(int argc, char *argv[])
 
 	DEBUG_MSG(LOG_WARNING, "print all final report");
 	fetch_reports(rpc_client);
+	aggregate_flush();
 	print_all_final_reports();
+	aggregate_cleanup(print_fairness_summary);
+	write_control_stats();
 
 	fg_list_clear(&flows_rpc_info);
 	fg_list_clear(&unique_daemons);
+	free_cdf_files();
 
 	close_logfile();
+	output_close();
+	capture_close();
 
 	xmlrpc_client_destroy(rpc_client);
 	xmlrpc_env_clean(&rpc_env);
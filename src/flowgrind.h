@@ -39,6 +39,9 @@
 
 #include "common.h"
 #include "fg_list.h"
+#include "fg_aggregate.h"
+#include "fg_output.h"
+#include "fg_capture.h"
 
 /** Number of whitespaces between to two interval report columns. */
 #define GUARDBAND 2
@@ -49,6 +52,25 @@
 /** Number of emited reports before interval header is printed again. */
 #define MAX_REPORTS_IN_ROW 25
 
+/** Number of flow size buckets for the flow completion time summary. Bucket
+ * i holds flows of 10^i up to 10^(i+1) bytes, the last one all larger flows. */
+#define NUM_FCT_BUCKETS 10
+
+/** Number of request/reply exchanges to estimate the clock offset of a
+ * daemon. The exchange with the smallest round-trip time is used. */
+#define CLOCK_SYNC_SAMPLES 8
+
+/** Time in seconds between starting the flows and their scheduled start, to
+ * allow the start request to reach all daemons. */
+#define START_LEAD_TIME 2.0
+
+/** First XML-RPC API version of the daemon supporting method add_flows. */
+#define ADD_FLOWS_API_VERSION 9
+
+/** Maximal number of flow endpoints added with a single add_flows call. Keeps
+ * the request below the XML size limit of the daemon. */
+#define ADD_FLOWS_BATCH_SIZE 256
+
 /** Transport protocols. */
 enum protocol_t {
 	/** Transmission Control Protocol. */
@@ -119,6 +141,33 @@ enum column_id {
 	COL_DLY_MIN,
 	COL_DLY_AVG,
 	COL_DLY_MAX,                                        /** @} */
+	/** Send time drift of a replayed trace. @{ */
+	COL_DRIFT_MIN,
+	COL_DRIFT_AVG,
+	COL_DRIFT_MAX,                                      /** @} */
+	/** Completed connections per second of a churn flow. */
+	COL_CONN_RATE,
+	/** Flow completion time quantiles of a churn flow. @{ */
+	COL_FCT_P50,
+	COL_FCT_P90,
+	COL_FCT_P99,                                        /** @} */
+	/** Corrupted blocks and mismatched bytes of option -E. @{ */
+	COL_CORRUPT_BLOCKS,
+	COL_CORRUPT_BYTES,                                  /** @} */
+	/** Dumped and dropped packets of the capture of option -M, packets
+	 * dropped on the interface. @{ */
+	COL_PCAP_PACKETS,
+	COL_PCAP_DROPS,
+	COL_PCAP_RING_DROPS,                                /** @} */
+	/** Retransmitted and reordered segments, RTT and bytes in flight
+	 * derived from the capture of option -M. @{ */
+	COL_WIRE_RETR,
+	COL_WIRE_REOR,
+	COL_WIRE_RTT,
+	COL_WIRE_FLIGHT,                                    /** @} */
+	/** Fairness between the members of an aggregation group. @{ */
+	COL_FAIR_JAIN,
+	COL_FAIR_RATIO,                                     /** @} */
 	/** Metric from the Linux / BSD TCP stack. @{ */
 	COL_TCP_CWND,
 	COL_TCP_SSTH,
@@ -172,6 +221,26 @@ enum mutex_context_t {
 enum long_opt_only {
 	/** Pseudo short option for option --log-file. */
 	LOG_FILE_OPTION = CHAR_MAX + 1,
+	/** Pseudo short option for option --trace. */
+	TRACE_OPTION,
+	/** Pseudo short option for option --churn. */
+	CHURN_OPTION,
+	/** Pseudo short option for option --blocks. */
+	BLOCKS_OPTION,
+	/** Pseudo short option for option --aggregate. */
+	AGGREGATE_OPTION,
+	/** Pseudo short option for option --aggregate-only. */
+	AGGREGATE_ONLY_OPTION,
+	/** Pseudo short option for option --tag. */
+	TAG_OPTION,
+	/** Pseudo short option for option --output. */
+	OUTPUT_OPTION,
+	/** Pseudo short option for option --capture. */
+	CAPTURE_OPTION,
+	/** Pseudo short option for option --control-stats. */
+	CONTROL_STATS_OPTION,
+	/** Pseudo short option for option --dump-merge. */
+	DUMP_MERGE_OPTION,
 };
 
 /** Controller options. */
@@ -186,6 +255,8 @@ struct controller_options {
 	bool log_to_file;
 	/** Prefix for dumpfile (option -e). */
 	const char *dump_prefix;
+	/** Merge the dumps of all flows on an interface (option --dump-merge). */
+	bool dump_merge;
 	/** Overwrite existing log files (option -o). */
 	bool clobber;
 	/** Report in MByte/s instead of MBit/s (option -m). */
@@ -194,6 +265,20 @@ struct controller_options {
 	bool symbolic;
 	/** Force kernel output to specific unit  (option -s). */
 	enum tcp_stack_t force_unit;
+	/** Aggregate the endpoints of each daemon (option --aggregate). */
+	bool aggregate_daemon;
+	/** Aggregate all endpoints (option --aggregate). */
+	bool aggregate_total;
+	/** Print interval reports of aggregates only (option --aggregate-only). */
+	bool aggregate_only;
+	/** Format of the machine-readable output (option --output). */
+	enum output_format output_format;
+	/** File of the machine-readable output, "-" for stdout. */
+	char *output_file;
+	/** Capture file of all reports (option --capture). */
+	char *capture_file;
+	/** File of the control plane statistics (option --control-stats). */
+	char *control_stats_file;
 };
 
 /** Infos about a flowgrind daemon. */
@@ -209,6 +294,14 @@ struct daemon {
 	char os_release[257];
 	/** Pointer to daemon XMLPRC URL. */
 	char *url;
+	/** Estimated offset of the daemon clock to the controller clock in
+	 * seconds, positive if the daemon clock is ahead. */
+	double clock_offset;
+	/** Round-trip time of the exchange the clock offset is based on. Half
+	 * of it bounds the error of the offset. */
+	double clock_rtt;
+	/** Aggregation group of all endpoints of this daemon. */
+	struct aggregate *aggregate;
 };
 
 /** Infos about a flowgrind daemon and daemon-controller connection. */
@@ -221,6 +314,14 @@ struct rpc_info {
 	unsigned short server_port;
 };
 
+/** Empirical CDF loaded from a file for option -G. */
+struct cdf_file {
+	/** Name of the file. */
+	char *filename;
+	/** CDF read from the file. Flow profiles hold their own copies. */
+	struct empirical_cdf *cdf;
+};
+
 /** Infos about the flow endpoint. */
 struct flow_endpoint {
 	/** Sending buffer (SO_SNDBUF). */
@@ -254,6 +355,8 @@ struct cflow {
 	char byte_counting;
 	/** Random seed for stochastic traffic generation (option -J). */
 	unsigned random_seed;
+	/** Maximal number of concurrent churn connections (option --churn). */
+	int churn;
 
 	/* For the following arrays: 0 stands for source; 1 for destination */
 
@@ -269,6 +372,12 @@ struct cflow {
 	char finished[2];
 	/** Final report from the daemon. */
 	struct report *final_report[2];
+	/** Trace file replayed instead of traffic generation (option --trace). */
+	char *trace_file[2];
+	/** Name of the aggregation group of the flow (option --tag). */
+	char *tag;
+	/** Aggregation groups the flow endpoint is member of. */
+	struct linked_list aggregates[2];
 };
 
 /** Header of an intermediated interval report column. */
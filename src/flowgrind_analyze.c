@@ -0,0 +1,727 @@
+/**
+ * @file flowgrind_analyze.c
+ * @brief Utility to summarize Flowgrind capture files
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "common.h"
+#include "fg_affinity.h"
+#include "fg_argparser.h"
+#include "fg_capture.h"
+#include "fg_definitions.h"
+#include "fg_error.h"
+#include "fg_histogram.h"
+#include "fg_progname.h"
+
+/** Value of tcpi_ca_state during fast recovery, as defined by Linux. */
+#define CA_STATE_RECOVERY 3
+/** Value of tcpi_ca_state after a retransmission timeout. */
+#define CA_STATE_LOSS 4
+
+/* External global variables. */
+extern const char *progname;
+
+/** Command line option parser. */
+static struct arg_parser parser;
+
+/** Analysis options. */
+static struct {
+	/** Width of a time bin of the throughput series in seconds (-b). */
+	double bin_width;
+	/** Number of worker threads (-j). */
+	unsigned threads;
+	/** Report in MByte/s instead of MBit/s (-m). */
+	bool mbyte;
+	/** Print the throughput series (-t). */
+	bool time_series;
+} opt = {
+	.bin_width = 1.0,
+	.threads = 0,
+	.mbyte = false,
+	.time_series = false,
+};
+
+/** Statistics of a flow endpoint. */
+struct endpoint_stats {
+	/** Number of interval reports. */
+	unsigned long intervals;
+	/** Begin of the first and end of the last interval report. */
+	double first, last;
+	/** Bytes written according to the interval reports. */
+	uint64_t bytes_written;
+	/** Whether the final report was captured. */
+	bool finished;
+	/** Bytes written, begin and end according to the final report. */
+	uint64_t final_bytes_written;
+	double final_begin, final_end;
+	/** Bytes written per time bin, starting with bin @p first_bin. Only
+	 * the bins spanned by the reports of the endpoint are allocated. */
+	double *bins;
+	size_t first_bin, num_bins;
+	/** Interval averages of the RTT and the one-way delay. */
+	struct fg_histogram rtt, delay;
+	/** Largest RTT and one-way delay. */
+	double rtt_max, delay_max;
+	/** Minimum, sum and maximum of the congestion window. */
+	uint64_t cwnd_min, cwnd_sum, cwnd_max;
+	/** Largest number of retransmitted and lost segments in flight. */
+	uint64_t retrans_max, lost_max;
+	/** Number of interval reports with retransmitted segments. */
+	unsigned long retrans_intervals;
+	/** Number of fast recoveries and retransmission timeouts. */
+	unsigned recoveries, timeouts;
+	/** Congestion avoidance state of the previous interval report. */
+	uint64_t ca_state;
+};
+
+/** Sums over the flows active in a time bin, for Jain's fairness index. */
+struct bin_sums {
+	/** Sum and sum of squares of the bytes written by the flows. */
+	double sum, sum_squares;
+	/** Number of flows active in the bin. */
+	unsigned active;
+};
+
+/** Analysis of a capture file, shared by the worker threads. */
+struct analysis {
+	/** Capture file. */
+	const struct capture_file *cf;
+	/** Number of time bins. */
+	size_t num_bins;
+	/** Statistics of all flow endpoints, indexed by flow ID. */
+	struct endpoint_stats (*stats)[2];
+	/** Sums per time bin of the sources and destinations. */
+	struct bin_sums *bin_sums[2];
+	/** Next flow to be analyzed by a worker. */
+	unsigned next_flow;
+	/** Protects @p next_flow and @p bin_sums. */
+	pthread_mutex_t lock;
+};
+
+/* Forward declarations. */
+static void usage(short status) __attribute__((noreturn));
+
+/**
+ * Print flowgrind-analyze usage and exit.
+ */
+static void usage(short status)
+{
+	/* Syntax error. Emit 'try help' to stderr and exit */
+	if (status != EXIT_SUCCESS) {
+		fprintf(stderr, "Try '%s -h' for more information\n", progname);
+		exit(status);
+	}
+
+	fprintf(stdout,
+		"Usage: %1$s [OPTION]... FILE...\n"
+		"Summarize the capture files written by flowgrind --capture.\n\n"
+
+		"Mandatory arguments to long options are mandatory for short options too.\n"
+		"  -b, --bin=#.#  width of a time bin of the throughput series and the\n"
+		"                 fairness index, in seconds (default: 1s)\n"
+		"  -h, --help     display this help and exit\n"
+		"  -j, --threads=#\n"
+		"                 number of worker threads (default: number of processors)\n"
+		"  -m             report throughput in 2**20 bytes/s (default: 10**6 bit/s)\n"
+		"  -t, --time-series\n"
+		"                 print the throughput of all flows per time bin\n"
+		"  -v, --version  print version information and exit\n\n"
+
+		"Example:\n"
+		"   %1$s -b 0.5 -t flowgrind.cap\n",
+		progname);
+	exit(EXIT_SUCCESS);
+}
+
+/** Throughput of @p bytes in @p seconds in the unit selected by option -m. */
+static inline double throughput(double bytes, double seconds)
+{
+	if (seconds <= 0)
+		return 0.0;
+	return opt.mbyte ? bytes / seconds / (1 << 20)
+			 : bytes / seconds * 8 / 1e6;
+}
+
+/** Unit of throughput(). */
+static inline const char *throughput_unit(void)
+{
+	return opt.mbyte ? "MiB/s" : "Mbit/s";
+}
+
+/** Time bin of @p time, limited to the @p num_bins bins from @p first_bin. */
+static inline size_t time_bin(double time, size_t first_bin, size_t num_bins)
+{
+	size_t b = time > 0 ? (size_t)(time / opt.bin_width) : 0;
+
+	ASSIGN_MAX(b, first_bin);
+	ASSIGN_MIN(b, first_bin + num_bins - 1);
+	return b;
+}
+
+/** Bytes written by the endpoint with statistics @p st in time bin @p b. */
+static inline double bin_bytes(const struct endpoint_stats *st, size_t b)
+{
+	if (b < st->first_bin || b >= st->first_bin + st->num_bins)
+		return 0.0;
+	return st->bins[b - st->first_bin];
+}
+
+/** Whether the endpoint with statistics @p st ran during time bin @p b. */
+static inline bool active_in_bin(const struct endpoint_stats *st, size_t b)
+{
+	return st->intervals && st->first < (b + 1) * opt.bin_width &&
+	       st->last > b * opt.bin_width;
+}
+
+/**
+ * Distribute @p bytes written from @p begin to @p end over the time bins of
+ * @p st proportional to their overlap.
+ */
+static void add_to_bins(struct endpoint_stats *st, double begin, double end,
+			double bytes)
+{
+	if (begin < 0)
+		begin = 0;
+	if (end < begin)
+		end = begin;
+
+	size_t first = time_bin(begin, st->first_bin, st->num_bins);
+	size_t last = time_bin(end, st->first_bin, st->num_bins);
+	double *bins = st->bins - st->first_bin;
+
+	if (first == last || end == begin) {
+		bins[first] += bytes;
+		return;
+	}
+
+	for (size_t b = first; b <= last; b++) {
+		double from = MAX(begin, b * opt.bin_width);
+		double to = MIN(end, (b + 1) * opt.bin_width);
+		if (to > from)
+			bins[b] += bytes * (to - from) / (end - begin);
+	}
+}
+
+/** Add the time bins of endpoint @p e with statistics @p st to the sums. */
+static void add_to_bin_sums(struct analysis *a, const struct endpoint_stats *st,
+			    enum endpoint_t e)
+{
+	struct bin_sums *sums = a->bin_sums[e];
+
+	pthread_mutex_lock(&a->lock);
+	for (size_t b = st->first_bin; b < st->first_bin + st->num_bins; b++) {
+		if (!active_in_bin(st, b))
+			continue;
+		const double x = bin_bytes(st, b);
+		sums[b].sum += x;
+		sums[b].sum_squares += x * x;
+		sums[b].active++;
+	}
+	pthread_mutex_unlock(&a->lock);
+}
+
+/** Add the interval report @p n of chunk @p c to statistics @p st. */
+static void add_interval(struct endpoint_stats *st,
+			 const struct capture_chunk *c, unsigned n)
+{
+	const union capture_value (*v)[CAPTURE_CHUNK_RECORDS] = c->values;
+	const double begin = v[CAPTURE_BEGIN][n].d;
+	const double end = v[CAPTURE_END][n].d;
+	const uint64_t bytes = v[CAPTURE_BYTES_WRITTEN][n].u;
+
+	if (!st->intervals++) {
+		st->first = begin;
+		st->cwnd_min = UINT64_MAX;
+	}
+	ASSIGN_MAX(st->last, end);
+	st->bytes_written += bytes;
+	add_to_bins(st, begin, end, bytes);
+
+	/* NaN if there is no sample in the interval */
+	const double rtt = v[CAPTURE_RTT_AVG][n].d;
+	if (!isnan(rtt)) {
+		histogram_add(&st->rtt, rtt);
+		ASSIGN_MAX(st->rtt_max, v[CAPTURE_RTT_MAX][n].d);
+	}
+	const double delay = v[CAPTURE_DELAY_AVG][n].d;
+	if (!isnan(delay)) {
+		histogram_add(&st->delay, delay);
+		ASSIGN_MAX(st->delay_max, v[CAPTURE_DELAY_MAX][n].d);
+	}
+
+	const uint64_t cwnd = v[CAPTURE_TCPI_SND_CWND][n].u;
+	ASSIGN_MIN(st->cwnd_min, cwnd);
+	ASSIGN_MAX(st->cwnd_max, cwnd);
+	st->cwnd_sum += cwnd;
+
+	const uint64_t retrans = v[CAPTURE_TCPI_RETRANS][n].u;
+	ASSIGN_MAX(st->retrans_max, retrans);
+	ASSIGN_MAX(st->lost_max, v[CAPTURE_TCPI_LOST][n].u);
+	if (retrans)
+		st->retrans_intervals++;
+
+	/* Count entering a state, not the intervals spent in it */
+	const uint64_t ca_state = v[CAPTURE_TCPI_CA_STATE][n].u;
+	if (ca_state != st->ca_state) {
+		if (ca_state == CA_STATE_RECOVERY)
+			st->recoveries++;
+		else if (ca_state == CA_STATE_LOSS)
+			st->timeouts++;
+	}
+	st->ca_state = ca_state;
+}
+
+/** Analyze all reports of endpoint @p e of flow @p id. */
+static void analyze_endpoint(struct analysis *a, unsigned id,
+			     enum endpoint_t e)
+{
+	const struct capture_file *cf = a->cf;
+	struct endpoint_stats *st = &a->stats[id][e];
+
+	/* The chunks of an endpoint are adjacent in the index and in order */
+	size_t first = capture_find(cf, id, e, -INFINITY), last = first;
+	double begin = INFINITY, end = -INFINITY;
+	for (; last < cf->num_chunks && cf->index[last].flow_id == (int)id &&
+	     cf->index[last].endpoint == (unsigned)e; last++) {
+		ASSIGN_MIN(begin, cf->index[last].begin);
+		ASSIGN_MAX(end, cf->index[last].end);
+	}
+	if (first == last)
+		return;
+
+	/* Only the bins spanned by the reports of the endpoint */
+	st->first_bin = time_bin(begin, 0, a->num_bins);
+	st->num_bins = time_bin(end, st->first_bin, a->num_bins - st->first_bin) -
+		       st->first_bin + 1;
+	st->bins = calloc(st->num_bins, sizeof(double));
+	if (!st->bins)
+		critx("could not allocate memory for time bins");
+
+	for (size_t i = first; i < last; i++) {
+		const struct capture_chunk *c = capture_chunk(cf, i);
+
+		for (unsigned n = 0; n < c->count; n++) {
+			if (c->values[CAPTURE_TYPE][n].u != FINAL) {
+				add_interval(st, c, n);
+				continue;
+			}
+			st->finished = true;
+			st->final_bytes_written =
+				c->values[CAPTURE_BYTES_WRITTEN][n].u;
+			st->final_begin = c->values[CAPTURE_BEGIN][n].d;
+			st->final_end = c->values[CAPTURE_END][n].d;
+		}
+	}
+
+	/* The bins of a flow are kept for the time series only */
+	add_to_bin_sums(a, st, e);
+	if (!opt.time_series) {
+		free(st->bins);
+		st->bins = NULL;
+	}
+}
+
+/** Worker thread analyzing one flow after the other. */
+static void *worker(void *arg)
+{
+	struct analysis *a = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&a->lock);
+		unsigned id = a->next_flow++;
+		pthread_mutex_unlock(&a->lock);
+
+		if (id >= a->cf->header->num_flows)
+			break;
+		foreach(int *i, SOURCE, DESTINATION)
+			analyze_endpoint(a, id, *i);
+	}
+
+	return NULL;
+}
+
+/** Bytes written by the endpoint with statistics @p st. */
+static inline double total_bytes(const struct endpoint_stats *st)
+{
+	return st->finished ? st->final_bytes_written : st->bytes_written;
+}
+
+/** Duration of the endpoint with statistics @p st, in seconds. */
+static inline double total_duration(const struct endpoint_stats *st)
+{
+	if (st->finished)
+		return st->final_end - st->final_begin;
+	return st->intervals ? st->last - st->first : 0.0;
+}
+
+/**
+ * Jain's fairness index of the throughput of endpoints @p e of all flows in
+ * time bin @p b, or over the whole test if @p b is SIZE_MAX.
+ *
+ * @return index between 1/n and 1, NaN if no flow was active
+ */
+static double jain_index(const struct analysis *a, enum endpoint_t e, size_t b)
+{
+	double sum = 0.0, sum_squares = 0.0;
+	unsigned n = 0;
+
+	if (b == SIZE_MAX) {
+		for (unsigned id = 0; id < a->cf->header->num_flows; id++) {
+			const struct endpoint_stats *st = &a->stats[id][e];
+			if (!st->intervals && !st->finished)
+				continue;
+			double x = throughput(total_bytes(st),
+					      total_duration(st));
+			sum += x;
+			sum_squares += x * x;
+			n++;
+		}
+	} else {
+		sum = a->bin_sums[e][b].sum;
+		sum_squares = a->bin_sums[e][b].sum_squares;
+		n = a->bin_sums[e][b].active;
+	}
+
+	if (!n || sum_squares == 0)
+		return NAN;
+	return sum * sum / (n * sum_squares);
+}
+
+/** Print the latency percentiles of histogram @p h with maximum @p max. */
+static void print_latency(const char *name, const struct fg_histogram *h,
+			  double max)
+{
+	if (!h->count)
+		return;
+
+	printf(", %s = %.3f/%.3f/%.3f/%.3f ms (p50/p90/p99/max)", name,
+	       histogram_quantile(h, 0.5) * 1e3,
+	       histogram_quantile(h, 0.9) * 1e3,
+	       histogram_quantile(h, 0.99) * 1e3, max * 1e3);
+}
+
+/** Print the summary of endpoint @p e of flow @p id. */
+static void print_endpoint(const struct analysis *a, unsigned id,
+			   enum endpoint_t e)
+{
+	const struct endpoint_stats *st = &a->stats[id][e];
+	const struct capture_flow *flow = &a->cf->flows[id];
+
+	if (!st->intervals && !st->finished)
+		return;
+
+	printf("# flow %d %c (%s): throughput = %.6f %s (%.0f bytes in %.3f s)",
+	       flow->flow_id, e == SOURCE ? 'S' : 'D', flow->host[e],
+	       throughput(total_bytes(st), total_duration(st)),
+	       throughput_unit(), total_bytes(st), total_duration(st));
+	print_latency("rtt", &st->rtt, st->rtt_max);
+	print_latency("delay", &st->delay, st->delay_max);
+
+	if (st->cwnd_max)
+		printf(", cwnd = %llu/%.1f/%llu (min/avg/max), recoveries = %u, "
+		       "timeouts = %u, retrans = %llu (max), lost = %llu (max), "
+		       "%.1f%% intervals with retrans",
+		       (unsigned long long)st->cwnd_min,
+		       (double)st->cwnd_sum / st->intervals,
+		       (unsigned long long)st->cwnd_max, st->recoveries,
+		       st->timeouts, (unsigned long long)st->retrans_max,
+		       (unsigned long long)st->lost_max,
+		       100.0 * st->retrans_intervals / st->intervals);
+	if (!st->finished)
+		printf(" (incomplete)");
+	printf("\n");
+}
+
+/** Print the summary over endpoints @p e of all flows. */
+static void print_total(const struct analysis *a, enum endpoint_t e)
+{
+	struct fg_histogram rtt, delay;
+	double rtt_max = 0.0, delay_max = 0.0, bytes = 0.0;
+	double begin = INFINITY, end = -INFINITY;
+	unsigned recoveries = 0, timeouts = 0, endpoints = 0;
+
+	histogram_reset(&rtt);
+	histogram_reset(&delay);
+
+	for (unsigned id = 0; id < a->cf->header->num_flows; id++) {
+		const struct endpoint_stats *st = &a->stats[id][e];
+		if (!st->intervals && !st->finished)
+			continue;
+
+		endpoints++;
+		bytes += total_bytes(st);
+		ASSIGN_MIN(begin, st->finished ? st->final_begin : st->first);
+		ASSIGN_MAX(end, st->finished ? st->final_end : st->last);
+		histogram_merge(&rtt, &st->rtt);
+		histogram_merge(&delay, &st->delay);
+		ASSIGN_MAX(rtt_max, st->rtt_max);
+		ASSIGN_MAX(delay_max, st->delay_max);
+		recoveries += st->recoveries;
+		timeouts += st->timeouts;
+	}
+
+	if (!endpoints)
+		return;
+
+	printf("# total %c (%u flows): throughput = %.6f %s (%.0f bytes in "
+	       "%.3f s)", e == SOURCE ? 'S' : 'D', endpoints,
+	       throughput(bytes, end - begin), throughput_unit(), bytes,
+	       end - begin);
+	print_latency("rtt", &rtt, rtt_max);
+	print_latency("delay", &delay, delay_max);
+	printf(", recoveries = %u, timeouts = %u\n", recoveries, timeouts);
+
+	/* Fairness over the bins in which at least one flow was active */
+	double sum = 0.0, min = INFINITY;
+	size_t bins = 0;
+	for (size_t b = 0; b < a->num_bins; b++) {
+		double j = jain_index(a, e, b);
+		if (isnan(j))
+			continue;
+		sum += j;
+		ASSIGN_MIN(min, j);
+		bins++;
+	}
+
+	double overall = jain_index(a, e, SIZE_MAX);
+	if (isnan(overall))
+		return;
+	printf("# total %c: Jain's fairness index = %.4f", e == SOURCE ? 'S' : 'D',
+	       overall);
+	if (bins)
+		printf(", %.4f/%.4f (avg/min over %zu bins of %.3f s)",
+		       sum / bins, min, bins, opt.bin_width);
+	printf("\n");
+}
+
+/** Print the throughput of endpoints @p e of all flows per time bin. */
+static void print_time_series(const struct analysis *a, enum endpoint_t e)
+{
+	const unsigned num_flows = a->cf->header->num_flows;
+
+	/* E.g. the destinations of bulk transfers */
+	double bytes = 0.0;
+	for (unsigned id = 0; id < num_flows; id++)
+		bytes += total_bytes(&a->stats[id][e]);
+	if (!bytes)
+		return;
+
+	printf("# %c begin end total[%s] jain", e == SOURCE ? 'S' : 'D',
+	       throughput_unit());
+	for (unsigned id = 0; id < num_flows; id++)
+		printf(" flow%d", a->cf->flows[id].flow_id);
+	printf("\n");
+
+	for (size_t b = 0; b < a->num_bins; b++) {
+		double total = 0.0;
+		for (unsigned id = 0; id < num_flows; id++)
+			total += bin_bytes(&a->stats[id][e], b);
+
+		printf("%c %.3f %.3f %.6f %.4f", e == SOURCE ? 'S' : 'D',
+		       b * opt.bin_width, (b + 1) * opt.bin_width,
+		       throughput(total, opt.bin_width), jain_index(a, e, b));
+		for (unsigned id = 0; id < num_flows; id++) {
+			const struct endpoint_stats *st = &a->stats[id][e];
+			printf(" %.6f", throughput(bin_bytes(st, b),
+						   opt.bin_width));
+		}
+		printf("\n");
+	}
+}
+
+/**
+ * Analyze capture file @p path and print the results.
+ *
+ * @return zero on success, -1 if the file could not be mapped
+ */
+static int analyze_file(const char *path)
+{
+	struct capture_file cf;
+
+	if (capture_map(path, &cf) == -1) {
+		if (errno == EINVAL)
+			warnx("'%s' is not a capture file of this host", path);
+		else
+			warn("could not open capture file '%s'", path);
+		return -1;
+	}
+
+	const unsigned num_flows = cf.header->num_flows;
+	struct analysis a = {
+		.cf = &cf,
+		.next_flow = 0,
+	};
+	pthread_mutex_init(&a.lock, NULL);
+
+	/* Bins up to the end of the last report */
+	double end = opt.bin_width;
+	for (size_t i = 0; i < cf.num_chunks; i++)
+		ASSIGN_MAX(end, cf.index[i].end);
+	a.num_bins = (size_t)ceil(end / opt.bin_width);
+
+	a.stats = calloc(num_flows ? num_flows : 1, sizeof(*a.stats));
+	if (!a.stats)
+		critx("could not allocate memory for flow statistics");
+	foreach(int *i, SOURCE, DESTINATION)
+		if (!(a.bin_sums[*i] = calloc(a.num_bins,
+					      sizeof(struct bin_sums))))
+			critx("could not allocate memory for time bins");
+
+	unsigned threads = MIN(opt.threads, MAX(num_flows, 1U));
+	pthread_t *tids = calloc(threads, sizeof(pthread_t));
+	if (!tids)
+		critx("could not allocate memory for threads");
+	for (unsigned t = 0; t < threads; t++)
+		if ((errno = pthread_create(&tids[t], NULL, worker, &a)))
+			crit("could not create worker thread");
+	for (unsigned t = 0; t < threads; t++)
+		pthread_join(tids[t], NULL);
+	free(tids);
+
+	char start[32];
+	const time_t start_sec = cf.header->start_sec;
+	strftime(start, sizeof(start), "%Y-%m-%d %H:%M:%S",
+		 localtime(&start_sec));
+	printf("# %s: %u flows, started %s, reporting interval %.3f s, "
+	       "%zu chunks%s\n", path, num_flows, start,
+	       cf.header->reporting_interval, cf.num_chunks,
+	       cf.rebuilt_index ? " (index rebuilt)" : "");
+
+	for (unsigned id = 0; id < num_flows; id++)
+		foreach(int *i, SOURCE, DESTINATION)
+			print_endpoint(&a, id, *i);
+	foreach(int *i, SOURCE, DESTINATION)
+		print_total(&a, *i);
+	if (opt.time_series)
+		foreach(int *i, SOURCE, DESTINATION)
+			print_time_series(&a, *i);
+
+	for (unsigned id = 0; id < num_flows; id++)
+		free_all(a.stats[id][SOURCE].bins,
+			 a.stats[id][DESTINATION].bins);
+	free_all(a.stats, a.bin_sums[SOURCE], a.bin_sums[DESTINATION]);
+	pthread_mutex_destroy(&a.lock);
+	capture_unmap(&cf);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	/* update progname from argv[0] */
+	set_progname(argv[0]);
+
+	const struct ap_Option options[] = {
+		{'b', "bin", ap_yes, 0, 0},
+		{'h', "help", ap_no, 0, 0},
+		{'j', "threads", ap_yes, 0, 0},
+		{'m', 0, ap_no, 0, 0},
+		{'t', "time-series", ap_no, 0, 0},
+		{'v', "version", ap_no, 0, 0},
+		{0, 0, ap_no, 0, 0}
+	};
+
+	if (!ap_init(&parser, argc, (const char* const*) argv, options, 0))
+		critx("could not allocate memory for option parser");
+	if (ap_error(&parser)) {
+		errx("%s", ap_error(&parser));
+		usage(EXIT_FAILURE);
+	}
+
+	/* parse command line */
+	for (int argind = 0; argind < ap_arguments(&parser); argind++) {
+		const int code = ap_code(&parser, argind);
+		const char *arg = ap_argument(&parser, argind);
+		int optint = 0;
+
+		switch (code) {
+		case 0:
+			break;
+		case 'b':
+			if (sscanf(arg, "%lf", &opt.bin_width) != 1 ||
+			    !(opt.bin_width > 0)) {
+				errx("option -b needs a positive number");
+				usage(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+			break;
+		case 'j':
+			if (sscanf(arg, "%d", &optint) != 1 || optint < 1) {
+				errx("option -j needs a positive number");
+				usage(EXIT_FAILURE);
+			}
+			opt.threads = optint;
+			break;
+		case 'm':
+			opt.mbyte = true;
+			break;
+		case 't':
+			opt.time_series = true;
+			break;
+		case 'v':
+			fprintf(stdout, "%s %s\n%s\n%s\n\n%s\n", progname,
+				FLOWGRIND_VERSION, FLOWGRIND_COPYRIGHT,
+				FLOWGRIND_COPYING, FLOWGRIND_AUTHORS);
+			exit(EXIT_SUCCESS);
+			break;
+		default:
+			errx("uncaught option: %s", arg);
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (!opt.threads) {
+		int ncores = get_ncores(NCORE_CURRENT);
+		opt.threads = ncores > 0 ? ncores : 1;
+	}
+
+	bool no_file = true, failed = false;
+	for (int argind = 0; argind < ap_arguments(&parser); argind++)
+		/* if non-option, it is a capture file */
+		if (!ap_code(&parser, argind)) {
+			if (analyze_file(ap_argument(&parser, argind)) == -1)
+				failed = true;
+			no_file = false;
+		}
+
+	if (no_file) {
+		errx("no capture file given");
+		usage(EXIT_FAILURE);
+	}
+
+	ap_free(&parser);
+	/* Analyze the remaining files, but report a file that failed */
+	exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,757 @@
+/**
+ * @file flowgrind_bench.c
+ * @brief Micro-benchmarks of the data path and the reporting of the daemon
+ */
+
+/*
+ * This file is part of Flowgrind.
+ *
+ * Flowgrind is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Flowgrind is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Flowgrind.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "daemon.h"
+#include "fg_affinity.h"
+#include "fg_argparser.h"
+#include "fg_definitions.h"
+#include "fg_error.h"
+#include "fg_flow_table.h"
+#include "fg_log.h"
+#include "fg_metrics.h"
+#include "fg_profile.h"
+#include "fg_progname.h"
+#include "fg_rpc_server.h"
+#include "fg_time.h"
+#include "trafgen.h"
+
+/** Block size of the request/response benchmark in bytes. */
+#define BENCH_RR_BLOCK_SIZE 64
+
+/** Block size of the event loop benchmark in bytes. */
+#define BENCH_LOOP_BLOCK_SIZE 512
+
+/** Sending rate of each flow of the event loop benchmark in bytes/s. */
+#define BENCH_LOOP_RATE (100 * BENCH_LOOP_BLOCK_SIZE)
+
+/** Interval in which the benchmark polls the daemon for finished flows. */
+#define BENCH_POLL_INTERVAL 10000
+
+/** XML-RPC call fetching the reports, as sent by the controller. */
+#define BENCH_GET_REPORTS_CALL "<?xml version=\"1.0\"?>" \
+	"<methodCall><methodName>get_reports</methodName>" \
+	"<params></params></methodCall>"
+
+/* External global variables. */
+extern const char *progname;
+
+/** Command line option parser. */
+static struct arg_parser parser;
+
+/** Benchmark options. */
+static struct {
+	/** Duration of the flow benchmarks in seconds (-d). */
+	double duration;
+	/** CPU core the daemon thread is bound to, -1 if unbound (-c). */
+	int core;
+	/** Number of flows of the event loop benchmark (-n). */
+	unsigned flows;
+	/** Number of reports of the report pipeline benchmarks (-r). */
+	unsigned reports;
+	/** Number of samples per distribution of the trafgen benchmark (-s). */
+	unsigned samples;
+	/** File the results are written to, NULL for stdout (-o). */
+	const char *output;
+} opt = {
+	.duration = 2.0,
+	.core = -1,
+	.flows = 128,
+	.reports = 100000,
+	.samples = 10000000,
+	.output = NULL,
+};
+
+/** A benchmark. */
+struct benchmark {
+	/** Name, used to select the benchmark on the command line. */
+	const char *name;
+	/** Run the benchmark and append its results to @p out. */
+	void (*run)(FILE *out);
+	/** Whether the benchmark was selected on the command line. */
+	bool selected;
+};
+
+/** Results of a flow between two endpoints of the in-process daemon. */
+struct flow_result {
+	/** Time from the start request until both endpoints finished. */
+	double elapsed;
+	/** CPU time of the daemon thread during @p elapsed. */
+	double cpu;
+	/** Final report of the source endpoint. */
+	struct report source;
+};
+
+/* Forward declarations. */
+static void usage(short status) __attribute__((noreturn));
+
+/**
+ * Print flowgrind-bench usage and exit.
+ */
+static void usage(short status)
+{
+	/* Syntax error. Emit 'try help' to stderr and exit */
+	if (status != EXIT_SUCCESS) {
+		fprintf(stderr, "Try '%s -h' for more information\n", progname);
+		exit(status);
+	}
+
+	fprintf(stdout,
+		"Usage: %1$s [OPTION]... [BENCHMARK]...\n"
+		"Run micro-benchmarks of the flowgrind daemon in-process and print the\n"
+		"results as JSON. Without BENCHMARK all benchmarks are run.\n\n"
+
+		"Mandatory arguments to long options are mandatory for short options too.\n"
+		"  -c #           bind the daemon thread to CPU core #. First CPU is 0\n"
+		"  -d #.#         duration of the flow benchmarks in seconds (default: 2s)\n"
+		"  -h, --help     display this help and exit\n"
+		"  -n #           number of flows of the event loop benchmark (default: 128)\n"
+		"  -o FILE        write the results to FILE instead of stdout\n"
+		"  -r #           number of reports of the report benchmarks (default: 100000)\n"
+		"  -s #           samples per distribution of the trafgen benchmarks\n"
+		"                 (default: 10000000)\n"
+		"  -v, --version  print version information and exit\n\n"
+
+		"Benchmarks:\n"
+		"  bulk           bulk transfer over loopback, throughput per CPU core\n"
+		"  rr             request/response transactions over loopback with %2$u byte\n"
+		"                 blocks\n"
+		"  event_loop     cost of an iteration of the event loop with many rate\n"
+		"                 limited flows over loopback\n"
+		"  report_queue   add_report() and get_reports() of the report queue\n"
+		"  report_rpc     add_report() and the XML-RPC method get_reports\n"
+		"  trafgen        sampling rate of the traffic generation distributions\n",
+		progname, BENCH_RR_BLOCK_SIZE);
+	exit(EXIT_SUCCESS);
+}
+
+/** Start the daemon thread, as flowgrindd does. */
+static void start_daemon_thread(void)
+{
+	int flags;
+
+	if (pipe(daemon_pipe) == -1)
+		crit("could not create pipe");
+
+	if ((flags = fcntl(daemon_pipe[0], F_GETFL, 0)) == -1)
+		flags = 0;
+	fcntl(daemon_pipe[0], F_SETFL, flags | O_NONBLOCK);
+
+	pthread_mutex_init(&mutex, NULL);
+
+	int rc = pthread_create(&daemon_thread, NULL, daemon_main, 0);
+	if (rc)
+		critc(rc, "could not start thread");
+
+	if (opt.core >= 0 && pthread_setaffinity(daemon_thread, opt.core))
+		warnx("failed to bind daemon thread to CPU core %i", opt.core);
+}
+
+/** CPU time consumed by the daemon thread so far, in seconds. */
+static double daemon_cpu_time(void)
+{
+	clockid_t clock;
+	struct timespec ts;
+
+	if (pthread_getcpuclockid(daemon_thread, &clock) ||
+	    clock_gettime(clock, &ts))
+		return 0.0;
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Settings of an endpoint as the controller sets them by default. The
+ * profile of the settings must be released with profile_unref().
+ */
+static void default_settings(struct flow_settings *settings, int block_size)
+{
+	memset(settings, 0, sizeof(*settings));
+	settings->profile = profile_new();
+	if (!settings->profile)
+		critx("could not allocate memory for flow profile");
+	settings->maximum_block_size = block_size;
+	settings->profile->request_trafgen_options.distribution = CONSTANT;
+	settings->profile->request_trafgen_options.param_one = block_size;
+	settings->profile->response_trafgen_options.distribution = CONSTANT;
+	settings->profile->interpacket_gap_trafgen_options.distribution =
+		CONSTANT;
+}
+
+/** Number of flows the daemon thread currently handles. */
+static int daemon_num_flows(void)
+{
+	struct request_get_status *request =
+		malloc(sizeof(struct request_get_status));
+	int num_flows = -1;
+
+	if (!request)
+		critx("could not allocate memory for request");
+	if (!dispatch_request((struct request *)request, REQUEST_GET_STATUS))
+		num_flows = request->num_flows;
+	free_all(request->r.error, request);
+
+	return num_flows;
+}
+
+/**
+ * Add a flow from @p source to @p destination over loopback to the daemon
+ * thread without starting it.
+ */
+static void add_flow_pair(const struct flow_settings *source,
+			  const struct flow_settings *destination)
+{
+	struct request_add_flow_destination *dst =
+		calloc(1, sizeof(struct request_add_flow_destination));
+	struct request_add_flow_source *src =
+		calloc(1, sizeof(struct request_add_flow_source));
+
+	if (!dst || !src)
+		critx("could not allocate memory for request");
+
+	dst->settings = *destination;
+	if (dispatch_request((struct request *)dst, REQUEST_ADD_DESTINATION))
+		critx("could not add destination: %s", dst->r.error);
+
+	src->settings = *source;
+	strcpy(src->source_settings.destination_host, "127.0.0.1");
+	src->source_settings.destination_port = dst->listen_data_port;
+	if (dispatch_request((struct request *)src, REQUEST_ADD_SOURCE))
+		critx("could not add source: %s", src->r.error);
+
+	free_all(dst->r.error, dst, src->r.error, src);
+}
+
+/** Start all flows of the daemon thread and wait until they finished. */
+static void run_flows(void)
+{
+	struct request_start_flows *start =
+		calloc(1, sizeof(struct request_start_flows));
+
+	if (!start)
+		critx("could not allocate memory for request");
+
+	gettime(&start->start_timestamp);
+	if (dispatch_request((struct request *)start, REQUEST_START_FLOWS))
+		critx("could not start flows: %s", start->r.error);
+
+	while (daemon_num_flows() > 0)
+		usleep(BENCH_POLL_INTERVAL);
+
+	free_all(start->r.error, start);
+}
+
+/**
+ * Run a flow from @p source to @p destination over loopback through the
+ * daemon thread, wait until it finished and collect its final reports.
+ */
+static void run_flow(const struct flow_settings *source,
+		     const struct flow_settings *destination,
+		     struct flow_result *result)
+{
+	struct timespec begin, end;
+	int has_more = 1;
+
+	add_flow_pair(source, destination);
+
+	const double cpu = daemon_cpu_time();
+	gettime(&begin);
+	run_flows();
+	gettime(&end);
+	result->elapsed = time_diff(&begin, &end);
+	result->cpu = daemon_cpu_time() - cpu;
+
+	memset(&result->source, 0, sizeof(result->source));
+	while (has_more) {
+		struct report *report = get_reports(&has_more);
+		while (report) {
+			struct report *next = report->next;
+			if (report->type == FINAL && report->endpoint == SOURCE)
+				result->source = *report;
+			free(report);
+			report = next;
+		}
+	}
+}
+
+/** Throughput in 10**6 bit/s of @p bytes in @p seconds. */
+static inline double mbps(unsigned long long bytes, double seconds)
+{
+	return seconds > 0 ? bytes * 8 / seconds / 1e6 : 0.0;
+}
+
+/** Bulk transfer: throughput and throughput per fully used CPU core. */
+static void bench_bulk(FILE *out)
+{
+	struct flow_settings source, destination;
+	struct flow_result r;
+
+	default_settings(&source, 8192);
+	default_settings(&destination, 8192);
+	source.duration[WRITE] = opt.duration;
+	destination.duration[READ] = opt.duration;
+
+	run_flow(&source, &destination, &r);
+	profile_unref(source.profile);
+	profile_unref(destination.profile);
+
+	const double duration = time_diff(&r.source.begin, &r.source.end);
+	const double throughput = mbps(r.source.bytes_written, duration);
+	fprintf(out, "\"bytes\": %llu, \"duration\": %.6f, "
+		"\"throughput_mbps\": %.3f, \"cpu_seconds\": %.6f, "
+		"\"cpu_utilization\": %.4f, \"mbps_per_core\": %.3f",
+		(unsigned long long)r.source.bytes_written, duration,
+		throughput, r.cpu, r.elapsed > 0 ? r.cpu / r.elapsed : 0.0,
+		r.cpu > 0 ? mbps(r.source.bytes_written, r.cpu) : 0.0);
+}
+
+/** Request/response with small blocks: transactions per second. */
+static void bench_rr(FILE *out)
+{
+	struct flow_settings source, destination;
+	struct flow_result r;
+
+	default_settings(&source, BENCH_RR_BLOCK_SIZE);
+	default_settings(&destination, BENCH_RR_BLOCK_SIZE);
+	source.profile->response_trafgen_options.param_one = BENCH_RR_BLOCK_SIZE;
+	source.nonagle = destination.nonagle = 1;
+	source.duration[WRITE] = opt.duration;
+	destination.duration[READ] = opt.duration;
+
+	run_flow(&source, &destination, &r);
+	profile_unref(source.profile);
+	profile_unref(destination.profile);
+
+	const double duration = time_diff(&r.source.begin, &r.source.end);
+	const unsigned transactions = r.source.response_blocks_read;
+	fprintf(out, "\"block_size\": %d, \"transactions\": %u, "
+		"\"duration\": %.6f, \"transactions_per_second\": %.1f, "
+		"\"rtt_avg\": %.9f, \"cpu_seconds\": %.6f, "
+		"\"cpu_utilization\": %.4f",
+		BENCH_RR_BLOCK_SIZE, transactions, duration,
+		duration > 0 ? transactions / duration : 0.0,
+		transactions ? r.source.rtt_sum / transactions : 0.0,
+		r.cpu, r.elapsed > 0 ? r.cpu / r.elapsed : 0.0);
+}
+
+/** Time in nanoseconds histogram @p h accumulated since @p base. */
+static inline double phase_ns(const struct metrics_histogram *h,
+			      const struct metrics_histogram *base)
+{
+	return (double)(h->sum - base->sum);
+}
+
+/**
+ * Event loop with many rate limited flows: cost per iteration of the loop
+ * and per flow, the latter being what the layout of struct flow affects.
+ */
+static void bench_event_loop(FILE *out)
+{
+	struct flow_settings source, destination;
+	struct daemon_metrics before, after;
+	struct timespec begin, end;
+	int has_more = 1;
+
+	default_settings(&source, BENCH_LOOP_BLOCK_SIZE);
+	default_settings(&destination, BENCH_LOOP_BLOCK_SIZE);
+	source.write_rate = BENCH_LOOP_RATE;
+	source.duration[WRITE] = opt.duration;
+	destination.duration[READ] = opt.duration;
+
+	for (unsigned i = 0; i < opt.flows; i++)
+		add_flow_pair(&source, &destination);
+	profile_unref(source.profile);
+	profile_unref(destination.profile);
+
+	/* without running flows the daemon thread blocks until the next
+	 * request, so the metrics do not change while being copied */
+	const double cpu = daemon_cpu_time();
+	before = metrics;
+	gettime(&begin);
+	run_flows();
+	gettime(&end);
+	after = metrics;
+	const double elapsed = time_diff(&begin, &end);
+
+	while (has_more) {
+		struct report *report = get_reports(&has_more);
+		while (report) {
+			struct report *next = report->next;
+			free(report);
+			report = next;
+		}
+	}
+
+	const double iterations = after.loop_iterations -
+				  before.loop_iterations;
+	const double serviced = after.flows_serviced - before.flows_serviced;
+	const double endpoints = 2.0 * opt.flows;
+	const double prepare = phase_ns(&after.phases[PHASE_PREPARE_FDS],
+					&before.phases[PHASE_PREPARE_FDS]);
+	const double timer = phase_ns(&after.phases[PHASE_TIMER_CHECK],
+				      &before.phases[PHASE_TIMER_CHECK]);
+	const double process = phase_ns(&after.phases[PHASE_PROCESS_SELECT],
+					&before.phases[PHASE_PROCESS_SELECT]);
+	const double per_iteration = iterations > 0 ? 1.0 / iterations : 0.0;
+	fprintf(out, "\"flows\": %u, \"endpoints\": %.0f, "
+		"\"flow_struct_bytes\": %zu, \"iterations\": %.0f, "
+		"\"iterations_per_second\": %.1f, "
+		"\"flows_serviced_per_iteration\": %.2f, "
+		"\"prepare_fds_ns_per_endpoint\": %.1f, "
+		"\"timer_check_ns_per_endpoint\": %.1f, "
+		"\"process_select_ns_per_endpoint\": %.1f, "
+		"\"cpu_seconds\": %.6f",
+		opt.flows, endpoints, sizeof(struct flow), iterations,
+		elapsed > 0 ? iterations / elapsed : 0.0,
+		serviced * per_iteration,
+		prepare * per_iteration / endpoints,
+		timer * per_iteration / endpoints,
+		process * per_iteration / endpoints,
+		daemon_cpu_time() - cpu);
+}
+
+/** Queue a batch of @p n final reports as the daemon thread does. */
+static void add_reports(unsigned n)
+{
+	for (unsigned i = 0; i < n; i++) {
+		struct report *report = calloc(1, sizeof(struct report));
+		if (!report)
+			critx("could not allocate memory for report");
+		report->id = i;
+		report->type = FINAL;
+		report->bytes_written = 1ULL << 32 | i;
+		report->rtt_min = report->rtt_max = report->rtt_sum = 1e-3;
+		add_report(report);
+	}
+}
+
+/** Report pipeline without XML-RPC: add_report() and get_reports(). */
+static void bench_report_queue(FILE *out)
+{
+	struct timespec begin, end;
+	unsigned done = 0;
+
+	gettime(&begin);
+	while (done < opt.reports) {
+		int has_more = 1;
+		add_reports(50);
+		while (has_more) {
+			struct report *report = get_reports(&has_more);
+			while (report) {
+				struct report *next = report->next;
+				free(report);
+				report = next;
+				done++;
+			}
+		}
+	}
+	gettime(&end);
+
+	const double elapsed = time_diff(&begin, &end);
+	fprintf(out, "\"reports\": %u, \"seconds\": %.6f, "
+		"\"reports_per_second\": %.1f", done, elapsed,
+		elapsed > 0 ? done / elapsed : 0.0);
+}
+
+/**
+ * Report pipeline as seen by the controller: add_report() and the XML-RPC
+ * method get_reports, including the encoding of the XML response.
+ */
+static void bench_report_rpc(FILE *out)
+{
+	xmlrpc_env env;
+	xmlrpc_registry *registry;
+	struct timespec begin, end;
+	unsigned done = 0;
+	unsigned long long xml_bytes = 0;
+
+	xmlrpc_env_init(&env);
+	registry = create_rpc_registry(&env);
+	if (env.fault_occurred)
+		critx("could not create XML-RPC registry: %s",
+		      env.fault_string);
+
+	gettime(&begin);
+	while (done < opt.reports) {
+		xmlrpc_mem_block *response = NULL;
+
+		add_reports(50);
+		xmlrpc_registry_process_call2(&env, registry,
+					      BENCH_GET_REPORTS_CALL,
+					      strlen(BENCH_GET_REPORTS_CALL),
+					      NULL, &response);
+		if (env.fault_occurred)
+			critx("XML-RPC call get_reports failed: %s",
+			      env.fault_string);
+		xml_bytes += xmlrpc_mem_block_size(response);
+		xmlrpc_mem_block_free(response);
+		done += 50;
+	}
+	gettime(&end);
+
+	xmlrpc_registry_free(registry);
+	xmlrpc_env_clean(&env);
+
+	const double elapsed = time_diff(&begin, &end);
+	fprintf(out, "\"reports\": %u, \"seconds\": %.6f, "
+		"\"reports_per_second\": %.1f, \"xml_bytes_per_report\": %.1f",
+		done, elapsed, elapsed > 0 ? done / elapsed : 0.0,
+		done ? (double)xml_bytes / done : 0.0);
+}
+
+/** Sampling rate of the block size and the gap for each distribution. */
+static void bench_trafgen(FILE *out)
+{
+	const struct {
+		const char *name;
+		struct trafgen_options options;
+	} dists[] = {
+		{"constant", {.distribution = CONSTANT, .param_one = 4096}},
+		{"normal", {.distribution = NORMAL, .param_one = 4096,
+			    .param_two = 1024}},
+		{"uniform", {.distribution = UNIFORM, .param_one = 1024,
+			     .param_two = 8192}},
+		{"exponential", {.distribution = EXPONENTIAL,
+				 .param_one = 4096}},
+		{"weibull", {.distribution = WEIBULL, .param_one = 4096,
+			     .param_two = 1.5}},
+		{"pareto", {.distribution = PARETO, .param_one = 1.5,
+			    .param_two = 1024}},
+		{"lognormal", {.distribution = LOGNORMAL, .param_one = 8,
+			       .param_two = 1}},
+	};
+	struct flow flow;
+
+	for (unsigned d = 0; d < sizeof(dists) / sizeof(dists[0]); d++) {
+		struct timespec begin, end;
+		/* keep the compiler from dropping the samples */
+		volatile double sink = 0;
+
+		memset(&flow, 0, sizeof(flow));
+		default_settings(&flow.settings, 8192);
+		flow.settings.profile->request_trafgen_options =
+			dists[d].options;
+		flow.settings.profile->interpacket_gap_trafgen_options =
+			dists[d].options;
+		flow.settings.random_seed = d + 1;
+		init_trafgen(&flow);
+
+		gettime(&begin);
+		for (unsigned i = 0; i < opt.samples; i++)
+			sink += next_request_block_size(&flow);
+		gettime(&end);
+		const double block_size = time_diff(&begin, &end);
+
+		gettime(&begin);
+		for (unsigned i = 0; i < opt.samples; i++)
+			sink += next_interpacket_gap(&flow);
+		gettime(&end);
+		const double gap = time_diff(&begin, &end);
+
+		free_trafgen(&flow);
+		profile_unref(flow.settings.profile);
+
+		fprintf(out, "%s\"%s\": {\"block_size_per_second\": %.0f, "
+			"\"gap_per_second\": %.0f}", d ? ", " : "",
+			dists[d].name,
+			block_size > 0 ? opt.samples / block_size : 0.0,
+			gap > 0 ? opt.samples / gap : 0.0);
+	}
+	fprintf(out, ", \"samples\": %u", opt.samples);
+}
+
+/** All benchmarks in the order they are run. */
+static struct benchmark benchmarks[] = {
+	{"bulk", bench_bulk, false},
+	{"rr", bench_rr, false},
+	{"event_loop", bench_event_loop, false},
+	{"report_queue", bench_report_queue, false},
+	{"report_rpc", bench_report_rpc, false},
+	{"trafgen", bench_trafgen, false},
+};
+
+/** Number of benchmarks. */
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/** Parse the command line and select the benchmarks. */
+static void parse_cmdline(int argc, char *argv[])
+{
+	const struct ap_Option options[] = {
+		{'c', 0, ap_yes, 0, 0},
+		{'d', 0, ap_yes, 0, 0},
+		{'h', "help", ap_no, 0, 0},
+		{'n', 0, ap_yes, 0, 0},
+		{'o', 0, ap_yes, 0, 0},
+		{'r', 0, ap_yes, 0, 0},
+		{'s', 0, ap_yes, 0, 0},
+		{'v', "version", ap_no, 0, 0},
+		{0, 0, ap_no, 0, 0}
+	};
+	bool any = false;
+
+	if (!ap_init(&parser, argc, (const char* const*) argv, options, 0))
+		critx("could not allocate memory for option parser");
+	if (ap_error(&parser)) {
+		errx("%s", ap_error(&parser));
+		usage(EXIT_FAILURE);
+	}
+
+	for (int argind = 0; argind < ap_arguments(&parser); argind++) {
+		const int code = ap_code(&parser, argind);
+		const char *arg = ap_argument(&parser, argind);
+		int optint = 0;
+		unsigned b;
+
+		switch (code) {
+		case 0:
+			for (b = 0; b < NUM_BENCHMARKS; b++)
+				if (!strcmp(arg, benchmarks[b].name))
+					break;
+			if (b == NUM_BENCHMARKS) {
+				errx("unknown benchmark: %s", arg);
+				usage(EXIT_FAILURE);
+			}
+			benchmarks[b].selected = true;
+			any = true;
+			break;
+		case 'c':
+			if (sscanf(arg, "%d", &opt.core) != 1 || opt.core < 0 ||
+			    opt.core >= (int)get_ncores(NCORE_CURRENT)) {
+				errx("option -c needs a valid CPU number");
+				usage(EXIT_FAILURE);
+			}
+			break;
+		case 'd':
+			if (sscanf(arg, "%lf", &opt.duration) != 1 ||
+			    !(opt.duration > 0)) {
+				errx("option -d needs a positive number");
+				usage(EXIT_FAILURE);
+			}
+			break;
+		case 'h':
+			usage(EXIT_SUCCESS);
+			break;
+		case 'n':
+			if (sscanf(arg, "%d", &optint) != 1 || optint < 1 ||
+			    optint > (MAX_FLOWS_DAEMON) / 2) {
+				errx("option -n needs a number between 1 and %d",
+				     (MAX_FLOWS_DAEMON) / 2);
+				usage(EXIT_FAILURE);
+			}
+			opt.flows = optint;
+			break;
+		case 'o':
+			opt.output = arg;
+			break;
+		case 'r':
+			if (sscanf(arg, "%d", &optint) != 1 || optint < 1) {
+				errx("option -r needs a positive number");
+				usage(EXIT_FAILURE);
+			}
+			opt.reports = optint;
+			break;
+		case 's':
+			if (sscanf(arg, "%d", &optint) != 1 || optint < 1) {
+				errx("option -s needs a positive number");
+				usage(EXIT_FAILURE);
+			}
+			opt.samples = optint;
+			break;
+		case 'v':
+			fprintf(stdout, "%s %s\n%s\n%s\n\n%s\n", progname,
+				FLOWGRIND_VERSION, FLOWGRIND_COPYRIGHT,
+				FLOWGRIND_COPYING, FLOWGRIND_AUTHORS);
+			exit(EXIT_SUCCESS);
+			break;
+		default:
+			errx("uncaught option: %s", arg);
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (!any)
+		for (unsigned b = 0; b < NUM_BENCHMARKS; b++)
+			benchmarks[b].selected = true;
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *out = stdout;
+	char now[30] = "";
+	bool first = true;
+
+	set_progname(argv[0]);
+	parse_cmdline(argc, argv);
+
+	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
+		crit("could not ignore SIGPIPE");
+
+	if (opt.output && !(out = fopen(opt.output, "w")))
+		crit("could not open %s", opt.output);
+
+	init_logging(LOGGING_STDERR);
+	if (flow_table_init())
+		critx("could not allocate memory for flow table");
+	start_daemon_thread();
+
+	ctimenow_r(now, sizeof(now), false);
+	fprintf(out, "{\"version\": \"%s\", \"date\": \"%s\", "
+		"\"cores\": %d, \"core\": %d, \"benchmarks\": {",
+		FLOWGRIND_VERSION, now, get_ncores(NCORE_CURRENT), opt.core);
+
+	for (unsigned b = 0; b < NUM_BENCHMARKS; b++) {
+		if (!benchmarks[b].selected)
+			continue;
+		fprintf(stderr, "running %s...\n", benchmarks[b].name);
+		fprintf(out, "%s\n  \"%s\": {", first ? "" : ",",
+			benchmarks[b].name);
+		benchmarks[b].run(out);
+		fprintf(out, "}");
+		fflush(out);
+		first = false;
+	}
+	fprintf(out, "\n}}\n");
+
+	if (out != stdout)
+		fclose(out);
+	ap_free(&parser);
+	close_logging();
+	exit(EXIT_SUCCESS);
+}
@@ -61,8 +61,11 @@
 #include "common.h"
 #include "daemon.h"
 #include "fg_log.h"
+#include "fg_metrics.h"
 #include "fg_affinity.h"
+#include "fg_block_pool.h"
 #include "fg_error.h"
+#include "fg_flow_table.h"
 #include "fg_math.h"
 #include "fg_progname.h"
 #include "fg_string.h"
@@ -97,6 +100,9 @@ static unsigned port = DEFAULT_LISTEN_PORT;
 /* XXX add a brief description doxygen */
 static char *rpc_bind_addr = NULL;
 
+/** Port of the HTTP metrics server, 0 if disabled. */
+static unsigned metrics_port = 0;
+
 /** CPU core to which flowgrindd should bind to. */
 static int core;
 
@@ -137,6 +143,11 @@ static void usage(short status)
 		"  -d             don't fork into background, log to stderr\n"
 #endif /* DEBUG */
 		"  -h, --help     display this help and exit\n"
+		"  -H, --hugepages\n"
+		"                 back the block buffers with 2 MB hugepages\n"
+		"  -i #           log a profile of the event loop every # seconds\n"
+		"  -m #           serve live metrics in the Prometheus text format via HTTP\n"
+		"                 on port # (path /metrics, bound to the -b address)\n"
 		"  -p #           XML-RPC server port\n"
 #ifdef HAVE_LIBPCAP
 		"  -w DIR         target directory for dump files. The daemon must be run as root\n"
@@ -262,6 +273,9 @@ static void parse_cmdline(int argc, char *argv[])
 		{'d', 0, ap_no, 0, 0},
 #endif
 		{'h', "help", ap_no, 0, 0},
+		{'H', "hugepages", ap_no, 0, 0},
+		{'i', 0, ap_yes, 0, 0},
+		{'m', 0, ap_yes, 0, 0},
 		{'o', 0, ap_yes, 0, 0},
 		{'p', 0, ap_yes, 0, 0},
 		{'v', "version", ap_no, 0, 0},
@@ -301,6 +315,19 @@ static void parse_cmdline(int argc, char *argv[])
 		case 'h':
 			usage(EXIT_SUCCESS);
 			break;
+		case 'H':
+			block_pool_use_hugepages(true);
+			break;
+		case 'i':
+			if (sscanf(arg, "%lf", &metrics_log_interval) != 1 ||
+			    metrics_log_interval <= 0)
+				PARSE_ERR("failed to parse profile interval");
+			break;
+		case 'm':
+			if (sscanf(arg, "%u", &metrics_port) != 1 ||
+			    !metrics_port || metrics_port > 65535)
+				PARSE_ERR("failed to parse metrics port number");
+			break;
 		case 'p':
 			if (sscanf(arg, "%u", &port) != 1)
 				PARSE_ERR("failed to parse port number");
@@ -395,13 +422,16 @@ int main(int argc, char *argv[])
 	else
 		init_logging(LOGGING_STDERR);
 
-	fg_list_init(&flows);
+	if (flow_table_init())
+		critx("could not allocate memory for flow table");
 
 #ifdef HAVE_LIBPCAP
 	fg_pcap_init();
 #endif /* HAVE_LIBPCAP */
 
 	init_rpc_server(&server, rpc_bind_addr, port);
+	if (metrics_port)
+		init_metrics_server(rpc_bind_addr, metrics_port);
 
 	/* Push flowgrindd into the background */
 	if (!ap_is_used(&parser, 'd')) {
@@ -416,6 +446,8 @@ int main(int argc, char *argv[])
 		bind_daemon_to_core();
 
 	create_daemon_thread();
+	if (metrics_port)
+		create_metrics_thread();
 
 	/* This will block */
 	run_rpc_server(&server);
@@ -59,20 +59,21 @@
 #include "fg_socket.h"
 #include "fg_time.h"
 #include "fg_log.h"
+#include "trafgen.h"
+#include "fg_trace.h"
+#include "fg_profile.h"
+#include "fg_flow_table.h"
+#include "fg_block_pool.h"
+#include "churn.h"
 
 #ifdef HAVE_LIBPCAP
 #include "fg_pcap.h"
 #endif /* HAVE_LIBPCAP */
 
-void remove_flow(unsigned i);
-
 #ifdef HAVE_TCP_INFO
 int get_tcp_info(struct flow *flow, struct tcp_info *info);
 #endif /* HAVE_TCP_INFO */
 
-void init_flow(struct flow* flow, int is_source);
-void uninit_flow(struct flow *flow);
-
 static int name2socket(struct flow *flow, char *server_name, unsigned port, struct sockaddr **saptr,
 		socklen_t *lenp,
 		const int read_buffer_size_req, int *read_buffer_size,
@@ -153,7 +154,7 @@ static int name2socket(struct flow *flow, char *server_name, unsigned port, stru
 int do_connect(struct flow *flow) {
 	int rc;
 
-	rc = connect(flow->fd, flow->addr, flow->addr_len);
+	rc = connect(flow->fd, flow->meta->addr, flow->meta->addr_len);
 	if (rc == -1 && errno != EINPROGRESS) {
 		flow_error(flow, "connect() failed: %s",
 				strerror(errno));
@@ -161,7 +162,11 @@ int do_connect(struct flow *flow) {
 		return rc;
 	}
 	flow->connect_called = 1;
-	flow->pmtu = get_pmtu(flow->fd);
+	flow->meta->pmtu = get_pmtu(flow->fd);
+#ifdef HAVE_LIBPCAP
+	/* the connection is known once connect() was called */
+	fg_pcap_go(flow);
+#endif /* HAVE_LIBPCAP */
 	return 0;
 }
 
@@ -181,61 +186,80 @@ int add_flow_source(struct request_add_flow_source *request)
 #endif /* HAVE_SO_TCP_CONGESTION */
 	struct flow *flow;
 
-	if (fg_list_size(&flows) >= MAX_FLOWS_DAEMON) {
+	if (flow_table_size() >= MAX_FLOWS_DAEMON) {
 		logging(LOG_WARNING, "can not accept another flow, already "
-			"handling %zu flows", fg_list_size(&flows));
+			"handling %zu flows", flow_table_size());
 		request_error(&request->r,
 			"Can not accept another flow, already "
-			"handling %zu flows.", fg_list_size(&flows));
+			"handling %zu flows.", flow_table_size());
 		return -1;
 	}
 
-	flow = malloc(sizeof(struct flow));
+	flow = alloc_flow(1);
 	if (!flow) {
 		logging(LOG_ALERT, "could not allocate memory for flow");
 		return -1;
 	}
 
-	init_flow(flow, 1);
-
 	flow->settings = request->settings;
-	flow->source_settings = request->source_settings;
-	/* be greedy with buffer sizes */
-	flow->write_block = calloc(1, flow->settings.maximum_block_size);
-	flow->read_block = calloc(1, flow->settings.maximum_block_size);
+	flow->meta->source_settings = request->source_settings;
+	/* flows with equal settings share a single profile */
+	flow->settings.profile = profile_intern(request->settings.profile);
+	if (!flow->settings.profile) {
+		logging(LOG_ALERT, "could not allocate memory for flow "
+			"profile");
+		request_error(&request->r, "could not allocate memory for "
+			      "flow profile");
+		uninit_flow(flow);
+		remove_flow(flow);
+		return -1;
+	}
+	if (flow->settings.trace_name[0]) {
+		const char *problem = NULL;
+		flow->trace = trace_map(flow->settings.trace_name, &problem);
+		if (!flow->trace) {
+			logging(LOG_ALERT, "could not map trace %s: %s",
+				flow->settings.trace_name, problem);
+			request_error(&request->r, "could not map trace: %s",
+				      problem);
+			uninit_flow(flow);
+			remove_flow(flow);
+			return -1;
+		}
+	}
 	/* Controller flow ID is set in the daemon */
 	flow->id = flow->settings.flow_id;
-	if (flow->write_block == NULL || flow->read_block == NULL) {
+	if (block_pool_reserve(flow->settings.maximum_block_size,
+			       flow->settings.byte_counting) == -1) {
 		logging(LOG_ALERT, "could not allocate memory for read/write "
 			"blocks");
 		request_error(&request->r, "could not allocate memory for read/write blocks");
 		uninit_flow(flow);
+		remove_flow(flow);
 		return -1;
 	}
-	if (flow->settings.byte_counting) {
-		int byte_idx;
-		for (byte_idx = 0; byte_idx < flow->settings.maximum_block_size; byte_idx++)
-			*(flow->write_block + byte_idx) = (unsigned char)(byte_idx & 0xff);
-	}
 
 	flow->state = GRIND_WAIT_CONNECT;
-	flow->fd = name2socket(flow, flow->source_settings.destination_host,
-			flow->source_settings.destination_port,
-			&flow->addr, &flow->addr_len,
+	flow->fd = name2socket(flow, flow->meta->source_settings.destination_host,
+			flow->meta->source_settings.destination_port,
+			&flow->meta->addr, &flow->meta->addr_len,
 			flow->settings.requested_read_buffer_size, &request->real_read_buffer_size,
 			flow->settings.requested_send_buffer_size, &request->real_send_buffer_size);
 	if (flow->fd == -1) {
 		logging(LOG_ALERT, "could not create data socket: %s",
-			flow->error);
-		request_error(&request->r, "Could not create data socket: %s", flow->error);
+			flow->meta->error);
+		request_error(&request->r, "Could not create data socket: %s",
+			      flow->meta->error);
 		uninit_flow(flow);
+		remove_flow(flow);
 		return -1;
 	}
 
 	if (set_flow_tcp_options(flow) == -1) {
-		request->r.error = flow->error;
-		flow->error = NULL;
+		request->r.error = flow->meta->error;
+		flow->meta->error = NULL;
 		uninit_flow(flow);
+		remove_flow(flow);
 		return -1;
 	}
 
@@ -246,26 +270,44 @@ int add_flow_source(struct request_add_flow_source *request)
 		request_error(&request->r, "failed to determine actual congestion control algorithm: %s",
 			strerror(errno));
 		uninit_flow(flow);
+		remove_flow(flow);
 		return -1;
 	}
 #endif /* HAVE_SO_TCP_CONGESTION */
 
-#ifdef HAVE_LIBPCAP
-	fg_pcap_go(flow);
-#endif /* HAVE_LIBPCAP */
-	if (!flow->source_settings.late_connect) {
+	/* the data socket only served to check the settings, connections of
+	 * a churn flow are opened once the flow is started */
+	if (flow->settings.churn) {
+		close(flow->fd);
+		flow->fd = -1;
+		if (init_churn(flow) == -1) {
+			logging(LOG_ALERT, "could not allocate memory for "
+				"churn connections");
+			request_error(&request->r, "could not allocate memory "
+				      "for churn connections");
+			uninit_flow(flow);
+			remove_flow(flow);
+			return -1;
+		}
+		request->flow_id = flow->id;
+		flow_table_insert(flow);
+		return 0;
+	}
+
+	if (!flow->meta->source_settings.late_connect) {
 		DEBUG_MSG(4, "(early) connecting test socket (fd=%u)", flow->fd);
 		if (do_connect(flow) == -1) {
-			request->r.error = flow->error;
-			flow->error = NULL;
+			request->r.error = flow->meta->error;
+			flow->meta->error = NULL;
 			uninit_flow(flow);
+			remove_flow(flow);
 			return -1;
 		}
 	}
 
 	request->flow_id = flow->id;
 
-	fg_list_push_back(&flows, flow);
+	flow_table_insert(flow);
 
 	return 0;
 }
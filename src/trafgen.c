@@ -39,152 +39,224 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <syslog.h>
+#include <arpa/inet.h>
 
 #include "daemon.h"
 #include "debug.h"
+#include "fg_definitions.h"
+#include "fg_error.h"
+#include "fg_cdf.h"
 #include "fg_math.h"
+#include "fg_time.h"
+#include "fg_trace.h"
 #include "trafgen.h"
 
 #define MAX_RUNS_PER_DISTRIBUTION 10
 
-inline static double calculate(struct flow *flow, enum distribution_t type, double param_one, double param_two) {
-
-	double val = 0;
-
-	switch (type) {
-		case NORMAL:
-			val = dist_normal (flow, param_one, param_two );
-			DEBUG_MSG(LOG_DEBUG, "calculated normal distribution "
-				  "value %f for parameters %f,%f", val,
-				  param_one, param_two);
-		break;
-
-		case UNIFORM:
-			val = dist_uniform (flow, param_one, param_two );
-			DEBUG_MSG(LOG_DEBUG, "calculated uniform distribution "
-				  "value %f", val);
-		break;
-
-		case WEIBULL:
-			val = dist_weibull (flow, param_one, param_two );
-			DEBUG_MSG(LOG_DEBUG, "calculated weibull distribution "
-				  "value %f for parameters %f,%f", val,
-				  param_one, param_two);
-		break;
-
-		case EXPONENTIAL:
-			val = dist_exponential (flow, param_one);
-			DEBUG_MSG(LOG_DEBUG, "calculated exponential "
-				  "distribution value %f for parameters %f",
-				  val, param_one);
-		break;
-
-		case PARETO:
-			val = dist_pareto (flow, param_one, param_two);
-			DEBUG_MSG(LOG_DEBUG, "calculated pareto distribution "
-				  "value %f for parameters %f,%f", val,
-				  param_one, param_two);
-		break;
-
-		case LOGNORMAL:
-			val = dist_normal (flow, param_one, param_two );
-			DEBUG_MSG(LOG_DEBUG, "calculated lognormal "
-				  "distribution value %f for parameters %f,%f",
-				  val, param_one, param_two);
-		break;
-
-		case CONSTANT:
-		/* constant is default */
-		default:
-			val = param_one;
-			DEBUG_MSG(LOG_DEBUG, "constant value %f", val);
+/* Seed offsets of the independent random number streams of a flow */
+enum trafgen_stream_id {
+	STREAM_REQUEST = 1,
+	STREAM_RESPONSE,
+	STREAM_GAP,
+};
 
-	}
+/**
+ * Allocate the sample buffers of flow @p flow and seed them from the random
+ * seed of the flow. The buffers start out empty, they are filled on first use.
+ */
+void init_trafgen(struct flow *flow)
+{
+	struct trafgen_samples *s = calloc(1, sizeof(struct trafgen_samples));
+	if (!s)
+		crit("calloc(): failed");
 
-	return val;
+	rng_seed(&s->request.rng, flow->settings.random_seed, STREAM_REQUEST);
+	rng_seed(&s->response.rng, flow->settings.random_seed, STREAM_RESPONSE);
+	rng_seed(&s->gap.rng, flow->settings.random_seed, STREAM_GAP);
+	s->request.next = s->response.next = s->gap.next = TRAFGEN_BATCH_SIZE;
 
+	flow->samples = s;
 }
-int next_request_block_size(struct flow *flow)
+
+void free_trafgen(struct flow *flow)
 {
-	int bs = 0;
-	int i = 0;
+	free(flow->samples);
+	flow->samples = NULL;
+}
+
+static void refill_request_block_size(struct flow *flow)
+{
+	struct trafgen_samples *s = flow->samples;
+	struct trafgen_stream *st = &s->request;
+	const struct trafgen_options *opt =
+		&flow->settings.profile->request_trafgen_options;
+	const int max = flow->settings.maximum_block_size;
+	unsigned pending[TRAFGEN_BATCH_SIZE];
+	unsigned n = TRAFGEN_BATCH_SIZE;
+
+	for (unsigned i = 0; i < n; i++)
+		pending[i] = i;
+
 	/* recalculate values to match prequisits, but at most 10 times */
-	while (( bs < MIN_BLOCK_SIZE || bs > flow->settings.maximum_block_size) && i < MAX_RUNS_PER_DISTRIBUTION) {
-
-		bs = round(calculate(
-			   flow,
-			   flow->settings.request_trafgen_options.distribution,
-			   flow->settings.request_trafgen_options.param_one,
-			   flow->settings.request_trafgen_options.param_two
-			   ));
-		i++;
+	for (int run = 0; n && run < MAX_RUNS_PER_DISTRIBUTION; run++) {
+		unsigned left = 0;
+
+		dist_fill(&st->rng, opt, s->raw, n);
+		for (unsigned i = 0; i < n; i++) {
+			const int bs = round(s->raw[i]);
+			st->size[pending[i]] = bs;
+			if (bs < MIN_BLOCK_SIZE || bs > max)
+				pending[left++] = pending[i];
+		}
+		n = left;
 	}
 
 	/* sanity checks */
-	if (i >= MAX_RUNS_PER_DISTRIBUTION && bs < MIN_BLOCK_SIZE) {
-		bs = MIN_BLOCK_SIZE;
-		DEBUG_MSG(LOG_WARNING, "applied minimal request size limit %d "
-			  "for flow %d", bs, flow->id);
+	for (unsigned i = 0; i < n; i++) {
+		int *bs = &st->size[pending[i]];
+		*bs = (*bs < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : max);
 	}
+	if (n)
+		DEBUG_MSG(LOG_WARNING, "applied request size limits to %u of "
+			  "%u samples for flow %d", n, TRAFGEN_BATCH_SIZE,
+			  flow->id);
 
-	if (i >= MAX_RUNS_PER_DISTRIBUTION && bs > flow->settings.maximum_block_size) {
-		bs = flow->settings.maximum_block_size;
-		DEBUG_MSG(LOG_WARNING, "applied maximal request size limit %d "
-			  "for flow %d", bs, flow->id);
+	DEBUG_MSG(LOG_NOTICE, "calculated %u request sizes for flow %d",
+		  TRAFGEN_BATCH_SIZE, flow->id);
 
+	st->next = 0;
+}
+
+static void refill_response_block_size(struct flow *flow)
+{
+	struct trafgen_samples *s = flow->samples;
+	struct trafgen_stream *st = &s->response;
+	const struct trafgen_options *opt =
+		&flow->settings.profile->response_trafgen_options;
+	const int max = flow->settings.maximum_block_size;
+	unsigned limited = 0;
+
+	dist_fill(&st->rng, opt, s->raw, TRAFGEN_BATCH_SIZE);
+
+	for (unsigned i = 0; i < TRAFGEN_BATCH_SIZE; i++) {
+		int bs = round(s->raw[i]);
+
+		/* sanity checks */
+		if (bs && bs < MIN_BLOCK_SIZE) {
+			bs = MIN_BLOCK_SIZE;
+			limited++;
+		}
+		if (bs > max) {
+			bs = max;
+			limited++;
+		}
+		st->size[i] = bs;
 	}
+	if (limited)
+		DEBUG_MSG(LOG_WARNING, "applied response size limits to %u of "
+			  "%u samples for flow %d", limited, TRAFGEN_BATCH_SIZE,
+			  flow->id);
 
-	DEBUG_MSG(LOG_NOTICE, "calculated request size %d for flow %d after %d "
-		  "runs", bs, flow->id, i);
+	DEBUG_MSG(LOG_NOTICE, "calculated %u response sizes for flow %d",
+		  TRAFGEN_BATCH_SIZE, flow->id);
 
-	return bs;
+	st->next = 0;
 }
 
-int next_response_block_size(struct flow *flow)
+static void refill_interpacket_gap(struct flow *flow)
 {
-	int bs = round(calculate(
-			   flow,
-			   flow->settings.response_trafgen_options.distribution,
-			   flow->settings.response_trafgen_options.param_one,
-			   flow->settings.response_trafgen_options.param_two
-			   ));
-
-	/* sanity checks */
-	if (bs && bs < MIN_BLOCK_SIZE) {
-		bs = MIN_BLOCK_SIZE;
-		DEBUG_MSG(LOG_WARNING, "applied minimal response size limit "
-			  "%d for flow %d", bs, flow->id);
+	struct trafgen_stream *st = &flow->samples->gap;
+	const struct trafgen_options *opt =
+		&flow->settings.profile->interpacket_gap_trafgen_options;
+	struct trafgen_options rate_limit = {
+		.distribution = CONSTANT,
+	};
+
+	if (flow->settings.write_rate) {
+		rate_limit.param_one =
+			((double)flow->settings.maximum_block_size) /
+			flow->settings.write_rate;
+		opt = &rate_limit;
 	}
-	if (bs > flow->settings.maximum_block_size) {
-		bs = flow->settings.maximum_block_size;
-		DEBUG_MSG(LOG_WARNING, "applied maximal response size limit "
-			  "%d for flow %d", bs, flow->id);
 
-	}
+	dist_fill(&st->rng, opt, st->gap, TRAFGEN_BATCH_SIZE);
+
+	DEBUG_MSG(LOG_NOTICE, "calculated %u interpacket gaps for flow %d",
+		  TRAFGEN_BATCH_SIZE, flow->id);
 
-	if (bs)
-		DEBUG_MSG(LOG_NOTICE, "calculated response size %d for flow "
-			  "%d", bs, flow->id);
+	st->next = 0;
+}
 
+/** Clamp the block size @p bs of a replayed trace to the buffer sizes. */
+static inline int trace_block_size(struct flow *flow, uint32_t bs)
+{
+	if (bs < (unsigned)MIN_BLOCK_SIZE)
+		return MIN_BLOCK_SIZE;
+	if (bs > (unsigned)flow->settings.maximum_block_size)
+		return flow->settings.maximum_block_size;
 	return bs;
+}
 
+/**
+ * Advance the replayed trace of flow @p flow to the next record and return
+ * the time until it is due.
+ *
+ * The gap is computed against the absolute send time of the record, so that
+ * rounding errors do not accumulate over long traces.
+ *
+ * @return gap in seconds, 0 if the trace is exhausted
+ */
+static double trace_interpacket_gap(struct flow *flow)
+{
+	struct trace_replay *trace = flow->trace;
+	struct timespec due = flow->start_timestamp[WRITE];
+
+	if (++trace->current >= trace->num_records)
+		return 0;
+
+	time_add(&due, trace_time(trace, trace->current));
+	return time_diff(&flow->next_write_block_timestamp, &due);
 }
 
-double next_interpacket_gap(struct flow *flow) {
+int next_request_block_size(struct flow *flow)
+{
+	struct trafgen_stream *st = &flow->samples->request;
+
+	if (flow->trace)
+		return trace_block_size(flow, ntohl(
+			flow->trace->record[flow->trace->current].request_size));
+
+	if (unlikely(st->next == TRAFGEN_BATCH_SIZE))
+		refill_request_block_size(flow);
+
+	return st->size[st->next++];
+}
+
+int next_response_block_size(struct flow *flow)
+{
+	struct trafgen_stream *st = &flow->samples->response;
+
+	if (flow->trace) {
+		uint32_t bs = ntohl(
+			flow->trace->record[flow->trace->current].response_size);
+		return bs ? trace_block_size(flow, bs) : 0;
+	}
+
+	if (unlikely(st->next == TRAFGEN_BATCH_SIZE))
+		refill_response_block_size(flow);
+
+	return st->size[st->next++];
+}
+
+double next_interpacket_gap(struct flow *flow)
+{
+	struct trafgen_stream *st = &flow->samples->gap;
 
-	double gap = 0.0;
-	if (flow->settings.write_rate)
-		gap = ((double)flow->settings.maximum_block_size)/flow->settings.write_rate;
-	else
-		gap = calculate(flow,
-				flow->settings.interpacket_gap_trafgen_options.distribution,
-				       flow->settings.interpacket_gap_trafgen_options.param_one,
-				       flow->settings.interpacket_gap_trafgen_options.param_two
-				      );
+	if (flow->trace)
+		return trace_interpacket_gap(flow);
 
-	if (gap)
-		DEBUG_MSG(LOG_NOTICE, "calculated next interpacket gap %.6fs "
-			  "for flow %d", gap, flow->id);
+	if (unlikely(st->next == TRAFGEN_BATCH_SIZE))
+		refill_interpacket_gap(flow);
 
-	return gap;
+	return st->gap[st->next++];
 }
@@ -30,6 +30,40 @@
 #include "config.h"
 #endif /* HAVE_CONFIG_H */
 
+#include "fg_math.h"
+
+/** Number of samples generated per refill of a trafgen sample buffer. */
+#define TRAFGEN_BATCH_SIZE 256
+
+/** Pre-generated samples of one flow parameter (request, response or gap). */
+struct trafgen_stream {
+	/** Independent random number generator of this parameter. */
+	struct fg_rng rng;
+	/** Index of the next unused sample, TRAFGEN_BATCH_SIZE if empty. */
+	unsigned next;
+	/** The samples. Block sizes are already rounded and clamped. */
+	union {
+		int size[TRAFGEN_BATCH_SIZE];
+		double gap[TRAFGEN_BATCH_SIZE];
+	};
+};
+
+/**
+ * Per-flow sample buffers of the traffic generator.
+ *
+ * The buffers are refilled in batches, so that the write path only needs to
+ * read the next array element.
+ */
+struct trafgen_samples {
+	struct trafgen_stream request;
+	struct trafgen_stream response;
+	struct trafgen_stream gap;
+	/** Scratch space for the raw samples of a refill. */
+	double raw[TRAFGEN_BATCH_SIZE];
+};
+
+extern void init_trafgen(struct flow *);
+extern void free_trafgen(struct flow *);
 extern int next_request_block_size(struct flow *);
 extern int next_response_block_size(struct flow *);
 extern double next_interpacket_gap(struct flow *);